@@ -0,0 +1,174 @@
+#include "alarms.h"
+#include "capture.h"
+#include "modbus_slave.h"
+#include "time_base.h"
+
+// cargador_gel_litio.ino
+extern HardwareSerial OrangePiSerial;
+bool isDecimalNumber(const String &text, bool allowFraction);
+
+static const char *const ALARM_CODE_NAMES[ALARM_CODE_COUNT] = {
+  "OVER_VOLTAGE", "OVER_TEMPERATURE", "ERROR_ENTERED", "LOAD_DISCONNECT", "ERROR_CLEARED", "LOAD_RECONNECT"
+};
+
+static const AlarmPriority ALARM_CODE_PRIORITIES[ALARM_CODE_COUNT] = {
+  ALARM_PRIORITY_CRITICAL, ALARM_PRIORITY_CRITICAL, ALARM_PRIORITY_CRITICAL,
+  ALARM_PRIORITY_WARNING, ALARM_PRIORITY_INFO, ALARM_PRIORITY_INFO
+};
+
+static const char *const ALARM_PRIORITY_NAMES[] = {"CRITICAL", "WARNING", "INFO"};
+
+struct PendingAlarm {
+  uint64_t raisedMs;
+  uint64_t nextSendMs;            // 0 = aún no enviada
+  uint32_t retryMs;
+  float value;
+  uint16_t seq;
+  uint8_t code;
+  uint8_t sends;
+};
+
+static PendingAlarm pending[ALARM_QUEUE_SIZE];
+static uint8_t pendingCount = 0;
+static uint16_t nextSeq = 1;
+static bool uartReady = false;
+
+static uint32_t raisedTotal = 0;
+static uint32_t framesSent = 0;
+static uint32_t ackedTotal = 0;
+static uint32_t droppedTotal = 0;
+static uint32_t worstAckMs = 0;
+
+static AlarmPriority priorityOf(const PendingAlarm &alarm) {
+  return ALARM_CODE_PRIORITIES[alarm.code];
+}
+
+// a antes que b en la transmisión: más prioritaria y, si empatan, más antigua
+static bool goesBefore(const PendingAlarm &a, const PendingAlarm &b) {
+  if (priorityOf(a) != priorityOf(b)) return priorityOf(a) < priorityOf(b);
+  return (int16_t)(a.seq - b.seq) < 0;
+}
+
+static void removeAt(uint8_t index) {
+  for (uint8_t i = index; i + 1 < pendingCount; i++) pending[i] = pending[i + 1];
+  pendingCount--;
+}
+
+// La UART es de la Orange Pi salvo durante un volcado de captura o en Modbus
+static bool canTransmit() {
+  return uartReady && !isCaptureStreaming() && !isModbusActive();
+}
+
+static void transmit(PendingAlarm &alarm, uint64_t now) {
+  char line[80];
+  alarm.sends++;
+  snprintf(line, sizeof(line), "ALARM:%u:%s:%s:%.2f:%lu:%u", alarm.seq, ALARM_PRIORITY_NAMES[priorityOf(alarm)],
+           ALARM_CODE_NAMES[alarm.code], alarm.value, (unsigned long)(alarm.raisedMs / 1000), alarm.sends);
+  OrangePiSerial.println(line);
+  framesSent++;
+  alarm.nextSendMs = now + alarm.retryMs;
+  alarm.retryMs = min(alarm.retryMs * 2, (uint32_t)ALARM_RETRY_MAX_MS);
+}
+
+// Envía las vencidas por orden de prioridad
+static void transmitDue(uint64_t now) {
+  if (!canTransmit()) return;
+  while (true) {
+    PendingAlarm *next = nullptr;
+    for (uint8_t i = 0; i < pendingCount; i++) {
+      PendingAlarm &alarm = pending[i];
+      if (alarm.nextSendMs > now) continue;
+      if (next == nullptr || goesBefore(alarm, *next)) next = &alarm;
+    }
+    if (next == nullptr) return;
+    transmit(*next, now);
+  }
+}
+
+void alarmRaise(AlarmCode code, float value) {
+  if (code >= ALARM_CODE_COUNT) return;
+  uint64_t now = monoMillis();
+  PendingAlarm alarm = {now, 0, ALARM_RETRY_MIN_MS, value, nextSeq, (uint8_t)code, 0};
+  nextSeq++;
+  if (nextSeq == 0) nextSeq = 1;
+  raisedTotal++;
+
+  if (pendingCount == ALARM_QUEUE_SIZE) {
+    // La víctima es la que iría última en la transmisión
+    uint8_t victim = 0;
+    for (uint8_t i = 1; i < pendingCount; i++) {
+      if (priorityOf(pending[i]) > priorityOf(pending[victim])) victim = i;
+    }
+    droppedTotal++;
+    if (priorityOf(pending[victim]) < priorityOf(alarm)) {
+      Serial.printf("⚠️ [ALARM] Cola llena: %s #%u descartada\n", ALARM_CODE_NAMES[code], alarm.seq);
+      return;
+    }
+    Serial.printf("⚠️ [ALARM] Cola llena: se descarta %s #%u\n",
+                  ALARM_CODE_NAMES[pending[victim].code], pending[victim].seq);
+    removeAt(victim);
+  }
+  pending[pendingCount++] = alarm;
+  Serial.printf("🚨 [ALARM] #%u %s %s = %.2f\n", alarm.seq, ALARM_PRIORITY_NAMES[priorityOf(alarm)],
+                ALARM_CODE_NAMES[code], value);
+  transmitDue(now);
+}
+
+void alarmsBegin() {
+  uartReady = true;
+  transmitDue(monoMillis());
+}
+
+void alarmsService() {
+  if (pendingCount > 0) transmitDue(monoMillis());
+}
+
+void handleAckCommand(const String &seqStr) {
+  // Sin respuesta: el ACK puede cruzarse con la de otro comando
+  long seq = isDecimalNumber(seqStr, false) && seqStr.length() <= 5 ? seqStr.toInt() : -1;
+  for (uint8_t i = 0; i < pendingCount; i++) {
+    if (pending[i].seq != seq) continue;
+    uint32_t latency = (uint32_t)(monoMillis() - pending[i].raisedMs);
+    worstAckMs = max(worstAckMs, latency);
+    ackedTotal++;
+    Serial.printf("✅ [ALARM] #%u confirmada en %lu ms (%u envíos)\n", pending[i].seq, (unsigned long)latency,
+                  pending[i].sends);
+    removeAt(i);
+    return;
+  }
+}
+
+String buildAlarmsJson() {
+  String json;
+  json.reserve(128 + pendingCount * 96);
+  json += "{\"pending\":[";
+  for (uint8_t i = 0; i < pendingCount; i++) {
+    const PendingAlarm &alarm = pending[i];
+    if (i > 0) json += ",";
+    json += "{\"seq\":" + String(alarm.seq);
+    json += ",\"priority\":\"" + String(ALARM_PRIORITY_NAMES[priorityOf(alarm)]);
+    json += "\",\"code\":\"" + String(ALARM_CODE_NAMES[alarm.code]);
+    json += "\",\"value\":" + String(alarm.value, 2);
+    json += ",\"t\":" + String((unsigned long)(alarm.raisedMs / 1000));
+    json += ",\"sends\":" + String(alarm.sends) + "}";
+  }
+  json += "],\"raised\":" + String(raisedTotal);
+  json += ",\"framesSent\":" + String(framesSent);
+  json += ",\"acked\":" + String(ackedTotal);
+  json += ",\"dropped\":" + String(droppedTotal);
+  json += ",\"worstAckMs\":" + String(worstAckMs);
+  json += ",\"nextSeq\":" + String(nextSeq) + "}";
+  return json;
+}
+
+uint8_t getAlarmsPending() {
+  return pendingCount;
+}
+
+uint32_t getAlarmsDropped() {
+  return droppedTotal;
+}
+
+const char *getAlarmCodeName(AlarmCode code) {
+  return code < ALARM_CODE_COUNT ? ALARM_CODE_NAMES[code] : "UNKNOWN";
+}
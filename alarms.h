@@ -0,0 +1,58 @@
+#ifndef ALARMS_H
+#define ALARMS_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Alarmas empujadas a la Orange Pi sin esperar a su sondeo. Cada alarma sale
+// por la UART en cuanto se produce como una línea no solicitada:
+//   ALARM:<seq>:<prioridad>:<código>:<valor>:<t s>:<envío>
+// (<t s> = segundos desde el arranque al producirse; <envío> = 1 el primero)
+// y se reenvía con espera creciente hasta que llega CMD:ACK:<seq>, que no
+// tiene respuesta. Pendientes como mucho ALARM_QUEUE_SIZE: llena, una alarma
+// nueva desplaza a la pendiente menos prioritaria (la más antigua si
+// empatan), o se descarta si todas son más prioritarias. Se transmite
+// primero la más prioritaria. Durante un volcado de captura o en Modbus
+// esperan en la cola.
+#define ALARM_QUEUE_SIZE 8
+#define ALARM_RETRY_MIN_MS 1000
+#define ALARM_RETRY_MAX_MS 16000
+
+enum AlarmPriority {
+  ALARM_PRIORITY_CRITICAL = 0,
+  ALARM_PRIORITY_WARNING,
+  ALARM_PRIORITY_INFO
+};
+
+// Códigos y su prioridad fija; el valor de cada uno va entre paréntesis
+enum AlarmCode {
+  ALARM_OVER_VOLTAGE = 0,         // Batería >= maxBatteryVoltageAllowed, primera lectura (V)
+  ALARM_OVER_TEMPERATURE,         // NTC >= TEMP_THRESHOLD_SHUTDOWN, primera lectura (°C)
+  ALARM_ERROR_ENTERED,            // Entrada en ERROR, carga bloqueada (V batería)
+  ALARM_LOAD_DISCONNECT,          // LVD: carga desconectada por voltaje bajo (V)
+  ALARM_ERROR_CLEARED,            // Salida de ERROR (V batería)
+  ALARM_LOAD_RECONNECT,           // LVR: carga reconectada tras un LVD (V)
+  ALARM_CODE_COUNT
+};
+
+// Encola la alarma y la transmite en el acto si la UART está libre. Sin heap:
+// se llama desde el ciclo de control.
+void alarmRaise(AlarmCode code, float value);
+
+// Tras initSerialCommunication(): envía lo encolado durante el arranque
+void alarmsBegin();
+
+// Reenvíos vencidos. Llamar desde loop().
+void alarmsService();
+
+// CMD:ACK:<seq>
+void handleAckCommand(const String &seqStr);
+
+// CMD:ALARMS: pendientes y contadores
+String buildAlarmsJson();
+
+uint8_t getAlarmsPending();
+uint32_t getAlarmsDropped();
+const char *getAlarmCodeName(AlarmCode code);
+
+#endif
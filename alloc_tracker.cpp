@@ -0,0 +1,178 @@
+#include "alloc_tracker.h"
+#include "time_base.h"
+
+#if CONFIG_HEAP_USE_HOOKS
+#include "esp_heap_caps.h"
+#endif
+
+static const char *const REGION_NAMES[ALLOC_REGION_COUNT] = {
+  "loop", "controlTick", "nightTick", "cmdGetData", "cmdSet", "cmdOther",
+  "webPage", "webData", "webMetrics", "webOther"
+};
+
+static AllocRegionStats regions[ALLOC_REGION_COUNT];
+static bool regionOpen[ALLOC_REGION_COUNT];
+static uint32_t regionStartAllocs[ALLOC_REGION_COUNT];
+static uint32_t regionStartBytes[ALLOC_REGION_COUNT];
+static uint32_t regionStartFree[ALLOC_REGION_COUNT];
+static bool active = false;
+static uint64_t startedAtMs = 0;
+
+// Contadores del allocador: solo se incrementan (también con el seguimiento
+// apagado) y cada región mira su diferencia
+static volatile uint32_t allocCount = 0;
+static volatile uint32_t freeCount = 0;
+static volatile uint32_t allocBytes = 0;
+static volatile bool hooksSeen = false;
+
+#if CONFIG_HEAP_USE_HOOKS
+// Solo cuenta la tarea de loop(): la pila WiFi asigna desde sus propias tareas.
+// Los hooks pueden llegar con la caché de flash deshabilitada: cuentan aquí
+// mismo, sin llamar a funciones en flash (los contadores están en .bss, DRAM).
+static TaskHandle_t trackedTask = NULL;
+
+extern "C" void IRAM_ATTR esp_heap_trace_alloc_hook(void *ptr, size_t size, uint32_t caps) {
+  if (trackedTask != NULL && xTaskGetCurrentTaskHandle() == trackedTask) {
+    allocCount++;
+    allocBytes += size;
+    hooksSeen = true;
+  }
+}
+
+extern "C" void IRAM_ATTR esp_heap_trace_free_hook(void *ptr) {
+  if (trackedTask != NULL && xTaskGetCurrentTaskHandle() == trackedTask) {
+    freeCount++;
+  }
+}
+#endif
+
+// Mismo recuento que los hooks, para el interpositor de malloc del host
+void allocTrackerNoteAlloc(size_t size) {
+  allocCount++;
+  allocBytes += size;
+  hooksSeen = true;
+}
+
+void allocTrackerNoteFree() {
+  freeCount++;
+}
+
+bool isAllocTrackerExact() {
+  return hooksSeen;
+}
+
+void allocTrackerReset() {
+  for (int i = 0; i < ALLOC_REGION_COUNT; i++) {
+    regions[i] = AllocRegionStats();
+    regionOpen[i] = false;
+  }
+  startedAtMs = monoMillis();
+}
+
+void allocTrackerStart() {
+  allocTrackerReset();
+#if CONFIG_HEAP_USE_HOOKS
+  trackedTask = xTaskGetCurrentTaskHandle();
+#endif
+  active = true;
+}
+
+void allocTrackerStop() {
+  active = false;
+#if CONFIG_HEAP_USE_HOOKS
+  trackedTask = NULL;
+#endif
+}
+
+bool isAllocTrackerActive() {
+  return active;
+}
+
+void allocRegionBegin(AllocRegion region) {
+  if (!active) return;
+  regionOpen[region] = true;
+  regionStartAllocs[region] = allocCount;
+  regionStartBytes[region] = allocBytes;
+  if (!hooksSeen) regionStartFree[region] = ESP.getFreeHeap();
+}
+
+void allocRegionEnd(AllocRegion region) {
+  if (!active || !regionOpen[region]) return;
+  regionOpen[region] = false;
+
+  AllocRegionStats &stats = regions[region];
+  uint32_t allocs;
+  if (hooksSeen) {
+    allocs = allocCount - regionStartAllocs[region];
+    stats.bytes += allocBytes - regionStartBytes[region];
+  } else {
+    // Modo neto: una "asignación" por llamada que dejó menos heap libre
+    uint32_t freeNow = ESP.getFreeHeap();
+    uint32_t retained = regionStartFree[region] > freeNow ? regionStartFree[region] - freeNow : 0;
+    stats.bytes += retained;
+    allocs = retained > 0 ? 1 : 0;
+  }
+  stats.calls++;
+  stats.lastAllocs = allocs;
+  stats.allocs += allocs;
+  if (allocs > 0) stats.allocatingCalls++;
+  if (allocs > stats.maxAllocs) stats.maxAllocs = allocs;
+}
+
+bool isAllocRegionOpen(AllocRegion region) {
+  return regionOpen[region];
+}
+
+const AllocRegionStats &getAllocRegionStats(AllocRegion region) {
+  return regions[region];
+}
+
+const char *getAllocRegionName(AllocRegion region) {
+  return region < ALLOC_REGION_COUNT ? REGION_NAMES[region] : "unknown";
+}
+
+AllocRegion getCommandAllocRegion(const String &command) {
+  if (command.startsWith("CMD:GET_DATA")) return ALLOC_REGION_CMD_GET_DATA;
+  if (command.startsWith("CMD:SET_")) return ALLOC_REGION_CMD_SET;
+  return ALLOC_REGION_CMD_OTHER;
+}
+
+String buildAllocJson() {
+  String json;
+  json.reserve(ALLOC_TRACKER_MAX_JSON);
+  json += "{\"active\":";
+  json += active ? "true" : "false";
+  json += ",\"mode\":\"";
+  json += hooksSeen ? "exact" : "net";
+  json += "\",\"sinceStartSeconds\":";
+  json += String((uint32_t)((monoMillis() - startedAtMs) / 1000));
+  json += ",\"freeHeap\":";
+  json += String(ESP.getFreeHeap());
+  json += ",\"minFreeHeap\":";
+  json += String(ESP.getMinFreeHeap());
+  if (hooksSeen) {
+    // Bloques asignados y no liberados mientras se contaba (fugas)
+    json += ",\"outstandingBlocks\":";
+    json += String((int32_t)(allocCount - freeCount));
+  }
+  json += ",\"regions\":{";
+  for (int i = 0; i < ALLOC_REGION_COUNT; i++) {
+    const AllocRegionStats &stats = regions[i];
+    if (i > 0) json += ",";
+    json += "\"";
+    json += REGION_NAMES[i];
+    json += "\":{\"calls\":";
+    json += String(stats.calls);
+    json += ",\"allocatingCalls\":";
+    json += String(stats.allocatingCalls);
+    json += ",\"allocs\":";
+    json += String(stats.allocs);
+    json += ",\"maxAllocs\":";
+    json += String(stats.maxAllocs);
+    json += hooksSeen ? ",\"bytes\":" : ",\"retainedBytes\":";
+    json += String((uint32_t)stats.bytes);
+    json += "}";
+  }
+  json += "}}";
+  return json;
+}
@@ -0,0 +1,65 @@
+#ifndef ALLOC_TRACKER_H
+#define ALLOC_TRACKER_H
+
+#include <Arduino.h>
+
+// Contabilidad de asignaciones de heap por región (CMD:HEAP). Cada región es
+// una vuelta de loop(), un ciclo de control o un tipo de petición; se cuenta
+// cuántas llamadas asignaron memoria, cuántas asignaciones hubo y el máximo
+// por llamada. Objetivo: ciclo de control sin heap (tools/alloc lo exige).
+//
+// Dos modos, elegidos solos:
+// - Exacto: el allocador avisa cada malloc/free. En el equipo requiere un
+//   núcleo compilado con CONFIG_HEAP_USE_HOOKS=y (hooks de ESP-IDF); en el
+//   host lo da el interpositor de malloc de tools/alloc.
+// - Neto: sin hooks solo se ve la variación del heap libre al cerrar cada
+//   región (memoria retenida, no la rotación asigna/libera).
+#define ALLOC_TRACKER_MAX_JSON 1024
+
+enum AllocRegion {
+  ALLOC_REGION_LOOP = 0,
+  ALLOC_REGION_CONTROL_TICK,
+  ALLOC_REGION_NIGHT_TICK,
+  ALLOC_REGION_CMD_GET_DATA,
+  ALLOC_REGION_CMD_SET,
+  ALLOC_REGION_CMD_OTHER,
+  ALLOC_REGION_WEB_PAGE,
+  ALLOC_REGION_WEB_DATA,
+  ALLOC_REGION_WEB_METRICS,
+  ALLOC_REGION_WEB_OTHER,
+  ALLOC_REGION_COUNT
+};
+
+struct AllocRegionStats {
+  uint32_t calls;
+  uint32_t allocatingCalls;        // Llamadas con al menos una asignación
+  uint32_t allocs;                 // Modo neto: llamadas que retuvieron memoria
+  uint32_t maxAllocs;              // Máximo en una sola llamada
+  uint32_t lastAllocs;             // Última llamada (herramientas de host)
+  uint64_t bytes;                  // Bytes asignados (modo neto: retenidos)
+};
+
+void allocTrackerStart();
+void allocTrackerStop();
+bool isAllocTrackerActive();
+void allocTrackerReset();
+bool isAllocTrackerExact();        // true si llegan avisos del allocador
+
+void allocRegionBegin(AllocRegion region);
+void allocRegionEnd(AllocRegion region);
+bool isAllocRegionOpen(AllocRegion region);
+const AllocRegionStats &getAllocRegionStats(AllocRegion region);
+const char *getAllocRegionName(AllocRegion region);
+
+// Región de un comando de la Orange Pi según su tipo
+AllocRegion getCommandAllocRegion(const String &command);
+
+// {"active":true,"mode":"exact","regions":{"loop":{...},...}}
+String buildAllocJson();
+
+// Avisos del allocador desde el interpositor de malloc del host (en el equipo
+// cuentan directamente los hooks de ESP-IDF, en IRAM)
+void allocTrackerNoteAlloc(size_t size);
+void allocTrackerNoteFree();
+
+#endif
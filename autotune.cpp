@@ -0,0 +1,269 @@
+#include "autotune.h"
+#include <Preferences.h>
+#include "flash_stall.h"
+
+extern Preferences preferences;
+
+TunedGains tunedGains = {false, 0.0, 0.0, 0.0, 0.0};
+
+static AutotuneState autotuneState = AUTOTUNE_IDLE;
+static String abortReason = "";
+static bool resultPending = false;
+
+// Ensayo en curso
+static float relaySetpoint = 0.0;
+static int relayBasePwm = 0;
+static ChargeState relayStage = FLOAT_CHARGE;
+static float relaySampleSeconds = 1.0;
+static bool relayHigh = true;
+static uint32_t relayTicks = 0;
+static uint32_t lastRisingSwitchTick = 0;
+static uint8_t switchCount = 0;
+static float halfCycleMax = 0.0;
+static float halfCycleMin = 0.0;
+static float peakMaxSum = 0.0;
+static float peakMinSum = 0.0;
+static uint8_t peakMaxCount = 0;
+static uint8_t peakMinCount = 0;
+static uint32_t periodTicksSum = 0;
+static uint8_t periodCount = 0;
+
+// Estado del PI incremental
+static ChargeState regulatorStage = BULK_CHARGE;
+static bool regulatorPrimed = false;
+static float regulatorPrevError = 0.0;
+static float regulatorResidue = 0.0;
+static float regulatorSampleSeconds = 1.0;
+
+void autotuneBegin() {
+  preferences.begin("charger", true);
+  tunedGains.valid = preferences.getBool("tuneValid", false);
+  tunedGains.ultimateGain = preferences.getFloat("tuneKu", 0.0);
+  tunedGains.ultimatePeriod = preferences.getFloat("tuneTu", 0.0);
+  tunedGains.kp = preferences.getFloat("tuneKp", 0.0);
+  tunedGains.ki = preferences.getFloat("tuneKi", 0.0);
+  regulatorSampleSeconds = preferences.getFloat("tuneTs", 1.0);
+  preferences.end();
+
+  if (tunedGains.valid && (tunedGains.kp <= 0.0 || tunedGains.ki < 0.0)) {
+    tunedGains.valid = false;
+  }
+  if (tunedGains.valid) {
+    Serial.println("🎛️ [Autotune] Ganancias guardadas: Kp=" + String(tunedGains.kp, 2) + " Ki=" + String(tunedGains.ki, 3));
+  } else {
+    Serial.println("🎛️ [Autotune] Sin ajustar - regulador con pasos fijos");
+  }
+}
+
+String autotuneStart(float setpoint, int basePwm, ChargeState stage, float sampleSeconds) {
+  if (autotuneState == AUTOTUNE_RUNNING) {
+    return "Autotune already running";
+  }
+  if (stage != ABSORPTION_CHARGE && stage != FLOAT_CHARGE) {
+    return "Autotune needs ABSORPTION or FLOAT stage";
+  }
+  if (basePwm - AUTOTUNE_RELAY_AMPLITUDE < 0 || basePwm + AUTOTUNE_RELAY_AMPLITUDE > 255) {
+    return "PWM too close to its limits";
+  }
+
+  relaySetpoint = setpoint;
+  relayBasePwm = basePwm;
+  relayStage = stage;
+  relaySampleSeconds = sampleSeconds;
+  relayHigh = true;
+  relayTicks = 0;
+  lastRisingSwitchTick = 0;
+  switchCount = 0;
+  halfCycleMax = 0.0;
+  halfCycleMin = 100.0;
+  peakMaxSum = 0.0;
+  peakMinSum = 0.0;
+  peakMaxCount = 0;
+  peakMinCount = 0;
+  periodTicksSum = 0;
+  periodCount = 0;
+  abortReason = "";
+  autotuneState = AUTOTUNE_RUNNING;
+
+  Serial.println("🎛️ [Autotune] Ensayo de relé en " + String(setpoint, 2) + " V, PWM " +
+                 String(basePwm) + " ± " + String(AUTOTUNE_RELAY_AMPLITUDE));
+  return "";
+}
+
+void autotuneAbort(const String &reason) {
+  if (autotuneState != AUTOTUNE_RUNNING) return;
+  autotuneState = AUTOTUNE_ABORTED;
+  abortReason = reason;
+  resultPending = true;
+  Serial.println("⚠️ [Autotune] Abortado: " + reason);
+}
+
+bool isAutotuneRunning() {
+  return autotuneState == AUTOTUNE_RUNNING;
+}
+
+static void finishAutotune() {
+  float amplitude = (peakMaxSum / peakMaxCount - peakMinSum / peakMinCount) / 2.0;
+  // Corrección por la histéresis del relé
+  float effective = amplitude * amplitude - AUTOTUNE_HYSTERESIS * AUTOTUNE_HYSTERESIS;
+  if (effective <= 0.0) {
+    autotuneAbort("Oscilación menor que la histéresis");
+    return;
+  }
+  float ku = 4.0 * AUTOTUNE_RELAY_AMPLITUDE / (PI * sqrtf(effective));
+  float tu = (float)periodTicksSum / periodCount * relaySampleSeconds;
+
+  // Tyreus-Luyben: Kp = Ku / 3.2, Ti = 2.2 Tu
+  tunedGains.ultimateGain = ku;
+  tunedGains.ultimatePeriod = tu;
+  tunedGains.kp = ku / 3.2;
+  tunedGains.ki = tunedGains.kp / (2.2 * tu);
+  tunedGains.valid = true;
+  regulatorSampleSeconds = relaySampleSeconds;
+  regulatorPrimed = false;
+
+  autotuneState = AUTOTUNE_DONE;
+  resultPending = true;
+  Serial.println("🎛️ [Autotune] Ku=" + String(ku, 1) + " cuentas/V, Tu=" + String(tu, 1) + " s -> Kp=" +
+                 String(tunedGains.kp, 2) + " Ki=" + String(tunedGains.ki, 3));
+}
+
+int autotuneStep(float batteryVoltage, float chargeCurrent, float maxCurrent, ChargeState stage) {
+  if (autotuneState != AUTOTUNE_RUNNING) {
+    return relayBasePwm;
+  }
+
+  relayTicks++;
+  if (stage != relayStage) {
+    autotuneAbort("Cambio de etapa");
+  } else if (batteryVoltage > relaySetpoint + AUTOTUNE_VOLTAGE_MARGIN) {
+    autotuneAbort("Sobrevoltaje (" + String(batteryVoltage, 2) + " V)");
+  } else if (chargeCurrent > maxCurrent) {
+    autotuneAbort("Sobrecorriente (" + String(chargeCurrent, 0) + " mA)");
+  } else if (relayTicks > AUTOTUNE_MAX_TICKS) {
+    autotuneAbort("Sin oscilación sostenida en " + String(AUTOTUNE_MAX_TICKS) + " ciclos");
+  }
+  if (autotuneState != AUTOTUNE_RUNNING) {
+    return relayBasePwm; // Se devuelve el PWM de partida; el regulador sigue desde ahí
+  }
+
+  halfCycleMax = max(halfCycleMax, batteryVoltage);
+  halfCycleMin = min(halfCycleMin, batteryVoltage);
+
+  bool switchLow = relayHigh && batteryVoltage > relaySetpoint + AUTOTUNE_HYSTERESIS;
+  bool switchHigh = !relayHigh && batteryVoltage < relaySetpoint - AUTOTUNE_HYSTERESIS;
+  if (switchLow || switchHigh) {
+    switchCount++;
+    bool counted = switchCount > AUTOTUNE_SETTLE_SWITCHES;
+
+    if (switchLow) {
+      // Termina el semiciclo alto: su máximo es un pico de la oscilación
+      if (counted) {
+        peakMaxSum += halfCycleMax;
+        peakMaxCount++;
+      }
+      halfCycleMin = batteryVoltage;
+    } else {
+      if (counted) {
+        peakMinSum += halfCycleMin;
+        peakMinCount++;
+        if (lastRisingSwitchTick != 0) {
+          periodTicksSum += relayTicks - lastRisingSwitchTick;
+          periodCount++;
+        }
+      }
+      if (switchCount >= AUTOTUNE_SETTLE_SWITCHES) {
+        lastRisingSwitchTick = relayTicks;
+      }
+      halfCycleMax = batteryVoltage;
+    }
+    relayHigh = switchHigh;
+
+    if (periodCount >= AUTOTUNE_CYCLES && peakMaxCount > 0 && peakMinCount > 0) {
+      finishAutotune();
+      return relayBasePwm;
+    }
+  }
+
+  return relayHigh ? relayBasePwm + AUTOTUNE_RELAY_AMPLITUDE : relayBasePwm - AUTOTUNE_RELAY_AMPLITUDE;
+}
+
+void autotuneService(Print &out) {
+  if (!resultPending) return;
+  resultPending = false;
+
+  if (autotuneState == AUTOTUNE_DONE) {
+    nvsCommitBegin();
+    preferences.begin("charger", false);
+    preferences.putBool("tuneValid", true);
+    preferences.putFloat("tuneKu", tunedGains.ultimateGain);
+    preferences.putFloat("tuneTu", tunedGains.ultimatePeriod);
+    preferences.putFloat("tuneKp", tunedGains.kp);
+    preferences.putFloat("tuneKi", tunedGains.ki);
+    preferences.putFloat("tuneTs", regulatorSampleSeconds);
+    preferences.end();
+    nvsCommitEnd();
+
+    out.println("AUTOTUNE:{\"result\":\"OK\",\"ku\":" + String(tunedGains.ultimateGain, 2) +
+                ",\"tu\":" + String(tunedGains.ultimatePeriod, 2) +
+                ",\"kp\":" + String(tunedGains.kp, 3) +
+                ",\"ki\":" + String(tunedGains.ki, 4) + "}");
+  } else if (autotuneState == AUTOTUNE_ABORTED) {
+    out.println("AUTOTUNE:{\"result\":\"ABORTED\",\"reason\":\"" + abortReason + "\"}");
+  }
+}
+
+void autotuneClearGains() {
+  tunedGains.valid = false;
+  regulatorPrimed = false;
+  nvsCommitBegin();
+  preferences.begin("charger", false);
+  preferences.putBool("tuneValid", false);
+  preferences.end();
+  nvsCommitEnd();
+  Serial.println("🎛️ [Autotune] Ganancias borradas - regulador con pasos fijos");
+}
+
+AutotuneState getAutotuneState() {
+  return autotuneState;
+}
+
+String getAutotuneStateString(AutotuneState state) {
+  switch (state) {
+    case AUTOTUNE_IDLE:
+      return "IDLE";
+    case AUTOTUNE_RUNNING:
+      return "RUNNING";
+    case AUTOTUNE_DONE:
+      return "DONE";
+    case AUTOTUNE_ABORTED:
+      return "ABORTED";
+    default:
+      return "UNKNOWN";
+  }
+}
+
+int tunedRegulatorStep(float setpoint, float batteryVoltage, ChargeState stage) {
+  float error = setpoint - batteryVoltage;
+  if (!regulatorPrimed || stage != regulatorStage) {
+    // Arranque sin salto: la primera muestra solo fija el error previo
+    regulatorStage = stage;
+    regulatorPrevError = error;
+    regulatorResidue = 0.0;
+    regulatorPrimed = true;
+  }
+
+  // Forma incremental: Δu = Kp·Δe + Ki·Ts·e (el PWM actúa de integrador)
+  float delta = tunedGains.kp * (error - regulatorPrevError) +
+                tunedGains.ki * regulatorSampleSeconds * error + regulatorResidue;
+  regulatorPrevError = error;
+
+  int step = (int)delta;
+  if (step > AUTOTUNE_MAX_STEP || step < -AUTOTUNE_MAX_STEP) {
+    step = constrain(step, -AUTOTUNE_MAX_STEP, AUTOTUNE_MAX_STEP);
+    regulatorResidue = 0.0;
+  } else {
+    regulatorResidue = delta - step; // Fracción de cuenta para el próximo ciclo
+  }
+  return step;
+}
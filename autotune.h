@@ -0,0 +1,65 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Autoajuste del regulador de voltaje por realimentación de relé
+// (Åström-Hägglund). Durante el ensayo el PWM conmuta entre base ± d cada vez
+// que el voltaje de batería cruza la consigna; la oscilación resultante da la
+// ganancia última Ku = 4d / (π·a) y el periodo último Tu. El ensayo corre al
+// ritmo del ciclo de control, de modo que Ku y Tu ya incluyen el retardo de
+// muestreo del lazo real. Con Ku/Tu se calcula un PI (Tyreus-Luyben, poco
+// sobreimpulso) que absorción y flotación aplican en forma incremental.
+#define AUTOTUNE_RELAY_AMPLITUDE 6        // d: cuentas PWM a cada lado del PWM base
+#define AUTOTUNE_HYSTERESIS 0.02          // V alrededor de la consigna
+#define AUTOTUNE_VOLTAGE_MARGIN 0.3       // V sobre la consigna que abortan el ensayo
+#define AUTOTUNE_SETTLE_SWITCHES 2        // Conmutaciones descartadas al inicio
+#define AUTOTUNE_CYCLES 3                 // Periodos completos promediados
+#define AUTOTUNE_MAX_TICKS 300            // Ciclos de control máximos (~5 min)
+#define AUTOTUNE_MAX_STEP 10              // Paso máximo del PI por ciclo
+
+enum AutotuneState {
+  AUTOTUNE_IDLE = 0,
+  AUTOTUNE_RUNNING,
+  AUTOTUNE_DONE,
+  AUTOTUNE_ABORTED
+};
+
+struct TunedGains {
+  bool valid;
+  float ultimateGain;     // Ku en cuentas PWM por voltio
+  float ultimatePeriod;   // Tu en segundos
+  float kp;               // Cuentas PWM por voltio de error
+  float ki;               // Cuentas PWM por voltio·segundo
+};
+
+extern TunedGains tunedGains;
+
+// Carga las ganancias guardadas (llamar en setup)
+void autotuneBegin();
+
+// Arranca el ensayo alrededor de 'setpoint' partiendo del PWM actual.
+// Devuelve "" si arrancó o el motivo del rechazo.
+String autotuneStart(float setpoint, int basePwm, ChargeState stage, float sampleSeconds);
+void autotuneAbort(const String &reason);
+bool isAutotuneRunning();
+
+// Un ciclo del ensayo: devuelve el PWM a aplicar
+int autotuneStep(float batteryVoltage, float chargeCurrent, float maxCurrent, ChargeState stage);
+
+// Desde loop(): guarda en NVS el resultado del último ensayo (fuera del ciclo
+// de control) y lo informa a la Orange Pi con una línea
+//   AUTOTUNE:{"result":"OK"|"ABORTED",...}
+void autotuneService(Print &out);
+
+// Borra las ganancias: el regulador vuelve a los pasos fijos
+void autotuneClearGains();
+
+AutotuneState getAutotuneState();
+String getAutotuneStateString(AutotuneState state);
+
+// Paso PI incremental para las etapas de voltaje (solo con tunedGains.valid)
+int tunedRegulatorStep(float setpoint, float batteryVoltage, ChargeState stage);
+
+#endif
@@ -0,0 +1,181 @@
+#include "benchmark.h"
+#include <Wire.h>
+#include <Adafruit_INA219.h>
+#include <Preferences.h>
+#include "esp_task_wdt.h"
+#include "time_base.h"
+#include "ripple_analyzer.h"
+#include "history_codec.h"
+#include "i2c_bus.h"
+
+extern Adafruit_INA219 ina219_1;
+extern Preferences preferences;
+
+float getAverageCurrent(Adafruit_INA219 &ina, int samples, bool recordNoise);
+float readTemperature();
+String buildOrangePiJson();
+
+// Evita que el compilador elimine los núcleos de prueba
+static volatile float floatSink;
+static volatile int32_t fixedSink;
+
+static int16_t kernelInput[BENCH_KERNEL_SAMPLES];
+static uint8_t historyBlock[BENCH_HISTORY_BLOCK_BYTES];
+
+typedef void (*BenchFunction)();
+
+static BenchResult measure(const char *name, uint16_t iterations, BenchFunction fn) {
+  BenchResult result = {name, iterations, UINT32_MAX, 0, 0.0};
+  uint64_t total = 0;
+  for (uint16_t i = 0; i < iterations; i++) {
+    uint64_t start = monoMicros();
+    fn();
+    uint32_t elapsed = (uint32_t)(monoMicros() - start);
+    total += elapsed;
+    result.minUs = min(result.minUs, elapsed);
+    result.maxUs = max(result.maxUs, elapsed);
+  }
+  result.avgUs = (float)total / iterations;
+  esp_task_wdt_reset();
+  return result;
+}
+
+static void benchIna219Read() {
+  floatSink = ina219BusVoltage(ina219_1); // Una lectura de registro por I2C
+}
+
+static void benchAverageCurrent() {
+  // Sin tocar samplingNoise_mA: el ruido del banco no es el de la regulación
+  floatSink = getAverageCurrent(ina219_1, BENCH_AVERAGE_SAMPLES, false);
+}
+
+static void benchTemperature() {
+  floatSink = readTemperature();
+}
+
+static void benchJsonBuild() {
+  String json = buildOrangePiJson();
+  fixedSink = json.length();
+}
+
+static void benchNvsWrite() {
+  // Espacio de nombres propio: no toca la configuración del cargador
+  preferences.begin("bench", false);
+  preferences.putULong("scratch", (uint32_t)monoMicros());
+  preferences.end();
+}
+
+// Filtro IIR de primer orden (alpha = 1/8) en float
+float iirFloatKernel(const int16_t *input, int count) {
+  float y = 0.0;
+  const float alpha = 0.125;
+  for (int i = 0; i < count; i++) {
+    y += alpha * ((float)input[i] - y);
+  }
+  return y;
+}
+
+// El mismo filtro en Q15 (alpha = 4096 / 32768). El error cabe en 32 bits
+// (entrada de 16 bits en Q15), pero el producto por alpha no: va en 64 bits.
+int32_t iirQ15Kernel(const int16_t *input, int count) {
+  int32_t y = 0;
+  const int32_t alphaQ15 = 4096;
+  for (int i = 0; i < count; i++) {
+    int32_t error = (int32_t)input[i] * 32768 - y;
+    y += (int32_t)(((int64_t)alphaQ15 * error) >> 15);
+  }
+  return y >> 15;
+}
+
+static void benchFloatKernel() {
+  floatSink = iirFloatKernel(kernelInput, BENCH_KERNEL_SAMPLES);
+}
+
+static void benchFixedKernel() {
+  fixedSink = iirQ15Kernel(kernelInput, BENCH_KERNEL_SAMPLES);
+}
+
+// FFT Q15 del analizador de rizado sobre la misma señal
+static void benchFftQ15() {
+  int16_t re[RIPPLE_FFT_SIZE];
+  int16_t im[RIPPLE_FFT_SIZE];
+  for (int i = 0; i < RIPPLE_FFT_SIZE; i++) {
+    re[i] = kernelInput[i];
+    im[i] = 0;
+  }
+  fftQ15(re, im, RIPPLE_FFT_BITS);
+  fixedSink = re[1];
+}
+
+// Compresor del histórico: BENCH_KERNEL_SAMPLES muestras de 1 s con la misma
+// señal en las corrientes y el voltaje de batería
+static void benchHistoryEncode() {
+  HistoryEncoder encoder;
+  historyEncoderBegin(encoder, historyBlock, sizeof(historyBlock), 0);
+  HistorySample sample = {};
+  for (int i = 0; i < BENCH_KERNEL_SAMPLES; i++) {
+    sample.timestamp = 1000ULL * i;
+    sample.panelToBatteryCurrent = 2000.0f + kernelInput[i];
+    sample.batteryToLoadCurrent = 400.0f + kernelInput[i] / 16;
+    sample.voltagePanel = 18.0f;
+    sample.voltageBattery = 13.0f + kernelInput[i] * 0.0001f;
+    sample.temperature = 25.0f;
+    sample.pwm = 128 + (kernelInput[i] >> 8);
+    historyEncoderAppend(encoder, sample);
+  }
+  fixedSink = (int32_t)historyEncoderFinish(encoder);
+}
+
+// Señal de prueba determinista (rampa con ruido LCG) para los núcleos
+void fillBenchKernelInput(int16_t *input) {
+  uint32_t lcg = 12345;
+  for (int i = 0; i < BENCH_KERNEL_SAMPLES; i++) {
+    lcg = lcg * 1664525u + 1013904223u;
+    input[i] = (int16_t)((i * 64) + (int16_t)(lcg >> 22) - 512);
+  }
+}
+
+static String resultToJson(const BenchResult &r) {
+  return "{\"name\":\"" + String(r.name) + "\",\"iterations\":" + String(r.iterations) +
+         ",\"min_us\":" + String(r.minUs) + ",\"avg_us\":" + String(r.avgUs, 1) +
+         ",\"max_us\":" + String(r.maxUs) + "}";
+}
+
+void runBenchmarks(Print &out) {
+  Serial.println("⏱️ [Bench] Ejecutando micro-benchmarks...");
+
+  fillBenchKernelInput(kernelInput);
+
+  BenchResult results[] = {
+    measure("ina219_read", BENCH_INA219_ITERATIONS, benchIna219Read),
+    measure("get_average_current", BENCH_AVERAGE_ITERATIONS, benchAverageCurrent),
+    measure("read_temperature", BENCH_TEMPERATURE_ITERATIONS, benchTemperature),
+    measure("json_build", BENCH_JSON_ITERATIONS, benchJsonBuild),
+    measure("nvs_write", BENCH_NVS_ITERATIONS, benchNvsWrite),
+    measure("iir_float", BENCH_KERNEL_ITERATIONS, benchFloatKernel),
+    measure("iir_q15", BENCH_KERNEL_ITERATIONS, benchFixedKernel),
+    measure("fft_q15_64", BENCH_KERNEL_ITERATIONS, benchFftQ15),
+    measure("history_encode", BENCH_KERNEL_ITERATIONS, benchHistoryEncode),
+  };
+
+  preferences.begin("bench", false);
+  preferences.clear();
+  preferences.end();
+
+  String reply = "BENCH:{";
+  reply += "\"chip\":\"" + String(ESP.getChipModel()) + "\",";
+  reply += "\"chipRevision\":" + String(ESP.getChipRevision()) + ",";
+  reply += "\"cpuMHz\":" + String(ESP.getCpuFreqMHz()) + ",";
+  reply += "\"flashHz\":" + String(ESP.getFlashChipSpeed()) + ",";
+  reply += "\"i2cHz\":" + String(Wire.getClock()) + ",";
+  reply += "\"kernelSamples\":" + String(BENCH_KERNEL_SAMPLES) + ",";
+  reply += "\"results\":[";
+  for (size_t i = 0; i < sizeof(results) / sizeof(results[0]); i++) {
+    if (i > 0) reply += ",";
+    reply += resultToJson(results[i]);
+  }
+  reply += "]}";
+
+  out.println(reply);
+  Serial.println("⏱️ [Bench] " + reply);
+}
@@ -0,0 +1,36 @@
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <Arduino.h>
+
+// Micro-benchmarks sobre el hardware real (CMD:BENCH). Sirven para comparar
+// placas (flash, pull-ups del I2C, revisiones del INA219) y detectar buses
+// I2C degradados por deriva de latencia.
+#define BENCH_INA219_ITERATIONS 50
+#define BENCH_AVERAGE_ITERATIONS 3
+#define BENCH_AVERAGE_SAMPLES 20         // Igual que numSamples del ciclo de control
+#define BENCH_TEMPERATURE_ITERATIONS 3
+#define BENCH_JSON_ITERATIONS 10
+#define BENCH_NVS_ITERATIONS 5
+#define BENCH_KERNEL_ITERATIONS 20
+#define BENCH_KERNEL_SAMPLES 256
+#define BENCH_HISTORY_BLOCK_BYTES 2048    // history_encode: BENCH_KERNEL_SAMPLES muestras
+
+struct BenchResult {
+  const char *name;
+  uint16_t iterations;
+  uint32_t minUs;
+  uint32_t maxUs;
+  float avgUs;
+};
+
+// Ejecuta la suite completa (bloquea ~1 s) y responde en una sola línea:
+//   BENCH:{"chip":...,"results":[{"name":...,"iterations":...,"min_us":...,"avg_us":...,"max_us":...},...]}
+void runBenchmarks(Print &out);
+
+// Núcleos de iir_float e iir_q15 (tools/bench comprueba que coinciden)
+void fillBenchKernelInput(int16_t *input);   // BENCH_KERNEL_SAMPLES muestras
+float iirFloatKernel(const int16_t *input, int count);
+int32_t iirQ15Kernel(const int16_t *input, int count);
+
+#endif
@@ -0,0 +1,336 @@
+#include "capture.h"
+#include <Wire.h>
+#include "time_base.h"
+#include "i2c_bus.h"
+
+extern ChargeState currentState;
+extern int currentPWM;
+
+#define INA219_PANEL_ADDRESS 0x40
+#define INA219_BATTERY_ADDRESS 0x41
+#define INA219_REG_SHUNT 0x01
+#define INA219_REG_BUS 0x02
+
+static int16_t captureBuffer[CAPTURE_BUFFER_WORDS];
+
+static volatile CaptureState captureState = CAPTURE_IDLE;
+static volatile bool cancelRequested = false;
+static TaskHandle_t captureTaskHandle = NULL;
+
+// Configuración de la captura en curso
+static char channelList[CAPTURE_MAX_CHANNELS + 1];
+static uint8_t channelCount = 0;
+static uint32_t frameCapacity = 0;
+static uint32_t preTriggerFrames = 0;
+static TickType_t periodTicks = 1;
+static CaptureTrigger captureTrigger = CAPTURE_TRIGGER_NOW;
+static ChargeState armedState = BULK_CHARGE;
+static int16_t overVoltageRaw = INT16_MAX;
+static uint32_t savedI2cHz = 0;
+
+// Progreso (escrito solo por la tarea de captura)
+static volatile uint32_t totalFrames = 0;
+static volatile uint32_t triggerFrame = 0;
+static volatile uint32_t missedDeadlines = 0;
+static volatile uint32_t readErrors = 0;
+static volatile uint64_t triggerUs = 0;
+
+// Volcado
+static uint32_t streamFirstFrame = 0;
+static uint32_t streamFrames = 0;
+static uint32_t streamedFrames = 0;
+static uint16_t streamCrc = 0xFFFF;
+
+// Sin STOP entre puntero y lectura, y con el mutex de i2c_bus.h tomado hasta
+// el último Wire.read(): las lecturas de loop() no se intercalan
+static bool readRegister(uint8_t address, uint8_t reg, int16_t &value) {
+  I2cBusGuard guard;
+  Wire.beginTransmission(address);
+  Wire.write(reg);
+  if (Wire.endTransmission(false) != 0) return false;
+  if (Wire.requestFrom(address, (uint8_t)2) != 2) return false;
+  uint8_t high = Wire.read();
+  uint8_t low = Wire.read();
+  value = (int16_t)((high << 8) | low);
+  return true;
+}
+
+static int16_t readChannel(char channel) {
+  int16_t raw = 0;
+  bool ok = true;
+  switch (channel) {
+    case 'V':
+      ok = readRegister(INA219_BATTERY_ADDRESS, INA219_REG_BUS, raw);
+      return ok ? (int16_t)((uint16_t)raw >> 3) : CAPTURE_READ_ERROR;
+    case 'P':
+      ok = readRegister(INA219_PANEL_ADDRESS, INA219_REG_BUS, raw);
+      return ok ? (int16_t)((uint16_t)raw >> 3) : CAPTURE_READ_ERROR;
+    case 'I':
+      ok = readRegister(INA219_PANEL_ADDRESS, INA219_REG_SHUNT, raw);
+      return ok ? raw : CAPTURE_READ_ERROR;
+    case 'L':
+      ok = readRegister(INA219_BATTERY_ADDRESS, INA219_REG_SHUNT, raw);
+      return ok ? raw : CAPTURE_READ_ERROR;
+    case 'D':
+      return (int16_t)currentPWM;
+    default:
+      return CAPTURE_READ_ERROR;
+  }
+}
+
+static bool triggerFired(int16_t batteryRaw) {
+  switch (captureTrigger) {
+    case CAPTURE_TRIGGER_NOW:
+      return true;
+    case CAPTURE_TRIGGER_STAGE:
+      return currentState != armedState;
+    case CAPTURE_TRIGGER_OVERVOLTAGE:
+      if (batteryRaw == CAPTURE_READ_ERROR) {
+        batteryRaw = readChannel('V');
+      }
+      return batteryRaw != CAPTURE_READ_ERROR && batteryRaw > overVoltageRaw;
+    default:
+      return false;
+  }
+}
+
+static void acquireFrame() {
+  int16_t *frame = &captureBuffer[(totalFrames % frameCapacity) * channelCount];
+  int16_t batteryRaw = CAPTURE_READ_ERROR;
+
+  for (uint8_t i = 0; i < channelCount; i++) {
+    frame[i] = readChannel(channelList[i]);
+    if (frame[i] == CAPTURE_READ_ERROR && channelList[i] != 'D') {
+      readErrors++;
+    }
+    if (channelList[i] == 'V') {
+      batteryRaw = frame[i];
+    }
+  }
+  totalFrames++;
+
+  if (captureState == CAPTURE_ARMED && triggerFired(batteryRaw)) {
+    triggerFrame = totalFrames - 1;
+    triggerUs = monoMicros();
+    captureState = CAPTURE_TRIGGERED;
+  }
+  if (captureState == CAPTURE_TRIGGERED && totalFrames - triggerFrame >= frameCapacity - preTriggerFrames) {
+    captureState = CAPTURE_COMPLETE;
+  }
+}
+
+static void runCapture() {
+  uint64_t armedAt = monoMillis();
+  TickType_t lastWake = xTaskGetTickCount();
+
+  while (true) {
+    if (cancelRequested) {
+      captureState = CAPTURE_IDLE;
+      break;
+    }
+    if (captureState == CAPTURE_ARMED && monoMillis() - armedAt > CAPTURE_ARM_TIMEOUT_MS) {
+      captureState = CAPTURE_TIMEOUT;
+      break;
+    }
+
+    acquireFrame();
+    if (captureState == CAPTURE_COMPLETE) {
+      break;
+    }
+
+    if (xTaskDelayUntil(&lastWake, periodTicks) == pdFALSE) {
+      missedDeadlines++; // La trama anterior excedió el periodo
+    }
+  }
+
+  I2cBusGuard guard;
+  Wire.setClock(savedI2cHz);
+}
+
+static void captureTask(void *arg) {
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    runCapture();
+  }
+}
+
+static TickType_t ticksForRate(uint32_t rateHz) {
+  TickType_t ticks = pdMS_TO_TICKS(1000 / rateHz);
+  return ticks == 0 ? 1 : ticks;
+}
+
+uint32_t getCaptureActualRate(uint32_t rateHz) {
+  return 1000 / (ticksForRate(rateHz) * portTICK_PERIOD_MS);
+}
+
+String captureArm(const String &channels, uint32_t rateHz, uint32_t frames,
+                  CaptureTrigger trigger, uint32_t preFrames, float overVoltage) {
+  if (captureState != CAPTURE_IDLE) {
+    return "Capture busy";
+  }
+  if (channels.length() == 0 || channels.length() > CAPTURE_MAX_CHANNELS) {
+    return "Invalid channels (1-" + String(CAPTURE_MAX_CHANNELS) + " of " + CAPTURE_CHANNEL_LETTERS + ")";
+  }
+  for (unsigned int i = 0; i < channels.length(); i++) {
+    if (strchr(CAPTURE_CHANNEL_LETTERS, channels[i]) == NULL || channels.indexOf(channels[i]) != (int)i) {
+      return "Invalid channels (1-" + String(CAPTURE_MAX_CHANNELS) + " of " + CAPTURE_CHANNEL_LETTERS + ")";
+    }
+  }
+  if (rateHz < 1 || rateHz > CAPTURE_MAX_RATE) {
+    return "Invalid rate (1-" + String(CAPTURE_MAX_RATE) + " Hz)";
+  }
+  uint32_t maxFrames = CAPTURE_BUFFER_WORDS / channels.length();
+  if (frames < 1 || frames > maxFrames) {
+    return "Invalid frames (1-" + String(maxFrames) + " for " + String(channels.length()) + " channels)";
+  }
+  if (trigger == CAPTURE_TRIGGER_NOW) {
+    preFrames = 0;
+  } else if (preFrames >= frames) {
+    return "Invalid pretrigger (0-" + String(frames - 1) + ")";
+  }
+
+  if (captureTaskHandle == NULL &&
+      xTaskCreate(captureTask, "capture", CAPTURE_TASK_STACK, NULL, CAPTURE_TASK_PRIORITY, &captureTaskHandle) != pdPASS) {
+    captureTaskHandle = NULL;
+    return "Capture task unavailable";
+  }
+
+  strncpy(channelList, channels.c_str(), CAPTURE_MAX_CHANNELS);
+  channelList[channels.length()] = '\0';
+  channelCount = channels.length();
+  frameCapacity = frames;
+  preTriggerFrames = preFrames;
+  periodTicks = ticksForRate(rateHz);
+  captureTrigger = trigger;
+  armedState = currentState;
+  overVoltageRaw = (int16_t)constrain(overVoltage * 250.0, 0.0, (float)INT16_MAX); // 4 mV por LSB
+
+  totalFrames = 0;
+  triggerFrame = 0;
+  missedDeadlines = 0;
+  readErrors = 0;
+  triggerUs = 0;
+  cancelRequested = false;
+
+  {
+    I2cBusGuard guard;
+    savedI2cHz = Wire.getClock();
+    Wire.setClock(CAPTURE_I2C_HZ);
+  }
+
+  captureState = CAPTURE_ARMED;
+  xTaskNotifyGive(captureTaskHandle);
+
+  Serial.println("🔬 [Captura] Armada: " + channels + " a " + String(getCaptureActualRate(rateHz)) + " Hz, " +
+                 String(frames) + " tramas, disparo " + getCaptureTriggerString(trigger) +
+                 " (pre " + String(preFrames) + ")");
+  return "";
+}
+
+void captureCancel() {
+  if (captureState == CAPTURE_ARMED || captureState == CAPTURE_TRIGGERED) {
+    cancelRequested = true;
+    Serial.println("🔬 [Captura] Cancelada");
+  } else if (captureState == CAPTURE_TIMEOUT) {
+    captureState = CAPTURE_IDLE;
+  }
+}
+
+CaptureState getCaptureState() {
+  return captureState;
+}
+
+bool isCaptureStreaming() {
+  return captureState == CAPTURE_STREAMING;
+}
+
+static void updateCrc(const uint8_t *data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    streamCrc ^= (uint16_t)data[i] << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      streamCrc = (streamCrc & 0x8000) ? (streamCrc << 1) ^ 0x1021 : streamCrc << 1;
+    }
+  }
+}
+
+static void beginStream(HardwareSerial &out) {
+  streamFrames = min((uint32_t)totalFrames, frameCapacity);
+  streamFirstFrame = totalFrames - streamFrames;
+  streamedFrames = 0;
+  streamCrc = 0xFFFF;
+
+  uint32_t preTrigger = triggerFrame - streamFirstFrame;
+  uint32_t bytes = streamFrames * channelCount * sizeof(int16_t);
+  char triggerUsText[21];
+  snprintf(triggerUsText, sizeof(triggerUsText), "%llu", (unsigned long long)triggerUs);
+
+  out.println("CAPTURE:BEGIN:channels=" + String(channelList) +
+              ",rate=" + String(1000 / (periodTicks * portTICK_PERIOD_MS)) +
+              ",frames=" + String(streamFrames) +
+              ",pretrigger=" + String(preTrigger) +
+              ",trigger=" + getCaptureTriggerString(captureTrigger) +
+              ",missed=" + String(missedDeadlines) +
+              ",errors=" + String(readErrors) +
+              ",triggerUs=" + String(triggerUsText) +
+              ",bytes=" + String(bytes));
+  Serial.println("🔬 [Captura] Completa: " + String(streamFrames) + " tramas (" + String(bytes) + " bytes), " +
+                 String(missedDeadlines) + " periodos perdidos");
+}
+
+bool captureService(HardwareSerial &out) {
+  switch (captureState) {
+    case CAPTURE_ARMED:
+    case CAPTURE_TRIGGERED:
+      return true;
+
+    case CAPTURE_TIMEOUT:
+      out.println("CAPTURE:TIMEOUT");
+      Serial.println("⏰ [Captura] Sin disparo en " + String(CAPTURE_ARM_TIMEOUT_MS / 1000) + " s");
+      captureState = CAPTURE_IDLE;
+      return false;
+
+    case CAPTURE_COMPLETE:
+      beginStream(out);
+      captureState = CAPTURE_STREAMING;
+      return true;
+
+    case CAPTURE_STREAMING: {
+      // Solo lo que cabe en el búfer de transmisión: a 9600 baudios el volcado
+      // completo tarda varios segundos y el ciclo de control no debe esperar
+      size_t frameBytes = channelCount * sizeof(int16_t);
+      while (streamedFrames < streamFrames && (size_t)out.availableForWrite() >= frameBytes) {
+        uint32_t slot = (streamFirstFrame + streamedFrames) % frameCapacity;
+        const uint8_t *data = (const uint8_t *)&captureBuffer[slot * channelCount];
+        out.write(data, frameBytes);
+        updateCrc(data, frameBytes);
+        streamedFrames++;
+      }
+      if (streamedFrames < streamFrames) {
+        return true;
+      }
+      char trailer[32];
+      snprintf(trailer, sizeof(trailer), "CAPTURE:END:crc=0x%04X", streamCrc);
+      out.println();
+      out.println(trailer);
+      captureState = CAPTURE_IDLE;
+      return false;
+    }
+
+    case CAPTURE_IDLE:
+    default:
+      return false;
+  }
+}
+
+String getCaptureTriggerString(CaptureTrigger trigger) {
+  switch (trigger) {
+    case CAPTURE_TRIGGER_NOW:
+      return "NOW";
+    case CAPTURE_TRIGGER_STAGE:
+      return "STAGE";
+    case CAPTURE_TRIGGER_OVERVOLTAGE:
+      return "OV";
+    default:
+      return "UNKNOWN";
+  }
+}
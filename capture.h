@@ -0,0 +1,66 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Captura en ráfaga tipo osciloscopio. Una tarea FreeRTOS lee los registros
+// crudos del INA219 a ritmo fijo en un búfer circular preasignado mientras el
+// ciclo de control sigue corriendo; con pre-disparo se conservan las tramas
+// anteriores al evento. Canales (una letra cada uno, int16 por trama):
+//   V  bus de batería (0x41)     LSB 4 mV
+//   P  bus de panel (0x40)       LSB 4 mV
+//   I  shunt de panel (0x40)     LSB 10 µV (1 mA con shunt de 10 mΩ)
+//   L  shunt de carga (0x41)     LSB 10 µV
+//   D  ciclo de trabajo PWM      0-255
+#define CAPTURE_BUFFER_WORDS 8192         // 16 KB preasignados
+#define CAPTURE_CHANNEL_LETTERS "VPILD"
+#define CAPTURE_MAX_CHANNELS 5
+#define CAPTURE_MAX_RATE 1000             // Hz: ~una conversión bus+shunt (1064 µs)
+#define CAPTURE_I2C_HZ 400000             // Reloj I2C durante la captura
+#define CAPTURE_ARM_TIMEOUT_MS 600000     // Espera máxima del disparo
+#define CAPTURE_OV_MARGIN 0.1             // V sobre la consigna de la etapa (disparo OV)
+#define CAPTURE_TASK_STACK 3072
+#define CAPTURE_TASK_PRIORITY 2           // Por encima de loop()
+#define CAPTURE_POLL_MS 20                // Servicio desde la rueda de temporizadores
+#define CAPTURE_READ_ERROR INT16_MIN      // Valor guardado si falla la lectura I2C
+
+enum CaptureTrigger {
+  CAPTURE_TRIGGER_NOW = 0,
+  CAPTURE_TRIGGER_STAGE,        // Cambio de etapa de carga
+  CAPTURE_TRIGGER_OVERVOLTAGE   // Bus de batería por encima del umbral
+};
+
+enum CaptureState {
+  CAPTURE_IDLE = 0,
+  CAPTURE_ARMED,
+  CAPTURE_TRIGGERED,
+  CAPTURE_COMPLETE,
+  CAPTURE_STREAMING,
+  CAPTURE_TIMEOUT
+};
+
+// Arma una captura de 'frames' tramas a 'rateHz'. Devuelve "" si quedó armada
+// o el motivo del rechazo.
+String captureArm(const String &channels, uint32_t rateHz, uint32_t frames,
+                  CaptureTrigger trigger, uint32_t preFrames, float overVoltage);
+
+// Aborta la adquisición (no un volcado ya en curso)
+void captureCancel();
+
+CaptureState getCaptureState();
+bool isCaptureStreaming();
+uint32_t getCaptureActualRate(uint32_t rateHz);
+
+// Llamar cada CAPTURE_POLL_MS desde el contexto principal. Al completarse la
+// captura emite, sin bloquear, la cabecera, los datos y la cola:
+//   CAPTURE:BEGIN:channels=<c>,rate=<hz>,frames=<n>,pretrigger=<n>,trigger=<t>,
+//                 missed=<n>,errors=<n>,triggerUs=<us>,bytes=<n>
+//   <bytes de tramas int16 little-endian, canales en el orden pedido>
+//   CAPTURE:END:crc=0x<CRC-16/CCITT-FALSE de los datos>
+// Devuelve false cuando ya no queda nada que atender.
+bool captureService(HardwareSerial &out);
+
+String getCaptureTriggerString(CaptureTrigger trigger);
+
+#endif
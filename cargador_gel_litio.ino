@@ -6,6 +6,29 @@
 #include <Preferences.h>
 #include "config.h"        // Incluimos el nuevo archivo de configuración
 #include "web_server.h"    // Incluir el archivo del servidor web
+#include "thermal_control.h" // Derating térmico y modelo del MOSFET
+#include "power_manager.h"   // Modo nocturno y light sleep
+#include "wifi_manager.h"    // Política de radio WiFi y softAP bajo demanda
+#include "time_base.h"       // Reloj monotónico de 64 bits y reloj de pared
+#include "timer_wheel.h"     // Temporizadores del planificador
+#include "event_bus.h"       // Bus de eventos entre sensado, control y E/S
+#include "profiler.h"        // Perfilador de CPU por muestreo
+#include "benchmark.h"       // Micro-benchmarks en el equipo (CMD:BENCH)
+#include "flash_stall.h"     // Bloqueos por escritura en NVS
+#include "sampling.h"        // Muestreo sincronizado con el PWM
+#include "capture.h"         // Captura en ráfaga (CMD:CAPTURE)
+#include "ripple_analyzer.h" // FFT del voltaje de batería (oscilación del control)
+#include "autotune.h"        // Autoajuste del regulador (CMD:AUTOTUNE)
+#include "regulation_metrics.h" // Calidad de la regulación por etapa
+#include "trace.h"           // Grabación del ciclo de control (CMD:TRACE)
+#include "alloc_tracker.h"   // Asignaciones de heap por región (CMD:HEAP)
+#include "metrics.h"         // Exposición OpenMetrics (/metrics)
+#include "modbus_slave.h"    // Esclavo Modbus RTU en la UART de la Orange Pi
+#include "mqtt_publisher.h"  // Telemetría MQTT por el túnel de la Orange Pi
+#include "alarms.h"          // Tramas ALARM con confirmación (CMD:ACK)
+#include "telemetry_codec.h" // JSON de telemetría generado desde telemetry_schema.h
+#include "history.h"         // Histórico comprimido de mediciones (CMD:HISTORY)
+#include "i2c_bus.h"         // Mutex del bus I2C compartido con la captura
 
 
 // ========== PROTOCOLO SERIAL ORANGE PI ==========
@@ -17,8 +40,14 @@
 HardwareSerial OrangePiSerial(0);  // Usar UART0
 
 // Buffer para comandos seriales
+#define SERIAL_LINE_MAX 200          // Una línea más larga se descarta entera
+#define SERIAL_READ_CHUNK 64         // Bytes leídos de la UART por llamada al driver
+#define SERIAL_MAX_LINES_PER_CALL 8  // Acota el trabajo por vuelta de loop()
 String serialBuffer = "";
-bool commandReady = false;
+bool serialLineDropped = false;      // Descartando hasta el próximo '\n'
+uint8_t serialChunk[SERIAL_READ_CHUNK];
+size_t serialChunkLength = 0;
+size_t serialChunkPos = 0;
 
 
 Preferences preferences;
@@ -35,7 +64,7 @@ Adafruit_INA219 ina219_2(0x41);
 
 // Configuración PWM
 const int pwmPin = 2;
-const int pwmFrequency = 40000;
+int pwmFrequency = PWM_FREE_RUNNING_FREQUENCY; // Depende de samplingMode
 const int pwmResolution = 8;
 
 // Configuración de lecturas
@@ -65,20 +94,23 @@ const float chargedBatteryRestVoltage = 12.88;
 
 // Variables para cálculo dinámico de tiempo de absorción
 float accumulatedAh = 0.0;
-unsigned long lastUpdateTime = 0;
+uint64_t lastUpdateTime = 0;
 
-unsigned long lastSaveTime = 0;
-const unsigned long SAVE_INTERVAL = 300000;
+uint64_t lastSaveTime = 0;
+const uint64_t SAVE_INTERVAL = 300000;
+bool chargingStateDirty = false;   // Guardado pendiente fuera del ciclo de control
 
-// Límite máximo de absorción (respaldo)
-const float maxAbsorptionHours = 1.0;
+// Límite máximo de absorción (respaldo; tools/sweep lo barre)
+float maxAbsorptionHours = 1.0;
 
 // Variables para tracking
 float calculatedAbsorptionHours = 0.0;
-unsigned long absorptionStartTime = 0;
+uint64_t absorptionStartTime = 0;
 
 
-unsigned long bulkStartTime = 0;
+// Inicio de BULK en ms monotónicos (0 = no iniciado). Con signo porque al
+// restaurar tras un reinicio puede quedar antes del arranque actual.
+int64_t bulkStartTime = 0;
 
 
 ChargeState currentState = BULK_CHARGE;
@@ -94,10 +126,6 @@ float batteryToLoadCurrent = 0;
 // const float LVD = 12.0;
 // const float LVR = 12.5;
 
-// Configuración del punto de acceso
-const char *ssid = "Cargador";
-const char *password = "12345678";
-
 // Variables para almacenar los valores de entrada
 float batteryCapacity = 50.0;
 float thresholdPercentage = 1.0;
@@ -109,17 +137,54 @@ float temperature;
 
 
 // Variables para el control de apagado temporal de la carga
-unsigned long loadOffStartTime = 0;
-unsigned long loadOffDuration = 0;
+uint64_t loadOffStartTime = 0;
+uint64_t loadOffDuration = 0;
 bool temporaryLoadOff = false;
 
+// === TEMPORIZADORES (rueda jerárquica) ===
+// loop() solo avanza la rueda y atiende UART/web; todo lo periódico o con
+// tiempo de espera es un temporizador con su callback.
+const uint32_t CONTROL_TICK_INTERVAL = 1000;    // Ciclo de control diurno
+const uint32_t HEARTBEAT_INTERVAL = 30000;      // HEARTBEAT al Orange Pi
+const uint32_t LOW_CURRENT_TIMEOUT = 3000;      // Gracia antes de resetear el PWM sin corriente
+const uint32_t REENTER_BULK_TIME = 30000;       // Tiempo bajo reEnterBulkVoltage para volver a BULK
+const uint32_t TEMP_CHECK_INTERVAL = 2000;      // Validaciones de temperatura crítica
+const uint32_t VOLTAGE_CHECK_INTERVAL = 1000;   // Validaciones de voltaje crítico
+const uint32_t ERROR_CHECK_INTERVAL = 2000;     // Reverificación de condiciones en ERROR
+const uint32_t ERROR_LED_BLINK_INTERVAL = 200;  // Parpadeo del LED en ERROR
+const uint32_t SCHEDULER_MAX_IDLE_MS = 20;      // Espera máxima de día (UART y web siguen atendidos)
+const int MAX_TEMP_ERROR_COUNT = 5;             // Validaciones consecutivas antes de ERROR
+const int MAX_VOLTAGE_ERROR_COUNT = 5;
+const float reEnterBulkVoltage = 12.6;
+
+WheelTimer controlTickTimer;
+WheelTimer nightTickTimer;
+WheelTimer heartbeatTimer;
+WheelTimer lowCurrentTimer;
+WheelTimer reEnterBulkTimer;
+WheelTimer tempCheckTimer;
+WheelTimer voltageCheckTimer;
+WheelTimer errorCheckTimer;
+WheelTimer errorBlinkTimer;
+WheelTimer loadOffTimer;
+WheelTimer profileTimer;
+WheelTimer profileDumpTimer;
+WheelTimer captureTimer;
+
+// Último voltaje de batería leído por el ciclo de control
+float lastBatteryVoltage = 0.0;
+
 float readTemperature();
 void saveChargingState();
+void requestChargingStateSave();
+uint32_t getBulkElapsedSeconds();
 void updateAhTracking();
 void resetChargingCycle();
 float calculateAbsorptionTime();
 float getSOCFromVoltage(float voltage);
-float getAverageCurrent(Adafruit_INA219 &ina);
+float getAverageCurrent(Adafruit_INA219 &ina, int samples = numSamples, bool recordNoise = true);
+void applySamplingMode(SamplingMode mode);
+void runSamplingNoiseTest();
 void updateChargeState(float batteryVoltage, float chargeCurrent);
 void bulkControl(float batteryVoltage, float chargeCurrent, float bulkVoltage);
 void absorptionControl(float batteryVoltage, float chargeCurrent, float absorptionVoltage);
@@ -127,44 +192,114 @@ void absorptionControlToLitium(float chargeCurrent, float batteryToLoadCurrent);
 void floatControl(float batteryVoltage, float floatVoltage);
 void adjustPWM(int step);
 void setPWM(int pwmValue);
+void applyLoadVoltageControl(float batteryVoltage);
+void enterNightMode();
+void exitNightMode();
+void initSchedulerTimers();
+void startDayTimers();
+void stopDayTimers();
+void enterErrorState(String reason);
+void idleUntilNextDeadline();
+void controlTick(void *arg);
+void nightTick(void *arg);
+void sendHeartbeat(void *arg);
+void lowCurrentTimeout(void *arg);
+void reEnterBulkTimeout(void *arg);
+void checkCriticalTemperature(void *arg);
+void checkCriticalVoltage(void *arg);
+void checkErrorRecovery(void *arg);
+void blinkErrorLed(void *arg);
+void loadOffExpired(void *arg);
+void handleProfileCommand(String cmd);
+void finishProfile(void *arg);
+void handleCaptureCommand(String cmd);
+void handleAutotuneCommand(String cmd);
+float getStageSetpoint(ChargeState state);
+void serviceCapture(void *arg);
+void subscribeBusConsumers();
+bool lookupParam(const String &name, ParamId &id);
+bool isDecimalNumber(const String &text, bool allowFraction);
+float parseParamValue(ParamId id, const String &text);
+bool isValidParamValue(ParamId id, float value);
+float getParamValue(ParamId id);
+void applyParamChange(const BusEvent &event);
+void persistParamChange(const BusEvent &event);
+void handleBusCommand(const BusEvent &event);
+void updateThermalFromMeasurement(const BusEvent &event);
+void handleOscillationEvent(const BusEvent &event);
+void publishControlSnapshot(float voltagePanel, float voltageBattery);
 String getChargeStateString(ChargeState state);
+const char *getChargeStateName(ChargeState state);
+void processSerialCommand(String command);
+void sendDataToOrangePi();
+const char *buildTelemetryJson(size_t &length);
+String buildOrangePiJson();
+void handleSetCommand(String cmd);
+void handleToggleLoad(String cmd);
+void handleModbusCommand(String cmd);
+bool isSerialLineIdle();
 
 
 // ========== FUNCIONES PROTOCOLO SERIAL ==========
 void initSerialCommunication() {
   OrangePiSerial.setTxBufferSize(2048);
   OrangePiSerial.begin(9600, SERIAL_8N1, RX_PIN_SERIAL, TX_PIN_SERIAL);
+  serialBuffer.reserve(SERIAL_LINE_MAX);
   Serial.println("📡 Comunicación serial con Orange Pi inicializada");
   Serial.printf("  RX: GPIO%d, TX: GPIO%d\n", RX_PIN_SERIAL, TX_PIN_SERIAL);
   Serial.println("  Baudrate: 9600 bps");
 }
 
+// Lee la UART por bloques y ejecuta cada línea completa. Coste O(n) en los
+// bytes recibidos: el buffer tiene capacidad fija (reservada en
+// initSerialCommunication) y una línea demasiado larga se descarta hasta su
+// '\n' en lugar de trocearse en comandos espurios.
 void handleSerialCommands() {
-  while (OrangePiSerial.available()) {
-    char inChar = (char)OrangePiSerial.read();
-    
+  int lines = 0;
+  // Tras CMD:MODBUS:ON el resto de la UART es de modbusService()
+  while (lines < SERIAL_MAX_LINES_PER_CALL && !isModbusActive()) {
+    if (serialChunkPos == serialChunkLength) {
+      int available = OrangePiSerial.available();
+      if (available <= 0) break;
+      serialChunkLength = OrangePiSerial.read(serialChunk, min(available, SERIAL_READ_CHUNK));
+      serialChunkPos = 0;
+      if (serialChunkLength == 0) break;
+    }
+
+    char inChar = (char)serialChunk[serialChunkPos++];
     if (inChar == '\n') {
-      commandReady = true;
-      break;
+      if (serialLineDropped) {
+        serialLineDropped = false;
+        metricsCountDroppedLine();
+        Serial.println("⚠️ [Orange Pi] Línea demasiado larga descartada");
+        OrangePiSerial.println("ERROR:Line too long");
+      } else {
+        AllocRegion region = getCommandAllocRegion(serialBuffer);
+        allocRegionBegin(region);
+        processSerialCommand(serialBuffer);
+        allocRegionEnd(region);
+      }
+      serialBuffer = "";
+      lines++;
+    } else if (serialLineDropped || inChar == '\0') {
+      // Sin efecto: resto de una línea descartada o byte nulo (ruido de línea)
+    } else if (serialBuffer.length() >= SERIAL_LINE_MAX) {
+      serialLineDropped = true;
+      serialBuffer = "";
     } else {
       serialBuffer += inChar;
     }
-    
-    if (serialBuffer.length() > 200) {
-      serialBuffer = "";
-      break;
-    }
-  }
-  
-  if (commandReady) {
-    processSerialCommand(serialBuffer);
-    serialBuffer = "";
-    commandReady = false;
   }
 }
 
+// true entre comandos (sin línea a medio recibir)
+bool isSerialLineIdle() {
+  return serialBuffer.length() == 0 && !serialLineDropped && serialChunkPos == serialChunkLength;
+}
+
 void processSerialCommand(String command) {
   command.trim();
+  traceCommand(command);
   Serial.println("📨 [Orange Pi] Comando recibido: " + command);
   
   if (command.startsWith("CMD:")) {
@@ -173,18 +308,127 @@ void processSerialCommand(String command) {
     if (cmd == "GET_DATA") {
       sendDataToOrangePi();
     }
+    else if (cmd == "BENCH") {
+      // Las pruebas leen el INA219 y ocupan el bucle durante segundos
+      if (nightModeActive) {
+        OrangePiSerial.println("ERROR:Night mode active");
+      } else if (getCaptureState() != CAPTURE_IDLE) {
+        OrangePiSerial.println("ERROR:Capture running");
+      } else if (isAutotuneRunning()) {
+        OrangePiSerial.println("ERROR:Autotune running");
+      } else {
+        runBenchmarks(OrangePiSerial);
+      }
+    }
+    else if (cmd == "SAMPLING_TEST") {
+      if (nightModeActive) {
+        OrangePiSerial.println("ERROR:Night mode active");
+      } else {
+        runSamplingNoiseTest();
+      }
+    }
+    else if (cmd.startsWith("SET_TIME:")) {
+      // Reloj de pared en segundos UNIX (toFloat perdería precisión). Hasta 10
+      // dígitos: strtoull satura "-1" o un número enorme a 2^64-1
+      String epochStr = cmd.substring(9);
+      uint64_t epoch = isDecimalNumber(epochStr, false) && epochStr.length() <= 10 ? strtoull(epochStr.c_str(), NULL, 10) : 0;
+      if (epoch >= 1600000000ULL) {
+        setWallClock(epoch);
+        OrangePiSerial.println("OK:Time set to " + uint64ToString(epoch));
+      } else {
+        OrangePiSerial.println("ERROR:Invalid epoch");
+      }
+    }
     else if (cmd.startsWith("SET_")) {
       handleSetCommand(cmd);
     }
     else if (cmd.startsWith("TOGGLE_LOAD:")) {
       handleToggleLoad(cmd);
     }
+    else if (cmd.startsWith("PROFILE:")) {
+      handleProfileCommand(cmd);
+    }
+    else if (cmd.startsWith("CAPTURE:")) {
+      handleCaptureCommand(cmd);
+    }
+    else if (cmd.startsWith("AUTOTUNE")) {
+      handleAutotuneCommand(cmd);
+    }
+    else if (cmd == "REGULATION") {
+      OrangePiSerial.println("REGULATION:" + buildRegulationJson());
+    }
+    else if (cmd == "REGULATION:RESET") {
+      regulationReset();
+      OrangePiSerial.println("OK:Regulation metrics reset");
+    }
+    else if (cmd == "HEAP") {
+      OrangePiSerial.println("HEAP:" + buildAllocJson());
+    }
+    else if (cmd == "HEAP:ON") {
+      allocTrackerStart();
+      OrangePiSerial.println(String("OK:Heap tracking on (") + (isAllocTrackerExact() ? "exact" : "net") + " mode)");
+    }
+    else if (cmd == "HEAP:OFF") {
+      allocTrackerStop();
+      OrangePiSerial.println("OK:Heap tracking off");
+    }
+    else if (cmd == "TRACE:ON") {
+      traceStart();
+      OrangePiSerial.println("OK:Trace recording on GPIO" + String(TRACE_TX_PIN) + " at " + String(TRACE_BAUD) + " baud");
+    }
+    else if (cmd == "TRACE:OFF") {
+      if (isTraceRecording()) {
+        traceStop();
+        OrangePiSerial.println("OK:Trace stopped, " + String(getTraceDropped()) + " records dropped");
+      } else {
+        OrangePiSerial.println("ERROR:Trace not recording");
+      }
+    }
+    else if (cmd.startsWith("WIFI_ON:")) {
+      unsigned long minutes = cmd.substring(8).toInt();
+      if (minutes >= 1 && minutes <= WIFI_MAX_WINDOW_MINUTES && requestWifiWindow(minutes)) {
+        OrangePiSerial.println("OK:WiFi on for " + String(minutes) + " minutes");
+      } else if (wifiPolicy == WIFI_POLICY_OFF) {
+        OrangePiSerial.println("ERROR:WiFi policy is OFF");
+      } else {
+        OrangePiSerial.println("ERROR:Invalid minutes (1-" + String(WIFI_MAX_WINDOW_MINUTES) + ")");
+      }
+    }
+    else if (cmd == "WIFI_OFF") {
+      closeWifiWindow();
+      OrangePiSerial.println(isWifiRadioOn() ? "OK:WiFi window closed (policy keeps radio on)" : "OK:WiFi off");
+    }
+    else if (cmd.startsWith("MODBUS:ON")) {
+      handleModbusCommand(cmd);
+    }
+    else if (cmd.startsWith("ACK:")) {
+      // Sin respuesta: confirma una trama ALARM
+      handleAckCommand(cmd.substring(4));
+    }
+    else if (cmd == "ALARMS") {
+      OrangePiSerial.println("ALARMS:" + buildAlarmsJson());
+    }
+    else if (cmd == "HISTORY" || cmd.startsWith("HISTORY:")) {
+      handleHistoryCommand(cmd.substring(7));
+    }
+    else if (cmd.startsWith("BRIDGE:")) {
+      // Túnel MQTT: sin respuesta, la Orange Pi no la espera
+      handleBridgeCommand(cmd.substring(7));
+    }
+    else if (cmd == "MQTT:ON") {
+      mqttSetEnabled(true);
+      OrangePiSerial.println("OK:MQTT publishing to " + mqttTopic + "/telemetry");
+    }
+    else if (cmd == "MQTT:OFF") {
+      mqttSetEnabled(false);
+      OrangePiSerial.println("OK:MQTT off");
+    }
+    else if (cmd == "MQTT:STATUS") {
+      OrangePiSerial.println("MQTT:" + buildMqttJson());
+    }
     else if (cmd == "CANCEL_TEMP_OFF") {
       // NUEVO: Comando para cancelar apagado temporal
-      if (temporaryLoadOff) {
-        temporaryLoadOff = false;
-        digitalWrite(LOAD_CONTROL_PIN, HIGH);
-        notaPersonalizada = "Apagado temporal cancelado (Orange Pi)";
+      if (temporaryLoadOff && publishCommand(COMMAND_CANCEL_LOAD_OFF, 0, SOURCE_SERIAL)) {
         OrangePiSerial.println("OK:Temporary load off cancelled");
         Serial.println("✅ [Orange Pi] Apagado temporal cancelado");
       } else {
@@ -204,101 +448,62 @@ void processSerialCommand(String command) {
 void sendDataToOrangePi() {
   Serial.println("📤 [Orange Pi] Preparando envío de datos completos...");
   
-  // Crear JSON con TODOS los datos del sistema
-  String json = "{";
-  
-  // === MEDICIONES EN TIEMPO REAL ===
-  json += "\"panelToBatteryCurrent\":" + String(panelToBatteryCurrent) + ",";
-  json += "\"batteryToLoadCurrent\":" + String(batteryToLoadCurrent) + ",";
-  json += "\"voltagePanel\":" + String(ina219_1.getBusVoltage_V()) + ",";
-  json += "\"voltageBatterySensor2\":" + String(ina219_2.getBusVoltage_V()) + ",";
-  json += "\"currentPWM\":" + String(currentPWM) + ",";
-  json += "\"temperature\":" + String(temperature) + ",";
-  json += "\"chargeState\":\"" + getChargeStateString(currentState) + "\",";
-  
-  // === PARÁMETROS DE CARGA ===
-  json += "\"bulkVoltage\":" + String(bulkVoltage) + ",";
-  json += "\"absorptionVoltage\":" + String(absorptionVoltage) + ",";
-  json += "\"floatVoltage\":" + String(floatVoltage) + ",";
-  json += "\"LVD\":" + String(LVD) + ",";
-  json += "\"LVR\":" + String(LVR) + ",";
-  
-  // === CONFIGURACIÓN DE BATERÍA ===
-  json += "\"batteryCapacity\":" + String(batteryCapacity) + ",";
-  json += "\"thresholdPercentage\":" + String(thresholdPercentage) + ",";
-  json += "\"maxAllowedCurrent\":" + String(maxAllowedCurrent) + ",";
-  json += "\"isLithium\":" + String(isLithium ? "true" : "false") + ",";
-  json += "\"maxBatteryVoltageAllowed\":" + String(maxBatteryVoltageAllowed) + ",";
-  
-  // === PARÁMETROS CALCULADOS ===
-  json += "\"absorptionCurrentThreshold_mA\":" + String(absorptionCurrentThreshold_mA) + ",";
-  json += "\"currentLimitIntoFloatStage\":" + String(currentLimitIntoFloatStage) + ",";
-  json += "\"calculatedAbsorptionHours\":" + String(calculatedAbsorptionHours) + ",";
-  json += "\"accumulatedAh\":" + String(accumulatedAh) + ",";
-  json += "\"estimatedSOC\":" + String(getSOCFromVoltage(ina219_2.getBusVoltage_V())) + ",";
-  json += "\"calculatedSOC\":" + String((accumulatedAh / batteryCapacity) * 100.0) + ",";
-  json += "\"netCurrent\":" + String(panelToBatteryCurrent - batteryToLoadCurrent) + ",";
-  json += "\"factorDivider\":" + String(factorDivider) + ",";
-  json += "\"currentBulkHours\":" + String(currentBulkHours) + ",";
-  json += "\"panelSensorAvailable\":" + String(panelSensorAvailable ? "true" : "false") + ",";
-  // === CONFIGURACIÓN DE FUENTE ===
-  json += "\"useFuenteDC\":" + String(useFuenteDC ? "true" : "false") + ",";
-  json += "\"fuenteDC_Amps\":" + String(fuenteDC_Amps) + ",";
-  json += "\"maxBulkHours\":" + String(maxBulkHours) + ",";
-  
-  // === CONFIGURACIÓN AVANZADA ===
-  json += "\"maxAbsorptionHours\":" + String(maxAbsorptionHours) + ",";
-  json += "\"chargedBatteryRestVoltage\":" + String(chargedBatteryRestVoltage) + ",";
-  json += "\"reEnterBulkVoltage\":12.6,"; // Valor fijo por ahora
-  json += "\"pwmFrequency\":" + String(pwmFrequency) + ",";
-  json += "\"tempThreshold\":55,"; // Valor fijo por ahora
-  
-  // === ESTADO DE APAGADO TEMPORAL ===
-  json += "\"temporaryLoadOff\":" + String(temporaryLoadOff ? "true" : "false") + ",";
-  if (temporaryLoadOff) {
-    unsigned long remainingTime = 0;
-    unsigned long elapsed = millis() - loadOffStartTime;
-    if (elapsed < loadOffDuration) {
-      remainingTime = (loadOffDuration - elapsed) / 1000; // Convertir a segundos
-    }
-    json += "\"loadOffRemainingSeconds\":" + String(remainingTime) + ",";
-    json += "\"loadOffDuration\":" + String(loadOffDuration / 1000) + ",";
-  } else {
-    json += "\"loadOffRemainingSeconds\":0,";
-    json += "\"loadOffDuration\":0,";
-  }
-  
-  // === ESTADO DEL SISTEMA ===
-  json += "\"loadControlState\":" + String(digitalRead(LOAD_CONTROL_PIN) ? "true" : "false") + ",";
-  json += "\"ledSolarState\":" + String(digitalRead(LED_SOLAR) ? "true" : "false") + ",";
-  
-  // Sanitizar nota personalizada para JSON
-  String sanitizedNota = notaPersonalizada;
-  sanitizedNota.replace("\"", "\\\"");
-  sanitizedNota.replace("\n", "\\n");
-  sanitizedNota.replace("\r", "");
-  json += "\"notaPersonalizada\":\"" + sanitizedNota + "\",";
-  
-  // === METADATOS ===
-  json += "\"connected\":true,";
-  json += "\"firmware_version\":\"ESP32_v2.1\",";
-  json += "\"uptime\":" + String(millis()) + ",";
-  json += "\"last_update\":\"" + String(millis()) + "\"";
-  
-  json += "}";
-  Serial.println("📏 Tamaño JSON: " + String(json.length()) + " caracteres");
-  // Verificar tamaño del JSON antes de enviar
-  if (json.length() > 2000) {
-    Serial.println("⚠️ [Orange Pi] JSON muy largo (" + String(json.length()) + " chars), dividiendo...");
-    // Por ahora, solo registrar el warning
+  size_t length;
+  const char *json = buildTelemetryJson(length);
+  if (length == 0) {
+    Serial.println("❌ [Orange Pi] El JSON de telemetría no cabe en TELEMETRY_JSON_MAX");
+    OrangePiSerial.println("ERROR:Telemetry overflow");
+    return;
   }
   
   // Enviar JSON a Orange Pi
   OrangePiSerial.println(json);
-  Serial.println("📤 [Orange Pi] Datos completos enviados: " + String(json.length()) + " caracteres");
+  Serial.printf("📤 [Orange Pi] Datos completos enviados: %u caracteres\n", (unsigned)length);
   
-  // Debug: mostrar primeros 200 caracteres del JSON
-  Serial.println("📋 [Orange Pi] JSON preview: " + json.substring(0, min(1050, (int)json.length())) + "...");
+  // Debug: mostrar el principio del JSON
+  Serial.printf("📋 [Orange Pi] JSON preview: %.*s...\n", (int)min(length, (size_t)1050), json);
+}
+
+// Segundos que faltan del apagado temporal (0 sin apagado)
+static uint64_t getLoadOffRemainingSeconds() {
+  if (!temporaryLoadOff) return 0;
+  uint64_t elapsed = monoMillis() - loadOffStartTime;
+  return elapsed < loadOffDuration ? (loadOffDuration - elapsed) / 1000 : 0;
+}
+
+// Cada campo de telemetry_schema.h desde su fuente
+void fillTelemetryRecord(TelemetryRecord &record) {
+  // Todas las mediciones salen de la misma instantánea del ciclo de control
+  MeasurementSnapshot m = getLatestMeasurement();
+  const RippleReport &ripple = getRippleReport();
+
+#define TELEMETRY_SET_FLOAT(field, source) telemetrySetNumber(&record, field, source)
+#define TELEMETRY_SET_INT(field, source) telemetrySetNumber(&record, field, (double)(source))
+#define TELEMETRY_SET_BOOL(field, source) telemetrySetNumber(&record, field, (source) ? 1 : 0)
+#define TELEMETRY_SET_TEXT(field, source) telemetrySetText(&record, field, source)
+#define TELEMETRY_FILL(name, type, decimals, source) TELEMETRY_SET_##type(TELEMETRY_FIELD_##name, source);
+  TELEMETRY_FIELDS(TELEMETRY_FILL)
+#undef TELEMETRY_FILL
+#undef TELEMETRY_SET_FLOAT
+#undef TELEMETRY_SET_INT
+#undef TELEMETRY_SET_BOOL
+#undef TELEMETRY_SET_TEXT
+}
+
+// JSON de telemetría (GET_DATA y /data) en un buffer fijo; length = 0 si no cabe
+const char *buildTelemetryJson(size_t &length) {
+  static TelemetryRecord record;
+  static char json[TELEMETRY_JSON_MAX];
+  fillTelemetryRecord(record);
+  int written = telemetryEncode(&record, json, sizeof(json));
+  length = written < 0 ? 0 : written;
+  return json;
+}
+
+// Copia en String para quien la necesita (benchmarks, web)
+String buildOrangePiJson() {
+  size_t length;
+  return String(buildTelemetryJson(length));
 }
 
 
@@ -313,120 +518,23 @@ void handleSetCommand(String cmd) {
   
   String parameter = cmd.substring(4, colonIndex); // Remover "SET_"
   String valueStr = cmd.substring(colonIndex + 1);
-  float value = valueStr.toFloat();
+  // Un valor mal formado queda en NAN y lo rechaza la validación de rango
+  float value = isDecimalNumber(valueStr, true) ? valueStr.toFloat() : NAN;
   
   bool success = false;
   String response = "OK:";
   
   Serial.println("🔧 [Orange Pi] Procesando SET " + parameter + " = " + valueStr);
   
-  // === PARÁMETROS BÁSICOS ===
-  if (parameter == "batteryCapacity") {
-    if (value > 0 && value <= 1000) {
-      // ✅ CORRECCIÓN: Recalcular SOC antes de cambiar capacidad
-      float oldCapacity = batteryCapacity;
-      float currentStoredEnergy = accumulatedAh; // Energía almacenada actual
-      
-      Serial.println("🔋 [Orange Pi] Cambiando capacidad de batería:");
-      Serial.println("   Capacidad anterior: " + String(oldCapacity, 1) + " Ah");
-      Serial.println("   Energía almacenada: " + String(currentStoredEnergy, 2) + " Ah");
-      Serial.println("   SOC anterior: " + String((currentStoredEnergy / oldCapacity) * 100.0, 1) + "%");
-      
-      // Actualizar capacidad
-      batteryCapacity = value;
-      
-      // ✅ RECALCULAR SOC: Mantener la misma energía almacenada
-      // Nuevo SOC = (Energía actual / Nueva capacidad) × 100%
-      float newSOC = (currentStoredEnergy / batteryCapacity) * 100.0;
-      
-      // ✅ VALIDACIÓN: Limitar SOC entre 0% y 110%
-      if (newSOC > 110.0) {
-        newSOC = 110.0;
-        accumulatedAh = (newSOC / 100.0) * batteryCapacity;
-        Serial.println("⚠️ [Orange Pi] SOC limitado a 110% - ajustando energía almacenada");
-      } else if (newSOC < 0.0) {
-        newSOC = 0.0;
-        accumulatedAh = 0.0;
-        Serial.println("⚠️ [Orange Pi] SOC limitado a 0% - ajustando energía almacenada");
-      } else {
-        // SOC válido - mantener energía almacenada actual
-        accumulatedAh = currentStoredEnergy;
-      }
-      
-      Serial.println("   Nueva capacidad: " + String(batteryCapacity, 1) + " Ah");
-      Serial.println("   Energía mantenida: " + String(accumulatedAh, 2) + " Ah");
-      Serial.println("   Nuevo SOC: " + String(newSOC, 1) + "%");
-      
-      // Recalcular parámetros dependientes
-      absorptionCurrentThreshold_mA = (batteryCapacity * thresholdPercentage) * 10;
-      currentLimitIntoFloatStage = absorptionCurrentThreshold_mA / factorDivider;
-      
-      // ✅ ACTUALIZAR maxBulkHours si se usa fuente DC
-      if (useFuenteDC && fuenteDC_Amps > 0) {
-        float oldMaxBulkHours = maxBulkHours;
-        maxBulkHours = batteryCapacity / fuenteDC_Amps;
-        Serial.println("   Tiempo máx. Bulk actualizado: " + String(oldMaxBulkHours, 1) + "h → " + String(maxBulkHours, 1) + "h");
-      }
-      
-      success = true;
-    }
-  }
-  else if (parameter == "thresholdPercentage") {
-    if (value >= 0.1 && value <= 5.0) {
-      thresholdPercentage = value;
-      absorptionCurrentThreshold_mA = (batteryCapacity * thresholdPercentage) * 10;
-      currentLimitIntoFloatStage = absorptionCurrentThreshold_mA / factorDivider;
-      success = true;
-    }
-  }
-  else if (parameter == "maxAllowedCurrent") {
-    if (value >= 1000 && value <= 15000) {
-      maxAllowedCurrent = value;
-      success = true;
-    }
-  }
-  else if (parameter == "bulkVoltage") {
-    if (value >= 12.0 && value <= 15.0) {
-      bulkVoltage = value;
-      success = true;
-    }
-  }
-  else if (parameter == "absorptionVoltage") {
-    if (value >= 12.0 && value <= 15.0) {
-      absorptionVoltage = value;
-      success = true;
-    }
-  }
-  else if (parameter == "floatVoltage") {
-    if (value >= 12.0 && value <= 15.0) {
-      floatVoltage = value;
-      success = true;
-    }
-  }
+  bool queueFull = false;
+  ParamId paramId;
   
-  // === PARÁMETROS DE TIPO BOOLEAN ===
-  else if (parameter == "isLithium") {
-    isLithium = (valueStr == "true" || valueStr == "1");
-    success = true;
-    Serial.println("🔋 [Orange Pi] Tipo de batería cambiado a: " + String(isLithium ? "Litio" : "GEL"));
-  }
-  else if (parameter == "useFuenteDC") {
-    useFuenteDC = (valueStr == "true" || valueStr == "1");
-    success = true;
-    Serial.println("⚡ [Orange Pi] Fuente de energía cambiada a: " + String(useFuenteDC ? "DC" : "Solar"));
-  }
-  
-  // === PARÁMETROS DE FUENTE DC ===
-  else if (parameter == "fuenteDC_Amps") {
-    if (value >= 0 && value <= 50) {
-      fuenteDC_Amps = value;
-      // Recalcular horas máximas en Bulk
-      if (useFuenteDC && fuenteDC_Amps > 0) {
-        maxBulkHours = batteryCapacity / fuenteDC_Amps;
-      } else {
-        maxBulkHours = 0.0;
-      }
-      success = true;
+  // === PARÁMETROS DE CARGA: se validan aquí y se aplican al despachar el bus ===
+  if (lookupParam(parameter, paramId)) {
+    value = parseParamValue(paramId, valueStr);
+    if (isValidParamValue(paramId, value)) {
+      success = publishParamChange(paramId, value, SOURCE_SERIAL);
+      queueFull = !success;
     }
   }
   
@@ -446,10 +554,36 @@ void handleSetCommand(String cmd) {
     }
   }
   
-  else if (parameter == "factorDivider") {
-    if (value >= 1 && value <= 10) {
-      factorDivider = (int)value;
-      currentLimitIntoFloatStage = absorptionCurrentThreshold_mA / factorDivider;
+  // === RADIO WIFI ===
+  else if (parameter == "wifiPolicy") {
+    if (valueStr == "0" || valueStr == "1" || valueStr == "2") {
+      setWifiPolicy((WifiPolicy)valueStr.toInt());
+      success = true;
+    }
+  }
+  else if (parameter == "wifiSsid") {
+    if (valueStr.length() >= 1 && valueStr.length() <= 32) {
+      wifiSsid = valueStr;
+      success = true;
+    }
+  }
+  else if (parameter == "wifiPassword") {
+    if (valueStr.length() >= 8 && valueStr.length() <= 63) {
+      wifiPassword = valueStr;
+      success = true;
+    }
+  }
+
+  // === MQTT ===
+  else if (parameter == "mqttTopic") {
+    if (isValidMqttTopic(valueStr)) {
+      mqttTopic = valueStr;
+      success = true;
+    }
+  }
+  else if (parameter == "mqttInterval") {
+    if (isDecimalNumber(valueStr, false) && value >= MQTT_MIN_INTERVAL_S && value <= MQTT_MAX_INTERVAL_S) {
+      mqttInterval = (uint16_t)value;
       success = true;
     }
   }
@@ -462,36 +596,43 @@ void handleSetCommand(String cmd) {
   
   // === GUARDAR EN PREFERENCES SI FUE EXITOSO ===
   if (success) {
-    preferences.begin("charger", false);
-    
-    // Guardar según el parámetro
-    if (parameter == "batteryCapacity") {
-      preferences.putFloat("batteryCap", batteryCapacity);
-      preferences.putFloat("accumulatedAh", accumulatedAh); // ← IMPORTANTE: Guardar SOC corregido
+    // Los parámetros de carga los persiste persistParamChange al despacharse
+    if (parameter == "wifiPolicy" || parameter == "wifiSsid" || parameter == "wifiPassword" ||
+        parameter == "mqttTopic" || parameter == "mqttInterval") {
+      nvsCommitBegin();
+      preferences.begin("charger", false);
+      if (parameter == "wifiPolicy") preferences.putUChar("wifiPolicy", (uint8_t)wifiPolicy);
+      else if (parameter == "wifiSsid") preferences.putString("wifiSsid", wifiSsid);
+      else if (parameter == "wifiPassword") preferences.putString("wifiPass", wifiPassword);
+      else if (parameter == "mqttTopic") preferences.putString("mqttTopic", mqttTopic);
+      else if (parameter == "mqttInterval") preferences.putUInt("mqttInterval", mqttInterval);
+      preferences.end();
+      nvsCommitEnd();
     }
-    else if (parameter == "thresholdPercentage") preferences.putFloat("thresholdPerc", thresholdPercentage);
-    else if (parameter == "maxAllowedCurrent") preferences.putFloat("maxCurrent", maxAllowedCurrent);
-    else if (parameter == "bulkVoltage") preferences.putFloat("bulkV", bulkVoltage);
-    else if (parameter == "absorptionVoltage") preferences.putFloat("absV", absorptionVoltage);
-    else if (parameter == "floatVoltage") preferences.putFloat("floatV", floatVoltage);
-    else if (parameter == "isLithium") preferences.putBool("isLithium", isLithium);
-    else if (parameter == "useFuenteDC") preferences.putBool("useFuenteDC", useFuenteDC);
-    else if (parameter == "fuenteDC_Amps") preferences.putFloat("fuenteDC_Amps", fuenteDC_Amps);
     
-    preferences.end();
+    // Las credenciales nuevas se aplican reiniciando el softAP
+    if (parameter == "wifiSsid" || parameter == "wifiPassword") {
+      restartWifiRadio();
+    }
+    // El tema es también el client id: nueva sesión con el broker
+    if (parameter == "mqttTopic") {
+      mqttRestart();
+    }
     
-    // Mensaje de respuesta personalizado para batteryCapacity
-    if (parameter == "batteryCapacity") {
-      float finalSOC = (accumulatedAh / batteryCapacity) * 100.0;
-      response += parameter + " updated to " + valueStr + ", SOC recalculated to " + String(finalSOC, 1) + "%";
-      notaPersonalizada = "Capacidad actualizada a " + valueStr + "Ah desde Orange Pi. SOC recalculado: " + String(finalSOC, 1) + "% (" + String(accumulatedAh, 2) + "Ah)";
+    // Mensaje de respuesta personalizado para la contraseña
+    if (parameter == "wifiPassword") {
+      response += parameter + " updated";
+      notaPersonalizada = "Contraseña WiFi actualizada desde Orange Pi";
     } else {
       response += parameter + " updated to " + valueStr;
       notaPersonalizada = "Parámetro " + parameter + " actualizado desde Orange Pi a " + valueStr;
     }
     
     Serial.println("✅ [Orange Pi] " + response);
-    Serial.println("💾 [Orange Pi] Parámetro guardado en Preferences");
+    Serial.println("💾 [Orange Pi] Parámetro aceptado");
+  } else if (queueFull) {
+    response = "ERROR:Event queue full, retry " + parameter;
+    Serial.println("❌ [Orange Pi] " + response);
   } else {
     response = "ERROR:Invalid value for " + parameter + " (received: " + valueStr + ")";
     Serial.println("❌ [Orange Pi] " + response);
@@ -509,19 +650,18 @@ void handleToggleLoad(String cmd) {
     return;
   }
   
-  int seconds = cmd.substring(colonIndex + 1).toInt();
+  String secondsStr = cmd.substring(colonIndex + 1);
+  int seconds = isDecimalNumber(secondsStr, false) && secondsStr.length() <= 5 ? secondsStr.toInt() : 0;
   
   Serial.println("🔌 [Orange Pi] Solicitud de apagado temporal: " + String(seconds) + " segundos");
   
   // CAMBIO: Aumentar límite a 43200 segundos (12 horas)
   if (seconds >= 1 && seconds <= 43200) {
     if (digitalRead(LOAD_CONTROL_PIN) == HIGH) {
-      digitalWrite(LOAD_CONTROL_PIN, LOW);
-      temporaryLoadOff = true;
-      loadOffStartTime = millis();
-      loadOffDuration = seconds * 1000UL; // UL para evitar overflow
-      
-      notaPersonalizada = "Carga apagada por " + String(seconds) + " segundos (Orange Pi)";
+      if (!publishCommand(COMMAND_LOAD_OFF, seconds, SOURCE_SERIAL)) {
+        OrangePiSerial.println("ERROR:Event queue full, retry");
+        return;
+      }
       OrangePiSerial.println("OK:Load turned off for " + String(seconds) + " seconds");
       Serial.println("🔌 [Orange Pi] ✅ Carga apagada por " + String(seconds) + " segundos");
     } else {
@@ -536,26 +676,481 @@ void handleToggleLoad(String cmd) {
 }
 
 
-void periodicSerialUpdate() {
-  static unsigned long lastAutoUpdate = 0;
-  unsigned long now = millis();
-  
-  if (now - lastAutoUpdate > 30000) {
-    if (!commandReady && serialBuffer.length() == 0) {
-      OrangePiSerial.println("HEARTBEAT:ESP32 Online");
-      Serial.println("💓 [Orange Pi] Heartbeat enviado");
+void sendHeartbeat(void *arg) {
+  if (isCaptureStreaming() || isModbusActive()) {
+    return; // No intercalar texto en el volcado binario ni entre tramas Modbus
+  }
+  if (isSerialLineIdle()) {
+    OrangePiSerial.println("HEARTBEAT:ESP32 Online");
+    Serial.println("💓 [Orange Pi] Heartbeat enviado");
+  }
+}
+
+
+// CMD:MODBUS:ON[:<id>] - la UART pasa a Modbus RTU (esclavo 1 por defecto).
+// Se vuelve al texto escribiendo 0 en el registro PROTOCOL.
+void handleModbusCommand(String cmd) {
+  String args = cmd.substring(9);  // "" o ":<id>"
+  int id = MODBUS_DEFAULT_ID;
+  if (args.length() > 0) {
+    String idStr = args.substring(1);
+    id = args.charAt(0) == ':' && isDecimalNumber(idStr, false) && idStr.length() <= 3 ? idStr.toInt() : 0;
+  }
+  if (id < 1 || id > MODBUS_MAX_ID) {
+    OrangePiSerial.println("ERROR:Invalid Modbus id (1-" + String(MODBUS_MAX_ID) + ")");
+    return;
+  }
+
+  // El OK sale aún en texto; lo que quede en la UART ya es Modbus
+  OrangePiSerial.println("OK:Modbus RTU slave " + String(id));
+  OrangePiSerial.flush();
+  serialBuffer = "";
+  serialChunkPos = serialChunkLength;
+  modbusStart(id);
+}
+
+
+// === PERFILADOR ===
+// CMD:PROFILE:<segundos>[:<hz>] - el volcado llega al terminar la captura
+void handleProfileCommand(String cmd) {
+  String args = cmd.substring(8);
+  int colonIndex = args.indexOf(':');
+  int seconds = (colonIndex == -1 ? args : args.substring(0, colonIndex)).toInt();
+  int hz = colonIndex == -1 ? PROFILER_DEFAULT_HZ : args.substring(colonIndex + 1).toInt();
+
+  if (seconds < 1 || seconds > PROFILER_MAX_SECONDS || hz < 1 || hz > PROFILER_MAX_HZ) {
+    OrangePiSerial.println("ERROR:Invalid profile args (1-" + String(PROFILER_MAX_SECONDS) + " s, 1-" + String(PROFILER_MAX_HZ) + " Hz)");
+    return;
+  }
+  if (!profilerStart(hz)) {
+    OrangePiSerial.println("ERROR:Profiler busy or unavailable");
+    return;
+  }
+  timerStart(&profileTimer, seconds * 1000UL);
+  OrangePiSerial.println("OK:Profiling " + String(seconds) + " s at " + String(hz) + " Hz");
+}
+
+void finishProfile(void *arg) {
+  profilerStop();
+  profilerDumpBegin();
+  timerStart(&profileDumpTimer, 0, CAPTURE_POLL_MS);
+}
+
+void serviceProfileDump(void *arg) {
+  if (isCaptureStreaming()) {
+    return;  // El volcado binario de la captura no admite líneas intercaladas
+  }
+  if (!profilerDumpService(OrangePiSerial)) {
+    timerCancel(&profileDumpTimer);
+  }
+}
+
+
+// === CAPTURA EN RÁFAGA ===
+// CMD:CAPTURE:<canales>:<hz>:<tramas>[:<NOW|STAGE|OV>[:<pre-disparo>]]
+// CMD:CAPTURE:CANCEL
+void handleCaptureCommand(String cmd) {
+  String args = cmd.substring(8);
+  if (args == "CANCEL") {
+    captureCancel();
+    OrangePiSerial.println("OK:Capture cancelled");
+    return;
+  }
+  if (nightModeActive) {
+    OrangePiSerial.println("ERROR:Night mode active");
+    return;
+  }
+
+  String parts[5];
+  int count = 0;
+  while (count < 5) {
+    int colonIndex = args.indexOf(':');
+    parts[count++] = colonIndex == -1 ? args : args.substring(0, colonIndex);
+    if (colonIndex == -1) break;
+    args = args.substring(colonIndex + 1);
+  }
+  if (count < 3) {
+    OrangePiSerial.println("ERROR:Invalid CAPTURE format");
+    return;
+  }
+
+  CaptureTrigger trigger = CAPTURE_TRIGGER_NOW;
+  if (count >= 4) {
+    if (parts[3] == "STAGE") trigger = CAPTURE_TRIGGER_STAGE;
+    else if (parts[3] == "OV") trigger = CAPTURE_TRIGGER_OVERVOLTAGE;
+    else if (parts[3] != "NOW") {
+      OrangePiSerial.println("ERROR:Invalid trigger (NOW, STAGE, OV)");
+      return;
+    }
+  }
+  uint32_t frames = parts[2].toInt();
+  uint32_t preFrames = count >= 5 ? parts[4].toInt() : frames / 4;
+
+  // Disparo OV: consigna de la etapa actual más un margen
+  float overVoltage = getStageSetpoint(currentState) + CAPTURE_OV_MARGIN;
+
+  String error = captureArm(parts[0], parts[1].toInt(), frames, trigger, preFrames, overVoltage);
+  if (error.length() > 0) {
+    OrangePiSerial.println("ERROR:" + error);
+    return;
+  }
+  timerStart(&captureTimer, CAPTURE_POLL_MS, CAPTURE_POLL_MS);
+  OrangePiSerial.println("OK:Capture armed (" + getCaptureTriggerString(trigger) + ", " +
+                         String(getCaptureActualRate(parts[1].toInt())) + " Hz)");
+}
+
+// === AUTOAJUSTE DEL REGULADOR ===
+// CMD:AUTOTUNE - ensayo de relé en la etapa actual; el resultado llega como
+// AUTOTUNE:{...} al terminar. CMD:AUTOTUNE:CANCEL, CMD:AUTOTUNE:RESET
+void handleAutotuneCommand(String cmd) {
+  if (cmd == "AUTOTUNE:CANCEL") {
+    autotuneAbort("Cancelado por comando");
+    OrangePiSerial.println("OK:Autotune cancelled");
+    return;
+  }
+  if (cmd == "AUTOTUNE:RESET") {
+    if (isAutotuneRunning()) {
+      OrangePiSerial.println("ERROR:Autotune running");
+      return;
+    }
+    autotuneClearGains();
+    OrangePiSerial.println("OK:Regulator back to fixed steps");
+    return;
+  }
+  if (cmd != "AUTOTUNE") {
+    OrangePiSerial.println("ERROR:Invalid AUTOTUNE format");
+    return;
+  }
+  if (nightModeActive || currentState == ERROR) {
+    OrangePiSerial.println("ERROR:Charger not regulating");
+    return;
+  }
+
+  float setpoint = getStageSetpoint(currentState);
+  String error = autotuneStart(setpoint, currentPWM, currentState, CONTROL_TICK_INTERVAL / 1000.0);
+  if (error.length() > 0) {
+    OrangePiSerial.println("ERROR:" + error);
+    return;
+  }
+  notaPersonalizada = "Autoajuste en curso alrededor de " + String(setpoint, 2) + " V";
+  OrangePiSerial.println("OK:Autotune started at " + String(setpoint, 2) + " V");
+}
+
+void serviceCapture(void *arg) {
+  if (!captureService(OrangePiSerial)) {
+    timerCancel(&captureTimer);
+  }
+}
+
+
+// === APAGADO TEMPORAL DE LA CARGA ===
+void startLoadOffTimer(uint32_t seconds) {
+  digitalWrite(LOAD_CONTROL_PIN, LOW);
+  temporaryLoadOff = true;
+  loadOffStartTime = monoMillis();
+  loadOffDuration = seconds * 1000ULL;
+  timerStart(&loadOffTimer, seconds * 1000UL);
+}
+
+void cancelLoadOffTimer() {
+  timerCancel(&loadOffTimer);
+  temporaryLoadOff = false;
+  digitalWrite(LOAD_CONTROL_PIN, HIGH);
+}
+
+void loadOffExpired(void *arg) {
+  temporaryLoadOff = false;
+  digitalWrite(LOAD_CONTROL_PIN, HIGH);
+  notaPersonalizada = "Apagado temporal completado, carga reactivada";
+  Serial.println("⏰ Apagado temporal completado, carga reactivada");
+}
+
+
+// ========== BUS DE EVENTOS ==========
+// Nombres del protocolo serial para cada ParamId
+const char *const PARAM_NAMES[PARAM_COUNT] = {
+  "batteryCapacity", "thresholdPercentage", "maxAllowedCurrent", "bulkVoltage",
+  "absorptionVoltage", "floatVoltage", "isLithium", "useFuenteDC",
+  "fuenteDC_Amps", "factorDivider", "tempSoftLimit", "tempHardLimit",
+  "samplingMode"
+};
+
+void subscribeBusConsumers() {
+  // applyParamChange antes que persistParamChange: se persiste el valor ya aplicado
+  eventBusSubscribe(EVENT_PARAM_CHANGE, applyParamChange);
+  eventBusSubscribe(EVENT_PARAM_CHANGE, persistParamChange);
+  eventBusSubscribe(EVENT_COMMAND, handleBusCommand);
+  eventBusSubscribe(EVENT_MEASUREMENT, updateThermalFromMeasurement);
+  eventBusSubscribe(EVENT_MEASUREMENT, mqttRecordMeasurement);
+  eventBusSubscribe(EVENT_MEASUREMENT, historyRecordMeasurement);
+  eventBusSubscribe(EVENT_OSCILLATION, handleOscillationEvent);
+}
+
+// Número del protocolo serial escrito completo en decimal (con fracción,
+// signo y exponente si allowFraction). toFloat/toInt aceptan "0x10", "nan",
+// "inf" o basura al final y devolverían un valor que sí pasa los rangos.
+bool isDecimalNumber(const String &text, bool allowFraction) {
+  const char *start = text.c_str();
+  if (*start == '\0') return false;
+  for (const char *c = start; *c != '\0'; c++) {
+    if (isdigit((unsigned char)*c)) continue;
+    if (allowFraction && strchr("+-.eE", *c) != NULL) continue;
+    return false;
+  }
+  char *end;
+  strtod(start, &end);
+  return *end == '\0';
+}
+
+bool lookupParam(const String &name, ParamId &id) {
+  for (int i = 0; i < PARAM_COUNT; i++) {
+    if (name == PARAM_NAMES[i]) {
+      id = (ParamId)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Texto de SET o del formulario web a valor del bus; NAN si está mal formado
+// (los booleanos aceptan true/false y 1/0)
+float parseParamValue(ParamId id, const String &text) {
+  if (id == PARAM_IS_LITHIUM || id == PARAM_USE_FUENTE_DC) {
+    if (text == "true" || text == "1") return 1.0;
+    if (text == "false" || text == "0") return 0.0;
+    return NAN;
+  }
+  return isDecimalNumber(text, true) ? text.toFloat() : NAN;
+}
+
+// Rangos válidos de cada parámetro (compartidos por UART y web)
+bool isValidParamValue(ParamId id, float value) {
+  switch (id) {
+    case PARAM_BATTERY_CAPACITY:
+      return value > 0 && value <= 1000;
+    case PARAM_THRESHOLD_PERCENTAGE:
+      return value >= 0.1 && value <= 5.0;
+    case PARAM_MAX_ALLOWED_CURRENT:
+      return value >= 1000 && value <= 15000;
+    case PARAM_BULK_VOLTAGE:
+    case PARAM_ABSORPTION_VOLTAGE:
+    case PARAM_FLOAT_VOLTAGE:
+      return value >= 12.0 && value <= 15.0;
+    case PARAM_IS_LITHIUM:
+    case PARAM_USE_FUENTE_DC:
+      return value == 0.0 || value == 1.0;
+    case PARAM_FUENTE_DC_AMPS:
+      return value >= 0 && value <= 50;
+    case PARAM_FACTOR_DIVIDER:
+      return value >= 1 && value <= 10;
+    case PARAM_TEMP_SOFT_LIMIT:
+      return value >= 40.0 && value < tempHardLimit;
+    case PARAM_TEMP_HARD_LIMIT:
+      return value > tempSoftLimit && value < TEMP_THRESHOLD_SHUTDOWN;
+    case PARAM_SAMPLING_MODE:
+      return value == SAMPLING_FREE_RUNNING || value == SAMPLING_PWM_SYNC;
+    default:
+      return false;
+  }
+}
+
+// Valor actual de cada parámetro, con la misma codificación que ParamChange
+float getParamValue(ParamId id) {
+  switch (id) {
+    case PARAM_BATTERY_CAPACITY: return batteryCapacity;
+    case PARAM_THRESHOLD_PERCENTAGE: return thresholdPercentage;
+    case PARAM_MAX_ALLOWED_CURRENT: return maxAllowedCurrent;
+    case PARAM_BULK_VOLTAGE: return bulkVoltage;
+    case PARAM_ABSORPTION_VOLTAGE: return absorptionVoltage;
+    case PARAM_FLOAT_VOLTAGE: return floatVoltage;
+    case PARAM_IS_LITHIUM: return isLithium ? 1.0 : 0.0;
+    case PARAM_USE_FUENTE_DC: return useFuenteDC ? 1.0 : 0.0;
+    case PARAM_FUENTE_DC_AMPS: return fuenteDC_Amps;
+    case PARAM_FACTOR_DIVIDER: return factorDivider;
+    case PARAM_TEMP_SOFT_LIMIT: return tempSoftLimit;
+    case PARAM_TEMP_HARD_LIMIT: return tempHardLimit;
+    case PARAM_SAMPLING_MODE: return samplingMode;
+    default: return NAN;
+  }
+}
+
+// Único punto donde se escriben los parámetros de carga
+void applyParamChange(const BusEvent &event) {
+  float value = event.param.value;
+  String source = getEventSourceString(event.source);
+
+  switch (event.param.id) {
+    case PARAM_BATTERY_CAPACITY: {
+      // ✅ Mantener la energía almacenada y recalcular el SOC con la nueva capacidad
+      float oldCapacity = batteryCapacity;
+      Serial.println("🔋 [Bus] Cambiando capacidad de batería:");
+      Serial.println("   Capacidad anterior: " + String(oldCapacity, 1) + " Ah");
+      Serial.println("   Energía almacenada: " + String(accumulatedAh, 2) + " Ah");
+      Serial.println("   SOC anterior: " + String((accumulatedAh / oldCapacity) * 100.0, 1) + "%");
+
+      batteryCapacity = value;
+      float newSOC = (accumulatedAh / batteryCapacity) * 100.0;
+
+      // ✅ VALIDACIÓN: Limitar SOC entre 0% y 110%
+      if (newSOC > 110.0) {
+        newSOC = 110.0;
+        accumulatedAh = (newSOC / 100.0) * batteryCapacity;
+        Serial.println("⚠️ [Bus] SOC limitado a 110% - ajustando energía almacenada");
+      } else if (newSOC < 0.0) {
+        newSOC = 0.0;
+        accumulatedAh = 0.0;
+        Serial.println("⚠️ [Bus] SOC limitado a 0% - ajustando energía almacenada");
+      }
+
+      Serial.println("   Nueva capacidad: " + String(batteryCapacity, 1) + " Ah");
+      Serial.println("   Nuevo SOC: " + String(newSOC, 1) + "%");
+      notaPersonalizada = "Capacidad actualizada a " + String(batteryCapacity, 1) + "Ah desde " + source + ". SOC recalculado: " + String(newSOC, 1) + "% (" + String(accumulatedAh, 2) + "Ah)";
+      break;
+    }
+    case PARAM_THRESHOLD_PERCENTAGE:
+      thresholdPercentage = value;
+      break;
+    case PARAM_MAX_ALLOWED_CURRENT:
+      maxAllowedCurrent = value;
+      break;
+    case PARAM_BULK_VOLTAGE:
+      bulkVoltage = value;
+      break;
+    case PARAM_ABSORPTION_VOLTAGE:
+      absorptionVoltage = value;
+      break;
+    case PARAM_FLOAT_VOLTAGE:
+      floatVoltage = value;
+      break;
+    case PARAM_IS_LITHIUM:
+      isLithium = value != 0.0;
+      Serial.println("🔋 [Bus] Tipo de batería cambiado a: " + String(isLithium ? "Litio" : "GEL"));
+      break;
+    case PARAM_USE_FUENTE_DC:
+      useFuenteDC = value != 0.0;
+      Serial.println("⚡ [Bus] Fuente de energía cambiada a: " + String(useFuenteDC ? "DC" : "Solar"));
+      break;
+    case PARAM_FUENTE_DC_AMPS:
+      fuenteDC_Amps = value;
+      break;
+    case PARAM_FACTOR_DIVIDER:
+      factorDivider = (int)value;
+      break;
+    // isValidParamValue() compara con el límite aplicado, no con el que aún
+    // espera en la cola: dos cambios del mismo lote (UART, web, Modbus) pueden
+    // pasar cada uno y dejar suave >= duro. Se vuelve a comprobar aquí.
+    case PARAM_TEMP_SOFT_LIMIT:
+    case PARAM_TEMP_HARD_LIMIT: {
+      bool soft = event.param.id == PARAM_TEMP_SOFT_LIMIT;
+      float newSoft = soft ? value : tempSoftLimit;
+      float newHard = soft ? tempHardLimit : value;
+      if (newSoft >= newHard) {
+        notaPersonalizada = String(PARAM_NAMES[event.param.id]) + "=" + String(value, 1) + " rechazado desde " + source +
+                            ": el límite suave (" + String(newSoft, 1) + "°C) debe quedar por debajo del duro (" +
+                            String(newHard, 1) + "°C)";
+        Serial.println("⚠️ [Bus] " + notaPersonalizada);
+        return;
+      }
+      if (soft) tempSoftLimit = value;
+      else tempHardLimit = value;
+      break;
     }
-    lastAutoUpdate = now;
+    case PARAM_SAMPLING_MODE:
+      applySamplingMode((SamplingMode)(int)value);
+      break;
+    default:
+      return;
   }
+
+  // Recalcular parámetros dependientes
+  absorptionCurrentThreshold_mA = (batteryCapacity * thresholdPercentage) * 10;
+  currentLimitIntoFloatStage = absorptionCurrentThreshold_mA / factorDivider;
+  if (useFuenteDC && fuenteDC_Amps > 0) {
+    maxBulkHours = batteryCapacity / fuenteDC_Amps;
+  } else {
+    maxBulkHours = 0.0;
+  }
+
+  Serial.println("✅ [Bus] " + String(PARAM_NAMES[event.param.id]) + " = " + String(value, 2) + " (desde " + source + ")");
 }
 
+void persistParamChange(const BusEvent &event) {
+  if (event.param.id == PARAM_FACTOR_DIVIDER) {
+    return; // No persistido: setup() lo fija
+  }
+  if (getParamValue(event.param.id) != event.param.value) {
+    return; // Rechazado por applyParamChange: nada que guardar
+  }
 
+  nvsCommitBegin();
+  preferences.begin("charger", false);
+  switch (event.param.id) {
+    case PARAM_BATTERY_CAPACITY:
+      preferences.putFloat("batteryCap", batteryCapacity);
+      preferences.putFloat("accumulatedAh", accumulatedAh); // ← IMPORTANTE: Guardar SOC corregido
+      break;
+    case PARAM_THRESHOLD_PERCENTAGE: preferences.putFloat("thresholdPerc", thresholdPercentage); break;
+    case PARAM_MAX_ALLOWED_CURRENT: preferences.putFloat("maxCurrent", maxAllowedCurrent); break;
+    case PARAM_BULK_VOLTAGE: preferences.putFloat("bulkV", bulkVoltage); break;
+    case PARAM_ABSORPTION_VOLTAGE: preferences.putFloat("absV", absorptionVoltage); break;
+    case PARAM_FLOAT_VOLTAGE: preferences.putFloat("floatV", floatVoltage); break;
+    case PARAM_IS_LITHIUM: preferences.putBool("isLithium", isLithium); break;
+    case PARAM_USE_FUENTE_DC: preferences.putBool("useFuenteDC", useFuenteDC); break;
+    case PARAM_FUENTE_DC_AMPS: preferences.putFloat("fuenteDC_Amps", fuenteDC_Amps); break;
+    case PARAM_TEMP_SOFT_LIMIT: preferences.putFloat("tempSoft", tempSoftLimit); break;
+    case PARAM_TEMP_HARD_LIMIT: preferences.putFloat("tempHard", tempHardLimit); break;
+    case PARAM_SAMPLING_MODE: preferences.putUChar("samplingMode", samplingMode); break;
+    default: break;
+  }
+  preferences.end();
+  nvsCommitEnd();
+}
 
+void handleBusCommand(const BusEvent &event) {
+  String source = getEventSourceString(event.source);
+
+  switch (event.command.id) {
+    case COMMAND_LOAD_OFF:
+      // El estado pudo cambiar entre la publicación y el despacho
+      if (digitalRead(LOAD_CONTROL_PIN) == HIGH) {
+        startLoadOffTimer(event.command.arg);
+        notaPersonalizada = "Carga apagada por " + String(event.command.arg) + " segundos (" + source + ")";
+        Serial.println("🔌 [Bus] ✅ Carga apagada por " + String(event.command.arg) + " segundos");
+      }
+      break;
+    case COMMAND_CANCEL_LOAD_OFF:
+      if (temporaryLoadOff) {
+        cancelLoadOffTimer();
+        notaPersonalizada = "Apagado temporal cancelado (" + source + ")";
+        Serial.println("✅ [Bus] Apagado temporal cancelado");
+      }
+      break;
+  }
+}
+
+void updateThermalFromMeasurement(const BusEvent &event) {
+  const MeasurementSnapshot &m = event.measurement;
+  // Derating térmico: aplica al siguiente ciclo de control
+  updateThermalModel(m.temperature, m.panelToBatteryCurrent, m.pwm, m.voltagePanel, pwmFrequency);
+}
+
+void handleOscillationEvent(const BusEvent &event) {
+  const OscillationEvent &o = event.oscillation;
+  if (o.active) {
+    notaPersonalizada = "Oscilación en " + getChargeStateString(currentState) + ": " + String(o.amplitude_mV, 0) +
+                        " mV a " + String(o.frequencyHz, 3) + " Hz (estabilidad " + String(o.stabilityScore) + "/100)";
+    Serial.println("〰️ [Rizado] " + notaPersonalizada);
+  } else {
+    Serial.println("✅ [Rizado] Oscilación desaparecida (estabilidad " + String(o.stabilityScore) + "/100)");
+  }
+}
 
 
 void setup() {
   Serial.begin(9600);
   delay(1000);
+  initSchedulerTimers();
+  subscribeBusConsumers();
   Serial.println("Iniciando sensores INA219...");
 
   // Pines de control
@@ -582,6 +1177,7 @@ void setup() {
   esp_task_wdt_add(NULL);
 
   // Inicializar I2C
+  i2cBusBegin();
   Wire.begin(SDA_PIN, SCL_PIN);
 
   // Inicializar sensores INA219
@@ -600,6 +1196,8 @@ void setup() {
   Serial.println("Sensores INA219 listos.");
 
   // Configurar PWM
+  samplingBegin();
+  pwmFrequency = getPwmFrequencyForMode(samplingMode);
   bool success = ledcAttach(pwmPin, pwmFrequency, pwmResolution);
   if (!success) {
     Serial.println("Error al configurar el PWM");
@@ -611,8 +1209,9 @@ void setup() {
   currentState = BULK_CHARGE;
 
   // Añadir detección inicial del estado de la batería
-  float initialBatteryVoltage = ina219_2.getBusVoltage_V();
+  float initialBatteryVoltage = ina219BusVoltage(ina219_2);
   float initialTemperature = readTemperature();
+  lastBatteryVoltage = initialBatteryVoltage;  // Valor de la alarma si el arranque entra en ERROR
   
   // === VERIFICACIÓN DE SEGURIDAD AL INICIO - CRÍTICO ===
   // NO encender carga si hay condiciones de error al arrancar
@@ -631,10 +1230,8 @@ void setup() {
   }
   
   if (!safeToStart) {
-    // ⛔ CONDICIONES PELIGROSAS AL INICIO - FORZAR ERROR
-    currentState = ERROR;
-    digitalWrite(LOAD_CONTROL_PIN, LOW); // ¡NUNCA encender la carga!
-    notaPersonalizada = "INICIO INSEGURO: " + safetyMessage + "Carga BLOQUEADA hasta normalización";
+    // ⛔ CONDICIONES PELIGROSAS AL INICIO - FORZAR ERROR (la carga queda apagada)
+    enterErrorState("INICIO INSEGURO: " + safetyMessage + "Carga BLOQUEADA hasta normalización");
     Serial.println("🚨 ¡ALERTA DE SEGURIDAD! Condiciones críticas detectadas al inicio:");
     Serial.println("   " + safetyMessage);
     Serial.println("   🔒 CARGA BLOQUEADA - Sistema en ERROR hasta normalización");
@@ -665,12 +1262,6 @@ void setup() {
     }
   }
 
-  // Configurar el punto de acceso
-  WiFi.softAP(ssid, password);
-  Serial.println("Punto de acceso iniciado");
-  Serial.print("IP del servidor: ");
-  Serial.println(WiFi.softAPIP());
-
   // Iniciar Preferences en modo lectura
   preferences.begin("charger", true);
   batteryCapacity = preferences.getFloat("batteryCap", 50.0);
@@ -697,9 +1288,37 @@ void setup() {
   isLithium = preferences.getBool("isLithium", false);
   useFuenteDC = preferences.getBool("useFuenteDC", false);
   fuenteDC_Amps = preferences.getFloat("fuenteDC_Amps", 0.0);
-  bulkStartTime = preferences.getULong("bulkStartTime", 0);
+  // Se persiste el tiempo transcurrido en BULK, no una marca de tiempo: una
+  // marca monotónica del arranque anterior no tiene sentido tras reiniciar
+  uint32_t storedBulkElapsedS = preferences.getULong("bulkElapsedS", 0);
+  tempSoftLimit = preferences.getFloat("tempSoft", TEMP_DERATE_SOFT_LIMIT);
+  tempHardLimit = preferences.getFloat("tempHard", TEMP_DERATE_HARD_LIMIT);
+  int storedSamplingMode = preferences.getUChar("samplingMode", SAMPLING_DEFAULT_MODE);
   preferences.end();
 
+  if (storedSamplingMode != SAMPLING_FREE_RUNNING && storedSamplingMode != SAMPLING_PWM_SYNC) {
+    storedSamplingMode = SAMPLING_DEFAULT_MODE;
+  }
+  applySamplingMode((SamplingMode)storedSamplingMode);
+  autotuneBegin();
+  regulationReset();
+  traceBegin();
+  modbusBegin();
+  mqttBegin();
+  historyBegin();
+
+  if (storedBulkElapsedS > 0) {
+    bulkStartTime = (int64_t)monoMillis() - (int64_t)storedBulkElapsedS * 1000;
+    if (bulkStartTime == 0) bulkStartTime = -1;
+    Serial.println("⏱️ [Setup] BULK restaurado: " + String(storedBulkElapsedS) + " s transcurridos");
+  }
+
+  // Validar límites térmicos restaurados
+  if (tempSoftLimit >= tempHardLimit || tempHardLimit >= TEMP_THRESHOLD_SHUTDOWN) {
+    tempSoftLimit = TEMP_DERATE_SOFT_LIMIT;
+    tempHardLimit = TEMP_DERATE_HARD_LIMIT;
+  }
+
   // Actualizar absorptionCurrentThreshold_mA
   absorptionCurrentThreshold_mA = (batteryCapacity * thresholdPercentage) * 10;
   factorDivider = 5;
@@ -715,27 +1334,126 @@ void setup() {
     notaPersonalizada = "Usando paneles solares";
   }
 
-  // Iniciar el servidor web
-  initWebServer();
+  // Radio WiFi según la política configurada (el servidor web arranca con ella)
+  wifiManagerBegin();
   initSerialCommunication();
+  alarmsBegin();
+
+  startDayTimers();
+  timerStart(&heartbeatTimer, HEARTBEAT_INTERVAL, HEARTBEAT_INTERVAL);
 }
 
 void loop() {
   esp_task_wdt_reset();
+  allocRegionBegin(ALLOC_REGION_LOOP);
 
-  unsigned long now = millis();
+  // Ejecutar los temporizadores vencidos (ciclo de control, validaciones, ERROR...)
+  timerWheelAdvance(monoMillis());
 
-  updateAhTracking();
+  // Durante un volcado de captura los comandos esperan en el búfer de la UART
+  if (!isCaptureStreaming()) {
+    if (isModbusActive()) {
+      modbusService();
+    } else {
+      handleSerialCommands();
+    }
+  }
+  wifiManagerLoop();
+  handleWebServer();
+
+  // Aplicar parámetros, comandos y mediciones publicados en este ciclo
+  eventBusDispatch();
+
+  // Las escrituras en flash bloquean la caché: se hacen aquí, entre ciclos de
+  // control (NVS y, en historyService(), la partición del histórico)
   saveChargingState();
+  if (!isCaptureStreaming()) {
+    autotuneService(OrangePiSerial);
+  }
+  mqttService();
+  alarmsService();
+  historyService();
+  allocRegionEnd(ALLOC_REGION_LOOP);
+
+  idleUntilNextDeadline();
+}
+
+// Espera hasta el próximo vencimiento de la rueda. De noche, con la radio
+// apagada, se duerme en light sleep (UART y botón despiertan antes); de día la
+// espera se acota para seguir atendiendo UART, botón y servidor web.
+void idleUntilNextDeadline() {
+  if (OrangePiSerial.available()) {
+    return;
+  }
+
+  uint64_t now = monoMillis();
+  uint64_t deadline = timerWheelNextDeadline();
+  if (deadline <= now) {
+    return;
+  }
+  uint64_t idle = deadline - now;
+
+  if (nightModeActive && !isWifiRadioOn()) {
+    nightLightSleep(min(idle, (uint64_t)NIGHT_TICK_INTERVAL));
+  } else {
+    delay(min(idle, (uint64_t)SCHEDULER_MAX_IDLE_MS));
+  }
+}
+
+void initSchedulerTimers() {
+  timerInit(&controlTickTimer, controlTick);
+  timerInit(&nightTickTimer, nightTick);
+  timerInit(&heartbeatTimer, sendHeartbeat);
+  timerInit(&lowCurrentTimer, lowCurrentTimeout);
+  timerInit(&reEnterBulkTimer, reEnterBulkTimeout);
+  timerInit(&tempCheckTimer, checkCriticalTemperature);
+  timerInit(&voltageCheckTimer, checkCriticalVoltage);
+  timerInit(&errorCheckTimer, checkErrorRecovery);
+  timerInit(&errorBlinkTimer, blinkErrorLed);
+  timerInit(&loadOffTimer, loadOffExpired);
+  timerInit(&profileTimer, finishProfile);
+  timerInit(&profileDumpTimer, serviceProfileDump);
+  timerInit(&captureTimer, serviceCapture);
+}
 
-  handleSerialCommands();
-  periodicSerialUpdate();
+// Temporizadores que solo tienen sentido con el control de carga activo
+void startDayTimers() {
+  resetControlTickTiming();
+  timerStart(&controlTickTimer, 0, CONTROL_TICK_INTERVAL);
+  timerStart(&tempCheckTimer, TEMP_CHECK_INTERVAL, TEMP_CHECK_INTERVAL);
+  timerStart(&voltageCheckTimer, VOLTAGE_CHECK_INTERVAL, VOLTAGE_CHECK_INTERVAL);
+}
+
+void stopDayTimers() {
+  timerCancel(&controlTickTimer);
+  timerCancel(&tempCheckTimer);
+  timerCancel(&voltageCheckTimer);
+  timerCancel(&lowCurrentTimer);
+  timerCancel(&reEnterBulkTimer);
+}
+
+// Ciclo de control diurno (cada CONTROL_TICK_INTERVAL)
+void controlTick(void *arg) {
+  allocRegionBegin(ALLOC_REGION_CONTROL_TICK);
+  recordControlTick(CONTROL_TICK_INTERVAL);
+  traceTick();
+  updateAhTracking();
 
-  // Leer datos de sensores
-  panelToBatteryCurrent = getAverageCurrent(ina219_1);
-  batteryToLoadCurrent = getAverageCurrent(ina219_2);
-  float voltagePanel = ina219_1.getBusVoltage_V();
-  float voltageBatterySensor2 = ina219_2.getBusVoltage_V();
+  // Leer datos de sensores (a través de trace para poder reproducir el ciclo)
+  panelToBatteryCurrent = traceRead(TRACE_PANEL_CURRENT, getAverageCurrent(ina219_1));
+  batteryToLoadCurrent = traceRead(TRACE_LOAD_CURRENT, getAverageCurrent(ina219_2));
+  float voltagePanel = traceRead(TRACE_PANEL_VOLTAGE, ina219BusVoltage(ina219_1));
+  float voltageBatterySensor2 = traceRead(TRACE_BATTERY_VOLTAGE, ina219BusVoltage(ina219_2));
+
+  // === DETECCIÓN DE NOCHE: panel por debajo de la batería ===
+  if (currentState != ERROR && shouldEnterNightMode(voltagePanel, voltageBatterySensor2, panelToBatteryCurrent)) {
+    enterNightMode();
+    traceOutput(currentState, currentPWM, accumulatedAh);
+    allocRegionEnd(ALLOC_REGION_CONTROL_TICK);
+    return;
+  }
+  lastBatteryVoltage = voltageBatterySensor2;
+  rippleAddSample(voltageBatterySensor2, currentState, 1000.0 / CONTROL_TICK_INTERVAL);
 
   // Encender LED si hay corriente desde el panel
   if (panelToBatteryCurrent > 50) {
@@ -759,80 +1477,48 @@ void loop() {
   Serial.println(" V");
 
   Serial.print("Estado de carga: ");
-  Serial.println(getChargeStateString(currentState));
+  Serial.println(getChargeStateName(currentState));
 
   Serial.print("Voltaje etapa BULK: ");
   Serial.println(bulkVoltage);
 
   // === PROTECCIÓN INTELIGENTE CONTRA RESET PWM POR BAJA CORRIENTE ===
-  static unsigned long lowCurrentStart = 0;
-  static bool lowCurrentDetected = false;
-  const unsigned long LOW_CURRENT_TIMEOUT = 3000; // 3 segundos de gracia
-  
   if (panelToBatteryCurrent <= 5.0) {
-    if (!lowCurrentDetected) {
-      // Primera detección de corriente baja - iniciar contador
-      lowCurrentDetected = true;
-      lowCurrentStart = millis();
-      Serial.println("⚠️ Corriente baja detectada (" + String(panelToBatteryCurrent, 1) + "mA) - iniciando período de gracia de 3s");
-    } else if (millis() - lowCurrentStart >= LOW_CURRENT_TIMEOUT && currentPWM != 0) {
-      // Corriente baja confirmada tras 3 segundos - proceder con reset
-      currentPWM = 0;
-      Serial.println("🚨 PWM forzado a 0 tras 3s sin corriente de paneles solares (corriente: " + String(panelToBatteryCurrent, 1) + "mA)");
-      lowCurrentDetected = false; // Reset para próxima detección
+    if (!timerIsActive(&lowCurrentTimer)) {
+      // Primera detección de corriente baja - iniciar período de gracia
+      timerStart(&lowCurrentTimer, LOW_CURRENT_TIMEOUT);
+      Serial.printf("⚠️ Corriente baja detectada (%.1fmA) - iniciando período de gracia de 3s\n", panelToBatteryCurrent);
     }
     // Si estamos en período de gracia, no hacer nada (mantener PWM actual)
-  } else {
+  } else if (timerIsActive(&lowCurrentTimer)) {
     // Corriente normal detectada - cancelar cualquier proceso de reset
-    if (lowCurrentDetected) {
-      Serial.println("✅ Corriente normalizada (" + String(panelToBatteryCurrent, 1) + "mA) - cancelando reset PWM");
-      lowCurrentDetected = false;
-    }
+    timerCancel(&lowCurrentTimer);
+    Serial.printf("✅ Corriente normalizada (%.1fmA) - cancelando reset PWM\n", panelToBatteryCurrent);
   }
 
   // Control de voltaje (LVD y LVR)
-  if (!temporaryLoadOff) {
-    if (voltageBatterySensor2 < LVD || voltageBatterySensor2 > maxBatteryVoltageAllowed) {
-      digitalWrite(LOAD_CONTROL_PIN, LOW);
-      Serial.println("Desactivando el sistema (voltaje < LVD | voltageBatterySensor2 > maxBatteryVoltageAllowed)");
-    } else if (voltageBatterySensor2 > LVR && voltageBatterySensor2 < maxBatteryVoltageAllowed) {
-      digitalWrite(LOAD_CONTROL_PIN, HIGH);
-      Serial.println("Reactivando el sistema (voltaje > LVR && voltageBatterySensor2 < maxBatteryVoltageAllowed)");
-    }
-  } else {
-    // Si hay un apagado temporal activo, verificar si debe terminar
-    if (millis() - loadOffStartTime >= loadOffDuration) {
-      temporaryLoadOff = false;
-      digitalWrite(LOAD_CONTROL_PIN, HIGH);
-      notaPersonalizada = "Apagado temporal completado, carga reactivada";
-      Serial.println("⏰ Apagado temporal completado, carga reactivada");
-    }
-  }
-
-  // RE-ENTRY CHECK
-  const float reEnterBulkVoltage = 12.6;
-  const unsigned long reEnterTime = 30000UL;
-  static unsigned long lowVoltageStart = 0;
-  static bool belowThreshold = false;
+  applyLoadVoltageControl(voltageBatterySensor2);
 
+  // RE-ENTRY CHECK: tras 30 s bajo el umbral se fuerza BULK en cada ciclo
   if (voltageBatterySensor2 < reEnterBulkVoltage) {
-    if (!belowThreshold) {
-      belowThreshold = true;
-      lowVoltageStart = millis();
-    } else {
-      if (millis() - lowVoltageStart >= reEnterTime) {
-        if (currentState != BULK_CHARGE) {
-          currentState = BULK_CHARGE;
-          Serial.println("-> Forzando retorno a BULK_CHARGE (batería < 12.6 V por 30s)");
-        }
-      }
+    if (!timerIsActive(&reEnterBulkTimer)) {
+      timerStart(&reEnterBulkTimer, REENTER_BULK_TIME, CONTROL_TICK_INTERVAL);
     }
   } else {
-    belowThreshold = false;
-    lowVoltageStart = 0;
+    timerCancel(&reEnterBulkTimer);
   }
 
-  updateChargeState(voltageBatterySensor2, panelToBatteryCurrent);
+  if (isAutotuneRunning()) {
+    // El ensayo de relé sustituye a la regulación de la etapa mientras dura
+    currentPWM = autotuneStep(voltageBatterySensor2, panelToBatteryCurrent, getEffectiveMaxCurrent(), currentState);
+    setPWM(currentPWM);
+    regulationPause();
+  } else {
+    ChargeState controlledState = currentState;
+    updateChargeState(voltageBatterySensor2, panelToBatteryCurrent);
+    regulationRecord(controlledState, getStageSetpoint(controlledState), voltageBatterySensor2,
+                     currentPWM, CONTROL_TICK_INTERVAL / 1000.0);
+  }
 
 
   // Recalcular horas máximas si se usa fuente DC
@@ -844,76 +1530,256 @@ void loop() {
       if (currentState == BULK_CHARGE) {
         // La nota ya se actualiza en el control de Bulk
       } else {
-        notaPersonalizada = "Tiempo máx. en Bulk: " + String(maxBulkHours, 1) + " horas";
+        // snprintf + asignación reutiliza el búfer de la nota (sin heap por ciclo)
+        char nota[48];
+        snprintf(nota, sizeof(nota), "Tiempo máx. en Bulk: %.1f horas", maxBulkHours);
+        if (notaPersonalizada != nota) notaPersonalizada = nota;
       }
     }
   } else {
     maxBulkHours = 0.0;
     
     // Solo actualizar la nota si no estamos en estado de ERROR
-    if (currentState != ERROR) {
+    if (currentState != ERROR && notaPersonalizada != "Usando paneles solares") {
       notaPersonalizada = "Usando paneles solares";
     }
   }
 
 
-  temperature = readTemperature();
+  temperature = traceRead(TRACE_TEMPERATURE, readTemperature());
   Serial.print("Temperatura: ");
   Serial.print(temperature);
   Serial.println(" °C");
+
+  publishControlSnapshot(voltagePanel, voltageBatterySensor2);
   
-  // === VALIDACIÓN MÚLTIPLE PARA TEMPERATURA CRÍTICA - SIN DELAY ===
+  Serial.printf("Panel->Batería: %.2f mA\n", panelToBatteryCurrent);
+  Serial.printf("Batería->Carga: %.2f mA\n", batteryToLoadCurrent);
+  Serial.printf("Voltaje Panel: %.2f V\n", ina219BusVoltage(ina219_1));
+  Serial.printf("Voltaje Batería: %.2f V\n", ina219BusVoltage(ina219_2));
+  Serial.printf("Estado: %s\n", getChargeStateName(currentState));
+  Serial.printf("pwmValue: %d\n", currentPWM);
+  traceOutput(currentState, currentPWM, accumulatedAh);
+  allocRegionEnd(ALLOC_REGION_CONTROL_TICK);
+}
+
+// Instantánea coherente del ciclo para los consumidores del bus
+void publishControlSnapshot(float voltagePanel, float voltageBattery) {
+  MeasurementSnapshot snapshot;
+  snapshot.timestamp = monoMillis();
+  snapshot.panelToBatteryCurrent = panelToBatteryCurrent;
+  snapshot.batteryToLoadCurrent = batteryToLoadCurrent;
+  snapshot.voltagePanel = voltagePanel;
+  snapshot.voltageBattery = voltageBattery;
+  snapshot.temperature = temperature;
+  snapshot.pwm = currentPWM;
+  snapshot.state = currentState;
+  snapshot.valid = true;
+  publishMeasurement(snapshot);
+}
+
+void lowCurrentTimeout(void *arg) {
+  // Corriente baja confirmada tras el período de gracia - proceder con reset
+  if (currentPWM != 0) {
+    currentPWM = 0;
+    Serial.println("🚨 PWM forzado a 0 tras 3s sin corriente de paneles solares (corriente: " + String(panelToBatteryCurrent, 1) + "mA)");
+  }
+}
+
+void reEnterBulkTimeout(void *arg) {
+  if (currentState != BULK_CHARGE && currentState != ERROR) {
+    currentState = BULK_CHARGE;
+    Serial.println("-> Forzando retorno a BULK_CHARGE (batería < 12.6 V por 30s)");
+  }
+}
+
+// === VALIDACIÓN MÚLTIPLE PARA TEMPERATURA CRÍTICA ===
+void checkCriticalTemperature(void *arg) {
   static int tempErrorCount = 0;
-  static unsigned long lastTempCheck = 0;
-  const unsigned long TEMP_CHECK_INTERVAL = 2000; // 2 segundos entre validaciones de temperatura
-  const int MAX_TEMP_ERROR_COUNT = 5; // 5 validaciones consecutivas
-  
-  unsigned long currentTime = millis();
-  
-  // Verificar temperatura crítica cada 2 segundos
-  if (currentTime - lastTempCheck >= TEMP_CHECK_INTERVAL) {
-    if (temperature >= TEMP_THRESHOLD_SHUTDOWN) {
-      tempErrorCount++;
-      Serial.println("🌡️ Temperatura crítica detectada " + String(tempErrorCount) + "/5: " + String(temperature, 1) + "°C >= " + String(TEMP_THRESHOLD_SHUTDOWN) + "°C");
-      
-      if (tempErrorCount >= MAX_TEMP_ERROR_COUNT) {
-        Serial.println("🔥 ERROR: Temperatura crítica confirmada tras " + String(MAX_TEMP_ERROR_COUNT) + " validaciones");
-        currentState = ERROR;
-        notaPersonalizada = "ERROR: Temperatura crítica confirmada (" + String(temperature, 1) + "°C >= " + String(TEMP_THRESHOLD_SHUTDOWN) + "°C)";
-        tempErrorCount = 0; // Reset contador
-      }
-    } else {
-      // Temperatura normal, resetear contador
-      if (tempErrorCount > 0) {
-        Serial.println("❄️ Temperatura normalizada, reseteando contador de errores térmicos");
-        tempErrorCount = 0;
-      }
+
+  if (currentState == ERROR) {
+    tempErrorCount = 0;
+    return;
+  }
+
+  if (temperature >= TEMP_THRESHOLD_SHUTDOWN) {
+    tempErrorCount++;
+    if (tempErrorCount == 1) alarmRaise(ALARM_OVER_TEMPERATURE, temperature);
+    Serial.println("🌡️ Temperatura crítica detectada " + String(tempErrorCount) + "/5: " + String(temperature, 1) + "°C >= " + String(TEMP_THRESHOLD_SHUTDOWN) + "°C");
+
+    if (tempErrorCount >= MAX_TEMP_ERROR_COUNT) {
+      Serial.println("🔥 ERROR: Temperatura crítica confirmada tras " + String(MAX_TEMP_ERROR_COUNT) + " validaciones");
+      enterErrorState("ERROR: Temperatura crítica confirmada (" + String(temperature, 1) + "°C >= " + String(TEMP_THRESHOLD_SHUTDOWN) + "°C)");
+      tempErrorCount = 0; // Reset contador
     }
-    lastTempCheck = currentTime;
+  } else if (tempErrorCount > 0) {
+    // Temperatura normal, resetear contador
+    Serial.println("❄️ Temperatura normalizada, reseteando contador de errores térmicos");
+    tempErrorCount = 0;
   }
-  Serial.println("Panel->Batería: " + String(panelToBatteryCurrent) + " mA");
-  Serial.println("Batería->Carga: " + String(batteryToLoadCurrent) + " mA");
-  Serial.println("Voltaje Panel: " + String(ina219_1.getBusVoltage_V()) + " V");
-  Serial.println("Voltaje Batería: " + String(ina219_2.getBusVoltage_V()) + " V");
-  Serial.println("Estado: " + getChargeStateString(currentState));
-  Serial.println("pwmValue: " + String(currentPWM));
-  handleWebServer();
+}
 
-  delay(1000);
+// === VALIDACIÓN MÚLTIPLE PARA VOLTAJE CRÍTICO ===
+void checkCriticalVoltage(void *arg) {
+  static int voltageErrorCount = 0;
+
+  if (currentState == ERROR) {
+    voltageErrorCount = 0;
+    return;
+  }
+
+  if (lastBatteryVoltage >= maxBatteryVoltageAllowed) {
+    voltageErrorCount++;
+    if (voltageErrorCount == 1) alarmRaise(ALARM_OVER_VOLTAGE, lastBatteryVoltage);
+    Serial.println("⚠️ Voltaje crítico detectado " + String(voltageErrorCount) + "/5: " + String(lastBatteryVoltage, 2) + "V >= " + String(maxBatteryVoltageAllowed, 1) + "V");
+
+    if (voltageErrorCount >= MAX_VOLTAGE_ERROR_COUNT) {
+      Serial.println("🚨 ERROR: Voltaje de batería confirmado demasiado alto tras " + String(MAX_VOLTAGE_ERROR_COUNT) + " validaciones");
+      enterErrorState("ERROR: Voltaje crítico confirmado tras 5 validaciones (" + String(lastBatteryVoltage, 2) + "V >= " + String(maxBatteryVoltageAllowed, 1) + "V)");
+      voltageErrorCount = 0; // Reset contador
+    }
+  } else if (voltageErrorCount > 0) {
+    // Voltaje normal, resetear contador
+    Serial.println("✅ Voltaje normalizado, reseteando contador de errores");
+    voltageErrorCount = 0;
+  }
+}
+
+// Control de la salida de carga por voltaje (LVD/LVR)
+void applyLoadVoltageControl(float batteryVoltage) {
+  static bool lvdTripped = false;   // Alarma solo en las transiciones LVD -> LVR
+
+  // Durante un apagado temporal manda loadOffTimer; en ERROR la carga queda bloqueada
+  if (temporaryLoadOff || currentState == ERROR) {
+    return;
+  }
+  if (batteryVoltage < LVD || batteryVoltage > maxBatteryVoltageAllowed) {
+    digitalWrite(LOAD_CONTROL_PIN, LOW);
+    if (batteryVoltage < LVD && !lvdTripped) {
+      lvdTripped = true;
+      alarmRaise(ALARM_LOAD_DISCONNECT, batteryVoltage);
+    }
+    Serial.println("Desactivando el sistema (voltaje < LVD | voltageBatterySensor2 > maxBatteryVoltageAllowed)");
+  } else if (batteryVoltage > LVR && batteryVoltage < maxBatteryVoltageAllowed) {
+    digitalWrite(LOAD_CONTROL_PIN, HIGH);
+    if (lvdTripped) {
+      lvdTripped = false;
+      alarmRaise(ALARM_LOAD_RECONNECT, batteryVoltage);
+    }
+    Serial.println("Reactivando el sistema (voltaje > LVR && voltageBatterySensor2 < maxBatteryVoltageAllowed)");
+  }
+}
+
+// === MODO NOCTURNO ===
+// Sin sol no hay nada que regular: se suspende el PWM, se apaga el softAP,
+// los INA219 quedan en power-down y el ESP32 duerme entre muestreos lentos.
+void enterNightMode() {
+  Serial.println("🌙 Entrando en modo nocturno (panel por debajo de la batería)");
+
+  captureCancel(); // Los INA219 pasan a power-down
+  rippleReset();    // La ventana no puede abarcar la noche
+  autotuneAbort("Modo nocturno");
+  regulationPause();
+
+  currentPWM = 0;
+  setPWM(0);
+  // Salida fija en alto (MOSFET apagado, lógica invertida) para que el LEDC no glitchee al dormir
+  ledcDetach(pwmPin);
+  pinMode(pwmPin, OUTPUT);
+  digitalWrite(pwmPin, HIGH);
+  digitalWrite(LED_SOLAR, LOW);
+
+  setWifiNightMode(true);
+
+  ina219PowerSave(ina219_1, true);
+  ina219PowerSave(ina219_2, true);
+
+  configureNightWakeSources();
+  nightModeActive = true;
+
+  stopDayTimers();
+  timerStart(&nightTickTimer, NIGHT_TICK_INTERVAL, NIGHT_TICK_INTERVAL);
+  notaPersonalizada = "Modo nocturno: muestreo cada " + String(NIGHT_TICK_INTERVAL / 1000) + "s";
+}
+
+void exitNightMode() {
+  releaseNightWakeSources();
+  nightModeActive = false;
+
+  timerCancel(&nightTickTimer);
+  startDayTimers();
+
+  ina219PowerSave(ina219_1, false);
+  ina219PowerSave(ina219_2, false);
+
+  ledcAttach(pwmPin, pwmFrequency, pwmResolution);
+  currentPWM = 0;
+  setPWM(0);
+
+  setWifiNightMode(false);
+
+  notaPersonalizada = "Fin del modo nocturno: panel disponible, reanudando carga";
+  Serial.println("☀️ Saliendo del modo nocturno - reanudando control de carga");
+}
+
+// Muestreo nocturno (cada NIGHT_TICK_INTERVAL); entre ticks loop() duerme
+void nightTick(void *arg) {
+  allocRegionBegin(ALLOC_REGION_NIGHT_TICK);
+  ina219PowerSave(ina219_1, false);
+  ina219PowerSave(ina219_2, false);
+  delay(2); // Esperar una conversión completa
+
+  updateAhTracking();
+
+  panelToBatteryCurrent = getAverageCurrent(ina219_1, NIGHT_NUM_SAMPLES);
+  batteryToLoadCurrent = getAverageCurrent(ina219_2, NIGHT_NUM_SAMPLES);
+  float voltagePanel = ina219BusVoltage(ina219_1);
+  float voltageBattery = ina219BusVoltage(ina219_2);
+  temperature = readTemperature();
+  publishControlSnapshot(voltagePanel, voltageBattery);
+
+  applyLoadVoltageControl(voltageBattery);
+
+  Serial.printf("🌙 Panel=%.2fV Bat=%.2fV Carga=%.1fmA Consumo propio≈%.2fmA (x%.1f)\n", voltagePanel,
+                voltageBattery, batteryToLoadCurrent, selfConsumption_mA, getPowerReductionFactor());
+
+  if (shouldExitNightMode(voltagePanel, voltageBattery)) {
+    exitNightMode();
+    allocRegionEnd(ALLOC_REGION_NIGHT_TICK);
+    return;
+  }
+
+  ina219PowerSave(ina219_1, true);
+  ina219PowerSave(ina219_2, true);
+  allocRegionEnd(ALLOC_REGION_NIGHT_TICK);
 }
 
 void saveChargingState() {
-  if (millis() - lastSaveTime > SAVE_INTERVAL) {
+  if (chargingStateDirty || monoMillis() - lastSaveTime > SAVE_INTERVAL) {
+    nvsCommitBegin();
     preferences.begin("charger", false);
     preferences.putFloat("accumulatedAh", accumulatedAh);
-    preferences.putULong("bulkStartTime", bulkStartTime);
+    preferences.putULong("bulkElapsedS", getBulkElapsedSeconds());
     preferences.end();
-    lastSaveTime = millis();
+    nvsCommitEnd();
+    lastSaveTime = monoMillis();
+    chargingStateDirty = false;
   }
 }
 
+// El ciclo de control no escribe en NVS: marca el estado y loop() lo guarda
+void requestChargingStateSave() {
+  chargingStateDirty = true;
+}
+
+// Segundos transcurridos en BULK (0 si no está iniciado)
+uint32_t getBulkElapsedSeconds() {
+  if (bulkStartTime == 0) return 0;
+  return (uint32_t)(((int64_t)monoMillis() - bulkStartTime) / 1000);
+}
+
 void updateAhTracking() {
-  unsigned long now = millis();
+  uint64_t now = traceMillis();
   
   // === CORRECCIÓN: Inicializar lastUpdateTime si es la primera ejecución ===
   if (lastUpdateTime == 0) {
@@ -927,7 +1793,7 @@ void updateAhTracking() {
   
   // === VALIDACIÓN: Evitar cálculos con intervalos extremos ===
   if (deltaHours > 1.0) {
-    Serial.println("⚠️ [Ah Tracking] Intervalo demasiado largo (" + String(deltaHours, 2) + "h) - posible reinicio");
+    Serial.printf("⚠️ [Ah Tracking] Intervalo demasiado largo (%.2fh) - posible reinicio\n", deltaHours);
     lastUpdateTime = now;
     return; // No actualizar Ah con intervalos sospechosos
   }
@@ -947,13 +1813,14 @@ void updateAhTracking() {
   
   // Calcular cambio en Ah (positivo = carga, negativo = descarga)
   float ahChange = (chargeCurrent - dischargeCurrent) * deltaHours;
+  metricsAddEnergy(chargeCurrent, dischargeCurrent, getLatestMeasurement().voltageBattery, deltaHours);
   
   // === VALIDACIÓN: Limitar cambios extremos ===
   float maxChangePerSecond = batteryCapacity / 3600.0; // 1C rate
   float maxChange = maxChangePerSecond * deltaHours * 3600.0; // Máximo cambio permitido
   
   if (abs(ahChange) > maxChange) {
-    Serial.println("⚠️ [Ah Tracking] Cambio excesivo detectado: " + String(ahChange, 3) + "Ah (máx: " + String(maxChange, 3) + "Ah)");
+    Serial.printf("⚠️ [Ah Tracking] Cambio excesivo detectado: %.3fAh (máx: %.3fAh)\n", ahChange, maxChange);
     ahChange = (ahChange > 0) ? maxChange : -maxChange; // Limitar el cambio
   }
   
@@ -969,15 +1836,17 @@ void updateAhTracking() {
   
   if (accumulatedAh > batteryCapacity * 1.1) { // Permitir 10% de sobrecarga
     accumulatedAh = batteryCapacity * 1.1;
-    Serial.println("🔋 [Ah Tracking] Límite superior: limitando a " + String(batteryCapacity * 1.1, 1) + " Ah");
+    Serial.printf("🔋 [Ah Tracking] Límite superior: limitando a %.1f Ah\n", batteryCapacity * 1.1);
   }
   
   // Debug cada 30 segundos
-  static unsigned long lastDebugTime = 0;
+  static uint64_t lastDebugTime = 0;
   if (now - lastDebugTime >= 30000) {
     float socPercent = (accumulatedAh / batteryCapacity) * 100.0;
-    Serial.println("🔋 [Ah Tracking] Δt=" + String(deltaHours * 3600, 1) + "s, ΔAh=" + String(ahChange, 4) + ", Total=" + String(accumulatedAh, 2) + "Ah (" + String(socPercent, 1) + "%)");
-    Serial.println("   Entrada: " + String(chargeCurrent, 3) + "A, Salida: " + String(dischargeCurrent, 3) + "A, Neta: " + String(chargeCurrent - dischargeCurrent, 3) + "A");
+    Serial.printf("🔋 [Ah Tracking] Δt=%.1fs, ΔAh=%.4f, Total=%.2fAh (%.1f%%)\n", deltaHours * 3600, ahChange,
+                  accumulatedAh, socPercent);
+    Serial.printf("   Entrada: %.3fA, Salida: %.3fA, Neta: %.3fA\n", chargeCurrent, dischargeCurrent,
+                  chargeCurrent - dischargeCurrent);
     lastDebugTime = now;
   }
   
@@ -985,7 +1854,7 @@ void updateAhTracking() {
 }
 
 void resetChargingCycle() {
-  float batteryVoltage = ina219_2.getBusVoltage_V();
+  float batteryVoltage = traceRead(TRACE_BATTERY_VOLTAGE, ina219BusVoltage(ina219_2));
   float currentSOC = (accumulatedAh / batteryCapacity) * 100.0;
   float voltageBasedSOC = getSOCFromVoltage(batteryVoltage);
   
@@ -1031,7 +1900,7 @@ void resetChargingCycle() {
   if (accumulatedAh < 0) accumulatedAh = 0;
   if (accumulatedAh > batteryCapacity * 1.1) accumulatedAh = batteryCapacity * 1.1;
   
-  saveChargingState();
+  requestChargingStateSave();
 }
 
 float calculateAbsorptionTime() {
@@ -1065,55 +1934,95 @@ float getSOCFromVoltage(float voltage) {
 }
 
 
-float getAverageCurrent(Adafruit_INA219 &ina) {
+float getAverageCurrent(Adafruit_INA219 &ina, int samples, bool recordNoise) {
   float totalCurrent = 0;
   int validSamples = 0;
-  for (int i = 0; i < numSamples; i++) {
-    float current_mA = ina.getCurrent_mA() * 10; // shunt 10 mΩ
+  RunningStats stats;
+  statsReset(stats);
+  beginSampleWindow();
+  for (int i = 0; i < samples; i++) {
+    float current_mA = ina219Current_mA(ina) * SHUNT_CURRENT_SCALE;
     if (current_mA >= 0 && current_mA <= maxAllowedCurrent) {
       totalCurrent += current_mA;
       validSamples++;
+      statsAdd(stats, current_mA);
     }
-    delay(5);
+    waitNextSample();
   }
+  endSampleWindow();
   if (validSamples == 0) return 0;
+  // El ruido reportado es el de la corriente regulada (panel -> batería)
+  if (recordNoise && &ina == &ina219_1 && validSamples == samples) {
+    recordSamplingNoise(statsStdDev(stats));
+  }
   return totalCurrent / validSamples;
 }
 
+// Cambia el modo de muestreo y la frecuencia PWM asociada
+void applySamplingMode(SamplingMode mode) {
+  samplingMode = mode;
+  pwmFrequency = getPwmFrequencyForMode(mode);
+  if (!nightModeActive) {
+    // ledcChangeFrequency conserva el ciclo de trabajo actual
+    uint32_t actual = ledcChangeFrequency(pwmPin, pwmFrequency, pwmResolution);
+    if (actual > 0) {
+      pwmFrequency = actual;
+    }
+  }
+  Serial.println("📏 [Muestreo] Modo " + getSamplingModeString(mode) + " - PWM a " + String(pwmFrequency) + " Hz");
+}
+
+// CMD:SAMPLING_TEST - ruido de la corriente de panel y del voltaje de batería
+// en cada modo, con la carga en marcha. Bloquea ~0.5 s.
+void runSamplingNoiseTest() {
+  SamplingMode originalMode = samplingMode;
+  String reply = "SAMPLING_TEST:{";
+
+  for (int m = SAMPLING_FREE_RUNNING; m <= SAMPLING_PWM_SYNC; m++) {
+    applySamplingMode((SamplingMode)m);
+    delay(20); // Asentamiento del filtro LC tras el cambio de frecuencia
+
+    RunningStats sampleStats, meanStats, voltageStats;
+    statsReset(sampleStats);
+    statsReset(meanStats);
+    statsReset(voltageStats);
+
+    for (int batch = 0; batch < SAMPLING_TEST_BATCHES; batch++) {
+      RunningStats batchStats;
+      statsReset(batchStats);
+      beginSampleWindow();
+      for (int i = 0; i < numSamples; i++) {
+        float current_mA = ina219Current_mA(ina219_1) * SHUNT_CURRENT_SCALE;
+        statsAdd(batchStats, current_mA);
+        statsAdd(sampleStats, current_mA);
+        waitNextSample();
+      }
+      endSampleWindow();
+      statsAdd(meanStats, batchStats.mean);
+      statsAdd(voltageStats, ina219BusVoltage(ina219_2) * 1000.0);
+      esp_task_wdt_reset();
+    }
+
+    if (m > SAMPLING_FREE_RUNNING) reply += ",";
+    reply += "\"" + getSamplingModeString((SamplingMode)m) + "\":{";
+    reply += "\"pwmHz\":" + String(pwmFrequency) + ",";
+    reply += "\"current_mA\":" + String(sampleStats.mean, 1) + ",";
+    reply += "\"sampleStd_mA\":" + String(statsStdDev(sampleStats), 2) + ",";
+    reply += "\"averageStd_mA\":" + String(statsStdDev(meanStats), 2) + ",";
+    reply += "\"voltageStd_mV\":" + String(statsStdDev(voltageStats), 2) + "}";
+  }
+
+  applySamplingMode(originalMode);
+  reply += ",\"mode\":\"" + getSamplingModeString(originalMode) + "\"}";
+  OrangePiSerial.println(reply);
+}
+
 void updateChargeState(float batteryVoltage, float chargeCurrent) {
   float batteryNetCurrent;
   float batteryNetCurrentAmps;
   float initialSOC = 0.0;
   
-  // === VALIDACIÓN MÚLTIPLE PARA ERROR - SIN DELAY ===
-  static int voltageErrorCount = 0;
-  static unsigned long lastVoltageCheck = 0;
-  const unsigned long CHECK_INTERVAL = 1000; // 1 segundo entre validaciones
-  const int MAX_ERROR_COUNT = 5; // 5 validaciones consecutivas
-  
-  unsigned long now = millis();
-  
-  // Verificar voltaje crítico cada segundo
-  if (now - lastVoltageCheck >= CHECK_INTERVAL) {
-    if (batteryVoltage >= maxBatteryVoltageAllowed) {
-      voltageErrorCount++;
-      Serial.println("⚠️ Voltaje crítico detectado " + String(voltageErrorCount) + "/5: " + String(batteryVoltage, 2) + "V >= " + String(maxBatteryVoltageAllowed, 1) + "V");
-      
-      if (voltageErrorCount >= MAX_ERROR_COUNT) {
-        currentState = ERROR;
-        notaPersonalizada = "ERROR: Voltaje crítico confirmado tras 5 validaciones (" + String(batteryVoltage, 2) + "V >= " + String(maxBatteryVoltageAllowed, 1) + "V)";
-        Serial.println("🚨 ERROR: Voltaje de batería confirmado demasiado alto tras " + String(MAX_ERROR_COUNT) + " validaciones");
-        voltageErrorCount = 0; // Reset contador
-      }
-    } else {
-      // Voltaje normal, resetear contador
-      if (voltageErrorCount > 0) {
-        Serial.println("✅ Voltaje normalizado, reseteando contador de errores");
-        voltageErrorCount = 0;
-      }
-    }
-    lastVoltageCheck = now;
-  }
+  // El voltaje crítico se valida en checkCriticalVoltage (voltageCheckTimer)
   
   // Si ya estamos en ERROR, no procesar otros estados
   if (currentState == ERROR) {
@@ -1127,13 +2036,11 @@ void updateChargeState(float batteryVoltage, float chargeCurrent) {
       // Agregar control de tiempo para fuente DC
       if (bulkStartTime == 0) {
         // Asegurarse de que bulkStartTime sea inicializado solo una vez al entrar en modo BULK
-        bulkStartTime = millis();
-        Serial.println("Inicializado bulkStartTime: " + String(bulkStartTime));
+        bulkStartTime = (int64_t)traceMillis();
+        Serial.printf("Inicializado bulkStartTime: %llu\n", (unsigned long long)bulkStartTime);
         
-        // Guardar inmediatamente el valor inicial
-        preferences.begin("charger", false);
-        preferences.putULong("bulkStartTime", bulkStartTime);
-        preferences.end();
+        // Guardar el valor inicial al terminar el ciclo
+        requestChargingStateSave();
       }
       
       // Verificar si debemos salir de BULK por voltaje
@@ -1142,28 +2049,26 @@ void updateChargeState(float batteryVoltage, float chargeCurrent) {
         float socFromVoltage = getSOCFromVoltage(batteryVoltage);
         initialSOC = min(initialSOC, socFromVoltage);
         currentState = ABSORPTION_CHARGE;
-        absorptionStartTime = millis();
+        absorptionStartTime = traceMillis();
         bulkStartTime = 0; // Resetear para próximo ciclo
-        preferences.begin("charger", false);
-        preferences.putULong("bulkStartTime", 0);
-        preferences.end();
+        requestChargingStateSave();
         Serial.println("-> Transición a ABSORPTION_CHARGE por voltaje");
       } 
       // Verificar si debemos salir de BULK por tiempo (solo con fuente DC)
       else if (useFuenteDC && fuenteDC_Amps > 0 && maxBulkHours > 0) {
         // Corregido: asegurar que el cálculo se realiza correctamente como float
-        currentBulkHours = (float)(millis() - bulkStartTime) / 3600000.0f;
+        currentBulkHours = (float)((int64_t)traceMillis() - bulkStartTime) / 3600000.0f;
         
         // Actualizar nota con tiempo transcurrido
-        notaPersonalizada = "Bulk: " + String(currentBulkHours, 1) + "h de " + String(maxBulkHours, 1) + "h máx";
+        char nota[48];
+        snprintf(nota, sizeof(nota), "Bulk: %.1fh de %.1fh máx", currentBulkHours, maxBulkHours);
+        if (notaPersonalizada != nota) notaPersonalizada = nota;
         
         if (currentBulkHours >= maxBulkHours) {
           currentState = ABSORPTION_CHARGE;
-          absorptionStartTime = millis();
+          absorptionStartTime = traceMillis();
           bulkStartTime = 0; // Resetear para próximo ciclo
-          preferences.begin("charger", false);
-          preferences.putULong("bulkStartTime", 0);
-          preferences.end();
+          requestChargingStateSave();
           notaPersonalizada = "Transición a ABSORPTION_CHARGE por tiempo máximo";
           Serial.println("-> Transición a ABSORPTION_CHARGE por tiempo máximo en BULK");
         }
@@ -1184,11 +2089,11 @@ void updateChargeState(float batteryVoltage, float chargeCurrent) {
         calculatedAbsorptionHours = remainingCapacity / batteryNetCurrentAmps;
         if (calculatedAbsorptionHours > maxAbsorptionHours) {
           calculatedAbsorptionHours = maxAbsorptionHours;
-          Serial.println("Tiempo calculado excede máximo, limitando a " + String(maxAbsorptionHours) + "h");
+          Serial.printf("Tiempo calculado excede máximo, limitando a %.2fh\n", maxAbsorptionHours);
         }
       }
-      Serial.println("Corriente neta en batería: " + String(batteryNetCurrent) + " mA");
-      Serial.println("Tiempo de absorción calculado: " + String(calculatedAbsorptionHours) + " horas");
+      Serial.printf("Corriente neta en batería: %.2f mA\n", batteryNetCurrent);
+      Serial.printf("Tiempo de absorción calculado: %.2f horas\n", calculatedAbsorptionHours);
       if (batteryNetCurrent <= absorptionCurrentThreshold_mA) {
         if (!isLithium) {
           currentState = FLOAT_CHARGE;
@@ -1200,11 +2105,11 @@ void updateChargeState(float batteryVoltage, float chargeCurrent) {
           absorptionControlToLitium(chargeCurrent, batteryToLoadCurrent);
         }
       }
-      else if ((millis() - absorptionStartTime) / 1000.0 / 3600.0 >= calculatedAbsorptionHours) {
+      else if ((traceMillis() - absorptionStartTime) / 1000.0 / 3600.0 >= calculatedAbsorptionHours) {
         if (!isLithium) {
           currentState = FLOAT_CHARGE;
           resetChargingCycle();
-          float timeElapsed = (millis() - absorptionStartTime) / 1000.0 / 3600.0;
+          float timeElapsed = (traceMillis() - absorptionStartTime) / 1000.0 / 3600.0;
           notaPersonalizada = "Transición a FLOAT: Tiempo de absorción cumplido (" + String(timeElapsed, 2) + "h >= " + String(calculatedAbsorptionHours, 2) + "h)";
           Serial.println("-> Transición a FLOAT_CHARGE (tiempo calculado alcanzado)");
         } else {
@@ -1218,7 +2123,7 @@ void updateChargeState(float batteryVoltage, float chargeCurrent) {
     case FLOAT_CHARGE:
       if (!isLithium) {
         calculatedAbsorptionHours = 0;
-        if (chargeCurrent <= (currentLimitIntoFloatStage + batteryToLoadCurrent)) {
+        if (chargeCurrent <= (currentLimitIntoFloatStage + batteryToLoadCurrent) && chargeCurrent <= getEffectiveMaxCurrent()) {
           floatControl(batteryVoltage, floatVoltage);
         } else {
           Serial.println("Corriente excesiva detectada en FLOAT_CHARGE. Reduciendo PWM.");
@@ -1232,85 +2137,90 @@ void updateChargeState(float batteryVoltage, float chargeCurrent) {
       break;
 
     case ERROR:
-      // === MANEJO DE ERROR SIN DELAY - NO BLOQUEANTE ===
-      static bool errorInitialized = false;
-      static unsigned long lastErrorCheck = 0;
-      static unsigned long lastLedToggle = 0;
-      static bool ledErrorState = false;
-      const unsigned long ERROR_CHECK_INTERVAL = 2000; // Verificar condiciones cada 2 segundos
-      const unsigned long LED_BLINK_INTERVAL = 200;    // Parpadeo cada 200ms
-      
-      unsigned long currentTime = millis();
-      
-      // Inicializar estado de error solo una vez
-      if (!errorInitialized) {
-        digitalWrite(LOAD_CONTROL_PIN, LOW);
-        setPWM(20);
-        pinMode(LED_SOLAR, OUTPUT);
-        notaPersonalizada = "ERROR: Sistema en modo protección - verificando condiciones cada 2s";
-        Serial.println("🚨 Entrando en modo ERROR - sistema protegido");
-        errorInitialized = true;
-        lastErrorCheck = currentTime;
-        lastLedToggle = currentTime;
-      }
-      
-      // Parpadeo del LED sin bloquear - cada 200ms
-      if (currentTime - lastLedToggle >= LED_BLINK_INTERVAL) {
-        ledErrorState = !ledErrorState;
-        digitalWrite(LED_SOLAR, ledErrorState ? HIGH : LOW);
-        lastLedToggle = currentTime;
-      }
-      
-      // Verificar condiciones de error cada 2 segundos
-      if (currentTime - lastErrorCheck >= ERROR_CHECK_INTERVAL) {
-        esp_task_wdt_reset(); // Reset watchdog
-        
-        // Obtener lecturas actuales
-        float currentTemp = readTemperature();
-        float currentVoltage = ina219_2.getBusVoltage_V();
-        
-        Serial.println("🔍 [ERROR] Verificando condiciones:");
-        Serial.println("   Temperatura: " + String(currentTemp, 1) + "°C (límite: " + String(TEMP_THRESHOLD_SHUTDOWN) + "°C)");
-        Serial.println("   Voltaje: " + String(currentVoltage, 2) + "V (límite: " + String(maxBatteryVoltageAllowed, 1) + "V)");
-        
-        // Verificar si las condiciones se han normalizado
-        if (currentTemp < TEMP_THRESHOLD_SHUTDOWN && currentVoltage < maxBatteryVoltageAllowed) {
-          // === VERIFICACIÓN ADICIONAL DE SEGURIDAD ANTES DE SALIR DE ERROR ===
-          // Asegurar que el voltaje también sea suficiente para operación segura
-          if (currentVoltage >= 12.0) {
-            // Condiciones completamente normalizadas - salir de ERROR
-            currentState = ABSORPTION_CHARGE;
-            errorInitialized = false; // Reset para próxima vez
-            digitalWrite(LED_SOLAR, LOW); // Apagar LED de error
-            // ✅ AHORA SÍ es seguro activar la carga
-            digitalWrite(LOAD_CONTROL_PIN, HIGH);
-            notaPersonalizada = "Recuperación de ERROR: Condiciones normalizadas, carga REACTIVADA, regresando a ABSORPTION";
-            Serial.println("✅ [ERROR] Condiciones completamente normalizadas:");
-            Serial.println("   🌡️ Temperatura OK: " + String(currentTemp, 1) + "°C < " + String(TEMP_THRESHOLD_SHUTDOWN) + "°C");
-            Serial.println("   ⚡ Voltaje OK: " + String(currentVoltage, 2) + "V < " + String(maxBatteryVoltageAllowed, 1) + "V");
-            Serial.println("   🔋 Voltaje operacional: " + String(currentVoltage, 2) + "V >= 12.0V");
-            Serial.println("   🔌 CARGA REACTIVADA - transición segura a ABSORPTION_CHARGE");
-          } else {
-            // Temperatura y voltaje máximo OK, pero voltaje muy bajo para activar carga
-            notaPersonalizada = "ERROR normalizado pero voltaje muy bajo (" + String(currentVoltage, 2) + "V < 12.0V) - carga BLOQUEADA";
-            Serial.println("⚠️ [ERROR] Temperatura y voltaje máximo normalizados, pero:");
-            Serial.println("   🔋 Voltaje insuficiente: " + String(currentVoltage, 2) + "V < 12.0V");
-            Serial.println("   🔒 Manteniendo carga DESACTIVADA por seguridad");
-          }
-        } else {
-          // Mantener en ERROR
-          notaPersonalizada = "ERROR activo: Temp=" + String(currentTemp, 1) + "°C, Volt=" + String(currentVoltage, 2) + "V - CARGA BLOQUEADA";
-          Serial.println("🚨 [ERROR] Condiciones aún críticas - manteniendo sistema protegido");
-        }
-        
-        lastErrorCheck = currentTime;
-      }
+      // Gestionado por errorCheckTimer y errorBlinkTimer (ver enterErrorState)
       break;
   }
 }
 
+// === MODO ERROR ===
+// Corta la carga, deja el PWM mínimo y arranca el parpadeo del LED y la
+// reverificación periódica de condiciones hasta la normalización.
+void enterErrorState(String reason) {
+  autotuneAbort("ERROR: " + reason);
+  currentState = ERROR;
+  metricsCountErrorState();
+  alarmRaise(ALARM_ERROR_ENTERED, lastBatteryVoltage);
+  digitalWrite(LOAD_CONTROL_PIN, LOW); // ¡NUNCA encender la carga!
+  setPWM(20);
+  pinMode(LED_SOLAR, OUTPUT);
+  notaPersonalizada = reason;
+  Serial.println("🚨 Entrando en modo ERROR - sistema protegido, verificando condiciones cada 2s");
+
+  timerCancel(&reEnterBulkTimer);
+  timerStart(&errorBlinkTimer, ERROR_LED_BLINK_INTERVAL, ERROR_LED_BLINK_INTERVAL);
+  timerStart(&errorCheckTimer, ERROR_CHECK_INTERVAL, ERROR_CHECK_INTERVAL);
+}
+
+void blinkErrorLed(void *arg) {
+  static bool ledErrorState = false;
+  ledErrorState = !ledErrorState;
+  digitalWrite(LED_SOLAR, ledErrorState ? HIGH : LOW);
+}
+
+void checkErrorRecovery(void *arg) {
+  esp_task_wdt_reset(); // Reset watchdog
+
+  // Obtener lecturas actuales
+  float currentTemp = readTemperature();
+  float currentVoltage = ina219BusVoltage(ina219_2);
+
+  Serial.println("🔍 [ERROR] Verificando condiciones:");
+  Serial.println("   Temperatura: " + String(currentTemp, 1) + "°C (límite: " + String(TEMP_THRESHOLD_SHUTDOWN) + "°C)");
+  Serial.println("   Voltaje: " + String(currentVoltage, 2) + "V (límite: " + String(maxBatteryVoltageAllowed, 1) + "V)");
+
+  // Verificar si las condiciones se han normalizado
+  if (currentTemp < TEMP_THRESHOLD_SHUTDOWN && currentVoltage < maxBatteryVoltageAllowed) {
+    // === VERIFICACIÓN ADICIONAL DE SEGURIDAD ANTES DE SALIR DE ERROR ===
+    // Asegurar que el voltaje también sea suficiente para operación segura
+    if (currentVoltage >= 12.0) {
+      // Condiciones completamente normalizadas - salir de ERROR
+      currentState = ABSORPTION_CHARGE;
+      timerCancel(&errorBlinkTimer);
+      timerCancel(&errorCheckTimer);
+      digitalWrite(LED_SOLAR, LOW); // Apagar LED de error
+      // ✅ AHORA SÍ es seguro activar la carga
+      digitalWrite(LOAD_CONTROL_PIN, HIGH);
+      alarmRaise(ALARM_ERROR_CLEARED, currentVoltage);
+      notaPersonalizada = "Recuperación de ERROR: Condiciones normalizadas, carga REACTIVADA, regresando a ABSORPTION";
+      Serial.println("✅ [ERROR] Condiciones completamente normalizadas:");
+      Serial.println("   🌡️ Temperatura OK: " + String(currentTemp, 1) + "°C < " + String(TEMP_THRESHOLD_SHUTDOWN) + "°C");
+      Serial.println("   ⚡ Voltaje OK: " + String(currentVoltage, 2) + "V < " + String(maxBatteryVoltageAllowed, 1) + "V");
+      Serial.println("   🔋 Voltaje operacional: " + String(currentVoltage, 2) + "V >= 12.0V");
+      Serial.println("   🔌 CARGA REACTIVADA - transición segura a ABSORPTION_CHARGE");
+    } else {
+      // Temperatura y voltaje máximo OK, pero voltaje muy bajo para activar carga
+      notaPersonalizada = "ERROR normalizado pero voltaje muy bajo (" + String(currentVoltage, 2) + "V < 12.0V) - carga BLOQUEADA";
+      Serial.println("⚠️ [ERROR] Temperatura y voltaje máximo normalizados, pero:");
+      Serial.println("   🔋 Voltaje insuficiente: " + String(currentVoltage, 2) + "V < 12.0V");
+      Serial.println("   🔒 Manteniendo carga DESACTIVADA por seguridad");
+    }
+  } else {
+    // Mantener en ERROR
+    notaPersonalizada = "ERROR activo: Temp=" + String(currentTemp, 1) + "°C, Volt=" + String(currentVoltage, 2) + "V - CARGA BLOQUEADA";
+    Serial.println("🚨 [ERROR] Condiciones aún críticas - manteniendo sistema protegido");
+  }
+}
+
+// === REGULADOR ===
+// Corre en la tarea del loop, que se detiene entera mientras una escritura en
+// NVS deshabilita la caché de flash. Por eso esas escrituras se hacen fuera
+// del ciclo de control (saveChargingState desde loop()): nunca caen a mitad de
+// un paso de regulación y, mientras duran, el LEDC mantiene el último ciclo
+// de trabajo.
+// Con ganancias de CMD:AUTOTUNE absorción y flotación usan el PI ajustado; los
+// límites de corriente, BULK y el lazo de litio conservan los pasos fijos.
 void bulkControl(float batteryVoltage, float chargeCurrent, float bulkVoltage) {
-  if (chargeCurrent > maxAllowedCurrent) {
+  if (chargeCurrent > getEffectiveMaxCurrent()) {
     adjustPWM(-5);
   } else if (batteryVoltage < bulkVoltage) {
     adjustPWM(+1);
@@ -1320,10 +2230,14 @@ void bulkControl(float batteryVoltage, float chargeCurrent, float bulkVoltage) {
 }
 
 void absorptionControl(float batteryVoltage, float chargeCurrent, float absorptionVoltage) {
+  if (tunedGains.valid && chargeCurrent < getEffectiveMaxCurrent()) {
+    adjustPWM(tunedRegulatorStep(absorptionVoltage, batteryVoltage, ABSORPTION_CHARGE));
+    return;
+  }
   if (batteryVoltage > absorptionVoltage) {
     adjustPWM(-1);
   } else if (batteryVoltage < absorptionVoltage) {
-    if (chargeCurrent < maxAllowedCurrent) {
+    if (chargeCurrent < getEffectiveMaxCurrent()) {
       adjustPWM(+1);
     } else {
       adjustPWM(-2);
@@ -1332,7 +2246,7 @@ void absorptionControl(float batteryVoltage, float chargeCurrent, float absorpti
 }
 
 void absorptionControlToLitium(float chargeCurrent, float batteryToLoadCurrent) {
-  if (chargeCurrent > batteryToLoadCurrent) {
+  if (chargeCurrent > batteryToLoadCurrent || chargeCurrent > getEffectiveMaxCurrent()) {
     adjustPWM(-3);
   } else {
     adjustPWM(+1);
@@ -1340,6 +2254,10 @@ void absorptionControlToLitium(float chargeCurrent, float batteryToLoadCurrent)
 }
 
 void floatControl(float batteryVoltage, float floatVoltage) {
+  if (tunedGains.valid) {
+    adjustPWM(tunedRegulatorStep(floatVoltage, batteryVoltage, FLOAT_CHARGE));
+    return;
+  }
   if (batteryVoltage > floatVoltage) {
     adjustPWM(-1);
   } else if (batteryVoltage < floatVoltage) {
@@ -1355,9 +2273,9 @@ void adjustPWM(int step) {
 
 void setPWM(int pwmValue) {
   pwmValue = constrain(pwmValue, 0, 255);
+  ledcWrite(pwmPin, 255 - pwmValue);
   int dutyCyclePercentage = map(pwmValue, 0, 255, 0, 100);
   int invertedDutyCycle = 255 - (dutyCyclePercentage * 255 / 100);
-  ledcWrite(pwmPin, 255 - pwmValue);
   Serial.print("PWM calculado: ");
   Serial.print(pwmValue);
   Serial.print(" (");
@@ -1366,7 +2284,22 @@ void setPWM(int pwmValue) {
   Serial.println(invertedDutyCycle);
 }
 
-String getChargeStateString(ChargeState state) {
+// Consigna de voltaje de cada etapa (ERROR no regula: 0)
+float getStageSetpoint(ChargeState state) {
+  switch (state) {
+    case BULK_CHARGE:
+      return bulkVoltage;
+    case ABSORPTION_CHARGE:
+      return absorptionVoltage;
+    case FLOAT_CHARGE:
+      return floatVoltage;
+    default:
+      return 0.0;
+  }
+}
+
+// Sin heap: el ciclo de control la usa en sus mensajes
+const char *getChargeStateName(ChargeState state) {
   switch (state) {
     case BULK_CHARGE:
       return "BULK_CHARGE";
@@ -1381,6 +2314,10 @@ String getChargeStateString(ChargeState state) {
   }
 }
 
+String getChargeStateString(ChargeState state) {
+  return String(getChargeStateName(state));
+}
+
 float readTemperature() {
   float adcValue = 0.0;
 
@@ -24,6 +24,42 @@
 #define NUM_SAMPLES 20
 #define TEMP_THRESHOLD_SHUTDOWN 90
 
+// Derating térmico (foldback): la corriente máxima se reduce linealmente
+// entre el límite suave y el límite duro, en lugar de saltar a ERROR
+#define TEMP_DERATE_SOFT_LIMIT 70.0     // °C: a partir de aquí se reduce la corriente
+#define TEMP_DERATE_HARD_LIMIT 85.0     // °C: corriente de carga nula
+#define TEMP_DERATE_SLEW_PER_S 0.05     // Recuperación máxima del factor por segundo
+
+// Modelo térmico de primer orden del MOSFET/disipador
+#define MOSFET_RDS_ON 0.015             // Ω en conducción
+#define MOSFET_SWITCHING_TIME 100e-9    // s (subida + bajada)
+#define MOSFET_RTH_JUNCTION_NTC 3.0     // °C/W entre MOSFET y NTC
+#define MOSFET_THERMAL_TAU 60.0         // s constante de tiempo
+
+// Modo nocturno / bajo consumo
+#define USER_BUTTON_PIN 5               // Botón (activo en bajo), fuente de despertar
+#define NIGHT_ENTER_MARGIN 0.5          // V: panel por debajo de batería para entrar
+#define NIGHT_EXIT_MARGIN 0.5           // V: panel por encima de batería para salir
+#define NIGHT_ENTER_CURRENT 5.0         // mA: corriente de panel máxima para entrar
+#define NIGHT_CONFIRM_TICKS 30          // Ciclos consecutivos (~30 s) antes de entrar
+#define NIGHT_TICK_INTERVAL 10000       // ms entre muestreos en modo nocturno
+#define NIGHT_NUM_SAMPLES 4             // Muestras INA219 por lectura nocturna
+
+// Política de radio WiFi (0 = siempre encendida, 1 = bajo demanda, 2 = apagada)
+#define WIFI_DEFAULT_POLICY 0
+#define WIFI_DEFAULT_SSID "Cargador"
+#define WIFI_DEFAULT_PASSWORD "12345678"
+#define WIFI_BUTTON_WINDOW_MINUTES 15   // Ventana abierta con el botón
+#define WIFI_MAX_WINDOW_MINUTES 720     // Máximo para CMD:WIFI_ON:<minutos>
+#define WIFI_AP_BEACON_INTERVAL 300     // TU (1 TU = 1.024 ms)
+#define WIFI_AP_DTIM_PERIOD 3           // Beacons entre DTIM
+#define WIFI_TX_POWER WIFI_POWER_8_5dBm // Suficiente para configuración local
+
+// Consumo propio del cargador calibrado en banco (mA desde la batería)
+#define SELF_CURRENT_ACTIVE_MA 85.0     // CPU activa + softAP
+#define SELF_CURRENT_AWAKE_MA 22.0      // CPU activa, radio apagada
+#define SELF_CURRENT_SLEEP_MA 0.9       // Light sleep con INA219 en power-down
+
 // Estados de carga
 enum ChargeState {
   BULK_CHARGE,
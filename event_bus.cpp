@@ -0,0 +1,142 @@
+#include "event_bus.h"
+
+static BusEvent queue[EVENT_BUS_QUEUE_SIZE];
+static uint8_t queueHead = 0;
+static uint8_t queueCount = 0;
+static uint32_t droppedEvents = 0;
+
+static EventHandler subscribers[EVENT_TYPE_COUNT][EVENT_BUS_MAX_SUBSCRIBERS];
+static uint8_t subscriberCount[EVENT_TYPE_COUNT];
+
+static MeasurementSnapshot latestMeasurement;
+
+// La cola puede recibir eventos desde otra tarea (p. ej. el servidor web)
+static portMUX_TYPE busMux = portMUX_INITIALIZER_UNLOCKED;
+
+bool eventBusSubscribe(EventType type, EventHandler handler) {
+  if (type >= EVENT_TYPE_COUNT || subscriberCount[type] >= EVENT_BUS_MAX_SUBSCRIBERS) {
+    Serial.println("❌ [Bus] Sin espacio para más suscriptores del tipo " + String((int)type));
+    return false;
+  }
+  subscribers[type][subscriberCount[type]++] = handler;
+  return true;
+}
+
+bool eventBusPublish(const BusEvent &event) {
+  bool queued = false;
+  portENTER_CRITICAL(&busMux);
+  if (queueCount < EVENT_BUS_QUEUE_SIZE) {
+    queue[(queueHead + queueCount) % EVENT_BUS_QUEUE_SIZE] = event;
+    queueCount++;
+    queued = true;
+  } else {
+    droppedEvents++;
+  }
+  portEXIT_CRITICAL(&busMux);
+  return queued;
+}
+
+bool publishMeasurement(const MeasurementSnapshot &snapshot) {
+  portENTER_CRITICAL(&busMux);
+  latestMeasurement = snapshot;
+  latestMeasurement.valid = true;
+  portEXIT_CRITICAL(&busMux);
+
+  BusEvent event;
+  event.type = EVENT_MEASUREMENT;
+  event.source = SOURCE_CONTROL;
+  event.measurement = snapshot;
+  event.measurement.valid = true;
+  return eventBusPublish(event);
+}
+
+bool publishParamChange(ParamId id, float value, EventSource source) {
+  BusEvent event;
+  event.type = EVENT_PARAM_CHANGE;
+  event.source = source;
+  event.param.id = id;
+  event.param.value = value;
+  return eventBusPublish(event);
+}
+
+bool publishParamChanges(const ParamChange *changes, size_t count, EventSource source) {
+  bool queued = false;
+  portENTER_CRITICAL(&busMux);
+  if (queueCount + count <= EVENT_BUS_QUEUE_SIZE) {
+    for (size_t i = 0; i < count; i++) {
+      BusEvent &event = queue[(queueHead + queueCount) % EVENT_BUS_QUEUE_SIZE];
+      event.type = EVENT_PARAM_CHANGE;
+      event.source = source;
+      event.param = changes[i];
+      queueCount++;
+    }
+    queued = true;
+  } else {
+    droppedEvents += count;
+  }
+  portEXIT_CRITICAL(&busMux);
+  return queued;
+}
+
+bool publishCommand(CommandId id, uint32_t arg, EventSource source) {
+  BusEvent event;
+  event.type = EVENT_COMMAND;
+  event.source = source;
+  event.command.id = id;
+  event.command.arg = arg;
+  return eventBusPublish(event);
+}
+
+bool publishOscillation(const OscillationEvent &oscillation) {
+  BusEvent event;
+  event.type = EVENT_OSCILLATION;
+  event.source = SOURCE_CONTROL;
+  event.oscillation = oscillation;
+  return eventBusPublish(event);
+}
+
+void eventBusDispatch() {
+  while (true) {
+    BusEvent event;
+    portENTER_CRITICAL(&busMux);
+    if (queueCount == 0) {
+      portEXIT_CRITICAL(&busMux);
+      return;
+    }
+    event = queue[queueHead];
+    queueHead = (queueHead + 1) % EVENT_BUS_QUEUE_SIZE;
+    queueCount--;
+    portEXIT_CRITICAL(&busMux);
+
+    // Los suscriptores se ejecutan fuera de la sección crítica y pueden publicar
+    for (uint8_t i = 0; i < subscriberCount[event.type]; i++) {
+      subscribers[event.type][i](event);
+    }
+  }
+}
+
+MeasurementSnapshot getLatestMeasurement() {
+  portENTER_CRITICAL(&busMux);
+  MeasurementSnapshot snapshot = latestMeasurement;
+  portEXIT_CRITICAL(&busMux);
+  return snapshot;
+}
+
+uint32_t getEventBusDropped() {
+  return droppedEvents;
+}
+
+String getEventSourceString(EventSource source) {
+  switch (source) {
+    case SOURCE_CONTROL:
+      return "control";
+    case SOURCE_SERIAL:
+      return "Orange Pi";
+    case SOURCE_WEB:
+      return "web";
+    case SOURCE_MODBUS:
+      return "Modbus";
+    default:
+      return "desconocido";
+  }
+}
@@ -0,0 +1,117 @@
+#ifndef EVENT_BUS_H
+#define EVENT_BUS_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Bus publicar/suscribir con cola estática. Los productores (control, UART,
+// servidor web) publican mensajes tipados; loop() los despacha en orden a
+// los suscriptores, de modo que los parámetros cambian entre ciclos de
+// control y nunca a mitad de uno.
+#define EVENT_BUS_QUEUE_SIZE 16
+#define EVENT_BUS_MAX_SUBSCRIBERS 4
+
+enum EventType {
+  EVENT_MEASUREMENT = 0,
+  EVENT_PARAM_CHANGE,
+  EVENT_COMMAND,
+  EVENT_OSCILLATION,
+  EVENT_TYPE_COUNT
+};
+
+enum EventSource {
+  SOURCE_CONTROL = 0,
+  SOURCE_SERIAL,
+  SOURCE_WEB,
+  SOURCE_MODBUS
+};
+
+// Instantánea coherente de un ciclo de control
+struct MeasurementSnapshot {
+  uint64_t timestamp;             // ms monotónicos
+  float panelToBatteryCurrent;    // mA
+  float batteryToLoadCurrent;     // mA
+  float voltagePanel;
+  float voltageBattery;
+  float temperature;
+  int pwm;
+  ChargeState state;
+  bool valid;
+};
+
+// Parámetros de carga modificables desde UART o web
+enum ParamId {
+  PARAM_BATTERY_CAPACITY = 0,
+  PARAM_THRESHOLD_PERCENTAGE,
+  PARAM_MAX_ALLOWED_CURRENT,
+  PARAM_BULK_VOLTAGE,
+  PARAM_ABSORPTION_VOLTAGE,
+  PARAM_FLOAT_VOLTAGE,
+  PARAM_IS_LITHIUM,
+  PARAM_USE_FUENTE_DC,
+  PARAM_FUENTE_DC_AMPS,
+  PARAM_FACTOR_DIVIDER,
+  PARAM_TEMP_SOFT_LIMIT,
+  PARAM_TEMP_HARD_LIMIT,
+  PARAM_SAMPLING_MODE,
+  PARAM_COUNT
+};
+
+struct ParamChange {
+  ParamId id;
+  float value;                    // Booleanos como 0.0 / 1.0
+};
+
+enum CommandId {
+  COMMAND_LOAD_OFF = 0,           // arg = segundos
+  COMMAND_CANCEL_LOAD_OFF
+};
+
+struct CommandMessage {
+  CommandId id;
+  uint32_t arg;
+};
+
+// Cambio del estado de oscilación detectado por el analizador de rizado
+struct OscillationEvent {
+  float frequencyHz;
+  float amplitude_mV;
+  uint8_t stabilityScore;
+  bool active;                    // false = la oscilación desapareció
+};
+
+struct BusEvent {
+  EventType type;
+  EventSource source;
+  union {
+    MeasurementSnapshot measurement;
+    ParamChange param;
+    CommandMessage command;
+    OscillationEvent oscillation;
+  };
+};
+
+typedef void (*EventHandler)(const BusEvent &event);
+
+// Los suscriptores de un mismo tipo se llaman en orden de suscripción
+bool eventBusSubscribe(EventType type, EventHandler handler);
+
+// Devuelven false si la cola está llena (el evento se descarta y se cuenta)
+bool eventBusPublish(const BusEvent &event);
+bool publishMeasurement(const MeasurementSnapshot &snapshot);
+bool publishParamChange(ParamId id, float value, EventSource source);
+// Todos o ninguno: si la cola no tiene sitio para el lote no se publica nada
+bool publishParamChanges(const ParamChange *changes, size_t count, EventSource source);
+bool publishCommand(CommandId id, uint32_t arg, EventSource source);
+bool publishOscillation(const OscillationEvent &oscillation);
+
+// Despacha todos los eventos pendientes. Llamar desde loop().
+void eventBusDispatch();
+
+// Última medición publicada (copia; valid = false antes del primer ciclo)
+MeasurementSnapshot getLatestMeasurement();
+
+uint32_t getEventBusDropped();
+String getEventSourceString(EventSource source);
+
+#endif
@@ -0,0 +1,52 @@
+#include "flash_stall.h"
+#include "time_base.h"
+
+uint32_t nvsCommitCount = 0;
+uint32_t nvsStallMaxUs = 0;
+uint32_t nvsLastStallUs = 0;
+uint64_t nvsStallTotalUs = 0;
+
+uint32_t controlTickLateMaxMs = 0;
+uint32_t controlTickLateCount = 0;
+
+static uint64_t commitStart = 0;
+static uint64_t lastControlTick = 0;
+
+void nvsCommitBegin() {
+  commitStart = monoMicros();
+}
+
+void nvsCommitEnd() {
+  if (commitStart == 0) return;
+  nvsLastStallUs = (uint32_t)(monoMicros() - commitStart);
+  commitStart = 0;
+  nvsCommitCount++;
+  nvsStallTotalUs += nvsLastStallUs;
+  if (nvsLastStallUs > nvsStallMaxUs) {
+    nvsStallMaxUs = nvsLastStallUs;
+    Serial.println("💾 [NVS] Nuevo máximo de bloqueo por escritura: " + String(nvsStallMaxUs) + " µs");
+  }
+}
+
+void recordControlTick(uint32_t intervalMs) {
+  uint64_t now = monoMillis();
+  if (lastControlTick != 0) {
+    uint64_t elapsed = now - lastControlTick;
+    if (elapsed > intervalMs) {
+      uint32_t late = (uint32_t)(elapsed - intervalMs);
+      controlTickLateMaxMs = max(controlTickLateMaxMs, late);
+      if (late > CONTROL_TICK_LATE_MS) {
+        controlTickLateCount++;
+      }
+    }
+  }
+  lastControlTick = now;
+}
+
+void resetControlTickTiming() {
+  lastControlTick = 0;
+}
+
+float getNvsStallAverageUs() {
+  return nvsCommitCount == 0 ? 0.0 : (float)nvsStallTotalUs / nvsCommitCount;
+}
@@ -0,0 +1,31 @@
+#ifndef FLASH_STALL_H
+#define FLASH_STALL_H
+
+#include <Arduino.h>
+
+// Contadores de bloqueo por escritura en flash. Durante un commit de NVS la
+// caché de flash queda deshabilitada y en el ESP32-C3 (un solo núcleo) solo
+// corren las ISR en IRAM: todo lo demás se detiene hasta que termina.
+extern uint32_t nvsCommitCount;
+extern uint32_t nvsStallMaxUs;
+extern uint32_t nvsLastStallUs;
+extern uint64_t nvsStallTotalUs;
+
+// Retraso del ciclo de control respecto a su periodo nominal
+extern uint32_t controlTickLateMaxMs;
+extern uint32_t controlTickLateCount;   // Ciclos con más de CONTROL_TICK_LATE_MS de retraso
+
+#define CONTROL_TICK_LATE_MS 50
+
+// Envolver cada bloque preferences.begin(..., false) ... end() y cada
+// escritura o borrado de una partición de datos (history.cpp)
+void nvsCommitBegin();
+void nvsCommitEnd();
+
+// Llamar al inicio de cada ciclo de control; reset al (re)arrancar el ciclo
+void recordControlTick(uint32_t intervalMs);
+void resetControlTickTiming();
+
+float getNvsStallAverageUs();
+
+#endif
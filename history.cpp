@@ -0,0 +1,464 @@
+#include "history.h"
+#include <Preferences.h>
+#include "esp_partition.h"
+#include "capture.h"
+#include "flash_stall.h"
+#include "modbus_slave.h"
+#include "time_base.h"
+
+// cargador_gel_litio.ino
+extern HardwareSerial OrangePiSerial;
+extern Preferences preferences;
+bool isDecimalNumber(const String &text, bool allowFraction);
+
+#define RECORD_MAGIC 0xA7
+#define NO_SEQUENCE UINT32_MAX
+#define SCAN_CHUNK 64
+
+// Cabecera de registro (little-endian): magia, 0, longitud del bloque (u16),
+// secuencia (u32), CRC del bloque (u16) y CRC de los 10 bytes anteriores (u16)
+struct Record {
+  uint32_t address;                       // De la cabecera, en la partición
+  uint32_t sequence;
+  uint16_t length;
+  uint16_t crc;
+};
+
+static const esp_partition_t *partition = NULL;
+static uint32_t sectorCount = 0;
+static uint32_t sectorFirstSequence[HISTORY_MAX_SECTORS];   // NO_SEQUENCE: sin registros
+static uint32_t writeSector = 0;
+static uint32_t writeOffset = HISTORY_SECTOR_BYTES;         // Lleno: la próxima grabación borra el siguiente
+static uint32_t nextSequence = 0;         // Secuencia del próximo bloque cerrado
+static uint32_t clearedSequence = 0;      // CMD:HISTORY:CLEAR descarta los anteriores (en NVS)
+
+static uint8_t openBlock[HISTORY_BLOCK_BYTES];
+static HistoryEncoder encoder;
+static bool blockOpen = false;
+
+// Bloque cerrado a la espera de historyService()
+static uint8_t pendingBlock[HISTORY_BLOCK_BYTES];
+static uint16_t pendingLength = 0;
+static uint32_t pendingSequence = 0;
+
+// Volcado en curso
+static bool exporting = false;
+static bool exportAnnounced = false;
+static uint32_t exportSequence = 0;
+static uint32_t exportEnd = 0;            // Secuencia tras el último bloque a enviar
+static Record exportRecord;
+static uint16_t exportOffset = 0;
+static uint16_t exportCrc = 0xFFFF;
+
+static const char BASE64_CHARS[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static size_t base64Encode(const uint8_t *data, size_t length, char *out) {
+  size_t o = 0;
+  for (size_t i = 0; i < length; i += 3) {
+    uint32_t n = (uint32_t)data[i] << 16;
+    if (i + 1 < length) n |= (uint32_t)data[i + 1] << 8;
+    if (i + 2 < length) n |= data[i + 2];
+    out[o++] = BASE64_CHARS[(n >> 18) & 0x3F];
+    out[o++] = BASE64_CHARS[(n >> 12) & 0x3F];
+    out[o++] = i + 1 < length ? BASE64_CHARS[(n >> 6) & 0x3F] : '=';
+    out[o++] = i + 2 < length ? BASE64_CHARS[n & 0x3F] : '=';
+  }
+  out[o] = '\0';
+  return o;
+}
+
+static uint16_t crc16(uint16_t crc, const uint8_t *data, size_t length) {
+  for (size_t i = 0; i < length; i++) {
+    crc ^= (uint16_t)data[i] << 8;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+static uint16_t get16(const uint8_t *p) {
+  return p[0] | (uint16_t)p[1] << 8;
+}
+
+static uint32_t get32(const uint8_t *p) {
+  return get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+static void put16(uint8_t *p, uint16_t value) {
+  p[0] = value & 0xFF;
+  p[1] = value >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t value) {
+  put16(p, value & 0xFFFF);
+  put16(p + 2, value >> 16);
+}
+
+// ===== Registros en la partición =====
+
+static bool readRecord(uint32_t address, Record &record) {
+  uint32_t inSector = address % HISTORY_SECTOR_BYTES;
+  if (inSector + HISTORY_RECORD_BYTES > HISTORY_SECTOR_BYTES) return false;
+  uint8_t header[HISTORY_RECORD_BYTES];
+  if (esp_partition_read(partition, address, header, sizeof(header)) != ESP_OK) return false;
+  if (header[0] != RECORD_MAGIC || get16(header + 10) != crc16(0xFFFF, header, 10)) return false;
+  record.address = address;
+  record.length = get16(header + 2);
+  record.sequence = get32(header + 4);
+  record.crc = get16(header + 8);
+  return record.length > 0 && inSector + HISTORY_RECORD_BYTES + record.length <= HISTORY_SECTOR_BYTES;
+}
+
+static bool recordDataValid(const Record &record) {
+  uint8_t chunk[SCAN_CHUNK];
+  uint16_t crc = 0xFFFF;
+  for (uint32_t at = 0; at < record.length; at += SCAN_CHUNK) {
+    size_t length = min((uint32_t)SCAN_CHUNK, record.length - at);
+    if (esp_partition_read(partition, record.address + HISTORY_RECORD_BYTES + at, chunk, length) != ESP_OK) return false;
+    crc = crc16(crc, chunk, length);
+  }
+  return crc == record.crc;
+}
+
+static bool isErased(uint32_t address, uint32_t length) {
+  uint8_t chunk[SCAN_CHUNK];
+  for (uint32_t at = 0; at < length; at += SCAN_CHUNK) {
+    size_t part = min((uint32_t)SCAN_CHUNK, length - at);
+    if (esp_partition_read(partition, address + at, chunk, part) != ESP_OK) return false;
+    for (size_t i = 0; i < part; i++) {
+      if (chunk[i] != 0xFF) return false;
+    }
+  }
+  return true;
+}
+
+// Registros válidos y consecutivos desde el inicio del sector. Devuelve el
+// desplazamiento tras el último.
+static uint32_t scanSector(uint32_t sector, uint32_t &first, uint32_t &last) {
+  first = NO_SEQUENCE;
+  uint32_t offset = 0;
+  Record record;
+  while (readRecord(sector * HISTORY_SECTOR_BYTES + offset, record) && recordDataValid(record) &&
+         (first == NO_SEQUENCE || record.sequence == last + 1)) {
+    if (first == NO_SEQUENCE) first = record.sequence;
+    last = record.sequence;
+    offset += HISTORY_RECORD_BYTES + record.length;
+  }
+  return offset;
+}
+
+// Los sectores siguen el orden del anillo: el más antiguo va tras el de escritura
+static uint32_t oldestSequence() {
+  uint32_t oldest = nextSequence - (pendingLength > 0 ? 1 : 0);
+  for (uint32_t i = 1; i <= sectorCount; i++) {
+    uint32_t first = sectorFirstSequence[(writeSector + i) % sectorCount];
+    if (first != NO_SEQUENCE) {
+      oldest = first;
+      break;
+    }
+  }
+  return max(oldest, clearedSequence);
+}
+
+static bool findRecord(uint32_t sequence, Record &record) {
+  int32_t sector = -1;
+  for (uint32_t s = 0; s < sectorCount; s++) {
+    uint32_t first = sectorFirstSequence[s];
+    if (first != NO_SEQUENCE && first <= sequence && (sector < 0 || first > sectorFirstSequence[sector])) {
+      sector = s;
+    }
+  }
+  if (sector < 0) return false;
+  uint32_t address = sector * HISTORY_SECTOR_BYTES;
+  while (readRecord(address, record) && record.sequence <= sequence) {
+    if (record.sequence == sequence) return true;
+    address += HISTORY_RECORD_BYTES + record.length;
+  }
+  return false;
+}
+
+// Muestras y bytes de los bloques grabados [from, end)
+static void sumRecords(uint32_t from, uint32_t end, uint32_t &samples, uint32_t &bytes) {
+  for (uint32_t seq = from; seq < end; seq++) {
+    Record record;
+    uint8_t header[HISTORY_HEADER_BYTES];
+    HistoryBlockInfo info;
+    if (!findRecord(seq, record) ||
+        esp_partition_read(partition, record.address + HISTORY_RECORD_BYTES, header, sizeof(header)) != ESP_OK ||
+        historyBlockInfo(header, record.length, &info) == 0) {
+      continue;
+    }
+    samples += info.samples;
+    bytes += record.length;
+  }
+}
+
+// Graba el bloque pendiente en el sector en curso o, si no cabe, en el
+// siguiente, que se borra antes (sus bloques, los más antiguos, se pierden)
+static void flushPending() {
+  if (pendingLength == 0) return;
+  uint16_t length = pendingLength;
+  pendingLength = 0;
+
+  if (writeOffset + HISTORY_RECORD_BYTES + length > HISTORY_SECTOR_BYTES) {
+    uint32_t sector = (writeSector + 1) % sectorCount;
+    sectorFirstSequence[sector] = NO_SEQUENCE;
+    nvsCommitBegin();
+    esp_err_t err = esp_partition_erase_range(partition, sector * HISTORY_SECTOR_BYTES, HISTORY_SECTOR_BYTES);
+    nvsCommitEnd();
+    if (err != ESP_OK) {
+      Serial.printf("⚠️ [Histórico] Error %d al borrar el sector %lu: bloque %lu perdido\n", err,
+                    (unsigned long)sector, (unsigned long)pendingSequence);
+      return;
+    }
+    writeSector = sector;
+    writeOffset = 0;
+  }
+
+  uint8_t header[HISTORY_RECORD_BYTES];
+  header[0] = RECORD_MAGIC;
+  header[1] = 0;
+  put16(header + 2, length);
+  put32(header + 4, pendingSequence);
+  put16(header + 8, crc16(0xFFFF, pendingBlock, length));
+  put16(header + 10, crc16(0xFFFF, header, 10));
+
+  uint32_t address = writeSector * HISTORY_SECTOR_BYTES + writeOffset;
+  nvsCommitBegin();
+  esp_err_t err = esp_partition_write(partition, address, header, sizeof(header));
+  if (err == ESP_OK) err = esp_partition_write(partition, address + HISTORY_RECORD_BYTES, pendingBlock, length);
+  nvsCommitEnd();
+  if (err != ESP_OK) {
+    // Lo que quedó a medias no se puede regrabar sin borrar: sigue en otro sector
+    writeOffset = HISTORY_SECTOR_BYTES;
+    Serial.printf("⚠️ [Histórico] Error %d al grabar el bloque %lu\n", err, (unsigned long)pendingSequence);
+    return;
+  }
+  writeOffset += HISTORY_RECORD_BYTES + length;
+  if (sectorFirstSequence[writeSector] == NO_SEQUENCE) sectorFirstSequence[writeSector] = pendingSequence;
+}
+
+// ===== Bloque abierto =====
+
+// Hueco para el bloque tras el pendiente: así ningún registro cruza un sector
+static size_t openBlockCapacity() {
+  uint32_t offset = writeOffset;
+  if (pendingLength > 0) {
+    if (offset + HISTORY_RECORD_BYTES + pendingLength > HISTORY_SECTOR_BYTES) offset = 0;
+    offset += HISTORY_RECORD_BYTES + pendingLength;
+  }
+  uint32_t room = offset + HISTORY_RECORD_BYTES < HISTORY_SECTOR_BYTES ? HISTORY_SECTOR_BYTES - offset - HISTORY_RECORD_BYTES : 0;
+  if (room < HISTORY_MIN_BLOCK_BYTES) room = HISTORY_SECTOR_BYTES - HISTORY_RECORD_BYTES;
+  return min((uint32_t)HISTORY_BLOCK_BYTES, room);
+}
+
+static void openNewBlock() {
+  int64_t wallClockOffset = isWallClockSynced() ? (int64_t)(wallClockMillis() - monoMillis()) : 0;
+  historyEncoderBegin(encoder, openBlock, openBlockCapacity(), wallClockOffset);
+  blockOpen = true;
+}
+
+// Cierra el bloque abierto y lo deja pendiente de grabar
+static void sealOpenBlock() {
+  if (!blockOpen) return;
+  blockOpen = false;
+  size_t length = historyEncoderFinish(encoder);
+  if (length == 0) return;
+  flushPending();   // Normalmente ya grabado por historyService()
+  memcpy(pendingBlock, openBlock, length);
+  pendingLength = (uint16_t)length;
+  pendingSequence = nextSequence++;
+}
+
+void historyBegin() {
+  partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)HISTORY_PARTITION_SUBTYPE,
+                                       HISTORY_PARTITION_LABEL);
+  sectorCount = partition != NULL ? min(partition->size / HISTORY_SECTOR_BYTES, (uint32_t)HISTORY_MAX_SECTORS) : 0;
+  blockOpen = false;
+  pendingLength = 0;
+  exporting = false;
+  if (sectorCount < 2) {
+    partition = NULL;
+    Serial.println("⚠️ [Histórico] Sin partición '" HISTORY_PARTITION_LABEL "' (partitions.csv): histórico desactivado");
+    return;
+  }
+
+  // El sector de escritura es el del registro más nuevo
+  bool found = false;
+  uint32_t newest = 0;
+  uint32_t newestEnd = 0;
+  writeSector = sectorCount - 1;
+  writeOffset = HISTORY_SECTOR_BYTES;
+  for (uint32_t s = 0; s < sectorCount; s++) {
+    uint32_t last = 0;
+    uint32_t end = scanSector(s, sectorFirstSequence[s], last);
+    if (sectorFirstSequence[s] != NO_SEQUENCE && (!found || last > newest)) {
+      found = true;
+      newest = last;
+      writeSector = s;
+      newestEnd = end;
+    }
+  }
+  nextSequence = found ? newest + 1 : 0;
+  // Tras el último registro el sector debe seguir borrado; si no (grabación
+  // cortada), se sigue en el siguiente
+  if (found) {
+    uint32_t address = writeSector * HISTORY_SECTOR_BYTES + newestEnd;
+    writeOffset = isErased(address, HISTORY_SECTOR_BYTES - newestEnd) ? newestEnd : HISTORY_SECTOR_BYTES;
+  }
+
+  preferences.begin("history", true);
+  clearedSequence = preferences.getULong("cleared", 0);
+  preferences.end();
+  nextSequence = max(nextSequence, clearedSequence);
+
+  Serial.printf("🗄️ [Histórico] Partición de %lu KB: %lu bloques guardados, siguiente %lu\n",
+                (unsigned long)(sectorCount * HISTORY_SECTOR_BYTES / 1024),
+                (unsigned long)(nextSequence - oldestSequence()), (unsigned long)nextSequence);
+}
+
+void historyRecordMeasurement(const BusEvent &event) {
+  const MeasurementSnapshot &m = event.measurement;
+  if (!m.valid || partition == NULL) return;
+
+  HistorySample sample;
+  sample.timestamp = m.timestamp;
+#define HISTORY_COPY(name, scale) sample.name = m.name;
+  HISTORY_CHANNELS(HISTORY_COPY)
+#undef HISTORY_COPY
+  sample.pwm = m.pwm;
+  sample.state = (uint8_t)m.state;
+
+  if (!blockOpen) openNewBlock();
+  if (!historyEncoderAppend(encoder, sample)) {
+    sealOpenBlock();
+    openNewBlock();
+    historyEncoderAppend(encoder, sample);
+  }
+}
+
+// La UART es de la Orange Pi salvo durante un volcado de captura o en Modbus
+static bool canTransmit() {
+  return !isCaptureStreaming() && !isModbusActive();
+}
+
+void handleHistoryCommand(const String &args) {
+  if (partition == NULL) {
+    OrangePiSerial.println("ERROR:History storage unavailable");
+    return;
+  }
+  if (args == ":CLEAR") {
+    // La numeración sigue: las descargas incrementales no repiten secuencias
+    exporting = false;
+    blockOpen = false;
+    pendingLength = 0;
+    clearedSequence = nextSequence;
+    nvsCommitBegin();
+    preferences.begin("history", false);
+    preferences.putULong("cleared", clearedSequence);
+    preferences.end();
+    nvsCommitEnd();
+    OrangePiSerial.println("OK:History cleared");
+    return;
+  }
+
+  uint32_t from = 0;
+  if (args.length() > 0) {
+    String fromStr = args.substring(1);
+    if (!args.startsWith(":") || !isDecimalNumber(fromStr, false) || fromStr.length() > 9) {
+      OrangePiSerial.println("ERROR:Invalid HISTORY format");
+      return;
+    }
+    from = fromStr.toInt();
+  }
+  if (exporting) {
+    OrangePiSerial.println("ERROR:History export in progress");
+    return;
+  }
+
+  sealOpenBlock();
+  exportSequence = max(from, oldestSequence());
+  exportEnd = max(exportSequence, nextSequence);
+  exportOffset = 0;
+  exportCrc = 0xFFFF;
+  exporting = true;
+  exportAnnounced = false;
+  historyService();
+}
+
+void historyService() {
+  // Entre ciclos de control, como saveChargingState()
+  flushPending();
+  if (!exporting || !canTransmit()) return;
+
+  if (!exportAnnounced) {
+    uint32_t bytes = 0;
+    uint32_t samples = 0;
+    sumRecords(exportSequence, exportEnd, samples, bytes);
+    char header[96];
+    snprintf(header, sizeof(header), "HISTORY:BEGIN:first=%lu,blocks=%lu,samples=%lu,bytes=%lu",
+             (unsigned long)exportSequence, (unsigned long)(exportEnd - exportSequence),
+             (unsigned long)samples, (unsigned long)bytes);
+    OrangePiSerial.println(header);
+    Serial.printf("🗄️ [Histórico] Volcado de %lu bloques (%lu muestras, %lu bytes)\n",
+                  (unsigned long)(exportEnd - exportSequence), (unsigned long)samples, (unsigned long)bytes);
+    exportAnnounced = true;
+  }
+
+  // Solo lo que cabe en el búfer de transmisión, como el volcado de captura
+  uint8_t data[HISTORY_EXPORT_CHUNK];
+  char line[(HISTORY_EXPORT_CHUNK + 2) / 3 * 4 + 1];
+  const size_t lineBytes = 10 + (sizeof(line) - 1) + 2;   // "HISTORY:D:" + base64 + "\r\n"
+  while (exportSequence < exportEnd && (size_t)OrangePiSerial.availableForWrite() >= lineBytes) {
+    if (exportSequence < oldestSequence() || (exportOffset == 0 && !findRecord(exportSequence, exportRecord))) {
+      OrangePiSerial.println("HISTORY:END:overrun");
+      Serial.println("⚠️ [Histórico] Volcado interrumpido: se borró un bloque pendiente");
+      exporting = false;
+      return;
+    }
+    size_t chunk = min((size_t)HISTORY_EXPORT_CHUNK, (size_t)(exportRecord.length - exportOffset));
+    uint32_t address = exportRecord.address + HISTORY_RECORD_BYTES + exportOffset;
+    if (esp_partition_read(partition, address, data, chunk) != ESP_OK) {
+      OrangePiSerial.println("HISTORY:END:overrun");
+      exporting = false;
+      return;
+    }
+    base64Encode(data, chunk, line);
+    exportCrc = crc16(exportCrc, data, chunk);
+    OrangePiSerial.print("HISTORY:D:");
+    OrangePiSerial.println(line);
+    exportOffset += chunk;
+    if (exportOffset >= exportRecord.length) {
+      exportSequence++;
+      exportOffset = 0;
+    }
+  }
+  if (exportSequence < exportEnd) return;
+
+  char trailer[48];
+  snprintf(trailer, sizeof(trailer), "HISTORY:END:next=%lu,crc=0x%04X", (unsigned long)exportEnd, exportCrc);
+  OrangePiSerial.println(trailer);
+  exporting = false;
+}
+
+bool isHistoryExporting() {
+  return exporting;
+}
+
+uint32_t getHistorySamples() {
+  if (partition == NULL) return 0;
+  uint32_t samples = blockOpen ? encoder.samples : 0;
+  uint32_t bytes = 0;
+  HistoryBlockInfo info;
+  if (pendingLength > 0 && historyBlockInfo(pendingBlock, pendingLength, &info) > 0) {
+    samples += info.samples;
+  }
+  sumRecords(oldestSequence(), nextSequence - (pendingLength > 0 ? 1 : 0), samples, bytes);
+  return samples;
+}
+
+uint32_t getHistoryNextSequence() {
+  return nextSequence;
+}
@@ -0,0 +1,57 @@
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include <Arduino.h>
+#include "event_bus.h"
+#include "history_codec.h"
+
+// Histórico comprimido de las mediciones del ciclo de control (una muestra
+// por instantánea del bus: 1 s de día, NIGHT_TICK_INTERVAL de noche). El
+// bloque abierto se codifica en RAM con history_codec.h; al llenarse queda
+// pendiente y historyService() lo graba desde loop(), entre ciclos de control,
+// en la partición "history" de partitions.csv. La partición es un anillo de
+// sectores: al entrar en uno se borra y se pierden los bloques más antiguos.
+// Sobrevive a los reinicios (historyBegin() la recorre al arrancar); la
+// Orange Pi la descarga con CMD:HISTORY[:<desde>] (tools/history decodifica).
+//
+//   HISTORY:BEGIN:first=<seq>,blocks=<n>,samples=<n>,bytes=<n>
+//   HISTORY:D:<base64 de hasta HISTORY_EXPORT_CHUNK bytes>   (bloques seguidos)
+//   HISTORY:END:next=<seq>,crc=0x<CRC-16/CCITT-FALSE de los bytes>
+//
+// El bloque abierto se cierra al pedir el volcado, así que este incluye la
+// última muestra. <seq> numera los bloques y sigue tras reiniciar y tras
+// CMD:HISTORY:CLEAR; next= es el <desde> de la siguiente descarga
+// incremental. Si durante el volcado se borra un sector aún no enviado,
+// termina con HISTORY:END:overrun.
+//
+// Cada bloque se graba tras una cabecera de HISTORY_RECORD_BYTES (secuencia,
+// longitud y CRC) y nunca cruza un sector: el bloque abierto se dimensiona con
+// el hueco que queda en el sector. Un registro a medio grabar (corte de
+// alimentación) no pasa el CRC y el arranque sigue en el sector siguiente.
+#define HISTORY_BLOCK_BYTES 2048
+#define HISTORY_PARTITION_LABEL "history"
+#define HISTORY_PARTITION_SUBTYPE 0x40
+#define HISTORY_SECTOR_BYTES 4096
+#define HISTORY_MAX_SECTORS 64            // 256 KB; una partición mayor usa solo estos
+#define HISTORY_RECORD_BYTES 12
+#define HISTORY_MIN_BLOCK_BYTES 256       // Hueco mínimo al final de un sector para otro bloque
+#define HISTORY_EXPORT_CHUNK 96           // Bytes por línea (128 caracteres base64)
+
+// Busca la partición y recupera los bloques grabados. Llamar desde setup().
+void historyBegin();
+
+// Suscriptor de EVENT_MEASUREMENT
+void historyRecordMeasurement(const BusEvent &event);
+
+// CMD:HISTORY, CMD:HISTORY:<desde>, CMD:HISTORY:CLEAR (args sin "HISTORY")
+void handleHistoryCommand(const String &args);
+
+// Graba el bloque pendiente y envía lo que quepa del volcado en curso sin
+// bloquear. Llamar desde loop().
+void historyService();
+
+bool isHistoryExporting();
+uint32_t getHistorySamples();             // Muestras guardadas (flash + bloque abierto)
+uint32_t getHistoryNextSequence();
+
+#endif
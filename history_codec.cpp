@@ -0,0 +1,288 @@
+#include "history_codec.h"
+#include <math.h>
+#include <string.h>
+
+#define HISTORY_SCALE(name, scale) (float)(scale),
+static const float CHANNEL_SCALES[HISTORY_CHANNEL_COUNT] = {HISTORY_CHANNELS(HISTORY_SCALE)};
+#undef HISTORY_SCALE
+
+// Anchos de los cuatro tamaños del código de prefijo
+static const uint8_t TIMESTAMP_WIDTHS[4] = {5, 10, 16, 64};   // Delta-de-delta (ms): fluctuación del ciclo
+static const uint8_t CHANNEL_WIDTHS[4] = {2, 5, 10, 32};   // Ruido del sensor: casi siempre ±1 cuanto
+static const uint8_t PWM_WIDTHS[4] = {3, 6, 9, 32};
+static const uint8_t RUN_WIDTHS[4] = {3, 7, 12, 16};          // Longitud de la racha - 1
+
+#define NAN_SENTINEL 0x80000000UL         // INT32_MIN: NaN, infinito o fuera de rango
+#define SAMPLE_MAX_BITS (4 + 64 + HISTORY_CHANNEL_COUNT * (4 + 32))   // Tamaño mayor en todo
+#define RUN_MAX_BITS (1 + 2 + 4 + 32 + 4 + 16)
+#define STATE_BITS 2
+
+// ===== Flujos de bits =====
+// Bits de más peso primero. El flujo trasero escribe el byte lógico j en
+// data[end - 1 - j], de modo que crece hacia el principio del búfer.
+struct BitWriter {
+  uint8_t *data;
+  uint32_t end;                       // Solo flujo trasero: un byte más allá del primero
+  bool reverse;
+};
+
+static inline uint8_t &byteAt(const BitWriter &writer, uint32_t index) {
+  return writer.reverse ? writer.data[writer.end - 1 - index] : writer.data[index];
+}
+
+static void putBits(const BitWriter &writer, uint32_t &position, uint64_t value, uint8_t count) {
+  while (count > 0) {
+    uint8_t used = position & 7;
+    uint8_t take = count < 8 - used ? count : 8 - used;
+    uint8_t bits = (uint8_t)((value >> (count - take)) & ((1u << take) - 1));
+    byteAt(writer, position >> 3) |= (uint8_t)(bits << (8 - used - take));
+    position += take;
+    count -= take;
+  }
+}
+
+// '0' para cero; si no, prefijo '10', '110', '1110' o '1111' y el valor con
+// el ancho del primer tamaño en que cabe
+static void putBucket(const BitWriter &writer, uint32_t &position, uint64_t value, const uint8_t widths[4]) {
+  if (value == 0) {
+    putBits(writer, position, 0, 1);
+    return;
+  }
+  int size = 0;
+  while (size < 3 && widths[size] < 64 && (value >> widths[size]) != 0) size++;
+  if (size < 3) {
+    putBits(writer, position, ((1u << (size + 1)) - 1) << 1, size + 2);
+  } else {
+    putBits(writer, position, 0xF, 4);
+  }
+  putBits(writer, position, value, widths[size]);
+}
+
+struct BitReader {
+  const uint8_t *data;
+  uint32_t end;
+  bool reverse;
+  uint32_t position;
+  uint32_t limit;                     // Bits válidos
+};
+
+static bool getBits(BitReader &reader, uint8_t count, uint64_t &value) {
+  if (count > reader.limit - reader.position) return false;
+  value = 0;
+  while (count > 0) {
+    uint8_t used = reader.position & 7;
+    uint8_t take = count < 8 - used ? count : 8 - used;
+    uint32_t index = reader.position >> 3;
+    uint8_t byte = reader.reverse ? reader.data[reader.end - 1 - index] : reader.data[index];
+    value = (value << take) | ((byte >> (8 - used - take)) & ((1u << take) - 1));
+    reader.position += take;
+    count -= take;
+  }
+  return true;
+}
+
+static bool getBucket(BitReader &reader, const uint8_t widths[4], uint64_t &value) {
+  int ones = 0;
+  uint64_t bit;
+  while (ones < 4) {
+    if (!getBits(reader, 1, bit)) return false;
+    if (bit == 0) break;
+    ones++;
+  }
+  if (ones == 0) {
+    value = 0;
+    return true;
+  }
+  return getBits(reader, widths[ones - 1], value);
+}
+
+static inline uint64_t zigzag64(int64_t value) {
+  return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static inline int64_t unzigzag64(uint64_t value) {
+  return (int64_t)(value >> 1) ^ -(int64_t)(value & 1);
+}
+
+// Diferencias en aritmética modular de 32 bits: cualquier salto cabe
+static inline uint64_t zigzag32(uint32_t delta) {
+  return (uint32_t)((delta << 1) ^ (uint32_t)((int32_t)delta >> 31));
+}
+
+static inline uint32_t unzigzag32(uint64_t value) {
+  return (uint32_t)(value >> 1) ^ (uint32_t)-(int32_t)(value & 1);
+}
+
+static uint32_t quantize(float value, float scale) {
+  double scaled = (double)value * scale;
+  if (!(scaled > -2147483647.0 && scaled < 2147483647.0)) return NAN_SENTINEL;   // También NaN
+  return (uint32_t)(int32_t)(scaled < 0 ? scaled - 0.5 : scaled + 0.5);
+}
+
+static float dequantize(uint32_t value, float scale) {
+  if (value == NAN_SENTINEL) return NAN;
+  return (float)((int32_t)value / (double)scale);
+}
+
+static void putLe(uint8_t *out, uint64_t value, int bytes) {
+  for (int i = 0; i < bytes; i++) out[i] = (uint8_t)(value >> (8 * i));
+}
+
+static uint64_t getLe(const uint8_t *in, int bytes) {
+  uint64_t value = 0;
+  for (int i = bytes - 1; i >= 0; i--) value = (value << 8) | in[i];
+  return value;
+}
+
+static inline uint32_t bytesFor(uint32_t bits) {
+  return (bits + 7) / 8;
+}
+
+// ===== Codificador =====
+
+void historyEncoderBegin(HistoryEncoder &encoder, uint8_t *block, size_t size, int64_t wallClockOffset) {
+  if (size > HISTORY_MAX_BLOCK_BYTES) size = HISTORY_MAX_BLOCK_BYTES;
+  memset(&encoder, 0, sizeof(encoder));
+  encoder.block = block;
+  encoder.dataBytes = size > HISTORY_HEADER_BYTES ? (uint32_t)(size - HISTORY_HEADER_BYTES) : 0;
+  memset(block, 0, size);
+  putLe(block + 16, (uint64_t)wallClockOffset, 8);
+}
+
+static void writeRun(HistoryEncoder &encoder) {
+  BitWriter back = {encoder.block + HISTORY_HEADER_BYTES, encoder.dataBytes, true};
+  bool stateChanged = encoder.runState != encoder.previousRunState;
+  putBits(back, encoder.backBits, stateChanged, 1);
+  if (stateChanged) putBits(back, encoder.backBits, encoder.runState, STATE_BITS);
+  putBucket(back, encoder.backBits, zigzag32((uint32_t)encoder.runPwm - (uint32_t)encoder.previousRunPwm), PWM_WIDTHS);
+  putBucket(back, encoder.backBits, encoder.runLength - 1, RUN_WIDTHS);
+  encoder.previousRunState = encoder.runState;
+  encoder.previousRunPwm = encoder.runPwm;
+}
+
+bool historyEncoderAppend(HistoryEncoder &encoder, const HistorySample &sample) {
+  // Hueco para esta muestra, la racha que pueda cerrar y la última al terminar
+  uint32_t needed = encoder.frontBits + encoder.backBits + SAMPLE_MAX_BITS + 2 * RUN_MAX_BITS + 16;
+  if (needed > encoder.dataBytes * 8 || encoder.samples == UINT16_MAX) return false;
+
+  BitWriter front = {encoder.block + HISTORY_HEADER_BYTES, 0, false};
+  if (encoder.samples == 0) {
+    putLe(encoder.block + 8, sample.timestamp, 8);
+  } else {
+    uint64_t delta = sample.timestamp - encoder.lastTimestamp;
+    putBucket(front, encoder.frontBits, zigzag64((int64_t)(delta - encoder.lastDelta)), TIMESTAMP_WIDTHS);
+    encoder.lastDelta = delta;
+  }
+  encoder.lastTimestamp = sample.timestamp;
+
+#define HISTORY_VALUE(name, scale) sample.name,
+  const float values[HISTORY_CHANNEL_COUNT] = {HISTORY_CHANNELS(HISTORY_VALUE)};
+#undef HISTORY_VALUE
+  for (int i = 0; i < HISTORY_CHANNEL_COUNT; i++) {
+    uint32_t value = quantize(values[i], CHANNEL_SCALES[i]);
+    putBucket(front, encoder.frontBits, zigzag32(value - encoder.last[i]), CHANNEL_WIDTHS);
+    encoder.last[i] = value;
+  }
+
+  uint8_t state = sample.state & ((1 << STATE_BITS) - 1);
+  if (encoder.runLength > 0 && (state != encoder.runState || sample.pwm != encoder.runPwm)) {
+    writeRun(encoder);
+    encoder.runLength = 0;
+  }
+  if (encoder.runLength == 0) {
+    encoder.runState = state;
+    encoder.runPwm = sample.pwm;
+  }
+  encoder.runLength++;
+  encoder.samples++;
+  return true;
+}
+
+size_t historyEncoderFinish(HistoryEncoder &encoder) {
+  if (encoder.samples == 0) return 0;
+  writeRun(encoder);
+  encoder.runLength = 0;
+
+  uint8_t *data = encoder.block + HISTORY_HEADER_BYTES;
+  uint32_t frontBytes = bytesFor(encoder.frontBits);
+  uint32_t backBytes = bytesFor(encoder.backBits);
+  memmove(data + frontBytes, data + encoder.dataBytes - backBytes, backBytes);
+
+  uint8_t *header = encoder.block;
+  header[0] = HISTORY_BLOCK_MAGIC;
+  header[1] = HISTORY_CODEC_VERSION;
+  putLe(header + 2, encoder.samples, 2);
+  putLe(header + 4, encoder.frontBits, 2);
+  putLe(header + 6, encoder.backBits, 2);
+  return HISTORY_HEADER_BYTES + frontBytes + backBytes;
+}
+
+// ===== Decodificador =====
+
+size_t historyBlockInfo(const uint8_t *block, size_t available, HistoryBlockInfo *info) {
+  if (available < HISTORY_HEADER_BYTES) return 0;
+  if (block[0] != HISTORY_BLOCK_MAGIC || block[1] != HISTORY_CODEC_VERSION) return 0;
+  HistoryBlockInfo header;
+  header.samples = (uint16_t)getLe(block + 2, 2);
+  header.sampleBits = (uint16_t)getLe(block + 4, 2);
+  header.runBits = (uint16_t)getLe(block + 6, 2);
+  header.firstTimestamp = getLe(block + 8, 8);
+  header.wallClockOffset = (int64_t)getLe(block + 16, 8);
+  size_t length = HISTORY_HEADER_BYTES + bytesFor(header.sampleBits) + bytesFor(header.runBits);
+  if (header.samples == 0 || length > available || length > HISTORY_MAX_BLOCK_BYTES) return 0;
+  if (info != nullptr) *info = header;
+  return length;
+}
+
+int historyDecodeBlock(const uint8_t *block, size_t length, HistorySample *out, size_t maxSamples) {
+  HistoryBlockInfo info;
+  if (historyBlockInfo(block, length, &info) == 0 || info.samples > maxSamples) return -1;
+
+  const uint8_t *data = block + HISTORY_HEADER_BYTES;
+  uint32_t frontBytes = bytesFor(info.sampleBits);
+  BitReader front = {data, 0, false, 0, info.sampleBits};
+  BitReader back = {data, frontBytes + bytesFor(info.runBits), true, 0, info.runBits};
+
+  uint64_t timestamp = info.firstTimestamp;
+  uint64_t delta = 0;
+  uint32_t last[HISTORY_CHANNEL_COUNT] = {0};
+  for (int n = 0; n < info.samples; n++) {
+    uint64_t value;
+    if (n > 0) {
+      if (!getBucket(front, TIMESTAMP_WIDTHS, value)) return -1;
+      delta += (uint64_t)unzigzag64(value);
+      timestamp += delta;
+    }
+    for (int i = 0; i < HISTORY_CHANNEL_COUNT; i++) {
+      if (!getBucket(front, CHANNEL_WIDTHS, value)) return -1;
+      last[i] += unzigzag32(value);
+    }
+    HistorySample &sample = out[n];
+    sample.timestamp = timestamp;
+    int channel = 0;
+#define HISTORY_STORE(name, scale) sample.name = dequantize(last[channel], CHANNEL_SCALES[channel]), channel++;
+    HISTORY_CHANNELS(HISTORY_STORE)
+#undef HISTORY_STORE
+  }
+  if (front.position != front.limit) return -1;
+
+  uint32_t filled = 0;
+  uint8_t state = 0;
+  uint32_t pwm = 0;
+  while (filled < info.samples) {
+    uint64_t changed, value, runLength;
+    if (!getBits(back, 1, changed)) return -1;
+    if (changed && !getBits(back, STATE_BITS, value)) return -1;
+    if (changed) state = (uint8_t)value;
+    if (!getBucket(back, PWM_WIDTHS, value) || !getBucket(back, RUN_WIDTHS, runLength)) return -1;
+    pwm += unzigzag32(value);
+    if (runLength + 1 > info.samples - filled) return -1;
+    for (uint64_t k = 0; k <= runLength; k++) {
+      out[filled].state = state;
+      out[filled].pwm = (int32_t)pwm;
+      filled++;
+    }
+  }
+  if (back.position != back.limit) return -1;
+  return info.samples;
+}
@@ -0,0 +1,101 @@
+#ifndef HISTORY_CODEC_H
+#define HISTORY_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compresor por bloques del histórico de mediciones (una muestra por ciclo
+// de control). Sin Arduino ni heap: el firmware codifica sobre un búfer fijo
+// (history.h) y las herramientas del host decodifican los bloques exportados
+// (tools/history).
+//
+// Cada bloque es autónomo y tiene dos flujos de bits en el mismo búfer:
+//   - por delante, una entrada por muestra: delta-de-delta de la marca de
+//     tiempo y, por canal, la diferencia con la muestra anterior del valor
+//     cuantizado (zig-zag);
+//   - por detrás, hacia atrás, las rachas (RLE) de etapa de carga y PWM, que
+//     se escriben al cerrarse cada racha.
+// Los enteros van con un código de prefijo de cuatro tamaños ('0' = cero,
+// '10', '110', '1110', '1111' + ancho fijo). Al cerrar el bloque las rachas se
+// mueven justo detrás de las muestras, así que su longitud sale de la cabecera.
+//
+// Los canales se guardan cuantizados: el error es de medio cuanto como máximo.
+// NaN, infinito y los valores fuera de 32 bits se guardan como NaN.
+
+#define HISTORY_CODEC_VERSION 1
+#define HISTORY_BLOCK_MAGIC 0x48          // 'H'
+#define HISTORY_HEADER_BYTES 24
+#define HISTORY_MAX_BLOCK_BYTES 8192      // Contadores de bits de 16 bits
+#define HISTORY_MIN_SAMPLE_BITS 6         // Marca y canales sin cambios
+#define HISTORY_BLOCK_MAX_SAMPLES(bytes) ((bytes) * 8 / HISTORY_MIN_SAMPLE_BITS + 1)
+
+// X(nombre, cuantos por unidad): mismos nombres que MeasurementSnapshot. Los
+// cuantos rondan la resolución del sensor (4 mV = LSB de bus del INA219);
+// afinarlos por debajo solo guarda ruido.
+#define HISTORY_CHANNELS(X)                                            \
+  X(panelToBatteryCurrent, 0.2)       /* mA, cuanto de 5 mA */         \
+  X(batteryToLoadCurrent, 0.2)        /* mA */                         \
+  X(voltagePanel, 250)                /* V, cuanto de 4 mV */          \
+  X(voltageBattery, 250)              /* V */                          \
+  X(temperature, 10)                  /* °C, cuanto de 0,1 °C */
+
+#define HISTORY_CHANNEL_ONE(name, scale) +1
+#define HISTORY_CHANNEL_COUNT (0 HISTORY_CHANNELS(HISTORY_CHANNEL_ONE))
+
+#define HISTORY_CHANNEL_FIELD(name, scale) float name;
+struct HistorySample {
+  uint64_t timestamp;                 // ms monotónicos
+  HISTORY_CHANNELS(HISTORY_CHANNEL_FIELD)
+  int32_t pwm;
+  uint8_t state;                      // ChargeState (dos bits)
+};
+#undef HISTORY_CHANNEL_FIELD
+
+// Cabecera (little-endian): magia, versión, muestras (u16), bits de muestras
+// (u16), bits de rachas (u16), primera marca (u64 ms monotónicos) y
+// desfase del reloj de pared (i64 ms, 0 si no estaba sincronizado al abrir)
+struct HistoryBlockInfo {
+  uint16_t samples;
+  uint16_t sampleBits;
+  uint16_t runBits;
+  uint64_t firstTimestamp;
+  int64_t wallClockOffset;
+};
+
+struct HistoryEncoder {
+  uint8_t *block;
+  uint32_t dataBytes;                 // Bytes tras la cabecera
+  uint32_t frontBits;
+  uint32_t backBits;
+  uint16_t samples;
+  uint64_t lastTimestamp;
+  uint64_t lastDelta;
+  uint32_t last[HISTORY_CHANNEL_COUNT];
+  // Racha abierta y la anterior (referencia de la diferencia de PWM)
+  int32_t runPwm;
+  uint8_t runState;
+  uint32_t runLength;
+  int32_t previousRunPwm;
+  uint8_t previousRunState;
+};
+
+// Empieza un bloque en 'block' (size hasta HISTORY_MAX_BLOCK_BYTES)
+void historyEncoderBegin(HistoryEncoder &encoder, uint8_t *block, size_t size, int64_t wallClockOffset);
+
+// Añade una muestra. false si el bloque está lleno: la muestra no se escribió
+// y hay que cerrarlo y empezar otro.
+bool historyEncoderAppend(HistoryEncoder &encoder, const HistorySample &sample);
+
+// Cierra el bloque: escribe la última racha y la cabecera y compacta. Devuelve
+// los bytes del bloque (0 si no tiene muestras).
+size_t historyEncoderFinish(HistoryEncoder &encoder);
+
+// Lee la cabecera. Devuelve la longitud total del bloque o 0 si no es un
+// bloque válido o no cabe en 'available'.
+size_t historyBlockInfo(const uint8_t *block, size_t available, HistoryBlockInfo *info);
+
+// Decodifica un bloque. Devuelve las muestras o -1 si el bloque está dañado
+// o tiene más de maxSamples.
+int historyDecodeBlock(const uint8_t *block, size_t length, HistorySample *out, size_t maxSamples);
+
+#endif
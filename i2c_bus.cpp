@@ -0,0 +1,35 @@
+#include "i2c_bus.h"
+
+static SemaphoreHandle_t i2cMutex = NULL;
+static StaticSemaphore_t i2cMutexBuffer;
+
+void i2cBusBegin() {
+  if (i2cMutex == NULL) {
+    i2cMutex = xSemaphoreCreateMutexStatic(&i2cMutexBuffer);
+  }
+}
+
+void i2cBusLock() {
+  xSemaphoreTake(i2cMutex, portMAX_DELAY);
+}
+
+void i2cBusUnlock() {
+  xSemaphoreGive(i2cMutex);
+}
+
+float ina219BusVoltage(Adafruit_INA219 &ina) {
+  I2cBusGuard guard;
+  return ina.getBusVoltage_V();
+}
+
+// getCurrent_mA() reescribe la calibración antes de leer: dos transacciones
+// que la captura tampoco debe separar
+float ina219Current_mA(Adafruit_INA219 &ina) {
+  I2cBusGuard guard;
+  return ina.getCurrent_mA();
+}
+
+void ina219PowerSave(Adafruit_INA219 &ina, bool on) {
+  I2cBusGuard guard;
+  ina.powerSave(on);
+}
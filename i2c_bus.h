@@ -0,0 +1,33 @@
+#ifndef I2C_BUS_H
+#define I2C_BUS_H
+
+#include <Arduino.h>
+#include <Adafruit_INA219.h>
+
+// Exclusión del bus I2C entre loop() y la tarea de captura (capture.cpp).
+// Wire solo protege cada llamada: requestFrom() suelta su cerrojo antes de
+// los Wire.read() y la tarea de captura, de mayor prioridad, puede adelantarse
+// entre la escritura del puntero de registro y la lectura. Cada transacción
+// completa (puntero + lectura) se hace con el mutex tomado; al ser un mutex
+// de FreeRTOS hereda prioridad y la captura no queda detrás de tareas medias.
+
+// Crea el mutex. Llamar en setup() antes de Wire.begin().
+void i2cBusBegin();
+void i2cBusLock();
+void i2cBusUnlock();
+
+// Mantiene el bus tomado durante su ámbito
+class I2cBusGuard {
+ public:
+  I2cBusGuard() { i2cBusLock(); }
+  ~I2cBusGuard() { i2cBusUnlock(); }
+  I2cBusGuard(const I2cBusGuard &) = delete;
+  I2cBusGuard &operator=(const I2cBusGuard &) = delete;
+};
+
+// Lecturas de los INA219 desde loop(), con el bus tomado
+float ina219BusVoltage(Adafruit_INA219 &ina);
+float ina219Current_mA(Adafruit_INA219 &ina);
+void ina219PowerSave(Adafruit_INA219 &ina, bool on);
+
+#endif
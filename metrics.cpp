@@ -0,0 +1,161 @@
+#include "metrics.h"
+#include "event_bus.h"
+#include "flash_stall.h"
+#include "power_manager.h"
+#include "thermal_control.h"
+#include "time_base.h"
+#include "trace.h"
+#include <stdarg.h>
+
+// cargador_gel_litio.ino
+extern float accumulatedAh;
+extern float batteryCapacity;
+extern bool temporaryLoadOff;
+const char *getChargeStateName(ChargeState state);
+
+#define METRICS_FIRMWARE_VERSION "ESP32_v2.1"
+#define METRICS_STATE_COUNT 4   // BULK, ABSORPTION, FLOAT, ERROR
+
+// double: a 1 Hz los incrementos (~1e-4 Ah) se perderían en un float
+// después de unos miles de Ah
+static double chargeAh = 0.0;
+static double dischargeAh = 0.0;
+static double chargeWh = 0.0;
+static double loadWh = 0.0;
+static uint32_t errorStateEntries = 0;
+static uint32_t droppedLines = 0;
+
+void metricsAddEnergy(float chargeAmps, float dischargeAmps, float batteryVoltage, float deltaHours) {
+  chargeAh += chargeAmps * deltaHours;
+  dischargeAh += dischargeAmps * deltaHours;
+  chargeWh += chargeAmps * batteryVoltage * deltaHours;
+  loadWh += dischargeAmps * batteryVoltage * deltaHours;
+}
+
+void metricsCountErrorState() {
+  errorStateEntries++;
+}
+
+void metricsCountDroppedLine() {
+  droppedLines++;
+}
+
+double getChargeAhTotal() { return chargeAh; }
+double getDischargeAhTotal() { return dischargeAh; }
+double getChargeWhTotal() { return chargeWh; }
+double getLoadWhTotal() { return loadWh; }
+uint32_t getErrorStateEntries() { return errorStateEntries; }
+
+// ===== Escritura por trozos =====
+static char chunk[METRICS_CHUNK_SIZE];
+static size_t chunkLength = 0;
+static MetricsSink chunkSink = NULL;
+
+static void flushChunk() {
+  if (chunkLength > 0) {
+    chunkSink(chunk, chunkLength);
+    chunkLength = 0;
+  }
+}
+
+// Ninguna línea supera el trozo: si no cabe, se envía lo acumulado y se
+// vuelve a formatear al principio del buffer
+static void appendf(const char *format, ...) {
+  for (int attempt = 0; attempt < 2; attempt++) {
+    size_t room = METRICS_CHUNK_SIZE - chunkLength;
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(chunk + chunkLength, room, format, args);
+    va_end(args);
+    if (written < 0) return;
+    if ((size_t)written < room) {
+      chunkLength += written;
+      return;
+    }
+    flushChunk();
+  }
+}
+
+static void writeFamily(const char *name, const char *type, const char *unit, const char *help) {
+  appendf("# TYPE %s %s\n", name, type);
+  if (unit != NULL) appendf("# UNIT %s %s\n", name, unit);
+  appendf("# HELP %s %s\n", name, help);
+}
+
+// OpenMetrics escribe NaN y ±Inf con esa grafía
+static void writeSample(const char *name, const char *suffix, double value, int decimals) {
+  if (isnan(value)) appendf("%s%s NaN\n", name, suffix);
+  else if (isinf(value)) appendf("%s%s %cInf\n", name, suffix, value > 0 ? '+' : '-');
+  else appendf("%s%s %.*f\n", name, suffix, decimals, value);
+}
+
+static void writeGauge(const char *name, const char *unit, const char *help, double value, int decimals) {
+  writeFamily(name, "gauge", unit, help);
+  writeSample(name, "", value, decimals);
+}
+
+static void writeCounter(const char *name, const char *unit, const char *help, double value, int decimals) {
+  writeFamily(name, "counter", unit, help);
+  writeSample(name, "_total", value, decimals);
+}
+
+void writeMetrics(MetricsSink sink) {
+  chunkSink = sink;
+  chunkLength = 0;
+  MeasurementSnapshot m = getLatestMeasurement();
+
+  appendf("# TYPE charger_build info\n# HELP charger_build Versión del firmware\n");
+  appendf("charger_build_info{version=\"%s\"} 1\n", METRICS_FIRMWARE_VERSION);
+
+  // === MEDICIONES (instantánea del último ciclo de control) ===
+  writeGauge("charger_panel_voltage_volts", "volts", "Voltaje del panel", m.voltagePanel, 3);
+  writeGauge("charger_battery_voltage_volts", "volts", "Voltaje de la batería", m.voltageBattery, 3);
+  writeGauge("charger_charge_current_amperes", "amperes", "Corriente panel a batería",
+             m.panelToBatteryCurrent / 1000.0, 4);
+  writeGauge("charger_load_current_amperes", "amperes", "Corriente batería a carga",
+             m.batteryToLoadCurrent / 1000.0, 4);
+  writeGauge("charger_pwm_duty_ratio", "ratio", "Ciclo de trabajo del PWM de carga", m.pwm / 255.0, 4);
+  writeGauge("charger_temperature_celsius", "celsius", "Temperatura del NTC", m.temperature, 2);
+  writeGauge("charger_measurement_age_seconds", "seconds", "Antigüedad de la instantánea",
+             (monoMillis() - m.timestamp) / 1000.0, 3);
+
+  // === ETAPA DE CARGA ===
+  writeFamily("charger_charge_state", "stateset", NULL, "Etapa del cargador");
+  for (int i = 0; i < METRICS_STATE_COUNT; i++) {
+    const char *state = getChargeStateName((ChargeState)i);
+    appendf("charger_charge_state{charger_charge_state=\"%s\"} %d\n", state, m.state == (ChargeState)i ? 1 : 0);
+  }
+  writeGauge("charger_load_enabled", NULL, "Salida de carga encendida (1) o cortada (0)",
+             digitalRead(LOAD_CONTROL_PIN) == HIGH ? 1 : 0, 0);
+  writeGauge("charger_load_temporarily_off", NULL, "Apagado temporal de la carga en curso", temporaryLoadOff ? 1 : 0, 0);
+  writeGauge("charger_night_mode", NULL, "Modo nocturno activo", nightModeActive ? 1 : 0, 0);
+
+  // === BATERÍA Y ENERGÍA ===
+  writeGauge("charger_battery_stored_ampere_hours", "ampere_hours", "Carga estimada en la batería", accumulatedAh, 3);
+  writeGauge("charger_battery_soc_ratio", "ratio", "Estado de carga por integración de Ah",
+             accumulatedAh / batteryCapacity, 4);
+  writeCounter("charger_battery_charge_ampere_hours", "ampere_hours", "Ah entregados a la batería", chargeAh, 4);
+  writeCounter("charger_battery_discharge_ampere_hours", "ampere_hours", "Ah consumidos por la carga", dischargeAh, 4);
+  writeCounter("charger_battery_charge_watt_hours", "watt_hours", "Wh entregados a la batería", chargeWh, 3);
+  writeCounter("charger_load_watt_hours", "watt_hours", "Wh consumidos por la carga", loadWh, 3);
+
+  // === TÉRMICO ===
+  writeGauge("charger_mosfet_temperature_celsius", "celsius", "Temperatura estimada del MOSFET", estimatedMosfetTemp, 2);
+  writeGauge("charger_thermal_derating_ratio", "ratio", "Factor de derating térmico", thermalDeratingFactor, 3);
+  writeGauge("charger_effective_max_current_amperes", "amperes", "Corriente máxima tras el derating",
+             getEffectiveMaxCurrent() / 1000.0, 3);
+  writeGauge("charger_self_consumption_amperes", "amperes", "Consumo propio estimado", selfConsumption_mA / 1000.0, 4);
+
+  // === ERRORES Y SALUD ===
+  writeCounter("charger_error_state_entries", NULL, "Entradas en modo ERROR", errorStateEntries, 0);
+  writeCounter("charger_event_bus_dropped", NULL, "Eventos descartados por cola llena", getEventBusDropped(), 0);
+  writeCounter("charger_control_tick_late", NULL, "Ciclos de control con retraso", controlTickLateCount, 0);
+  writeCounter("charger_serial_lines_dropped", NULL, "Líneas serie descartadas por largas", droppedLines, 0);
+  writeCounter("charger_trace_dropped", NULL, "Registros de traza perdidos", getTraceDropped(), 0);
+  writeCounter("charger_nvs_commits", NULL, "Escrituras en NVS", nvsCommitCount, 0);
+  writeGauge("charger_nvs_stall_max_seconds", "seconds", "Bloqueo máximo por escritura en NVS", nvsStallMaxUs / 1e6, 6);
+  writeGauge("charger_uptime_seconds", "seconds", "Tiempo desde el arranque", monoMillis() / 1000.0, 3);
+
+  appendf("# EOF\n");
+  flushChunk();
+}
@@ -0,0 +1,35 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Exposición en formato OpenMetrics (/metrics) para Prometheus: voltajes,
+// corrientes, PWM, temperaturas, etapa de carga (stateset), contadores de
+// Ah/Wh y de errores. El texto se escribe por trozos en un buffer fijo y se
+// entrega a un sumidero (en la web, sendContent con transferencia chunked):
+// la respuesta completa nunca está en RAM.
+#define METRICS_CHUNK_SIZE 512
+#define METRICS_CONTENT_TYPE "application/openmetrics-text; version=1.0.0; charset=utf-8"
+
+typedef void (*MetricsSink)(const char *data, size_t length);
+
+// Escribe la exposición completa (terminada en "# EOF") en trozos de hasta
+// METRICS_CHUNK_SIZE bytes
+void writeMetrics(MetricsSink sink);
+
+// Energía desde el arranque, alimentada por updateAhTracking (corrientes en A)
+void metricsAddEnergy(float chargeAmps, float dischargeAmps, float batteryVoltage, float deltaHours);
+
+// Contadores de errores sin otro registro
+void metricsCountErrorState();
+void metricsCountDroppedLine();
+
+// Totales desde el arranque (también en el mapa Modbus)
+double getChargeAhTotal();
+double getDischargeAhTotal();
+double getChargeWhTotal();
+double getLoadWhTotal();
+uint32_t getErrorStateEntries();
+
+#endif
@@ -0,0 +1,403 @@
+#include "modbus_slave.h"
+#include <Preferences.h>
+#include "flash_stall.h"
+#include "metrics.h"
+#include "power_manager.h"
+#include "thermal_control.h"
+#include "time_base.h"
+#include "wifi_manager.h"
+
+extern Preferences preferences;
+
+// cargador_gel_litio.ino
+extern HardwareSerial OrangePiSerial;
+extern float accumulatedAh;
+extern float batteryCapacity;
+extern float calculatedAbsorptionHours;
+extern bool isLithium;
+extern bool useFuenteDC;
+extern bool temporaryLoadOff;
+extern uint64_t loadOffStartTime;
+extern uint64_t loadOffDuration;
+float getParamValue(ParamId id);
+bool isValidParamValue(ParamId id, float value);
+
+static uint8_t slaveId = 0;               // 0 = protocolo de texto
+static bool stopPending = false;          // Volver al texto tras enviar la respuesta
+
+static uint8_t frame[MODBUS_MAX_FRAME];
+static size_t frameLength = 0;
+static uint64_t lastByteMs = 0;
+static uint8_t response[MODBUS_MAX_FRAME];
+
+static uint32_t frameCount = 0;
+static uint32_t crcErrors = 0;
+
+void modbusBegin() {
+  preferences.begin("charger", true);
+  uint8_t storedId = preferences.getUChar("modbusId", 0);
+  preferences.end();
+
+  slaveId = storedId <= MODBUS_MAX_ID ? storedId : 0;
+  if (slaveId != 0) {
+    Serial.printf("🔌 [Modbus] UART en modo Modbus RTU, esclavo %u\n", slaveId);
+  }
+}
+
+static void saveSlaveId() {
+  nvsCommitBegin();
+  preferences.begin("charger", false);
+  preferences.putUChar("modbusId", slaveId);
+  preferences.end();
+  nvsCommitEnd();
+}
+
+void modbusStart(uint8_t id) {
+  slaveId = id;
+  frameLength = 0;
+  stopPending = false;
+  saveSlaveId();
+  Serial.printf("🔌 [Modbus] UART en modo Modbus RTU, esclavo %u\n", slaveId);
+}
+
+void modbusStop() {
+  slaveId = 0;
+  frameLength = 0;
+  stopPending = false;
+  saveSlaveId();
+  Serial.println("🔌 [Modbus] UART de vuelta al protocolo de texto");
+}
+
+bool isModbusActive() {
+  return slaveId != 0;
+}
+
+uint8_t getModbusSlaveId() {
+  return slaveId;
+}
+
+uint32_t getModbusFrameCount() {
+  return frameCount;
+}
+
+uint32_t getModbusCrcErrors() {
+  return crcErrors;
+}
+
+uint16_t modbusCrc16(const uint8_t *data, size_t length) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+    }
+  }
+  return crc;
+}
+
+static uint16_t readWord(const uint8_t *data) {
+  return ((uint16_t)data[0] << 8) | data[1];
+}
+
+static void putWord(uint8_t *data, uint16_t value) {
+  data[0] = value >> 8;
+  data[1] = value & 0xFF;
+}
+
+// ===== Codificación de valores =====
+static void encodeValue(uint16_t *words, int count, double value, uint16_t scale, bool isSigned) {
+  if (isnan(value) || isinf(value)) {
+    uint16_t invalid = isSigned ? 0x8000 : 0xFFFF;
+    for (int i = 0; i < count; i++) words[i] = invalid;
+    return;
+  }
+  double scaled = round(value * scale);
+  if (count == 2) {
+    uint32_t raw = scaled <= 0 ? 0 : scaled >= 4294967295.0 ? 0xFFFFFFFFUL : (uint32_t)scaled;
+    words[0] = raw >> 16;
+    words[1] = raw & 0xFFFF;
+  } else if (isSigned) {
+    words[0] = (uint16_t)(int16_t)constrain(scaled, -32768.0, 32767.0);
+  } else {
+    words[0] = (uint16_t)constrain(scaled, 0.0, 65535.0);
+  }
+}
+
+static uint16_t getFlags(const MeasurementSnapshot &m) {
+  uint16_t flags = 0;
+  if (digitalRead(LOAD_CONTROL_PIN) == HIGH) flags |= MODBUS_FLAG_LOAD_ON;
+  if (temporaryLoadOff) flags |= MODBUS_FLAG_LOAD_TEMP_OFF;
+  if (nightModeActive) flags |= MODBUS_FLAG_NIGHT_MODE;
+  if (isWifiRadioOn()) flags |= MODBUS_FLAG_WIFI_ON;
+  if (isLithium) flags |= MODBUS_FLAG_LITHIUM;
+  if (useFuenteDC) flags |= MODBUS_FLAG_FUENTE_DC;
+  if (m.valid) flags |= MODBUS_FLAG_MEASUREMENT_VALID;
+  return flags;
+}
+
+static uint32_t getLoadOffRemainingSeconds() {
+  if (!temporaryLoadOff) return 0;
+  uint64_t elapsed = monoMillis() - loadOffStartTime;
+  return elapsed >= loadOffDuration ? 0 : (uint32_t)((loadOffDuration - elapsed + 999) / 1000);
+}
+
+static double getInputValue(ModbusInputRegister reg, const MeasurementSnapshot &m) {
+  switch (reg) {
+    case MODBUS_INPUT_PANEL_VOLTAGE: return m.voltagePanel;
+    case MODBUS_INPUT_BATTERY_VOLTAGE: return m.voltageBattery;
+    case MODBUS_INPUT_CHARGE_CURRENT: return m.panelToBatteryCurrent;
+    case MODBUS_INPUT_LOAD_CURRENT: return m.batteryToLoadCurrent;
+    case MODBUS_INPUT_PWM: return m.pwm;
+    case MODBUS_INPUT_TEMPERATURE: return m.temperature;
+    case MODBUS_INPUT_CHARGE_STATE: return m.state;
+    case MODBUS_INPUT_FLAGS: return getFlags(m);
+    case MODBUS_INPUT_SOC: return accumulatedAh / batteryCapacity * 100.0;
+    case MODBUS_INPUT_STORED_AH: return accumulatedAh;
+    case MODBUS_INPUT_CHARGE_AH_TOTAL: return getChargeAhTotal();
+    case MODBUS_INPUT_DISCHARGE_AH_TOTAL: return getDischargeAhTotal();
+    case MODBUS_INPUT_CHARGE_WH_TOTAL: return getChargeWhTotal();
+    case MODBUS_INPUT_LOAD_WH_TOTAL: return getLoadWhTotal();
+    case MODBUS_INPUT_MOSFET_TEMPERATURE: return estimatedMosfetTemp;
+    case MODBUS_INPUT_THERMAL_DERATING: return thermalDeratingFactor;
+    case MODBUS_INPUT_EFFECTIVE_MAX_CURRENT: return getEffectiveMaxCurrent();
+    case MODBUS_INPUT_ABSORPTION_HOURS: return calculatedAbsorptionHours;
+    case MODBUS_INPUT_ERROR_STATE_ENTRIES: return getErrorStateEntries();
+    case MODBUS_INPUT_LOAD_OFF_REMAINING: return getLoadOffRemainingSeconds();
+    case MODBUS_INPUT_UPTIME: return monoMillis() / 1000;
+    default: return NAN;
+  }
+}
+
+// Mapa input completo de una sola instantánea: una lectura parcial que corta
+// un valor de dos registros devuelve igualmente palabras coherentes
+static void buildInputImage(uint16_t *image) {
+  MeasurementSnapshot m = getLatestMeasurement();
+#define MODBUS_INPUT_ENCODE(name, words, scale, isSigned) \
+  encodeValue(&image[MODBUS_INPUT_##name], words, getInputValue(MODBUS_INPUT_##name, m), scale, isSigned);
+  MODBUS_INPUT_REGISTERS(MODBUS_INPUT_ENCODE)
+#undef MODBUS_INPUT_ENCODE
+}
+
+static uint16_t getHoldingScale(ParamId id) {
+  switch (id) {
+#define MODBUS_HOLDING_SCALE(name, scale) case PARAM_##name: return scale;
+    MODBUS_HOLDING_REGISTERS(MODBUS_HOLDING_SCALE)
+#undef MODBUS_HOLDING_SCALE
+    default: return 1;
+  }
+}
+
+static uint16_t readHoldingRegister(uint16_t address) {
+  uint16_t word;
+  if (address < PARAM_COUNT) {
+    ParamId id = (ParamId)address;
+    encodeValue(&word, 1, getParamValue(id), getHoldingScale(id), false);
+  } else if (address == MODBUS_HOLDING_LOAD_OFF) {
+    encodeValue(&word, 1, getLoadOffRemainingSeconds(), 1, false);
+  } else {
+    word = 1;   // MODBUS_HOLDING_PROTOCOL
+  }
+  return word;
+}
+
+// Valida (apply = false) o ejecuta una escritura. Devuelve 0 o el código de
+// excepción. Los parámetros siguen el camino de CMD:SET_: se validan aquí y
+// se aplican y persisten al despachar el bus.
+static uint8_t writeHoldingRegister(uint16_t address, uint16_t raw, bool apply) {
+  if (address < PARAM_COUNT) {
+    ParamId id = (ParamId)address;
+    float value = (float)raw / getHoldingScale(id);
+    if (!isValidParamValue(id, value)) return MODBUS_EX_ILLEGAL_VALUE;
+    if (!apply) return 0;
+    Serial.printf("🔧 [Modbus] Registro %u = %u\n", address, raw);
+    return publishParamChange(id, value, SOURCE_MODBUS) ? 0 : MODBUS_EX_DEVICE_BUSY;
+  }
+  if (address == MODBUS_HOLDING_LOAD_OFF) {
+    if (raw > 43200) return MODBUS_EX_ILLEGAL_VALUE;
+    if (!apply) return 0;
+    Serial.printf("🔧 [Modbus] Apagado temporal de la carga: %u s\n", raw);
+    bool queued = raw == 0 ? publishCommand(COMMAND_CANCEL_LOAD_OFF, 0, SOURCE_MODBUS)
+                           : publishCommand(COMMAND_LOAD_OFF, raw, SOURCE_MODBUS);
+    return queued ? 0 : MODBUS_EX_DEVICE_BUSY;
+  }
+  // MODBUS_HOLDING_PROTOCOL
+  if (raw > 1) return MODBUS_EX_ILLEGAL_VALUE;
+  if (apply && raw == 0) stopPending = true;
+  return 0;
+}
+
+// ===== Tramas =====
+static void sendResponse(size_t length) {
+  uint16_t crc = modbusCrc16(response, length);
+  response[length++] = crc & 0xFF;        // CRC con el byte bajo primero
+  response[length++] = crc >> 8;
+  OrangePiSerial.write(response, length);
+  OrangePiSerial.flush();
+}
+
+static void sendException(uint8_t function, uint8_t code) {
+  response[0] = slaveId;
+  response[1] = function | 0x80;
+  response[2] = code;
+  sendResponse(3);
+}
+
+static void handleRead(const uint8_t *request, uint16_t registerCount) {
+  uint8_t function = request[1];
+  uint16_t start = readWord(request + 2);
+  uint16_t count = readWord(request + 4);
+  if (count == 0 || count > MODBUS_MAX_READ) {
+    sendException(function, MODBUS_EX_ILLEGAL_VALUE);
+    return;
+  }
+  if ((uint32_t)start + count > registerCount) {
+    sendException(function, MODBUS_EX_ILLEGAL_ADDRESS);
+    return;
+  }
+
+  uint16_t image[MODBUS_INPUT_COUNT];
+  if (function == MODBUS_FC_READ_INPUT) buildInputImage(image);
+  response[0] = slaveId;
+  response[1] = function;
+  response[2] = count * 2;
+  for (uint16_t i = 0; i < count; i++) {
+    uint16_t word = function == MODBUS_FC_READ_INPUT ? image[start + i] : readHoldingRegister(start + i);
+    putWord(response + 3 + i * 2, word);
+  }
+  sendResponse(3 + count * 2);
+}
+
+// Escribe count registros desde values (palabras big-endian). Todos se
+// validan antes de aplicar ninguno.
+static uint8_t writeRegisters(uint16_t start, uint16_t count, const uint8_t *values) {
+  if ((uint32_t)start + count > MODBUS_HOLDING_COUNT) return MODBUS_EX_ILLEGAL_ADDRESS;
+  for (int pass = 0; pass < 2; pass++) {
+    for (uint16_t i = 0; i < count; i++) {
+      uint8_t exception = writeHoldingRegister(start + i, readWord(values + i * 2), pass == 1);
+      if (exception != 0) return exception;
+    }
+  }
+  return 0;
+}
+
+static void handleFrame(const uint8_t *request, size_t length) {
+  uint8_t address = request[0];
+  uint8_t function = request[1];
+  bool broadcast = address == 0;
+  if (!broadcast && address != slaveId) return;
+  frameCount++;
+
+  uint8_t exception = 0;
+  switch (function) {
+    case MODBUS_FC_READ_HOLDING:
+      if (!broadcast) handleRead(request, MODBUS_HOLDING_COUNT);
+      return;
+    case MODBUS_FC_READ_INPUT:
+      if (!broadcast) handleRead(request, MODBUS_INPUT_COUNT);
+      return;
+    case MODBUS_FC_WRITE_SINGLE:
+      exception = writeRegisters(readWord(request + 2), 1, request + 4);
+      if (exception == 0 && !broadcast) {
+        memcpy(response, request, 6);     // La respuesta repite la petición
+        sendResponse(6);
+      }
+      break;
+    case MODBUS_FC_WRITE_MULTIPLE: {
+      uint16_t count = readWord(request + 4);
+      if (count == 0 || count > MODBUS_MAX_WRITE || request[6] != count * 2) {
+        exception = MODBUS_EX_ILLEGAL_VALUE;
+      } else {
+        exception = writeRegisters(readWord(request + 2), count, request + 7);
+      }
+      if (exception == 0 && !broadcast) {
+        memcpy(response, request, 6);     // Dirección, función, inicio y cantidad
+        sendResponse(6);
+      }
+      break;
+    }
+    default:
+      exception = MODBUS_EX_ILLEGAL_FUNCTION;
+      break;
+  }
+  if (exception != 0 && !broadcast) sendException(function, exception);
+  if (stopPending) modbusStop();
+}
+
+// Longitud de la trama que empieza en frame: 0 si aún faltan bytes para
+// saberla, FRAME_LENGTH_UNKNOWN si la función no está soportada
+#define FRAME_LENGTH_UNKNOWN SIZE_MAX
+
+static size_t expectedFrameLength() {
+  if (frameLength < 2) return 0;
+  switch (frame[1]) {
+    case MODBUS_FC_READ_HOLDING:
+    case MODBUS_FC_READ_INPUT:
+    case MODBUS_FC_WRITE_SINGLE:
+      return 8;
+    case MODBUS_FC_WRITE_MULTIPLE:
+      return frameLength < 7 ? 0 : 9 + frame[6];
+    default:
+      return FRAME_LENGTH_UNKNOWN;
+  }
+}
+
+static bool hasValidCrc(const uint8_t *data, size_t length) {
+  if (length < 4) return false;
+  uint16_t crc = modbusCrc16(data, length - 2);
+  return data[length - 2] == (crc & 0xFF) && data[length - 1] == (crc >> 8);
+}
+
+static void dropBytes(size_t count) {
+  memmove(frame, frame + count, frameLength - count);
+  frameLength -= count;
+}
+
+void modbusService() {
+  uint64_t now = monoMillis();
+
+  // Trama cerrada por silencio: función desconocida (excepción 01 si el CRC
+  // es válido) o resto de una trama perdida
+  if (frameLength > 0 && now - lastByteMs >= MODBUS_FRAME_TIMEOUT_MS) {
+    if (hasValidCrc(frame, frameLength)) {
+      handleFrame(frame, frameLength);
+    } else {
+      crcErrors++;
+    }
+    frameLength = 0;
+  }
+
+  while (isModbusActive()) {
+    int available = OrangePiSerial.available();
+    if (available <= 0) break;
+    if (frameLength == MODBUS_MAX_FRAME) {
+      crcErrors++;                        // Basura sin silencio entre tramas
+      frameLength = 0;
+    }
+    frameLength += OrangePiSerial.read(frame + frameLength, min((size_t)available, MODBUS_MAX_FRAME - frameLength));
+    lastByteMs = now;
+
+    // Sin un silencio de 3,5 caracteres fiable (la UART se lee cada pocos
+    // ms), las tramas se delimitan por longitud. Un CRC erróneo descarta un
+    // byte y se vuelve a sincronizar con el siguiente, igual que una función
+    // desconocida dirigida a otro esclavo (su longitud no se puede saber); la
+    // dirigida a este se cierra por silencio y recibe la excepción 01.
+    while (isModbusActive()) {
+      size_t expected = expectedFrameLength();
+      if (expected == 0) break;
+      if (expected == FRAME_LENGTH_UNKNOWN) {
+        if (frame[0] == slaveId) break;
+        dropBytes(1);
+        continue;
+      }
+      bool fits = expected <= MODBUS_MAX_FRAME;
+      if (fits && frameLength < expected) break;
+      if (fits && hasValidCrc(frame, expected)) {
+        handleFrame(frame, expected);
+        if (isModbusActive()) dropBytes(expected);
+      } else {
+        crcErrors++;
+        dropBytes(1);
+      }
+    }
+  }
+}
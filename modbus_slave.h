@@ -0,0 +1,128 @@
+#ifndef MODBUS_SLAVE_H
+#define MODBUS_SLAVE_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "event_bus.h"
+
+// Esclavo Modbus RTU opcional en la UART de la Orange Pi (OrangePiSerial,
+// mismos pines y 9600 8N1 que el protocolo de texto). CMD:MODBUS:ON[:<id>]
+// cambia la UART a Modbus; el maestro vuelve al texto escribiendo 0 en el
+// registro PROTOCOL. El modo se guarda en NVS y sobrevive a reinicios.
+//
+// Funciones: 03 (leer holding), 04 (leer input), 06 (escribir un registro) y
+// 16 (escribir varios). Los dos mapas son contiguos desde la dirección 0 y se
+// generan de las tablas de abajo:
+//   input    telemetría; una lectura FC04 de MODBUS_INPUT_COUNT registros
+//            devuelve la instantánea completa (59 bytes de respuesta)
+//   holding  parámetros de carga en el orden de ParamId (se validan con
+//            isValidParamValue y se aplican por el bus de eventos), seguidos
+//            de los registros de control
+//
+// Valores enteros escalados: valor real = registro / escala. Los de dos
+// registros van con la palabra alta primero. Un valor no finito se lee como
+// 0x8000 (con signo) o 0xFFFF (sin signo).
+#define MODBUS_DEFAULT_ID 1
+#define MODBUS_MAX_ID 247
+#define MODBUS_FRAME_TIMEOUT_MS 100       // Silencio que descarta una trama a medias
+#define MODBUS_MAX_FRAME 256
+#define MODBUS_MAX_READ 125               // Registros por lectura (límite del protocolo)
+#define MODBUS_MAX_WRITE 123              // Registros por escritura FC16
+
+#define MODBUS_FC_READ_HOLDING 0x03
+#define MODBUS_FC_READ_INPUT 0x04
+#define MODBUS_FC_WRITE_SINGLE 0x06
+#define MODBUS_FC_WRITE_MULTIPLE 0x10
+
+#define MODBUS_EX_ILLEGAL_FUNCTION 0x01
+#define MODBUS_EX_ILLEGAL_ADDRESS 0x02
+#define MODBUS_EX_ILLEGAL_VALUE 0x03
+#define MODBUS_EX_DEVICE_BUSY 0x06        // Cola del bus llena: reintentar
+
+// Registros input: X(nombre, registros, escala, con signo)
+#define MODBUS_INPUT_REGISTERS(X)                                               \
+  X(PANEL_VOLTAGE, 1, 1000, false)          /* V */                             \
+  X(BATTERY_VOLTAGE, 1, 1000, false)        /* V */                             \
+  X(CHARGE_CURRENT, 1, 1, true)             /* mA panel -> batería */           \
+  X(LOAD_CURRENT, 1, 1, true)               /* mA batería -> carga */           \
+  X(PWM, 1, 1, false)                       /* 0-255 */                         \
+  X(TEMPERATURE, 1, 100, true)              /* °C */                            \
+  X(CHARGE_STATE, 1, 1, false)              /* ChargeState */                   \
+  X(FLAGS, 1, 1, false)                     /* MODBUS_FLAG_* */                 \
+  X(SOC, 1, 100, false)                     /* % por integración de Ah */       \
+  X(STORED_AH, 2, 1000, false)              /* Ah */                            \
+  X(CHARGE_AH_TOTAL, 2, 1000, false)        /* Ah desde el arranque */          \
+  X(DISCHARGE_AH_TOTAL, 2, 1000, false)     /* Ah desde el arranque */          \
+  X(CHARGE_WH_TOTAL, 2, 10, false)          /* Wh desde el arranque */          \
+  X(LOAD_WH_TOTAL, 2, 10, false)            /* Wh desde el arranque */          \
+  X(MOSFET_TEMPERATURE, 1, 100, true)       /* °C estimados */                  \
+  X(THERMAL_DERATING, 1, 1000, false)       /* factor 0-1 */                    \
+  X(EFFECTIVE_MAX_CURRENT, 1, 1, false)     /* mA tras el derating */           \
+  X(ABSORPTION_HOURS, 1, 100, false)        /* h calculadas */                  \
+  X(ERROR_STATE_ENTRIES, 1, 1, false)       /* entradas en ERROR */             \
+  X(LOAD_OFF_REMAINING, 1, 1, false)        /* s de apagado temporal */         \
+  X(UPTIME, 2, 1, false)                    /* s */
+
+// Registros holding de parámetros: X(sufijo de ParamId, escala). La
+// dirección es el propio ParamId.
+#define MODBUS_HOLDING_REGISTERS(X)                                             \
+  X(BATTERY_CAPACITY, 10)                   /* Ah */                            \
+  X(THRESHOLD_PERCENTAGE, 100)              /* % */                             \
+  X(MAX_ALLOWED_CURRENT, 1)                 /* mA */                            \
+  X(BULK_VOLTAGE, 1000)                     /* V */                             \
+  X(ABSORPTION_VOLTAGE, 1000)               /* V */                             \
+  X(FLOAT_VOLTAGE, 1000)                    /* V */                             \
+  X(IS_LITHIUM, 1)                          /* 0/1 */                           \
+  X(USE_FUENTE_DC, 1)                       /* 0/1 */                           \
+  X(FUENTE_DC_AMPS, 100)                    /* A */                             \
+  X(FACTOR_DIVIDER, 1)                                                          \
+  X(TEMP_SOFT_LIMIT, 10)                    /* °C */                            \
+  X(TEMP_HARD_LIMIT, 10)                    /* °C */                            \
+  X(SAMPLING_MODE, 1)                       /* SamplingMode */
+
+// Dirección de cada registro input (los de dos registros ocupan también _END)
+#define MODBUS_INPUT_ENUM(name, words, scale, isSigned) \
+  MODBUS_INPUT_##name, MODBUS_INPUT_##name##_END = MODBUS_INPUT_##name + (words) - 1,
+enum ModbusInputRegister {
+  MODBUS_INPUT_REGISTERS(MODBUS_INPUT_ENUM)
+  MODBUS_INPUT_COUNT
+};
+#undef MODBUS_INPUT_ENUM
+
+#define MODBUS_HOLDING_ONE(name, scale) +1
+static_assert(0 MODBUS_HOLDING_REGISTERS(MODBUS_HOLDING_ONE) == PARAM_COUNT,
+              "MODBUS_HOLDING_REGISTERS debe cubrir todos los ParamId");
+#undef MODBUS_HOLDING_ONE
+
+enum ModbusHoldingRegister {
+  MODBUS_HOLDING_LOAD_OFF = PARAM_COUNT,  // s de apagado temporal; escribir 0 lo cancela
+  MODBUS_HOLDING_PROTOCOL,                // Se lee 1; escribir 0 vuelve al protocolo de texto
+  MODBUS_HOLDING_COUNT
+};
+
+// Bits del registro FLAGS
+#define MODBUS_FLAG_LOAD_ON 0x0001
+#define MODBUS_FLAG_LOAD_TEMP_OFF 0x0002
+#define MODBUS_FLAG_NIGHT_MODE 0x0004
+#define MODBUS_FLAG_WIFI_ON 0x0008
+#define MODBUS_FLAG_LITHIUM 0x0010
+#define MODBUS_FLAG_FUENTE_DC 0x0020
+#define MODBUS_FLAG_MEASUREMENT_VALID 0x0040
+
+void modbusBegin();                       // Restaura el modo guardado
+void modbusStart(uint8_t slaveId);        // Pasa la UART a Modbus y lo guarda
+void modbusStop();                        // Vuelve al protocolo de texto y lo guarda
+bool isModbusActive();
+uint8_t getModbusSlaveId();
+
+// Lee la UART y atiende las tramas completas. Llamar desde loop() en lugar
+// de handleSerialCommands() mientras isModbusActive().
+void modbusService();
+
+uint16_t modbusCrc16(const uint8_t *data, size_t length);
+
+// Contadores de diagnóstico
+uint32_t getModbusFrameCount();           // Tramas atendidas (dirigidas a este esclavo)
+uint32_t getModbusCrcErrors();            // Tramas descartadas por CRC o incompletas
+
+#endif
@@ -0,0 +1,720 @@
+#include "mqtt_publisher.h"
+#include <Preferences.h>
+#include "capture.h"
+#include "flash_stall.h"
+#include "modbus_slave.h"
+#include "time_base.h"
+
+extern Preferences preferences;
+
+// cargador_gel_litio.ino
+extern HardwareSerial OrangePiSerial;
+
+String mqttTopic = MQTT_DEFAULT_TOPIC;
+uint16_t mqttInterval = MQTT_DEFAULT_INTERVAL_S;
+
+enum MqttState {
+  MQTT_DISABLED = 0,
+  MQTT_WAIT_RETRY,        // Esperando para volver a abrir el túnel
+  MQTT_WAIT_BRIDGE,       // BRIDGE:OPEN enviado, falta CMD:BRIDGE:UP
+  MQTT_WAIT_CONNACK,
+  MQTT_CONNECTED
+};
+
+static const char *const MQTT_STATE_NAMES[] = {
+  "DISABLED", "WAIT_RETRY", "WAIT_BRIDGE", "WAIT_CONNACK", "CONNECTED"
+};
+
+// Muestra compacta: un lote completo cabe en un solo blob de NVS
+struct MqttSample {
+  uint16_t offset;          // s desde baseTime
+  uint16_t panel_mV;
+  uint16_t battery_mV;
+  int16_t charge_mA;
+  int16_t load_mA;
+  int16_t temperature_dC;
+  uint8_t pwm;
+  uint8_t state;
+};
+
+struct MqttBatch {
+  uint32_t baseTime;        // s UNIX o s desde el arranque (wallClock)
+  uint16_t boot;
+  uint16_t sequence;
+  uint8_t wallClock;
+  uint8_t count;
+  MqttSample samples[MQTT_BATCH_SAMPLES];
+};
+
+#define MQTT_BATCH_HEADER_SIZE offsetof(MqttBatch, samples)
+
+// Tipos de paquete MQTT 3.1.1 (nibble alto de la cabecera fija)
+#define MQTT_CONNECT 0x10
+#define MQTT_CONNACK 0x20
+#define MQTT_PUBLISH 0x30
+#define MQTT_PUBACK 0x40
+#define MQTT_PINGREQ 0xC0
+#define MQTT_PINGRESP 0xD0
+#define MQTT_DISCONNECT 0xE0
+
+static MqttState mqttState = MQTT_DISABLED;
+static uint64_t stateSinceMs = 0;
+static uint64_t retryAtMs = 0;
+static uint32_t retryDelayMs = MQTT_RETRY_MIN_MS;
+static uint16_t bootCount = 0;
+
+// Lote en construcción
+static MqttBatch batch;
+static uint64_t batchOpenedMs = 0;
+static uint16_t nextSequence = 0;
+static MeasurementSnapshot lastSampled;
+static bool hasLastSampled = false;
+static uint64_t lastSampleMs = 0;
+
+// Lote publicado a la espera de su PUBACK
+static MqttBatch inflight;
+static bool inflightActive = false;
+static bool inflightFromQueue = false;
+static uint16_t inflightPacketId = 0;
+static uint64_t inflightSentMs = 0;
+static uint16_t nextPacketId = 1;
+
+static uint64_t lastDrainMs = 0;
+static uint64_t lastTxMs = 0;
+static bool pingPending = false;
+static uint64_t pingSentMs = 0;
+
+// Cola en NVS
+static uint32_t queueHead = 0;
+static uint32_t queueCount = 0;
+static uint32_t droppedBatches = 0;
+static uint32_t publishedBatches = 0;
+
+// Paquete saliente: el cuerpo se escribe desde packet[5] y la cabecera fija
+// se antepone al enviar
+static uint8_t packet[MQTT_PACKET_MAX];
+static size_t packetLength = 0;
+static char payload[MQTT_PACKET_MAX - 64];
+
+// Receptor incremental de paquetes entrantes
+enum RxState { RX_HEADER, RX_LENGTH, RX_BODY };
+static RxState rxState = RX_HEADER;
+static uint8_t rxHeader = 0;
+static uint32_t rxRemaining = 0;
+static uint32_t rxMultiplier = 1;
+static uint8_t rxBody[4];
+static uint8_t rxBodyLength = 0;
+
+static void closeSession();
+static void closeBatch();
+static void dropSession(const char *reason);
+
+// ========== Validación y configuración ==========
+
+bool isValidMqttTopic(const String &topic) {
+  if (topic.length() == 0 || topic.length() > MQTT_TOPIC_MAX) return false;
+  for (size_t i = 0; i < topic.length(); i++) {
+    char c = topic[i];
+    if (!isalnum((unsigned char)c) && c != '_' && c != '-') return false;
+  }
+  return true;
+}
+
+static void saveEnabled(bool enabled) {
+  nvsCommitBegin();
+  preferences.begin("charger", false);
+  preferences.putBool("mqttOn", enabled);
+  if (enabled) preferences.putUInt("mqttBoot", bootCount);
+  preferences.end();
+  nvsCommitEnd();
+}
+
+static void loadQueueIndex() {
+  preferences.begin("mqttq", true);
+  queueHead = preferences.getUInt("head", 0);
+  queueCount = preferences.getUInt("count", 0);
+  preferences.end();
+  if (queueHead >= MQTT_QUEUE_SLOTS || queueCount > MQTT_QUEUE_SLOTS) {
+    queueHead = 0;
+    queueCount = 0;
+  }
+}
+
+void mqttBegin() {
+  preferences.begin("charger", true);
+  bool enabled = preferences.getBool("mqttOn", false);
+  mqttTopic = preferences.getString("mqttTopic", MQTT_DEFAULT_TOPIC);
+  uint32_t interval = preferences.getUInt("mqttInterval", MQTT_DEFAULT_INTERVAL_S);
+  bootCount = (uint16_t)preferences.getUInt("mqttBoot", 0);
+  preferences.end();
+
+  if (!isValidMqttTopic(mqttTopic)) mqttTopic = MQTT_DEFAULT_TOPIC;
+  if (interval < MQTT_MIN_INTERVAL_S || interval > MQTT_MAX_INTERVAL_S) {
+    interval = MQTT_DEFAULT_INTERVAL_S;
+  }
+  mqttInterval = (uint16_t)interval;
+  loadQueueIndex();
+
+  if (enabled) mqttSetEnabled(true);
+}
+
+void mqttSetEnabled(bool enabled) {
+  if (enabled == (mqttState != MQTT_DISABLED)) return;
+
+  if (enabled) {
+    bootCount++;
+    nextSequence = 0;
+    batch.count = 0;
+    hasLastSampled = false;
+    retryDelayMs = MQTT_RETRY_MIN_MS;
+    retryAtMs = monoMillis();
+    mqttState = MQTT_WAIT_RETRY;
+    saveEnabled(true);
+    Serial.printf("📡 [MQTT] Publicación activa en %s/telemetry (arranque %u, %u lotes en cola)\n",
+                  mqttTopic.c_str(), bootCount, (unsigned)queueCount);
+    mqttService();                  // BRIDGE:OPEN sin esperar a la siguiente vuelta
+  } else {
+    // El lote a medias y el publicado sin PUBACK quedan en la cola
+    closeSession();
+    mqttState = MQTT_DISABLED;
+    closeBatch();
+    saveEnabled(false);
+    Serial.printf("📡 [MQTT] Publicación desactivada (%u lotes en cola)\n", (unsigned)queueCount);
+  }
+}
+
+bool isMqttEnabled() {
+  return mqttState != MQTT_DISABLED;
+}
+
+bool isMqttConnected() {
+  return mqttState == MQTT_CONNECTED;
+}
+
+void mqttRestart() {
+  if (mqttState == MQTT_DISABLED) return;
+  dropSession("Reinicio de la sesión");
+  retryDelayMs = MQTT_RETRY_MIN_MS;
+  retryAtMs = monoMillis();
+}
+
+// ========== Cola de lotes en NVS ==========
+
+static void slotKey(uint32_t slot, char *key) {
+  snprintf(key, 8, "b%u", (unsigned)slot);
+}
+
+static void saveQueueIndex() {
+  preferences.putUInt("head", queueHead);
+  preferences.putUInt("count", queueCount);
+}
+
+// front: el lote es anterior a todos los de la cola (volvía de un envío fallido)
+static void queueInsert(const MqttBatch &item, bool front) {
+  if (queueCount == MQTT_QUEUE_SLOTS) {
+    droppedBatches++;
+    if (front) {
+      Serial.printf("⚠️ [MQTT] Cola llena: lote %u descartado\n", item.sequence);
+      return;
+    }
+    queueHead = (queueHead + 1) % MQTT_QUEUE_SLOTS;
+    queueCount--;
+    Serial.println("⚠️ [MQTT] Cola llena: se descarta el lote más antiguo");
+  }
+
+  uint32_t slot;
+  if (front) {
+    queueHead = (queueHead + MQTT_QUEUE_SLOTS - 1) % MQTT_QUEUE_SLOTS;
+    slot = queueHead;
+  } else {
+    slot = (queueHead + queueCount) % MQTT_QUEUE_SLOTS;
+  }
+  queueCount++;
+
+  char key[8];
+  slotKey(slot, key);
+  nvsCommitBegin();
+  preferences.begin("mqttq", false);
+  preferences.putBytes(key, &item, MQTT_BATCH_HEADER_SIZE + item.count * sizeof(MqttSample));
+  saveQueueIndex();
+  preferences.end();
+  nvsCommitEnd();
+}
+
+static bool queuePeek(MqttBatch &item) {
+  char key[8];
+  slotKey(queueHead, key);
+  preferences.begin("mqttq", true);
+  size_t length = preferences.getBytes(key, &item, sizeof(MqttBatch));
+  preferences.end();
+  return length >= MQTT_BATCH_HEADER_SIZE && item.count > 0 && item.count <= MQTT_BATCH_SAMPLES &&
+         length == MQTT_BATCH_HEADER_SIZE + item.count * sizeof(MqttSample);
+}
+
+static void queuePop() {
+  if (queueCount == 0) return;
+  char key[8];
+  slotKey(queueHead, key);
+  queueHead = (queueHead + 1) % MQTT_QUEUE_SLOTS;
+  queueCount--;
+  nvsCommitBegin();
+  preferences.begin("mqttq", false);
+  preferences.remove(key);
+  saveQueueIndex();
+  preferences.end();
+  nvsCommitEnd();
+}
+
+// ========== Túnel por la UART ==========
+
+static const char BASE64_CHARS[] =
+  "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static size_t base64Encode(const uint8_t *data, size_t length, char *out) {
+  size_t o = 0;
+  for (size_t i = 0; i < length; i += 3) {
+    uint32_t n = (uint32_t)data[i] << 16;
+    if (i + 1 < length) n |= (uint32_t)data[i + 1] << 8;
+    if (i + 2 < length) n |= data[i + 2];
+    out[o++] = BASE64_CHARS[(n >> 18) & 0x3F];
+    out[o++] = BASE64_CHARS[(n >> 12) & 0x3F];
+    out[o++] = i + 1 < length ? BASE64_CHARS[(n >> 6) & 0x3F] : '=';
+    out[o++] = i + 2 < length ? BASE64_CHARS[n & 0x3F] : '=';
+  }
+  out[o] = '\0';
+  return o;
+}
+
+static int base64Value(char c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+') return 62;
+  if (c == '/') return 63;
+  return -1;
+}
+
+// Devuelve los bytes decodificados o -1 si el texto no es base64 válido
+static int base64Decode(const char *text, size_t length, uint8_t *out, size_t maxLength) {
+  if (length % 4 != 0) return -1;
+  size_t o = 0;
+  for (size_t i = 0; i < length; i += 4) {
+    int v[4];
+    int padding = 0;
+    for (int k = 0; k < 4; k++) {
+      char c = text[i + k];
+      if (c == '=' && i + 4 == length && k >= 2) {
+        v[k] = 0;
+        padding++;
+      } else {
+        if (padding > 0) return -1;
+        v[k] = base64Value(c);
+        if (v[k] < 0) return -1;
+      }
+    }
+    uint32_t n = ((uint32_t)v[0] << 18) | ((uint32_t)v[1] << 12) | ((uint32_t)v[2] << 6) | v[3];
+    int bytes = 3 - padding;
+    if (o + bytes > maxLength) return -1;
+    out[o++] = (n >> 16) & 0xFF;
+    if (bytes > 1) out[o++] = (n >> 8) & 0xFF;
+    if (bytes > 2) out[o++] = n & 0xFF;
+  }
+  return (int)o;
+}
+
+// La UART es de la Orange Pi salvo durante un volcado de captura o en Modbus
+static bool isUartAvailable() {
+  return !isCaptureStreaming() && !isModbusActive();
+}
+
+static void bridgeWrite(const uint8_t *data, size_t length) {
+  char line[(MQTT_BRIDGE_CHUNK / 3) * 4 + 1];
+  for (size_t offset = 0; offset < length; offset += MQTT_BRIDGE_CHUNK) {
+    size_t chunk = min((size_t)MQTT_BRIDGE_CHUNK, length - offset);
+    base64Encode(data + offset, chunk, line);
+    OrangePiSerial.print("BRIDGE:D:");
+    OrangePiSerial.println(line);
+  }
+  lastTxMs = monoMillis();
+}
+
+// ========== Paquetes MQTT salientes ==========
+
+static void bodyBegin() {
+  packetLength = 5;
+}
+
+static void putByte(uint8_t value) {
+  if (packetLength < sizeof(packet)) packet[packetLength++] = value;
+}
+
+static void putWord(uint16_t value) {
+  putByte(value >> 8);
+  putByte(value & 0xFF);
+}
+
+static void putBytes(const void *data, size_t length) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  for (size_t i = 0; i < length; i++) putByte(bytes[i]);
+}
+
+static void putString(const char *text) {
+  size_t length = strlen(text);
+  putWord((uint16_t)length);
+  putBytes(text, length);
+}
+
+// Antepone la cabecera fija (tipo + longitud restante) y envía por el túnel
+static void sendPacket(uint8_t header) {
+  uint32_t remaining = packetLength - 5;
+  uint8_t encoded[4];
+  size_t encodedLength = 0;
+  do {
+    uint8_t digit = remaining % 128;
+    remaining /= 128;
+    if (remaining > 0) digit |= 0x80;
+    encoded[encodedLength++] = digit;
+  } while (remaining > 0);
+
+  size_t start = 5 - 1 - encodedLength;
+  packet[start] = header;
+  memcpy(packet + start + 1, encoded, encodedLength);
+  bridgeWrite(packet + start, packetLength - start);
+}
+
+static void sendConnect() {
+  char topic[MQTT_TOPIC_MAX + 8];
+  snprintf(topic, sizeof(topic), "%s/status", mqttTopic.c_str());
+
+  bodyBegin();
+  putString("MQTT");
+  putByte(4);                       // MQTT 3.1.1
+  putByte(0x26);                    // Sesión limpia, último deseo retenido con QoS 0
+  putWord(MQTT_KEEPALIVE_S);
+  putString(mqttTopic.c_str());     // Client id
+  putString(topic);
+  putWord(7);
+  putBytes("offline", 7);
+  sendPacket(MQTT_CONNECT);
+}
+
+static void sendPublish(const char *suffix, const char *data, size_t length, bool retain, uint16_t packetId) {
+  char topic[MQTT_TOPIC_MAX + 12];
+  snprintf(topic, sizeof(topic), "%s/%s", mqttTopic.c_str(), suffix);
+
+  bodyBegin();
+  putString(topic);
+  if (packetId != 0) putWord(packetId);
+  putBytes(data, length);
+  sendPacket(MQTT_PUBLISH | (packetId != 0 ? 0x02 : 0) | (retain ? 0x01 : 0));
+}
+
+static void sendEmpty(uint8_t header) {
+  bodyBegin();
+  sendPacket(header);
+}
+
+// ========== Lotes ==========
+
+static uint16_t toMilli(float value) {
+  if (isnan(value) || isinf(value) || value <= 0) return 0;
+  return (uint16_t)min(value * 1000.0f + 0.5f, 65535.0f);
+}
+
+static int16_t toInt16(float value) {
+  if (isnan(value) || isinf(value)) return INT16_MIN;
+  return (int16_t)constrain(lroundf(value), -32767L, 32767L);
+}
+
+static size_t formatBatch(const MqttBatch &item) {
+  size_t length = snprintf(payload, sizeof(payload), "%u,%u,%s,%lu\n",
+                           item.boot, item.sequence, item.wallClock ? "unix" : "uptime",
+                           (unsigned long)item.baseTime);
+  for (uint8_t i = 0; i < item.count && length < sizeof(payload); i++) {
+    const MqttSample &s = item.samples[i];
+    length += snprintf(payload + length, sizeof(payload) - length, "%u,%u,%u,%d,%d,%u,%u,%d\n",
+                       s.offset, s.panel_mV, s.battery_mV, s.charge_mA, s.load_mA,
+                       s.pwm, s.state, s.temperature_dC);
+  }
+  return min(length, sizeof(payload) - 1);
+}
+
+static void publishInflight() {
+  size_t length = formatBatch(inflight);
+  inflightPacketId = nextPacketId++;
+  if (nextPacketId == 0) nextPacketId = 1;
+  sendPublish("telemetry", payload, length, false, inflightPacketId);
+  inflightActive = true;
+  inflightSentMs = monoMillis();
+}
+
+// Sale directo si la sesión está libre; si no, a la cola para mantener el orden
+static void closeBatch() {
+  if (batch.count == 0) return;
+  if (mqttState == MQTT_CONNECTED && !inflightActive && queueCount == 0 && isUartAvailable()) {
+    inflight = batch;
+    inflightFromQueue = false;
+    publishInflight();
+  } else {
+    queueInsert(batch, false);
+  }
+  batch.count = 0;
+}
+
+static bool exceedsDeadband(const MeasurementSnapshot &m) {
+  return m.state != lastSampled.state ||
+         abs(m.pwm - lastSampled.pwm) >= MQTT_DEADBAND_PWM ||
+         fabs(m.voltagePanel - lastSampled.voltagePanel) * 1000.0f > MQTT_DEADBAND_MV ||
+         fabs(m.voltageBattery - lastSampled.voltageBattery) * 1000.0f > MQTT_DEADBAND_MV ||
+         fabs(m.panelToBatteryCurrent - lastSampled.panelToBatteryCurrent) > MQTT_DEADBAND_MA ||
+         fabs(m.batteryToLoadCurrent - lastSampled.batteryToLoadCurrent) > MQTT_DEADBAND_MA;
+}
+
+void mqttRecordMeasurement(const BusEvent &event) {
+  if (mqttState == MQTT_DISABLED) return;
+  const MeasurementSnapshot &m = event.measurement;
+  if (!m.valid) return;
+
+  uint64_t now = monoMillis();
+  if (hasLastSampled && now - lastSampleMs < (uint64_t)mqttInterval * 1000 && !exceedsDeadband(m)) {
+    return;
+  }
+  lastSampled = m;
+  hasLastSampled = true;
+  lastSampleMs = now;
+
+  // Un lote no mezcla relojes: si el reloj se sincroniza, se cierra
+  bool synced = isWallClockSynced();
+  uint32_t nowSeconds = (uint32_t)((synced ? wallClockMillis() : now) / 1000);
+  if (batch.count > 0 && (batch.wallClock != synced || nowSeconds < batch.baseTime)) {
+    closeBatch();
+  }
+  if (batch.count == 0) {
+    batch.baseTime = nowSeconds;
+    batch.wallClock = synced;
+    batch.boot = bootCount;
+    batch.sequence = nextSequence++;
+    batchOpenedMs = now;
+  }
+
+  MqttSample &s = batch.samples[batch.count++];
+  s.offset = (uint16_t)min(nowSeconds - batch.baseTime, (uint32_t)65535);
+  s.panel_mV = toMilli(m.voltagePanel);
+  s.battery_mV = toMilli(m.voltageBattery);
+  s.charge_mA = toInt16(m.panelToBatteryCurrent);
+  s.load_mA = toInt16(m.batteryToLoadCurrent);
+  s.temperature_dC = toInt16(m.temperature * 10.0f);
+  s.pwm = (uint8_t)constrain(m.pwm, 0, 255);
+  s.state = (uint8_t)m.state;
+
+  if (batch.count == MQTT_BATCH_SAMPLES) closeBatch();
+}
+
+// ========== Sesión ==========
+
+static void resetReceiver() {
+  rxState = RX_HEADER;
+  rxBodyLength = 0;
+}
+
+// Cierra el túnel y devuelve a la cola el lote sin PUBACK
+static void closeSession() {
+  if (mqttState >= MQTT_WAIT_BRIDGE && isUartAvailable()) {
+    if (mqttState == MQTT_CONNECTED) sendEmpty(MQTT_DISCONNECT);
+    OrangePiSerial.println("BRIDGE:CLOSE");
+  }
+  // Es más antiguo que todo lo encolado
+  if (inflightActive && !inflightFromQueue) queueInsert(inflight, true);
+  inflightActive = false;
+  pingPending = false;
+}
+
+static void dropSession(const char *reason) {
+  bool open = mqttState >= MQTT_WAIT_BRIDGE;
+  closeSession();
+  if (open) {
+    Serial.printf("⚠️ [MQTT] %s - reintento en %lu s\n", reason, (unsigned long)(retryDelayMs / 1000));
+  }
+  mqttState = MQTT_WAIT_RETRY;
+  stateSinceMs = monoMillis();
+  retryAtMs = stateSinceMs + retryDelayMs;
+  retryDelayMs = min(retryDelayMs * 2, (uint32_t)MQTT_RETRY_MAX_MS);
+}
+
+static void onConnected() {
+  uint64_t now = monoMillis();
+  mqttState = MQTT_CONNECTED;
+  stateSinceMs = now;
+  retryDelayMs = MQTT_RETRY_MIN_MS;
+  lastDrainMs = now - MQTT_DRAIN_INTERVAL_MS;
+  sendPublish("status", "online", 6, true, 0);
+  Serial.printf("📡 [MQTT] Conectado al broker (%u lotes en cola)\n", (unsigned)queueCount);
+}
+
+static void handlePacket() {
+  switch (rxHeader & 0xF0) {
+    case MQTT_CONNACK:
+      if (mqttState != MQTT_WAIT_CONNACK) break;
+      if (rxBodyLength >= 2 && rxBody[1] == 0) {
+        onConnected();
+      } else {
+        dropSession("Conexión rechazada por el broker");
+      }
+      break;
+    case MQTT_PUBACK:
+      if (rxBodyLength >= 2 && inflightActive &&
+          (uint16_t)((rxBody[0] << 8) | rxBody[1]) == inflightPacketId) {
+        inflightActive = false;
+        publishedBatches++;
+        if (inflightFromQueue) queuePop();
+      }
+      break;
+    case MQTT_PINGRESP:
+      pingPending = false;
+      break;
+    default:
+      break;                        // PUBLISH u otros: la sesión no se suscribe a nada
+  }
+}
+
+static void receiveByte(uint8_t value) {
+  switch (rxState) {
+    case RX_HEADER:
+      rxHeader = value;
+      rxRemaining = 0;
+      rxMultiplier = 1;
+      rxBodyLength = 0;
+      rxState = RX_LENGTH;
+      break;
+    case RX_LENGTH:
+      rxRemaining += (value & 0x7F) * rxMultiplier;
+      rxMultiplier *= 128;
+      if ((value & 0x80) == 0) {
+        if (rxRemaining == 0) {
+          handlePacket();
+          rxState = RX_HEADER;
+        } else {
+          rxState = RX_BODY;
+        }
+      } else if (rxMultiplier > 128UL * 128 * 128) {
+        dropSession("Paquete MQTT mal formado");
+      }
+      break;
+    case RX_BODY:
+      if (rxBodyLength < sizeof(rxBody)) rxBody[rxBodyLength++] = value;
+      if (--rxRemaining == 0) {
+        rxState = RX_HEADER;
+        handlePacket();
+      }
+      break;
+  }
+}
+
+void handleBridgeCommand(const String &args) {
+  if (args == "UP") {
+    if (mqttState != MQTT_WAIT_BRIDGE) return;
+    resetReceiver();
+    sendConnect();
+    mqttState = MQTT_WAIT_CONNACK;
+    stateSinceMs = monoMillis();
+  } else if (args == "DOWN") {
+    if (mqttState >= MQTT_WAIT_BRIDGE) dropSession("Túnel cerrado por la Orange Pi");
+  } else if (args.startsWith("D:")) {
+    if (mqttState < MQTT_WAIT_CONNACK) return;
+    uint8_t data[MQTT_BRIDGE_CHUNK + 3];
+    int length = base64Decode(args.c_str() + 2, args.length() - 2, data, sizeof(data));
+    if (length < 0) {
+      Serial.println("⚠️ [MQTT] Bloque del túnel no es base64 válido");
+      return;
+    }
+    for (int i = 0; i < length && mqttState >= MQTT_WAIT_CONNACK; i++) receiveByte(data[i]);
+  }
+}
+
+void mqttService() {
+  if (mqttState == MQTT_DISABLED) return;
+  uint64_t now = monoMillis();
+
+  if (batch.count > 0 && now - batchOpenedMs >= (uint64_t)MQTT_BATCH_MAX_AGE_S * 1000) closeBatch();
+
+  if (isCaptureStreaming()) return;           // El túnel espera al final del volcado
+  if (isModbusActive()) {
+    if (mqttState != MQTT_WAIT_RETRY) dropSession("UART en modo Modbus");
+    return;
+  }
+
+  switch (mqttState) {
+    case MQTT_WAIT_RETRY:
+      if (now >= retryAtMs) {
+        OrangePiSerial.println("BRIDGE:OPEN");
+        mqttState = MQTT_WAIT_BRIDGE;
+        stateSinceMs = now;
+      }
+      break;
+
+    case MQTT_WAIT_BRIDGE:
+    case MQTT_WAIT_CONNACK:
+      if (now - stateSinceMs >= MQTT_RESPONSE_TIMEOUT_MS) {
+        dropSession(mqttState == MQTT_WAIT_BRIDGE ? "Túnel sin respuesta" : "Broker sin CONNACK");
+      }
+      break;
+
+    case MQTT_CONNECTED:
+      if (inflightActive && now - inflightSentMs >= MQTT_RESPONSE_TIMEOUT_MS) {
+        dropSession("PUBACK sin llegar");
+        break;
+      }
+      if (pingPending && now - pingSentMs >= MQTT_RESPONSE_TIMEOUT_MS) {
+        dropSession("PINGRESP sin llegar");
+        break;
+      }
+      if (!inflightActive && queueCount > 0 && now - lastDrainMs >= MQTT_DRAIN_INTERVAL_MS) {
+        lastDrainMs = now;
+        if (queuePeek(inflight)) {
+          inflightFromQueue = true;
+          publishInflight();
+        } else {
+          Serial.println("⚠️ [MQTT] Lote ilegible en la cola, descartado");
+          queuePop();
+        }
+      }
+      if (!pingPending && now - lastTxMs >= (uint64_t)MQTT_KEEPALIVE_S * 500) {
+        sendEmpty(MQTT_PINGREQ);
+        pingPending = true;
+        pingSentMs = now;
+      }
+      break;
+
+    default:
+      break;
+  }
+}
+
+String buildMqttJson() {
+  String json;
+  json.reserve(256);
+  json += "{\"enabled\":";
+  json += mqttState != MQTT_DISABLED ? "true" : "false";
+  json += ",\"state\":\"";
+  json += MQTT_STATE_NAMES[mqttState];
+  json += "\",\"topic\":\"";
+  json += mqttTopic;
+  json += "\",\"interval\":";
+  json += String(mqttInterval);
+  json += ",\"boot\":";
+  json += String(bootCount);
+  json += ",\"queued\":";
+  json += String(queueCount);
+  json += ",\"queueSlots\":";
+  json += String(MQTT_QUEUE_SLOTS);
+  json += ",\"dropped\":";
+  json += String(droppedBatches);
+  json += ",\"published\":";
+  json += String(publishedBatches);
+  json += ",\"batchSamples\":";
+  json += String(batch.count);
+  json += ",\"inflight\":";
+  json += inflightActive ? "true" : "false";
+  json += "}";
+  return json;
+}
@@ -0,0 +1,70 @@
+#ifndef MQTT_PUBLISHER_H
+#define MQTT_PUBLISHER_H
+
+#include <Arduino.h>
+#include "config.h"
+#include "event_bus.h"
+
+// Publicador de telemetría MQTT 3.1.1 (CMD:MQTT:ON). La radio del equipo es
+// un softAP local que se apaga de noche, así que el broker se alcanza por la
+// UART de la Orange Pi: el ESP32 lleva la sesión MQTT completa y la Orange
+// Pi solo reenvía bytes por un socket TCP (túnel BRIDGE):
+//   ESP32 -> Orange Pi   BRIDGE:OPEN | BRIDGE:CLOSE | BRIDGE:D:<base64>
+//   Orange Pi -> ESP32   CMD:BRIDGE:UP | CMD:BRIDGE:DOWN | CMD:BRIDGE:D:<base64>
+// Las líneas CMD:BRIDGE no tienen respuesta y llevan como mucho
+// MQTT_BRIDGE_CHUNK bytes.
+//
+// Una muestra cada mqttInterval segundos, o antes si la etapa, el PWM, un
+// voltaje o una corriente se mueven más que su banda muerta (como mucho una
+// por ciclo de control). MQTT_BATCH_SAMPLES muestras forman un lote que se
+// publica con QoS 1 en <mqttTopic>/telemetry:
+//   <arranque>,<lote>,<unix|uptime>,<t0 s>
+//   <dt s>,<panel mV>,<batería mV>,<carga mA>,<consumo mA>,<pwm>,<etapa>,<°C x10>
+//   ...
+// Sin broker los lotes se guardan en NVS (espacio "mqttq", cola circular de
+// MQTT_QUEUE_SLOTS lotes; llena, se descarta el más antiguo) y al reconectar
+// se vacía a un lote cada MQTT_DRAIN_INTERVAL_MS. Cada lote se borra solo
+// tras su PUBACK. <mqttTopic>/status queda retenido en "online", y el último
+// deseo lo pasa a "offline".
+#define MQTT_DEFAULT_TOPIC "cargador"
+#define MQTT_TOPIC_MAX 23                 // También es el client id (límite de MQTT 3.1.1)
+#define MQTT_DEFAULT_INTERVAL_S 30
+#define MQTT_MIN_INTERVAL_S 5
+#define MQTT_MAX_INTERVAL_S 3600
+#define MQTT_BATCH_SAMPLES 8
+#define MQTT_BATCH_MAX_AGE_S 300          // Un lote incompleto se cierra a esta edad
+#define MQTT_DEADBAND_MV 50
+#define MQTT_DEADBAND_MA 200
+#define MQTT_DEADBAND_PWM 16
+#define MQTT_QUEUE_SLOTS 48               // ~5 entradas de NVS por lote
+#define MQTT_DRAIN_INTERVAL_MS 3000       // Ritmo de vaciado: ~15 % de la UART a 9600 baudios
+#define MQTT_KEEPALIVE_S 120
+#define MQTT_RESPONSE_TIMEOUT_MS 15000    // Túnel, CONNACK, PUBACK y PINGRESP
+#define MQTT_RETRY_MIN_MS 5000
+#define MQTT_RETRY_MAX_MS 300000
+#define MQTT_BRIDGE_CHUNK 96              // Bytes por línea (128 caracteres base64)
+#define MQTT_PACKET_MAX 512
+
+extern String mqttTopic;
+extern uint16_t mqttInterval;             // s entre muestras sin cambios
+
+void mqttBegin();                         // Configuración y cola guardadas
+void mqttSetEnabled(bool enabled);        // Persistido
+bool isMqttEnabled();
+bool isMqttConnected();
+void mqttRestart();                       // Reabre la sesión (p. ej. tras cambiar el tema)
+bool isValidMqttTopic(const String &topic); // 1..MQTT_TOPIC_MAX de [A-Za-z0-9_-]
+
+// Suscriptor de EVENT_MEASUREMENT: muestrea y cierra lotes
+void mqttRecordMeasurement(const BusEvent &event);
+
+// Sesión, reintentos, keepalive y vaciado de la cola. Llamar desde loop().
+void mqttService();
+
+// CMD:BRIDGE:<args> de la Orange Pi ("UP", "DOWN" o "D:<base64>")
+void handleBridgeCommand(const String &args);
+
+// CMD:MQTT:STATUS
+String buildMqttJson();
+
+#endif
@@ -12,13 +12,19 @@ import threading
 from datetime import datetime
 import argparse
 from dataclasses import dataclass
-from typing import Optional, Dict, Any
+from typing import Optional, Dict, Any, List
+from collections import deque
 import logging
 from http.server import HTTPServer, BaseHTTPRequestHandler
 import socketserver
 import urllib.parse
 import os
 import functools
+import binascii
+import struct
+import base64
+import socket
+from telemetry import decode_data
 
 # Configuración de logging
 logging.basicConfig(
@@ -36,6 +42,102 @@ class ESP32Config:
     max_retries: int = 3
     command_delay: float = 0.5
     heartbeat_interval: float = 30.0
+    mqtt_broker: Optional[str] = None   # host[:puerto] para el túnel MQTT del ESP32
+
+class MqttBridge:
+    """Túnel TCP del publicador MQTT del ESP32 (mqtt_publisher.h).
+
+    El ESP32 lleva la sesión MQTT completa; aquí solo se reenvían bytes entre
+    la UART y un socket TCP al broker:
+      BRIDGE:OPEN / BRIDGE:CLOSE / BRIDGE:D:<base64>    ESP32 -> Orange Pi
+      CMD:BRIDGE:UP / CMD:BRIDGE:DOWN / CMD:BRIDGE:D:<base64>    Orange Pi -> ESP32
+    Sin broker configurado cada BRIDGE:OPEN se contesta con CMD:BRIDGE:DOWN
+    y el ESP32 guarda los lotes en su cola.
+    """
+    CHUNK = 96  # MQTT_BRIDGE_CHUNK del firmware
+
+    def __init__(self, monitor: 'ESP32Monitor', broker: Optional[str]):
+        self.monitor = monitor
+        self.address = None
+        if broker:
+            host, _, port = broker.partition(':')
+            self.address = (host, int(port) if port else 1883)
+        self.sock: Optional[socket.socket] = None
+        self.sock_lock = threading.Lock()
+
+    def handle_line(self, line: str) -> bool:
+        """Atender una línea BRIDGE: del ESP32. False si no es del túnel."""
+        if not line.startswith("BRIDGE:"):
+            return False
+        if line == "BRIDGE:OPEN":
+            # La conexión puede tardar: fuera del hilo que lee la UART
+            threading.Thread(target=self._open, daemon=True).start()
+        elif line == "BRIDGE:CLOSE":
+            self._close()
+        elif line.startswith("BRIDGE:D:"):
+            try:
+                data = base64.b64decode(line[9:], validate=True)
+            except binascii.Error:
+                logger.warning(f"⚠️ Bloque del túnel MQTT no es base64: {line}")
+                return True
+            with self.sock_lock:
+                sock = self.sock
+            if sock is None:
+                return True
+            try:
+                sock.sendall(data)
+            except OSError as e:
+                logger.warning(f"⚠️ Túnel MQTT: error enviando al broker: {e}")
+                self._lost(sock)
+        return True
+
+    def _open(self):
+        self._close()
+        if self.address is None:
+            self.monitor.write_line("CMD:BRIDGE:DOWN")
+            return
+        try:
+            sock = socket.create_connection(self.address, timeout=5)
+            sock.settimeout(None)
+        except OSError as e:
+            logger.warning(f"⚠️ Túnel MQTT: broker {self.address[0]}:{self.address[1]} inaccesible: {e}")
+            self.monitor.write_line("CMD:BRIDGE:DOWN")
+            return
+        with self.sock_lock:
+            self.sock = sock
+        logger.info(f"📡 Túnel MQTT abierto hacia {self.address[0]}:{self.address[1]}")
+        self.monitor.write_line("CMD:BRIDGE:UP")
+        threading.Thread(target=self._reader, args=(sock,), daemon=True).start()
+
+    def _close(self):
+        with self.sock_lock:
+            sock, self.sock = self.sock, None
+        if sock is not None:
+            try:
+                sock.close()
+            except OSError:
+                pass
+
+    def _lost(self, sock: socket.socket):
+        """El broker cerró la conexión: se avisa al ESP32 una sola vez"""
+        with self.sock_lock:
+            if self.sock is not sock:
+                return
+            self.sock = None
+        sock.close()
+        logger.warning("⚠️ Túnel MQTT cerrado por el broker")
+        self.monitor.write_line("CMD:BRIDGE:DOWN")
+
+    def _reader(self, sock: socket.socket):
+        while True:
+            try:
+                data = sock.recv(self.CHUNK)
+            except OSError:
+                data = b''
+            if not data:
+                self._lost(sock)
+                return
+            self.monitor.write_line("CMD:BRIDGE:D:" + base64.b64encode(data).decode('ascii'))
 
 class ESP32Monitor:
     """Monitor robusto para comunicación con ESP32"""
@@ -47,7 +149,13 @@ class ESP32Monitor:
         self.last_data: Dict[str, Any] = {}
         self.last_command_time = 0
         self.lock = threading.Lock()
+        # Toda la E/S serial: las líneas BRIDGE: y ALARM: llegan en cualquier momento
+        self.io_lock = threading.RLock()
         self.running = False
+        self.bridge = MqttBridge(self, config.mqtt_broker)
+        # Alarmas recibidas (ALARM:...), la más reciente al final
+        self.alarms = deque(maxlen=100)
+        self.alarm_keys = deque(maxlen=100)
         
     def connect(self) -> bool:
         """Establecer conexión serial con reintentos"""
@@ -67,10 +175,12 @@ class ESP32Monitor:
                 
                 self.serial_conn.reset_input_buffer()
                 self.serial_conn.reset_output_buffer()
+                self.start_listener()
                 
                 if self._send_command_raw("CMD:GET_DATA", expect_response=False):
                     self.connected = True
                     logger.info(f"✅ Conectado al ESP32 en {self.config.port}")
+                    self.sync_time()
                     return True
                     
             except Exception as e:
@@ -80,6 +190,16 @@ class ESP32Monitor:
         self.connected = False
         return False
     
+    def sync_time(self) -> bool:
+        """Sincronizar el reloj de pared del ESP32 (CMD:SET_TIME)"""
+        time.sleep(self.config.command_delay)
+        response = self._send_command_raw(f"CMD:SET_TIME:{int(time.time())}")
+        if response and response.startswith("OK:"):
+            logger.info("🕒 Reloj del ESP32 sincronizado")
+            return True
+        logger.warning(f"⚠️ No se pudo sincronizar el reloj del ESP32: {response}")
+        return False
+    
     def disconnect(self):
         """Cerrar conexión serial"""
         self.running = False
@@ -96,32 +216,109 @@ class ESP32Monitor:
                 time.sleep(self.config.command_delay - elapsed)
             self.last_command_time = time.time()
     
+    def _read_line(self) -> str:
+        """Leer una línea del ESP32; las del túnel MQTT y las alarmas se atienden y devuelven ''"""
+        line = self.serial_conn.readline().decode('utf-8', errors='ignore').strip()
+        if self.bridge.handle_line(line) or self._handle_alarm(line):
+            return ""
+        return line
+
+    def _handle_alarm(self, line: str) -> bool:
+        """Confirmar una trama ALARM:<seq>:<prioridad>:<código>:<valor>:<t s>:<envío>.
+
+        El ESP32 la reenvía hasta recibir CMD:ACK:<seq>; los reenvíos de una
+        alarma ya registrada solo se vuelven a confirmar.
+        """
+        if not line.startswith("ALARM:"):
+            return False
+        fields = line[6:].split(':')
+        try:
+            seq, priority, code, value, uptime, sends = fields
+            alarm = {'seq': int(seq), 'priority': priority, 'code': code, 'value': float(value),
+                     'uptime': int(uptime), 'received': datetime.now().isoformat()}
+        except ValueError:
+            logger.warning(f"⚠️ Trama de alarma mal formada: {line}")
+            return True
+        self.write_line(f"CMD:ACK:{alarm['seq']}")
+        key = (alarm['seq'], code, alarm['uptime'])
+        if key in self.alarm_keys:
+            return True
+        self.alarm_keys.append(key)
+        self.alarms.append(alarm)
+        log = logger.error if priority == "CRITICAL" else logger.warning
+        log(f"🚨 Alarma #{seq} {priority} {code} = {value}")
+        return True
+
+    def get_alarms(self) -> List[Dict[str, Any]]:
+        """Alarmas recibidas desde el arranque del monitor (las últimas 100)"""
+        return list(self.alarms)
+
+    def _drain_input(self):
+        """Descartar respuestas atrasadas sin perder las líneas del túnel"""
+        while self.serial_conn.in_waiting > 0:
+            self._read_line()
+
+    def write_line(self, line: str) -> bool:
+        """Enviar una línea sin esperar respuesta (CMD:BRIDGE:...)"""
+        with self.io_lock:
+            if not self.serial_conn or not self.serial_conn.is_open:
+                return False
+            try:
+                self.serial_conn.write(f"{line}\n".encode('utf-8'))
+                self.serial_conn.flush()
+                return True
+            except Exception as e:
+                logger.error(f"❌ Error enviando '{line}': {e}")
+                return False
+
+    def start_listener(self):
+        """Atender las líneas BRIDGE: y ALARM: mientras no haya un comando en curso"""
+        if self.running:
+            return
+        self.running = True
+        threading.Thread(target=self._listen_loop, daemon=True).start()
+
+    def _listen_loop(self):
+        while self.running:
+            if self.io_lock.acquire(blocking=False):
+                try:
+                    if self.serial_conn and self.serial_conn.is_open and self.serial_conn.in_waiting > 0:
+                        line = self._read_line()
+                        if line:
+                            logger.debug(f"Línea sin comando en curso: {line}")
+                except Exception as e:
+                    logger.debug(f"Error leyendo la UART: {e}")
+                finally:
+                    self.io_lock.release()
+            time.sleep(0.05)
+
     def _send_command_raw(self, command: str, expect_response: bool = True) -> Optional[str]:
         """Enviar comando raw al ESP32 con manejo de errores"""
         if not self.serial_conn or not self.serial_conn.is_open:
             return None
             
         try:
-            self.serial_conn.reset_input_buffer()
-            cmd_bytes = f"{command}\n".encode('utf-8')
-            self.serial_conn.write(cmd_bytes)
-            self.serial_conn.flush()
-            
-            if not expect_response:
-                return "OK"
-            
-            response = ""
-            start_time = time.time()
-            
-            while time.time() - start_time < self.config.timeout:
-                if self.serial_conn.in_waiting > 0:
-                    line = self.serial_conn.readline().decode('utf-8', errors='ignore').strip()
-                    if line:
-                        response = line
-                        break
-                time.sleep(0.01)
-            
-            return response if response else None
+            with self.io_lock:
+                self._drain_input()
+                cmd_bytes = f"{command}\n".encode('utf-8')
+                self.serial_conn.write(cmd_bytes)
+                self.serial_conn.flush()
+                
+                if not expect_response:
+                    return "OK"
+                
+                response = ""
+                start_time = time.time()
+                
+                while time.time() - start_time < self.config.timeout:
+                    if self.serial_conn.in_waiting > 0:
+                        line = self._read_line()
+                        if line:
+                            response = line
+                            break
+                    time.sleep(0.01)
+                
+                return response if response else None
             
         except Exception as e:
             logger.error(f"❌ Error enviando comando '{command}': {e}")
@@ -150,19 +347,16 @@ class ESP32Monitor:
     def get_data(self) -> Optional[Dict[str, Any]]:
         """Obtener datos del ESP32"""
         response = self.send_command("CMD:GET_DATA")
-        if not response or not response.startswith("DATA:"):
-            return None
-            
-        try:
-            json_str = response[5:]
-            data = json.loads(json_str)
-            data['connected'] = True
-            data['last_update'] = datetime.now().isoformat()
-            self.last_data = data
-            return data
-        except json.JSONDecodeError as e:
-            logger.error(f"❌ Error decodificando JSON: {e}")
+        data = decode_data(response)
+        if data is None:
+            if response:
+                logger.error(f"❌ Error decodificando JSON: {response[:200]}")
             return None
+
+        data['connected'] = True
+        data['last_update'] = datetime.now().isoformat()
+        self.last_data = data
+        return data
     
     def set_parameter(self, parameter: str, value: Any) -> bool:
         """Establecer un parámetro en el ESP32"""
@@ -207,6 +401,184 @@ class ESP32Monitor:
             logger.error(f"❌ Error cancelando apagado temporal: {response}")
             return False
 
+    def run_benchmark(self) -> Optional[Dict[str, Any]]:
+        """Ejecutar CMD:BENCH y devolver los resultados por prueba"""
+        response = self.send_command("CMD:BENCH")
+        if not response or not response.startswith("BENCH:"):
+            logger.error(f"❌ Error ejecutando benchmark: {response}")
+            return None
+
+        try:
+            return json.loads(response[6:])
+        except json.JSONDecodeError as e:
+            logger.error(f"❌ Error decodificando benchmark: {e}")
+            return None
+
+    def run_sampling_test(self) -> Optional[Dict[str, Any]]:
+        """Ejecutar CMD:SAMPLING_TEST y devolver el ruido medido en cada modo"""
+        response = self.send_command("CMD:SAMPLING_TEST")
+        if not response or not response.startswith("SAMPLING_TEST:"):
+            logger.error(f"❌ Error en prueba de muestreo: {response}")
+            return None
+
+        try:
+            return json.loads(response[14:])
+        except json.JSONDecodeError as e:
+            logger.error(f"❌ Error decodificando prueba de muestreo: {e}")
+            return None
+
+    def get_regulation(self) -> Optional[Dict[str, Any]]:
+        """Métricas de calidad de la regulación por etapa (CMD:REGULATION)"""
+        response = self.send_command("CMD:REGULATION")
+        if not response or not response.startswith("REGULATION:"):
+            logger.error(f"❌ Error leyendo métricas de regulación: {response}")
+            return None
+
+        try:
+            return json.loads(response[11:])
+        except json.JSONDecodeError as e:
+            logger.error(f"❌ Error decodificando métricas de regulación: {e}")
+            return None
+
+    def set_trace(self, enabled: bool) -> bool:
+        """Iniciar/detener la grabación de trazas (CMD:TRACE:ON/OFF).
+
+        La traza sale por la UART1 del ESP32 (GPIO10, 921600 baudios), no por
+        este puerto; se reproduce con tools/replay/trace_replay.
+        """
+        response = self.send_command("CMD:TRACE:ON" if enabled else "CMD:TRACE:OFF")
+        if response and response.startswith("OK:"):
+            logger.info(f"✅ {response[3:]}")
+            return True
+        logger.error(f"❌ Error en grabación de traza: {response}")
+        return False
+
+    def get_heap_stats(self) -> Optional[Dict[str, Any]]:
+        """Asignaciones de heap por región (CMD:HEAP; activar con set_heap_tracking)"""
+        response = self.send_command("CMD:HEAP")
+        if not response or not response.startswith("HEAP:"):
+            logger.error(f"❌ Error leyendo estadísticas de heap: {response}")
+            return None
+
+        try:
+            return json.loads(response[5:])
+        except json.JSONDecodeError as e:
+            logger.error(f"❌ Error decodificando estadísticas de heap: {e}")
+            return None
+
+    def set_heap_tracking(self, enabled: bool) -> bool:
+        """Iniciar/detener la contabilidad de heap (CMD:HEAP:ON/OFF)"""
+        response = self.send_command("CMD:HEAP:ON" if enabled else "CMD:HEAP:OFF")
+        if response and response.startswith("OK:"):
+            logger.info(f"✅ {response[3:]}")
+            return True
+        logger.error(f"❌ Error en contabilidad de heap: {response}")
+        return False
+
+    def get_mqtt_status(self) -> Optional[Dict[str, Any]]:
+        """Estado del publicador MQTT y de su cola (CMD:MQTT:STATUS)"""
+        response = self.send_command("CMD:MQTT:STATUS")
+        if not response or not response.startswith("MQTT:"):
+            logger.error(f"❌ Error leyendo estado MQTT: {response}")
+            return None
+
+        try:
+            return json.loads(response[5:])
+        except json.JSONDecodeError as e:
+            logger.error(f"❌ Error decodificando estado MQTT: {e}")
+            return None
+
+    def set_mqtt(self, enabled: bool) -> bool:
+        """Activar/desactivar el publicador MQTT del ESP32 (CMD:MQTT:ON/OFF)"""
+        response = self.send_command("CMD:MQTT:ON" if enabled else "CMD:MQTT:OFF")
+        if response and response.startswith("OK:"):
+            logger.info(f"✅ {response[3:]}")
+            return True
+        logger.error(f"❌ Error en publicador MQTT: {response}")
+        return False
+
+    def run_autotune(self, wait: float = 360.0) -> Optional[Dict[str, Any]]:
+        """Ejecutar CMD:AUTOTUNE y esperar el resultado del ensayo de relé"""
+        response = self.send_command("CMD:AUTOTUNE")
+        if not response or not response.startswith("OK:"):
+            logger.error(f"❌ Error iniciando autoajuste: {response}")
+            return None
+
+        try:
+            deadline = time.time() + wait
+            with self.io_lock:
+                while time.time() < deadline:
+                    line = self._read_line()
+                    if line.startswith("AUTOTUNE:"):
+                        return json.loads(line[9:])
+        except Exception as e:
+            logger.error(f"❌ Error leyendo resultado del autoajuste: {e}")
+            return None
+
+        logger.error("❌ El autoajuste no respondió a tiempo")
+        return None
+
+    # Escala de cada canal de CMD:CAPTURE (valor crudo -> unidad física)
+    CAPTURE_SCALES = {'V': 0.004, 'P': 0.004, 'I': 1.0, 'L': 1.0, 'D': 1.0}
+
+    def run_capture(self, channels: str, rate: int, frames: int, trigger: str = "NOW",
+                    pretrigger: Optional[int] = None, wait: float = 660.0) -> Optional[Dict[str, Any]]:
+        """Ejecutar CMD:CAPTURE y leer el volcado binario.
+
+        Devuelve la cabecera y una lista de valores por canal: V/P en voltios,
+        I/L en mA (shunt de 10 mΩ) y D como ciclo de trabajo 0-255.
+        """
+        command = f"CMD:CAPTURE:{channels}:{rate}:{frames}:{trigger}"
+        if pretrigger is not None:
+            command += f":{pretrigger}"
+        response = self.send_command(command)
+        if not response or not response.startswith("OK:"):
+            logger.error(f"❌ Error armando captura: {response}")
+            return None
+
+        # Hasta el trailer la UART es del volcado (el firmware detiene el túnel)
+        self.io_lock.acquire()
+        try:
+            deadline = time.time() + wait
+            header = None
+            while time.time() < deadline:
+                line = self._read_line()
+                if line.startswith("CAPTURE:TIMEOUT"):
+                    logger.warning("⏰ Captura sin disparo")
+                    return None
+                if line.startswith("CAPTURE:BEGIN:"):
+                    header = dict(item.split('=', 1) for item in line[14:].split(','))
+                    break
+            if header is None:
+                logger.error("❌ No llegó la cabecera de la captura")
+                return None
+
+            size = int(header['bytes'])
+            payload = b''
+            while len(payload) < size and time.time() < deadline:
+                payload += self.serial_conn.read(size - len(payload))
+            trailer = b''
+            while not trailer.strip() and time.time() < deadline:
+                trailer = self.serial_conn.readline()
+            trailer = trailer.decode('utf-8', errors='ignore').strip()
+            if len(payload) != size or not trailer.startswith("CAPTURE:END:crc="):
+                logger.error(f"❌ Volcado de captura incompleto ({len(payload)}/{size} bytes)")
+                return None
+            if binascii.crc_hqx(payload, 0xFFFF) != int(trailer[16:], 16):
+                logger.error("❌ CRC de la captura no coincide")
+                return None
+        except Exception as e:
+            logger.error(f"❌ Error leyendo captura: {e}")
+            return None
+        finally:
+            self.io_lock.release()
+
+        names = header['channels']
+        raw = struct.unpack(f"<{size // 2}h", payload)
+        data = {name: [raw[i] * self.CAPTURE_SCALES[name] for i in range(k, len(raw), len(names))]
+                for k, name in enumerate(names)}
+        return {'header': header, 'channels': data}
+
 class WebHandler(BaseHTTPRequestHandler):
     """Manejador HTTP para la interfaz web"""
     
@@ -218,6 +590,13 @@ class WebHandler(BaseHTTPRequestHandler):
             self.end_headers()
             self.wfile.write(self.get_html().encode('utf-8'))
         
+        elif self.path == '/api/alarms':
+            self.send_response(200)
+            self.send_header('Content-type', 'application/json')
+            self.send_header('Access-Control-Allow-Origin', '*')
+            self.end_headers()
+            self.wfile.write(json.dumps(self.server.monitor.get_alarms()).encode('utf-8'))
+
         elif self.path == '/api/data':
             self.send_response(200)
             self.send_header('Content-type', 'application/json')
@@ -778,6 +1157,7 @@ def main():
     parser.add_argument('--baudrate', type=int, default=9600, help='Velocidad serial (default: 9600)')
     parser.add_argument('--web-host', default='0.0.0.0', help='Dirección del servidor web (default: 0.0.0.0)')
     parser.add_argument('--web-port', type=int, default=8080, help='Puerto del servidor web (default: 8080)')
+    parser.add_argument('--mqtt-broker', help='Broker MQTT host[:puerto] para el túnel del ESP32 (CMD:MQTT:ON)')
     parser.add_argument('--debug', action='store_true', help='Habilitar logging debug')
     
     args = parser.parse_args()
@@ -789,7 +1169,8 @@ def main():
     config = ESP32Config(
         port=args.port,
         baudrate=args.baudrate,
-        command_delay=0.5
+        command_delay=0.5,
+        mqtt_broker=args.mqtt_broker
     )
     
     # Crear monitor
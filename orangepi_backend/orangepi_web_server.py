@@ -14,6 +14,7 @@ from datetime import datetime, timedelta
 from flask import Flask, render_template, request, jsonify, send_file
 from flask_cors import CORS
 import io
+from telemetry import decode_data
 
 # Configuración de logging
 logging.basicConfig(
@@ -169,28 +170,23 @@ class ChargerController:
     def request_data(self):
         """Solicitar datos actuales del ESP32"""
         response = self.send_command("GET_DATA")
-        if response and response.startswith("DATA:"):
-            try:
-                json_str = response[5:]  # Remover "DATA:"
-                new_data = json.loads(json_str)
-                
-                with self.lock:
-                    # Actualizar solo los campos recibidos
-                    for key, value in new_data.items():
-                        self.data[key] = value
-                    
-                    # Actualizar metadatos
-                    self.data['last_update'] = datetime.now().isoformat()
-                    self.data['connected'] = True
-                    
-                logger.debug(f"📊 Datos actualizados: {len(new_data)} campos")
-                return True
-                
-            except json.JSONDecodeError as e:
-                logger.error(f"❌ Error al decodificar JSON: {e}")
+        new_data = decode_data(response)  # "{...}" o "DATA:{...}"
+        if new_data is None:
+            if response:
+                logger.error("❌ Error al decodificar JSON")
                 logger.error(f"Respuesta recibida: {response}")
-                return False
-        return False
+            return False
+
+        with self.lock:
+            # Actualizar solo los campos recibidos
+            self.data.update(new_data)
+
+            # Actualizar metadatos
+            self.data['last_update'] = datetime.now().isoformat()
+            self.data['connected'] = True
+
+        logger.debug(f"📊 Datos actualizados: {len(new_data)} campos")
+        return True
     
     def set_parameter(self, parameter, value):
         """Establecer un parámetro en el ESP32"""
@@ -0,0 +1,222 @@
+#!/usr/bin/env python3
+"""
+Decodificación de la telemetría del ESP32 (respuesta a CMD:GET_DATA)
+
+Usa libesp32telemetry.so (tools/telemetry, generada desde telemetry_schema.h)
+por ctypes: la lista de campos y sus tipos se leen de la propia biblioteca,
+así que aquí no se repite el esquema. Sin la biblioteca se recurre a
+json.loads con el mismo resultado.
+
+    cmake -S tools/telemetry -B build-telemetry && cmake --build build-telemetry
+    ESP32_TELEMETRY_LIB=build-telemetry/libesp32telemetry.so python3 esp32_web_monitor.py
+
+    python3 telemetry.py --lib <.so> <muestra.json>   # compara con json.loads y mide
+"""
+
+import ctypes
+import json
+import logging
+import operator
+import os
+import sys
+import time
+from typing import Any, Dict, List, Optional, Tuple
+
+logger = logging.getLogger(__name__)
+
+LIB_NAME = "libesp32telemetry.so"
+TYPE_FLOAT, TYPE_INT, TYPE_BOOL, TYPE_TEXT = range(4)
+
+
+class TelemetryCodec:
+    """Decodificador/codificador C con la interfaz de json.loads/json.dumps"""
+
+    def __init__(self, path: str):
+        lib = ctypes.CDLL(path)
+        lib.telemetryDecode.argtypes = [ctypes.c_char_p, ctypes.c_size_t, ctypes.c_void_p]
+        lib.telemetryDecode.restype = ctypes.c_int
+        lib.telemetryEncode.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t]
+        lib.telemetryEncode.restype = ctypes.c_int
+        lib.telemetryFieldName.argtypes = [ctypes.c_int]
+        lib.telemetryFieldName.restype = ctypes.c_char_p
+        lib.telemetryRecordSize.restype = ctypes.c_size_t
+        self.lib = lib
+        self.path = path
+
+        count = lib.telemetryFieldCount()
+        text_count = lib.telemetryTextCount()
+        text_size = lib.telemetryTextSize()
+        present_words = (count + 31) // 32
+
+        class Record(ctypes.Structure):
+            _fields_ = [('present', ctypes.c_uint32 * present_words),
+                        ('values', ctypes.c_double * count),
+                        ('text', (ctypes.c_char * text_size) * text_count)]
+
+        if ctypes.sizeof(Record) != lib.telemetryRecordSize():
+            raise OSError(f"{path}: TelemetryRecord no coincide")
+        self.Record = Record
+        self.names: List[str] = [lib.telemetryFieldName(i).decode() for i in range(count)]
+        self.types: List[int] = [lib.telemetryFieldType(i) for i in range(count)]
+        self.slots: List[int] = [lib.telemetryTextSlot(i) for i in range(count)]
+        # Conversión por tipo con itemgetter/map/zip: sin bucle Python por campo
+        by_type = {kind: [i for i in range(count) if self.types[i] == kind] for kind in range(4)}
+        self.float_names = [self.names[i] for i in by_type[TYPE_FLOAT]]
+        self.int_names = [self.names[i] for i in by_type[TYPE_INT]]
+        self.bool_names = [self.names[i] for i in by_type[TYPE_BOOL]]
+        self.get_floats = operator.itemgetter(*by_type[TYPE_FLOAT])
+        self.get_ints = operator.itemgetter(*by_type[TYPE_INT])
+        self.get_bools = operator.itemgetter(*by_type[TYPE_BOOL])
+        self.texts: List[Tuple[int, str]] = [(self.slots[i], self.names[i]) for i in by_type[TYPE_TEXT]]
+        self.encode_buffer = ctypes.create_string_buffer(8192)
+
+    def decode(self, line: str) -> Optional[Dict[str, Any]]:
+        """Diccionario de los campos presentes (None si no es un objeto JSON)"""
+        raw = line.encode('utf-8')
+        record = self.Record()   # Uno por llamada: ctypes suelta el GIL durante la decodificación
+        count = self.lib.telemetryDecode(raw, len(raw), ctypes.byref(record))
+        if count < 0:
+            return None
+        values = record.values[:]
+        texts = record.text
+        if count == len(self.names):
+            data = dict(zip(self.float_names, self.get_floats(values)))
+            data.update(zip(self.int_names, map(int, self.get_ints(values))))
+            data.update(zip(self.bool_names, map(bool, self.get_bools(values))))
+            for slot, name in self.texts:
+                data[name] = texts[slot].value.decode('utf-8', 'replace')
+            return data
+        # Firmware con otro esquema: solo los campos leídos, en el orden del esquema
+        present = record.present[:]
+        data = {}
+        for i, name in enumerate(self.names):
+            if not present[i // 32] >> (i % 32) & 1:
+                continue
+            kind = self.types[i]
+            if kind == TYPE_TEXT:
+                data[name] = texts[self.slots[i]].value.decode('utf-8', 'replace')
+            elif kind == TYPE_INT:
+                data[name] = int(values[i])
+            elif kind == TYPE_BOOL:
+                data[name] = values[i] != 0
+            else:
+                data[name] = values[i]
+        return data
+
+    def encode(self, data: Dict[str, Any]) -> str:
+        """JSON compacto en el formato del firmware (las claves fuera del esquema se ignoran)"""
+        record = self.Record()
+        for i, name in enumerate(self.names):
+            value = data.get(name)
+            if value is None:
+                continue
+            if self.types[i] == TYPE_TEXT:
+                record.text[self.slots[i]].value = str(value).encode('utf-8')[:len(record.text[0]) - 1]
+            else:
+                record.values[i] = float(value)
+        length = self.lib.telemetryEncode(ctypes.byref(record), self.encode_buffer, len(self.encode_buffer))
+        if length < 0:
+            raise ValueError("La telemetría no cabe en el buffer de codificación")
+        return self.encode_buffer.raw[:length].decode('utf-8')
+
+
+class JsonCodec:
+    """Misma interfaz con json.loads cuando no está la biblioteca"""
+
+    path = None
+
+    def decode(self, line: str) -> Optional[Dict[str, Any]]:
+        if line.startswith("DATA:"):
+            line = line[5:]
+        try:
+            data = json.loads(line)
+        except json.JSONDecodeError:
+            return None
+        return data if isinstance(data, dict) else None
+
+    def encode(self, data: Dict[str, Any]) -> str:
+        return json.dumps(data, separators=(',', ':'))
+
+
+def _library_candidates() -> List[str]:
+    here = os.path.dirname(os.path.abspath(__file__))
+    candidates = [os.environ.get("ESP32_TELEMETRY_LIB", "")]
+    candidates.append(os.path.join(here, LIB_NAME))
+    candidates.append(os.path.join(here, "..", "build-telemetry", LIB_NAME))
+    return [path for path in candidates if path]
+
+
+def load_codec(path: Optional[str] = None):
+    """TelemetryCodec si se encuentra la biblioteca; si no, JsonCodec"""
+    for candidate in [path] if path else _library_candidates():
+        if not os.path.exists(candidate):
+            continue
+        try:
+            codec = TelemetryCodec(candidate)
+            logger.info(f"📦 Telemetría decodificada con {candidate}")
+            return codec
+        except (OSError, AttributeError) as e:
+            logger.warning(f"⚠️ No se pudo cargar {candidate}: {e}")
+    if path:
+        raise OSError(f"No se pudo cargar {path}")
+    logger.info("📦 Telemetría decodificada con json.loads (sin libesp32telemetry.so)")
+    return JsonCodec()
+
+
+codec = load_codec()
+
+
+def decode_data(response: Optional[str]) -> Optional[Dict[str, Any]]:
+    """Respuesta a CMD:GET_DATA ("{...}" o "DATA:{...}") -> diccionario o None"""
+    if not response:
+        return None
+    return codec.decode(response)
+
+
+def _self_test(lib_path: str, sample_path: str, iterations: int) -> int:
+    native = load_codec(lib_path)
+    with open(sample_path, encoding='utf-8') as f:
+        sample = f.read().strip()
+
+    reference = JsonCodec().decode(sample)
+    decoded = native.decode(sample)
+    failures = 0
+    if decoded != reference:
+        failures += 1
+        for key in sorted(set(reference) | set(decoded or {})):
+            if (decoded or {}).get(key) != reference.get(key):
+                print(f"✗ {key}: {(decoded or {}).get(key)!r} != {reference.get(key)!r}")
+    else:
+        print(f"✓ {len(decoded)} campos iguales a json.loads")
+    if native.encode(decoded or {}) != sample:
+        failures += 1
+        print("✗ encode(decode(x)) != x")
+    else:
+        print("✓ encode(decode(x)) == x")
+    if native.decode("DATA:" + sample) != reference or native.decode(sample[:-1]) is not None:
+        failures += 1
+        print("✗ prefijo DATA: o JSON truncado")
+    else:
+        print("✓ prefijo DATA: y JSON truncado")
+
+    for name, fn in (("json.loads", reference_decode), ("ctypes", native.decode)):
+        start = time.perf_counter()
+        for _ in range(iterations):
+            fn(sample)
+        elapsed = time.perf_counter() - start
+        print(f"  {name:<10} {elapsed / iterations * 1e6:7.2f} µs por respuesta ({len(sample)} bytes)")
+    return 1 if failures else 0
+
+
+def reference_decode(line: str) -> Dict[str, Any]:
+    return json.loads(line)
+
+
+if __name__ == "__main__":
+    import argparse
+    parser = argparse.ArgumentParser(description="Comprueba libesp32telemetry.so contra json.loads")
+    parser.add_argument('--lib', required=True, help='Ruta de libesp32telemetry.so')
+    parser.add_argument('--iterations', type=int, default=20000)
+    parser.add_argument('sample', help='Respuesta a CMD:GET_DATA guardada en un fichero')
+    args = parser.parse_args()
+    sys.exit(_self_test(args.lib, args.sample, args.iterations))
@@ -14,6 +14,7 @@ import argparse
 from dataclasses import dataclass
 from typing import Optional, Dict, Any
 import logging
+from telemetry import decode_data
 
 # Configuración de logging
 logging.basicConfig(
@@ -151,18 +152,15 @@ class ESP32Monitor:
     def get_data(self) -> Optional[Dict[str, Any]]:
         """Obtener datos del ESP32"""
         response = self.send_command("CMD:GET_DATA")
-        if not response or not response.startswith("DATA:"):
-            return None
-            
-        try:
-            json_str = response[5:]  # Remover "DATA:"
-            data = json.loads(json_str)
-            self.last_data = data
-            return data
-        except json.JSONDecodeError as e:
-            logger.error(f"❌ Error decodificando JSON: {e}")
-            logger.error(f"Respuesta recibida: {response[:200]}...")
+        data = decode_data(response)  # "{...}" o "DATA:{...}"
+        if data is None:
+            if response:
+                logger.error("❌ Error decodificando JSON")
+                logger.error(f"Respuesta recibida: {response[:200]}...")
             return None
+
+        self.last_data = data
+        return data
     
     def set_parameter(self, parameter: str, value: Any) -> bool:
         """Establecer un parámetro en el ESP32"""
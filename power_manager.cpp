@@ -0,0 +1,93 @@
+#include "power_manager.h"
+#include "esp_sleep.h"
+#include "esp_timer.h"
+#include "driver/uart.h"
+#include "driver/gpio.h"
+
+extern HardwareSerial OrangePiSerial;
+
+bool nightModeActive = false;
+float selfConsumption_mA = SELF_CURRENT_ACTIVE_MA;
+float awakeDutyPercent = 100.0;
+
+static int nightConfirmCount = 0;
+
+// Contabilidad de tiempo despierto/dormido en modo nocturno (µs)
+static int64_t lastWakeUs = 0;
+static int64_t windowAwakeUs = 0;
+static int64_t windowSleepUs = 0;
+const int64_t CONSUMPTION_WINDOW_US = 60000000LL; // Ventana de 1 minuto
+
+bool shouldEnterNightMode(float panelVoltage, float batteryVoltage, float panelCurrent) {
+  if (panelVoltage < batteryVoltage - NIGHT_ENTER_MARGIN && panelCurrent <= NIGHT_ENTER_CURRENT) {
+    nightConfirmCount++;
+  } else {
+    nightConfirmCount = 0;
+  }
+  return nightConfirmCount >= NIGHT_CONFIRM_TICKS;
+}
+
+bool shouldExitNightMode(float panelVoltage, float batteryVoltage) {
+  return panelVoltage > batteryVoltage + NIGHT_EXIT_MARGIN;
+}
+
+void configureNightWakeSources() {
+  // UART0 (Orange Pi): despierta tras 3 flancos en RX. Los bytes que provocan
+  // el despertar se pierden; el Orange Pi reintenta el comando.
+  uart_set_wakeup_threshold(UART_NUM_0, 3);
+  esp_sleep_enable_uart_wakeup(UART_NUM_0);
+
+  // Botón de usuario (activo en bajo)
+  pinMode(USER_BUTTON_PIN, INPUT_PULLUP);
+  gpio_wakeup_enable((gpio_num_t)USER_BUTTON_PIN, GPIO_INTR_LOW_LEVEL);
+  esp_sleep_enable_gpio_wakeup();
+
+  nightConfirmCount = 0;
+  lastWakeUs = esp_timer_get_time();
+  windowAwakeUs = 0;
+  windowSleepUs = 0;
+}
+
+void releaseNightWakeSources() {
+  gpio_wakeup_disable((gpio_num_t)USER_BUTTON_PIN);
+  esp_sleep_disable_wakeup_source(ESP_SLEEP_WAKEUP_ALL);
+  nightConfirmCount = 0;
+  selfConsumption_mA = SELF_CURRENT_ACTIVE_MA;
+  awakeDutyPercent = 100.0;
+}
+
+static void updateConsumptionWindow() {
+  int64_t total = windowAwakeUs + windowSleepUs;
+  if (total < CONSUMPTION_WINDOW_US) return;
+
+  awakeDutyPercent = (windowAwakeUs * 100.0) / total;
+  selfConsumption_mA = (windowAwakeUs * SELF_CURRENT_AWAKE_MA + windowSleepUs * SELF_CURRENT_SLEEP_MA) / total;
+  windowAwakeUs = 0;
+  windowSleepUs = 0;
+}
+
+void nightLightSleep(unsigned long ms) {
+  if (ms == 0) return;
+
+  // Vaciar buffers antes de detener los relojes de la UART
+  Serial.flush();
+  OrangePiSerial.flush();
+
+  int64_t sleepStart = esp_timer_get_time();
+  windowAwakeUs += sleepStart - lastWakeUs;
+
+  // Mantener el estado de la salida de carga mientras se duerme
+  gpio_hold_en((gpio_num_t)LOAD_CONTROL_PIN);
+  esp_sleep_enable_timer_wakeup((uint64_t)ms * 1000ULL);
+  esp_light_sleep_start();
+  gpio_hold_dis((gpio_num_t)LOAD_CONTROL_PIN);
+
+  lastWakeUs = esp_timer_get_time();
+  windowSleepUs += lastWakeUs - sleepStart;
+  updateConsumptionWindow();
+}
+
+float getPowerReductionFactor() {
+  if (selfConsumption_mA <= 0) return 1.0;
+  return SELF_CURRENT_ACTIVE_MA / selfConsumption_mA;
+}
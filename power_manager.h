@@ -0,0 +1,28 @@
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Estado del modo nocturno
+extern bool nightModeActive;
+
+// Consumo propio estimado del cargador (mA) a partir del tiempo despierto/dormido
+extern float selfConsumption_mA;
+extern float awakeDutyPercent;
+
+// Detección con histéresis: panel por debajo de la batería durante NIGHT_CONFIRM_TICKS
+bool shouldEnterNightMode(float panelVoltage, float batteryVoltage, float panelCurrent);
+bool shouldExitNightMode(float panelVoltage, float batteryVoltage);
+
+// Configuran/retiran las fuentes de despertar (UART, botón y temporizador)
+void configureNightWakeSources();
+void releaseNightWakeSources();
+
+// Light sleep hasta 'ms' milisegundos; devuelve antes si llega UART o el botón
+void nightLightSleep(unsigned long ms);
+
+// Relación entre el consumo diurno y el nocturno actual
+float getPowerReductionFactor();
+
+#endif
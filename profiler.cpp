@@ -0,0 +1,132 @@
+#include "profiler.h"
+
+struct ProfileBucket {
+  uint32_t pc;
+  uint32_t count;     // 0 = libre
+};
+
+static ProfileBucket buckets[PROFILER_BUCKETS];
+static volatile uint32_t totalSamples = 0;
+static volatile uint32_t droppedSamples = 0;
+static volatile uint32_t usedBuckets = 0;
+
+static hw_timer_t *profileTimer = NULL;
+static uint32_t profileHz = 0;
+
+// Volcado en curso (profilerDumpService)
+static bool dumping = false;
+static bool dumpHeaderSent = false;
+static int dumpIndex = 0;
+
+static inline uint32_t IRAM_ATTR readInterruptedPc() {
+  uint32_t pc = 0;
+#if defined(__riscv)
+  asm volatile("csrr %0, mepc" : "=r"(pc));
+#elif defined(__XTENSA__)
+  asm volatile("rsr %0, epc1" : "=r"(pc));
+  pc = (pc & 0x3FFFFFFF) | 0x40000000; // Los 2 bits altos guardan el incremento de ventana
+#endif
+  return pc;
+}
+
+static void IRAM_ATTR profilerIsr() {
+  uint32_t pc = readInterruptedPc();
+  totalSamples++;
+
+  // Hash multiplicativo de Knuth; las instrucciones están alineadas a 2 bytes
+  uint32_t slot = ((pc >> 1) * 2654435761u) >> (32 - PROFILER_BUCKET_BITS);
+  for (int i = 0; i < PROFILER_MAX_PROBE; i++) {
+    ProfileBucket &bucket = buckets[(slot + i) & (PROFILER_BUCKETS - 1)];
+    if (bucket.count == 0) {
+      bucket.pc = pc;
+      bucket.count = 1;
+      usedBuckets++;
+      return;
+    }
+    if (bucket.pc == pc) {
+      bucket.count++;
+      return;
+    }
+  }
+  droppedSamples++;
+}
+
+bool profilerStart(uint32_t sampleHz) {
+  if (profileTimer != NULL || dumping) {
+    return false;
+  }
+  memset(buckets, 0, sizeof(buckets));
+  totalSamples = 0;
+  droppedSamples = 0;
+  usedBuckets = 0;
+  profileHz = constrain(sampleHz, 1u, (uint32_t)PROFILER_MAX_HZ);
+
+  profileTimer = timerBegin(1000000); // Base de 1 MHz
+  if (profileTimer == NULL) {
+    Serial.println("❌ [Profiler] No hay temporizador hardware disponible");
+    return false;
+  }
+  timerAttachInterrupt(profileTimer, &profilerIsr);
+  timerAlarm(profileTimer, 1000000 / profileHz, true, 0);
+  Serial.println("📊 [Profiler] Muestreando a " + String(profileHz) + " Hz");
+  return true;
+}
+
+void profilerStop() {
+  if (profileTimer == NULL) {
+    return;
+  }
+  timerEnd(profileTimer);
+  profileTimer = NULL;
+  Serial.println("📊 [Profiler] Captura detenida: " + String(totalSamples) + " muestras, " +
+                 String(usedBuckets) + " PCs distintos, " + String(droppedSamples) + " descartadas");
+}
+
+bool isProfilerRunning() {
+  return profileTimer != NULL;
+}
+
+void profilerDumpBegin() {
+  dumping = true;
+  dumpHeaderSent = false;
+  dumpIndex = 0;
+}
+
+bool isProfilerDumping() {
+  return dumping;
+}
+
+bool profilerDumpService(HardwareSerial &out) {
+  if (!dumping) {
+    return false;
+  }
+#if defined(__riscv)
+  const char *arch = "riscv";
+#elif defined(__XTENSA__)
+  const char *arch = "xtensa";
+#else
+  const char *arch = "unknown";
+#endif
+
+  // Solo lo que cabe en el búfer de transmisión, como el volcado de captura:
+  // a 9600 baudios los 512 PCs tardan más de 10 s
+  if (!dumpHeaderSent) {
+    if ((size_t)out.availableForWrite() < PROFILER_DUMP_LINE_BYTES) {
+      return true;
+    }
+    out.printf("PROFILE:BEGIN:arch=%s,hz=%u,samples=%u,dropped=%u,buckets=%u\n",
+               arch, (unsigned)profileHz, (unsigned)totalSamples, (unsigned)droppedSamples, (unsigned)usedBuckets);
+    dumpHeaderSent = true;
+  }
+  while (dumpIndex < PROFILER_BUCKETS && (size_t)out.availableForWrite() >= PROFILER_DUMP_LINE_BYTES) {
+    const ProfileBucket &bucket = buckets[dumpIndex++];
+    if (bucket.count == 0) continue;
+    out.printf("PROFILE:PC:0x%08x:%u\n", (unsigned)bucket.pc, (unsigned)bucket.count);
+  }
+  if (dumpIndex < PROFILER_BUCKETS || (size_t)out.availableForWrite() < PROFILER_DUMP_LINE_BYTES) {
+    return true;
+  }
+  out.println("PROFILE:END");
+  dumping = false;
+  return false;
+}
@@ -0,0 +1,34 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+
+// Perfilador por muestreo: una interrupción de temporizador guarda el PC
+// interrumpido (mepc en RISC-V, EPC1 en Xtensa) en un histograma hash de
+// tamaño fijo. El volcado se simboliza en el PC con tools/profiler.
+#define PROFILER_BUCKET_BITS 9
+#define PROFILER_BUCKETS (1 << PROFILER_BUCKET_BITS)
+#define PROFILER_MAX_PROBE 8          // Sondeo lineal máximo antes de descartar
+#define PROFILER_DEFAULT_HZ 1000
+#define PROFILER_MAX_HZ 5000
+#define PROFILER_MAX_SECONDS 300
+#define PROFILER_DUMP_LINE_BYTES 96   // Línea más larga del volcado (la cabecera), con holgura
+
+// Arranca una captura nueva (borra el histograma). false si ya hay una activa
+// o si aún se está volcando la anterior.
+bool profilerStart(uint32_t sampleHz);
+void profilerStop();
+bool isProfilerRunning();
+
+// Vuelca el histograma en texto, una línea por PC:
+//   PROFILE:BEGIN:arch=<riscv|xtensa>,hz=<n>,samples=<n>,dropped=<n>,buckets=<n>
+//   PROFILE:PC:0x<pc>:<muestras>
+//   PROFILE:END
+// profilerDumpBegin() lo prepara tras profilerStop(); profilerDumpService()
+// envía solo lo que cabe en el búfer de la UART y devuelve false al terminar.
+// Llamarlo periódicamente desde la rueda de temporizadores.
+void profilerDumpBegin();
+bool profilerDumpService(HardwareSerial &out);
+bool isProfilerDumping();
+
+#endif
@@ -0,0 +1,150 @@
+#include "regulation_metrics.h"
+#include "sampling.h"
+#include "time_base.h"
+
+struct StageMetrics {
+  RunningStats error;        // V medido - consigna
+  uint32_t inBandTicks;
+  float maxOvershoot;        // V sobre la consigna
+  float seconds;             // Tiempo registrado en la etapa
+  uint32_t pwmReversals;
+  RunningStats settling;     // s hasta REGULATION_SETTLE_TICKS en banda
+  float settlingMax;
+  uint32_t entries;          // Transiciones hacia la etapa
+  uint32_t unsettled;        // Transiciones que salieron sin asentarse
+};
+
+static StageMetrics stages[REGULATION_STAGES];
+static uint64_t resetAtMs = 0;
+
+// Seguimiento de la estancia actual
+static bool tracking = false;
+static ChargeState trackedState = BULK_CHARGE;
+static bool measureSettling = false;
+static bool settled = false;
+static float secondsSinceEntry = 0.0;
+static uint8_t inBandStreak = 0;
+static int lastPwm = 0;
+static int lastDirection = 0;
+
+void regulationReset() {
+  for (int i = 0; i < REGULATION_STAGES; i++) {
+    StageMetrics &m = stages[i];
+    statsReset(m.error);
+    statsReset(m.settling);
+    m.inBandTicks = 0;
+    m.maxOvershoot = 0.0;
+    m.seconds = 0.0;
+    m.pwmReversals = 0;
+    m.settlingMax = 0.0;
+    m.entries = 0;
+    m.unsettled = 0;
+  }
+  tracking = false;
+  resetAtMs = monoMillis();
+}
+
+void regulationPause() {
+  if (tracking && measureSettling && !settled) {
+    stages[trackedState].unsettled++;
+  }
+  tracking = false;
+}
+
+void regulationRecord(ChargeState state, float setpoint, float batteryVoltage, int pwm, float tickSeconds) {
+  if (state != BULK_CHARGE && state != ABSORPTION_CHARGE && state != FLOAT_CHARGE) {
+    regulationPause();
+    return;
+  }
+  StageMetrics &m = stages[state];
+
+  if (!tracking || state != trackedState) {
+    if (tracking && measureSettling && !settled) {
+      stages[trackedState].unsettled++;
+    }
+    // Solo una transición entre etapas mide asentamiento (no el arranque ni
+    // la vuelta de una pausa)
+    measureSettling = tracking;
+    if (measureSettling) {
+      m.entries++;
+    }
+    tracking = true;
+    trackedState = state;
+    settled = false;
+    secondsSinceEntry = 0.0;
+    inBandStreak = 0;
+    lastPwm = pwm;
+    lastDirection = 0;
+  }
+
+  float error = batteryVoltage - setpoint;
+  bool inBand = fabs(error) <= REGULATION_BAND_V;
+  statsAdd(m.error, error);
+  m.seconds += tickSeconds;
+  secondsSinceEntry += tickSeconds;
+  if (inBand) {
+    m.inBandTicks++;
+  }
+  if (error > m.maxOvershoot) {
+    m.maxOvershoot = error;
+  }
+
+  // Inversión: el PWM cambia de sentido respecto al último movimiento
+  int delta = pwm - lastPwm;
+  if (delta != 0) {
+    int direction = delta > 0 ? 1 : -1;
+    if (lastDirection != 0 && direction != lastDirection) {
+      m.pwmReversals++;
+    }
+    lastDirection = direction;
+  }
+  lastPwm = pwm;
+
+  if (measureSettling && !settled) {
+    inBandStreak = inBand ? inBandStreak + 1 : 0;
+    if (inBandStreak >= REGULATION_SETTLE_TICKS) {
+      settled = true;
+      // Se cuenta hasta el primer ciclo de la racha en banda
+      float settlingSeconds = secondsSinceEntry - (REGULATION_SETTLE_TICKS - 1) * tickSeconds;
+      statsAdd(m.settling, settlingSeconds);
+      m.settlingMax = max(m.settlingMax, settlingSeconds);
+    }
+  }
+}
+
+static String stageToJson(const StageMetrics &m) {
+  uint32_t n = m.error.count;
+  float rms = n > 0 ? sqrt(m.error.mean * m.error.mean + m.error.m2 / n) : 0.0;
+  float minutes = m.seconds / 60.0;
+
+  String json = "{";
+  json += "\"samples\":" + String(n) + ",";
+  json += "\"inBandPercent\":" + String(n > 0 ? 100.0 * m.inBandTicks / n : 0.0, 1) + ",";
+  json += "\"meanError_mV\":" + String(m.error.mean * 1000.0, 1) + ",";
+  json += "\"rmsError_mV\":" + String(rms * 1000.0, 1) + ",";
+  json += "\"errorStd_mV\":" + String(statsStdDev(m.error) * 1000.0, 1) + ",";
+  json += "\"maxOvershoot_mV\":" + String(m.maxOvershoot * 1000.0, 0) + ",";
+  json += "\"pwmReversals\":" + String(m.pwmReversals) + ",";
+  json += "\"reversalsPerMinute\":" + String(minutes > 0 ? m.pwmReversals / minutes : 0.0, 2) + ",";
+  json += "\"entries\":" + String(m.entries) + ",";
+  json += "\"settled\":" + String(m.settling.count) + ",";
+  json += "\"unsettled\":" + String(m.unsettled) + ",";
+  json += "\"settlingMean_s\":" + String(m.settling.mean, 1) + ",";
+  json += "\"settlingStd_s\":" + String(statsStdDev(m.settling), 1) + ",";
+  json += "\"settlingMax_s\":" + String(m.settlingMax, 1) + ",";
+  json += "\"minutes\":" + String(minutes, 1);
+  json += "}";
+  return json;
+}
+
+String buildRegulationJson() {
+  String json = "{";
+  json += "\"sinceResetSeconds\":" + String((uint32_t)((monoMillis() - resetAtMs) / 1000)) + ",";
+  json += "\"bandV\":" + String(REGULATION_BAND_V, 3) + ",";
+  json += "\"stages\":{";
+  json += "\"BULK_CHARGE\":" + stageToJson(stages[BULK_CHARGE]) + ",";
+  json += "\"ABSORPTION_CHARGE\":" + stageToJson(stages[ABSORPTION_CHARGE]) + ",";
+  json += "\"FLOAT_CHARGE\":" + stageToJson(stages[FLOAT_CHARGE]);
+  json += "}}";
+  return json;
+}
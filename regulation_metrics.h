@@ -0,0 +1,28 @@
+#ifndef REGULATION_METRICS_H
+#define REGULATION_METRICS_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Calidad de la regulación por etapa (BULK, ABSORPTION, FLOAT), acumulada en
+// memoria constante con Welford: banda de ±50 mV, error RMS, sobreimpulso
+// máximo, inversiones de sentido del PWM por minuto y tiempo de asentamiento
+// tras cada transición. Comparable entre versiones de firmware y parámetros.
+#define REGULATION_BAND_V 0.05            // Banda alrededor de la consigna
+#define REGULATION_SETTLE_TICKS 10        // Ciclos seguidos en banda para "asentado"
+#define REGULATION_STAGES 3               // BULK, ABSORPTION, FLOAT
+
+// Un ciclo de control: la etapa, su consigna, el voltaje medido y el PWM
+// aplicado. Los estados fuera de las tres etapas no se registran.
+void regulationRecord(ChargeState state, float setpoint, float batteryVoltage, int pwm, float tickSeconds);
+
+// Interrumpe el seguimiento (noche, autoajuste): la próxima muestra cuenta
+// como una entrada nueva en la etapa, sin medir su asentamiento
+void regulationPause();
+
+void regulationReset();
+
+// {"sinceResetSeconds":...,"stages":{"BULK_CHARGE":{...},...}}
+String buildRegulationJson();
+
+#endif
@@ -0,0 +1,191 @@
+#include "ripple_analyzer.h"
+#include "event_bus.h"
+#include "time_base.h"
+
+static int16_t samples_mV[RIPPLE_FFT_SIZE];   // Ventana circular
+static uint32_t sampleCount = 0;
+static ChargeState windowState = BULK_CHARGE;
+
+static int16_t twiddleCos[RIPPLE_FFT_SIZE / 2];
+static int16_t twiddleSin[RIPPLE_FFT_SIZE / 2];
+static int16_t hannWindow[RIPPLE_FFT_SIZE];
+static bool tablesReady = false;
+
+static uint8_t oscillatingWindows = 0;
+static RippleReport report = {0.0, 0.0, 0.0, 100, false, 0, 0};
+
+static void buildTables() {
+  if (tablesReady) return;
+  for (int k = 0; k < RIPPLE_FFT_SIZE / 2; k++) {
+    float angle = 2.0 * PI * k / RIPPLE_FFT_SIZE;
+    twiddleCos[k] = (int16_t)constrain(lroundf(cosf(angle) * 32767.0), -32767L, 32767L);
+    twiddleSin[k] = (int16_t)constrain(lroundf(sinf(angle) * 32767.0), -32767L, 32767L);
+  }
+  for (int i = 0; i < RIPPLE_FFT_SIZE; i++) {
+    hannWindow[i] = (int16_t)lroundf(0.5 * (1.0 - cosf(2.0 * PI * i / RIPPLE_FFT_SIZE)) * 32767.0);
+  }
+  tablesReady = true;
+}
+
+void fftQ15(int16_t *re, int16_t *im, int bits) {
+  buildTables();
+  int n = 1 << bits;
+
+  // Permutación por inversión de bits
+  for (int i = 1, j = 0; i < n; i++) {
+    int bit = n >> 1;
+    for (; j & bit; bit >>= 1) {
+      j ^= bit;
+    }
+    j |= bit;
+    if (i < j) {
+      int16_t t = re[i]; re[i] = re[j]; re[j] = t;
+      t = im[i]; im[i] = im[j]; im[j] = t;
+    }
+  }
+
+  // Mariposas con W = e^(-j2πk/size); el >>1 por etapa evita el desborde
+  for (int size = 2; size <= n; size <<= 1) {
+    int half = size >> 1;
+    int step = RIPPLE_FFT_SIZE / size;
+    for (int start = 0; start < n; start += size) {
+      for (int k = 0; k < half; k++) {
+        int32_t wr = twiddleCos[k * step];
+        int32_t wi = -twiddleSin[k * step];
+        int a = start + k;
+        int b = a + half;
+        int32_t tr = (wr * re[b] - wi * im[b]) >> 15;
+        int32_t ti = (wr * im[b] + wi * re[b]) >> 15;
+        int32_t ar = re[a];
+        int32_t ai = im[a];
+        re[b] = (int16_t)((ar - tr) >> 1);
+        im[b] = (int16_t)((ai - ti) >> 1);
+        re[a] = (int16_t)((ar + tr) >> 1);
+        im[a] = (int16_t)((ai + ti) >> 1);
+      }
+    }
+  }
+}
+
+static void publishOscillationChange() {
+  OscillationEvent oscillation;
+  oscillation.frequencyHz = report.frequencyHz;
+  oscillation.amplitude_mV = report.amplitude_mV;
+  oscillation.stabilityScore = report.stabilityScore;
+  oscillation.active = report.oscillating;
+  publishOscillation(oscillation);
+}
+
+// Sin ventana no hay medida: el informe vuelve a "estable" y, si había una
+// oscilación activa, se publica su fin
+void rippleReset() {
+  sampleCount = 0;
+  oscillatingWindows = 0;
+  bool wasOscillating = report.oscillating;
+  report.frequencyHz = 0.0;
+  report.amplitude_mV = 0.0;
+  report.tonality = 0.0;
+  report.stabilityScore = 100;
+  report.oscillating = false;
+  if (wasOscillating) {
+    publishOscillationChange();
+  }
+}
+
+static void analyzeWindow(float sampleRateHz) {
+  uint64_t start = monoMicros();
+  buildTables();
+  int16_t re[RIPPLE_FFT_SIZE];
+  int16_t im[RIPPLE_FFT_SIZE];
+
+  // La muestra más antigua está en sampleCount % N
+  int32_t sum = 0;
+  for (int i = 0; i < RIPPLE_FFT_SIZE; i++) {
+    sum += samples_mV[i];
+  }
+  int32_t mean = sum / RIPPLE_FFT_SIZE;
+  int32_t maxDeviation = 0;
+  for (int i = 0; i < RIPPLE_FFT_SIZE; i++) {
+    maxDeviation = max(maxDeviation, abs(samples_mV[i] - mean));
+  }
+
+  report.analyses++;
+  if (maxDeviation == 0) {
+    report.frequencyHz = 0.0;
+    report.amplitude_mV = 0.0;
+    report.tonality = 0.0;
+    report.stabilityScore = 100;
+  } else {
+    // Normalizar a ~2^14 para aprovechar el rango Q15 pese al escalado 1/N
+    int shift = 0;
+    while ((maxDeviation << (shift + 1)) <= 16383) {
+      shift++;
+    }
+    uint32_t oldest = sampleCount % RIPPLE_FFT_SIZE;
+    for (int i = 0; i < RIPPLE_FFT_SIZE; i++) {
+      int32_t deviation = (samples_mV[(oldest + i) % RIPPLE_FFT_SIZE] - mean) << shift;
+      re[i] = (int16_t)((deviation * hannWindow[i]) >> 15);
+      im[i] = 0;
+    }
+    fftQ15(re, im, RIPPLE_FFT_BITS);
+
+    float power[RIPPLE_FFT_SIZE / 2];
+    float totalPower = 0.0;
+    int peakBin = RIPPLE_MIN_BIN;
+    for (int k = 1; k < RIPPLE_FFT_SIZE / 2; k++) {
+      power[k] = (float)re[k] * re[k] + (float)im[k] * im[k];
+      totalPower += power[k];
+      if (k >= RIPPLE_MIN_BIN && power[k] > power[peakBin]) {
+        peakBin = k;
+      }
+    }
+
+    // Hann: un tono centrado en un bin da |X| = A/4 con el escalado 1/N
+    float peakPower = power[peakBin] + power[peakBin - 1] +
+                      (peakBin + 1 < RIPPLE_FFT_SIZE / 2 ? power[peakBin + 1] : 0.0);
+    report.frequencyHz = peakBin * sampleRateHz / RIPPLE_FFT_SIZE;
+    report.amplitude_mV = 4.0 * sqrtf(power[peakBin]) / (1 << shift);
+    report.tonality = totalPower > 0 ? peakPower / totalPower : 0.0;
+    float severity = min(1.0f, report.amplitude_mV / (float)RIPPLE_OSCILLATION_MV);
+    report.stabilityScore = (uint8_t)lroundf(100.0 * (1.0 - report.tonality * severity));
+  }
+
+  bool windowOscillating = report.amplitude_mV >= RIPPLE_OSCILLATION_MV && report.tonality >= RIPPLE_TONALITY_MIN;
+  if (windowOscillating) {
+    if (oscillatingWindows < RIPPLE_PERSIST_WINDOWS) oscillatingWindows++;
+  } else {
+    oscillatingWindows = 0;
+  }
+
+  bool wasOscillating = report.oscillating;
+  report.oscillating = oscillatingWindows >= RIPPLE_PERSIST_WINDOWS;
+  report.analysisUs = (uint32_t)(monoMicros() - start);
+
+  if (report.oscillating != wasOscillating) {
+    publishOscillationChange();
+  }
+}
+
+bool rippleAddSample(float batteryVoltage, ChargeState state, float sampleRateHz) {
+  if (state != ABSORPTION_CHARGE && state != FLOAT_CHARGE) {
+    rippleReset();
+    return false;
+  }
+  if (state != windowState) {
+    windowState = state;
+    rippleReset();
+  }
+
+  samples_mV[sampleCount % RIPPLE_FFT_SIZE] = (int16_t)constrain(lroundf(batteryVoltage * 1000.0), 0L, 32767L);
+  sampleCount++;
+
+  if (sampleCount < RIPPLE_FFT_SIZE || (sampleCount - RIPPLE_FFT_SIZE) % RIPPLE_HOP != 0) {
+    return false;
+  }
+  analyzeWindow(sampleRateHz);
+  return true;
+}
+
+const RippleReport &getRippleReport() {
+  return report;
+}
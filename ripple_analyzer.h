@@ -0,0 +1,43 @@
+#ifndef RIPPLE_ANALYZER_H
+#define RIPPLE_ANALYZER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Analizador de oscilación del voltaje de batería. Una FFT radix-2 en punto
+// fijo (Q15) sobre una ventana deslizante de las muestras del ciclo de control
+// detecta el "cazado" del PWM alrededor de la consigna en absorción y
+// flotación, que en la media por segundo no se ve.
+#define RIPPLE_FFT_BITS 6
+#define RIPPLE_FFT_SIZE (1 << RIPPLE_FFT_BITS)  // 64 muestras (64 s a 1 Hz)
+#define RIPPLE_HOP 32                           // Análisis cada 32 muestras (50 % de solape)
+#define RIPPLE_MIN_BIN 2                        // Bins 0-1: deriva lenta, no oscilación
+#define RIPPLE_OSCILLATION_MV 30.0              // Amplitud pico mínima de una oscilación
+#define RIPPLE_TONALITY_MIN 0.4                 // Fracción de la energía AC en el pico
+#define RIPPLE_PERSIST_WINDOWS 3                // Análisis seguidos antes de avisar
+
+struct RippleReport {
+  float frequencyHz;        // Componente dominante
+  float amplitude_mV;       // Amplitud pico estimada del bin dominante
+  float tonality;           // Energía del pico (±1 bin) / energía AC total
+  uint8_t stabilityScore;   // 100 = estable, 0 = oscilación franca
+  bool oscillating;         // Oscilación persistente (RIPPLE_PERSIST_WINDOWS)
+  uint32_t analysisUs;      // Coste del último análisis
+  uint32_t analyses;
+};
+
+// Añade la muestra de un ciclo de control. Solo se analizan las etapas
+// reguladas por voltaje; cualquier otra etapa o un cambio de etapa vacía la
+// ventana (rippleReset). Devuelve true si la muestra completó un análisis.
+bool rippleAddSample(float batteryVoltage, ChargeState state, float sampleRateHz);
+// Vacía la ventana y deja el informe en estable; una oscilación activa se da
+// por terminada (EVENT_OSCILLATION inactivo)
+void rippleReset();
+
+const RippleReport &getRippleReport();
+
+// FFT compleja in-place en Q15 con escalado 1/N (un >>1 por etapa).
+// bits <= RIPPLE_FFT_BITS.
+void fftQ15(int16_t *re, int16_t *im, int bits);
+
+#endif
@@ -0,0 +1,98 @@
+#include "sampling.h"
+#include "time_base.h"
+
+SamplingMode samplingMode = (SamplingMode)SAMPLING_DEFAULT_MODE;
+float samplingNoise_mA[2] = {0.0, 0.0};
+
+static bool noiseMeasured[2] = {false, false};
+
+static hw_timer_t *sampleTimer = NULL;
+static volatile uint32_t sampleTrigger = 0;
+
+static void IRAM_ATTR sampleTimerIsr() {
+  sampleTrigger++;
+}
+
+void statsReset(RunningStats &stats) {
+  stats.count = 0;
+  stats.mean = 0.0;
+  stats.m2 = 0.0;
+}
+
+void statsAdd(RunningStats &stats, float value) {
+  stats.count++;
+  double delta = value - stats.mean;
+  stats.mean += delta / stats.count;
+  stats.m2 += delta * (value - stats.mean);
+}
+
+float statsStdDev(const RunningStats &stats) {
+  if (stats.count < 2) return 0.0;
+  return sqrt(stats.m2 / (stats.count - 1));
+}
+
+void samplingBegin() {
+  if (sampleTimer != NULL) return;
+  sampleTimer = timerBegin(1000000); // Base de 1 MHz
+  if (sampleTimer == NULL) {
+    // Sin temporizador se mantiene el espaciado con delayMicroseconds()
+    Serial.println("⚠️ [Muestreo] No hay temporizador hardware, disparo por software");
+    return;
+  }
+  timerStop(sampleTimer);
+  timerAttachInterrupt(sampleTimer, &sampleTimerIsr);
+  timerAlarm(sampleTimer, SYNC_SAMPLE_PERIOD_US, true, 0);
+}
+
+uint32_t getPwmFrequencyForMode(SamplingMode mode) {
+  return mode == SAMPLING_PWM_SYNC ? PWM_SYNC_FREQUENCY : PWM_FREE_RUNNING_FREQUENCY;
+}
+
+void beginSampleWindow() {
+  if (samplingMode != SAMPLING_PWM_SYNC || sampleTimer == NULL) return;
+  timerWrite(sampleTimer, 0);
+  timerStart(sampleTimer);
+}
+
+void waitNextSample() {
+  if (samplingMode != SAMPLING_PWM_SYNC) {
+    delay(FREE_RUNNING_SAMPLE_DELAY_MS);
+    return;
+  }
+  if (sampleTimer == NULL) {
+    delayMicroseconds(SYNC_SAMPLE_PERIOD_US);
+    return;
+  }
+
+  // Espera activa corta (~1 ms): delay() cedería la CPU más allá del disparo
+  uint32_t trigger = sampleTrigger;
+  uint64_t start = monoMicros();
+  while (sampleTrigger == trigger && monoMicros() - start < 2 * SYNC_SAMPLE_PERIOD_US) {
+  }
+}
+
+void endSampleWindow() {
+  if (sampleTimer == NULL) return;
+  timerStop(sampleTimer);
+}
+
+void recordSamplingNoise(float stdDev_mA) {
+  int mode = samplingMode;
+  if (!noiseMeasured[mode]) {
+    samplingNoise_mA[mode] = stdDev_mA;
+    noiseMeasured[mode] = true;
+  } else {
+    samplingNoise_mA[mode] += SAMPLING_NOISE_ALPHA * (stdDev_mA - samplingNoise_mA[mode]);
+  }
+}
+
+String getSamplingModeString(SamplingMode mode) {
+  switch (mode) {
+    case SAMPLING_FREE_RUNNING:
+      return "FREE_RUNNING";
+    case SAMPLING_PWM_SYNC:
+      return "PWM_SYNC";
+    default:
+      return "UNKNOWN";
+  }
+}
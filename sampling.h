@@ -0,0 +1,58 @@
+#ifndef SAMPLING_H
+#define SAMPLING_H
+
+#include <Arduino.h>
+
+// Muestreo sincronizado con el PWM. El INA219 integra cada conversión durante
+// 532 µs (12 bits, 1 muestra); a 40 kHz eso son 21.28 periodos y la fracción
+// sobrante del rizado de conmutación aparece como ruido en la media. En modo
+// sincronizado el PWM se ajusta para que cada conversión cubra un número
+// entero de periodos y las lecturas se disparan desde un temporizador
+// hardware, siempre con una conversión completa entre dos lecturas.
+#define INA219_CONVERSION_US 532
+#define PWM_SYNC_PERIODS 21               // Periodos PWM por conversión
+#define PWM_SYNC_FREQUENCY 39474          // 21 / 532 µs
+#define PWM_FREE_RUNNING_FREQUENCY 40000
+#define SYNC_SAMPLE_PERIOD_US (2 * INA219_CONVERSION_US)
+#define FREE_RUNNING_SAMPLE_DELAY_MS 5
+#define SHUNT_CURRENT_SCALE 10.0          // Shunt de 10 mΩ
+#define SAMPLING_NOISE_ALPHA 0.05         // Filtro exponencial del ruido reportado
+#define SAMPLING_TEST_BATCHES 10          // Promedios por modo en CMD:SAMPLING_TEST
+#define SAMPLING_DEFAULT_MODE 1
+
+enum SamplingMode {
+  SAMPLING_FREE_RUNNING = 0,
+  SAMPLING_PWM_SYNC = 1
+};
+
+// Media y varianza en una pasada (Welford)
+struct RunningStats {
+  uint32_t count;
+  double mean;
+  double m2;
+};
+
+void statsReset(RunningStats &stats);
+void statsAdd(RunningStats &stats, float value);
+float statsStdDev(const RunningStats &stats);
+
+extern SamplingMode samplingMode;
+
+// Desviación estándar de las muestras de corriente de panel (mA) por modo
+extern float samplingNoise_mA[2];
+
+// Reserva el temporizador hardware del modo sincronizado
+void samplingBegin();
+
+uint32_t getPwmFrequencyForMode(SamplingMode mode);
+
+// Envolver cada ráfaga de lecturas: beginSampleWindow() fija la fase de la
+// base de tiempo y waitNextSample() espera al siguiente instante de disparo
+void beginSampleWindow();
+void waitNextSample();
+void endSampleWindow();
+
+void recordSamplingNoise(float stdDev_mA);
+String getSamplingModeString(SamplingMode mode);
+
+#endif
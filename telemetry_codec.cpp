@@ -0,0 +1,567 @@
+#include "telemetry_codec.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TELEMETRY_NAME(name, type, decimals, source) #name,
+static const char *const FIELD_NAMES[TELEMETRY_FIELD_COUNT] = {TELEMETRY_FIELDS(TELEMETRY_NAME)};
+#undef TELEMETRY_NAME
+
+#define TELEMETRY_NAME_LENGTH(name, type, decimals, source) sizeof(#name) - 1,
+static const uint8_t FIELD_NAME_LENGTHS[TELEMETRY_FIELD_COUNT] = {TELEMETRY_FIELDS(TELEMETRY_NAME_LENGTH)};
+#undef TELEMETRY_NAME_LENGTH
+
+// Clave ya con comillas y ':' para el codificador
+#define TELEMETRY_KEY(name, type, decimals, source) "\"" #name "\":",
+static const char *const FIELD_KEYS[TELEMETRY_FIELD_COUNT] = {TELEMETRY_FIELDS(TELEMETRY_KEY)};
+#undef TELEMETRY_KEY
+
+#define TELEMETRY_TYPE(name, type, decimals, source) TELEMETRY_TYPE_##type,
+static const uint8_t FIELD_TYPES[TELEMETRY_FIELD_COUNT] = {TELEMETRY_FIELDS(TELEMETRY_TYPE)};
+#undef TELEMETRY_TYPE
+
+#define TELEMETRY_DECIMALS(name, type, decimals, source) decimals,
+static const uint8_t FIELD_DECIMALS[TELEMETRY_FIELD_COUNT] = {TELEMETRY_FIELDS(TELEMETRY_DECIMALS)};
+#undef TELEMETRY_DECIMALS
+
+static const double POWERS_OF_TEN[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+#define MAX_EXACT_POWER 22
+#define MAX_DECIMALS 9
+#define MAX_EXACT_MANTISSA 9007199254740992ULL   // 2^53
+#define FIXED_LIMIT 9.0e15                         // |valor| * 10^decimales con formato propio
+
+static int textSlotOf(int field) {
+  if (FIELD_TYPES[field] != TELEMETRY_TYPE_TEXT) return -1;
+  int slot = 0;
+  for (int i = 0; i < field; i++) {
+    if (FIELD_TYPES[i] == TELEMETRY_TYPE_TEXT) slot++;
+  }
+  return slot;
+}
+
+static void markPresent(TelemetryRecord *record, int field) {
+  record->present[field / 32] |= 1UL << (field % 32);
+}
+
+// ===== Textos UTF-8 acotados =====
+struct TextBuffer {
+  char *data;
+  size_t capacity;  // Con el '\0'
+  size_t length;
+  bool full;        // Algo no cupo: se ignora el resto
+};
+
+// Copia una secuencia completa o nada
+static void appendSequence(TextBuffer &text, const char *bytes, size_t count) {
+  if (text.full) return;
+  if (text.length + count > text.capacity - 1) {
+    text.full = true;
+    return;
+  }
+  memcpy(text.data + text.length, bytes, count);
+  text.length += count;
+}
+
+// Copia un tramo UTF-8; si no cabe, hasta el último carácter completo
+static void appendRun(TextBuffer &text, const char *bytes, size_t count) {
+  if (text.full || count == 0) return;
+  size_t room = text.capacity - 1 - text.length;
+  if (count > room) {
+    count = room;
+    while (count > 0 && ((uint8_t)bytes[count] & 0xC0) == 0x80) count--;
+    text.full = true;
+  }
+  memcpy(text.data + text.length, bytes, count);
+  text.length += count;
+}
+
+static void appendCodePoint(TextBuffer &text, uint32_t code) {
+  char bytes[4];
+  size_t count;
+  if (code < 0x80) {
+    bytes[0] = (char)code;
+    count = 1;
+  } else if (code < 0x800) {
+    bytes[0] = (char)(0xC0 | (code >> 6));
+    bytes[1] = (char)(0x80 | (code & 0x3F));
+    count = 2;
+  } else if (code < 0x10000) {
+    bytes[0] = (char)(0xE0 | (code >> 12));
+    bytes[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+    bytes[2] = (char)(0x80 | (code & 0x3F));
+    count = 3;
+  } else {
+    bytes[0] = (char)(0xF0 | (code >> 18));
+    bytes[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+    bytes[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+    bytes[3] = (char)(0x80 | (code & 0x3F));
+    count = 4;
+  }
+  appendSequence(text, bytes, count);
+}
+
+// ===== Codificador =====
+struct Writer {
+  char *out;
+  size_t size;
+  size_t length;
+  bool overflow;
+};
+
+static void put(Writer &writer, const char *data, size_t count) {
+  if (writer.overflow || writer.length + count >= writer.size) {
+    writer.overflow = true;
+    return;
+  }
+  memcpy(writer.out + writer.length, data, count);
+  writer.length += count;
+}
+
+static void putChar(Writer &writer, char c) {
+  if (writer.overflow || writer.length + 1 >= writer.size) {
+    writer.overflow = true;
+    return;
+  }
+  writer.out[writer.length++] = c;
+}
+
+static void putUnsigned(Writer &writer, uint64_t value, int minDigits) {
+  char digits[24];
+  int count = 0;
+  do {
+    digits[sizeof(digits) - 1 - count++] = (char)('0' + value % 10);
+    value /= 10;
+  } while (value > 0 || count < minDigits);
+  put(writer, digits + sizeof(digits) - count, count);
+}
+
+static void putInteger(Writer &writer, double value) {
+  if (!isfinite(value)) value = 0;
+  if (fabs(value) >= FIXED_LIMIT) {
+    char buffer[32];
+    int count = snprintf(buffer, sizeof(buffer), "%.0f", value);
+    put(writer, buffer, count);
+    return;
+  }
+  long long integer = (long long)(value < 0 ? value - 0.5 : value + 0.5);
+  if (integer < 0) putChar(writer, '-');
+  putUnsigned(writer, (uint64_t)(integer < 0 ? -integer : integer), 1);
+}
+
+// Punto fijo con redondeo a la mitad lejos de cero, como String(float, decimales)
+static void putFixed(Writer &writer, double value, int decimals) {
+  if (!isfinite(value)) value = 0;
+  if (decimals > MAX_DECIMALS) decimals = MAX_DECIMALS;
+  double scale = POWERS_OF_TEN[decimals];
+  if (fabs(value) * scale >= FIXED_LIMIT) {
+    char buffer[48];
+    int count = snprintf(buffer, sizeof(buffer), "%.*f", decimals, value);
+    put(writer, buffer, count);
+    return;
+  }
+  double product = value * scale;
+  long long scaled = (long long)(product < 0 ? product - 0.5 : product + 0.5);
+  if (scaled < 0) putChar(writer, '-');
+  uint64_t magnitude = (uint64_t)(scaled < 0 ? -scaled : scaled);
+  uint64_t unit = (uint64_t)scale;
+  putUnsigned(writer, magnitude / unit, 1);
+  if (decimals > 0) {
+    putChar(writer, '.');
+    putUnsigned(writer, magnitude % unit, decimals);
+  }
+}
+
+static void putText(Writer &writer, const char *text) {
+  static const char HEX_DIGITS[] = "0123456789abcdef";
+  putChar(writer, '"');
+  const char *run = text;
+  for (const char *p = text; *p != '\0'; p++) {
+    uint8_t c = (uint8_t)*p;
+    if (c >= 0x20 && c != '"' && c != '\\') continue;
+    put(writer, run, p - run);
+    run = p + 1;
+    if (c == '"') put(writer, "\\\"", 2);
+    else if (c == '\\') put(writer, "\\\\", 2);
+    else if (c == '\n') put(writer, "\\n", 2);
+    else if (c == '\t') put(writer, "\\t", 2);
+    else if (c == '\r') continue;             // Como la nota en el JSON anterior
+    else {
+      char escape[6] = {'\\', 'u', '0', '0', HEX_DIGITS[c >> 4], HEX_DIGITS[c & 0xF]};
+      put(writer, escape, sizeof(escape));
+    }
+  }
+  put(writer, run, strlen(run));
+  putChar(writer, '"');
+}
+
+int telemetryEncode(const TelemetryRecord *record, char *out, size_t size) {
+  if (size == 0) return -1;
+  Writer writer = {out, size, 0, false};
+  putChar(writer, '{');
+  for (int field = 0; field < TELEMETRY_FIELD_COUNT; field++) {
+    if (field > 0) putChar(writer, ',');
+    put(writer, FIELD_KEYS[field], FIELD_NAME_LENGTHS[field] + 3);
+    double value = record->values[field];
+    switch (FIELD_TYPES[field]) {
+      case TELEMETRY_TYPE_FLOAT: putFixed(writer, value, FIELD_DECIMALS[field]); break;
+      case TELEMETRY_TYPE_INT: putInteger(writer, value); break;
+      case TELEMETRY_TYPE_BOOL:
+        if (value != 0) put(writer, "true", 4);
+        else put(writer, "false", 5);
+        break;
+      case TELEMETRY_TYPE_TEXT: putText(writer, record->text[textSlotOf(field)]); break;
+    }
+  }
+  putChar(writer, '}');
+  if (writer.overflow) {
+    out[0] = '\0';
+    return -1;
+  }
+  out[writer.length] = '\0';
+  return (int)writer.length;
+}
+
+void telemetrySetNumber(TelemetryRecord *record, int field, double value) {
+  if (field < 0 || field >= TELEMETRY_FIELD_COUNT) return;
+  record->values[field] = value;
+  markPresent(record, field);
+}
+
+void telemetrySetText(TelemetryRecord *record, int field, const char *value) {
+  int slot = field >= 0 && field < TELEMETRY_FIELD_COUNT ? textSlotOf(field) : -1;
+  if (slot < 0) return;
+  TextBuffer text = {record->text[slot], TELEMETRY_TEXT_SIZE, 0, false};
+  appendRun(text, value, strlen(value));
+  text.data[text.length] = '\0';
+  markPresent(record, field);
+}
+
+// ===== Decodificador =====
+struct Reader {
+  const char *p;
+  const char *end;
+};
+
+static void skipSpace(Reader &reader) {
+  while (reader.p < reader.end && (*reader.p == ' ' || *reader.p == '\t' || *reader.p == '\n' || *reader.p == '\r')) {
+    reader.p++;
+  }
+}
+
+static bool consume(Reader &reader, char c) {
+  skipSpace(reader);
+  if (reader.p >= reader.end || *reader.p != c) return false;
+  reader.p++;
+  return true;
+}
+
+static int hexValue(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+static bool readHex4(Reader &reader, uint32_t &code) {
+  if (reader.end - reader.p < 4) return false;
+  code = 0;
+  for (int i = 0; i < 4; i++) {
+    int digit = hexValue(reader.p[i]);
+    if (digit < 0) return false;
+    code = code << 4 | digit;
+  }
+  reader.p += 4;
+  return true;
+}
+
+// Cadena que empieza en la comilla, por tramos sin escapes. Si raw no es
+// NULL y no hay escapes, raw/rawLength apuntan al texto dentro del JSON y no
+// se copia nada; si no, se decodifica en text (si no es NULL).
+static bool readString(Reader &reader, TextBuffer *text, const char **raw, size_t *rawLength) {
+  reader.p++;
+  const char *start = reader.p;
+  bool escaped = false;
+  while (true) {
+    const char *run = reader.p;
+    while (reader.p < reader.end && *reader.p != '"' && *reader.p != '\\' && (uint8_t)*reader.p >= 0x20) reader.p++;
+    if (text != NULL && (raw == NULL || escaped)) appendRun(*text, run, reader.p - run);
+    if (reader.p >= reader.end || (uint8_t)*reader.p < 0x20) return false;
+    if (*reader.p == '"') break;
+
+    if (!escaped && raw != NULL && text != NULL) appendRun(*text, start, reader.p - start);
+    escaped = true;
+    if (++reader.p >= reader.end) return false;
+    char kind = *reader.p++;
+    uint32_t code;
+    switch (kind) {
+      case '"': code = '"'; break;
+      case '\\': code = '\\'; break;
+      case '/': code = '/'; break;
+      case 'b': code = '\b'; break;
+      case 'f': code = '\f'; break;
+      case 'n': code = '\n'; break;
+      case 'r': code = '\r'; break;
+      case 't': code = '\t'; break;
+      case 'u': {
+        if (!readHex4(reader, code)) return false;
+        uint32_t low;
+        if (code >= 0xD800 && code < 0xDC00 && reader.end - reader.p >= 6 && reader.p[0] == '\\' &&
+            reader.p[1] == 'u') {
+          Reader lookahead = {reader.p + 2, reader.end};
+          if (readHex4(lookahead, low) && low >= 0xDC00 && low < 0xE000) {
+            code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+            reader.p = lookahead.p;
+          }
+        }
+        if (code >= 0xD800 && code < 0xE000) code = 0xFFFD;   // Sustituto suelto
+        break;
+      }
+      default: return false;
+    }
+    if (text != NULL) appendCodePoint(*text, code);
+  }
+  if (raw != NULL) {
+    *raw = escaped ? NULL : start;
+    *rawLength = reader.p - start;
+  }
+  reader.p++;
+  return true;
+}
+
+// Camino rápido exacto: hasta 19 dígitos significativos sin perder nada y
+// potencia de diez representable (mantisa <= 2^53, |exponente| <= 22). El
+// resto va a strtod.
+static bool readNumber(Reader &reader, double &value) {
+  const char *start = reader.p;
+  const char *p = reader.p;
+  bool negative = p < reader.end && *p == '-';
+  if (negative) p++;
+  uint64_t mantissa = 0;
+  int digits = 0;
+  int exponent = 0;
+  const char *integerStart = p;
+  while (p < reader.end && *p >= '0' && *p <= '9') {
+    if (digits < 19) mantissa = mantissa * 10 + (*p - '0');
+    else exponent++;
+    if (mantissa > 0 || digits > 0) digits++;
+    p++;
+  }
+  if (p == integerStart) return false;
+  if (p < reader.end && *p == '.') {
+    p++;
+    const char *fractionStart = p;
+    while (p < reader.end && *p >= '0' && *p <= '9') {
+      if (digits < 19) {
+        mantissa = mantissa * 10 + (*p - '0');
+        exponent--;
+      }
+      if (mantissa > 0 || digits > 0) digits++;
+      p++;
+    }
+    if (p == fractionStart) return false;
+  }
+  if (p < reader.end && (*p == 'e' || *p == 'E')) {
+    p++;
+    bool negativeExponent = false;
+    if (p < reader.end && (*p == '+' || *p == '-')) negativeExponent = *p++ == '-';
+    const char *exponentStart = p;
+    int written = 0;
+    while (p < reader.end && *p >= '0' && *p <= '9') {
+      if (written < 10000) written = written * 10 + (*p - '0');
+      p++;
+    }
+    if (p == exponentStart) return false;
+    exponent += negativeExponent ? -written : written;
+  }
+  reader.p = p;
+
+  if (digits <= 19 && mantissa <= MAX_EXACT_MANTISSA && exponent >= -MAX_EXACT_POWER &&
+      exponent <= MAX_EXACT_POWER) {
+    value = exponent < 0 ? (double)mantissa / POWERS_OF_TEN[-exponent] : (double)mantissa * POWERS_OF_TEN[exponent];
+    if (negative) value = -value;
+    return true;
+  }
+  char buffer[64];
+  size_t length = p - start;
+  if (length >= sizeof(buffer)) {
+    value = negative ? -HUGE_VAL : HUGE_VAL;
+    return true;
+  }
+  memcpy(buffer, start, length);
+  buffer[length] = '\0';
+  value = strtod(buffer, NULL);
+  return true;
+}
+
+static bool readLiteral(Reader &reader, const char *literal, size_t length) {
+  if ((size_t)(reader.end - reader.p) < length || memcmp(reader.p, literal, length) != 0) return false;
+  reader.p += length;
+  return true;
+}
+
+static bool skipValue(Reader &reader, int depth);
+
+static bool skipContainer(Reader &reader, char close, int depth) {
+  reader.p++;
+  if (consume(reader, close)) return true;
+  while (true) {
+    if (close == '}') {
+      skipSpace(reader);
+      if (reader.p >= reader.end || *reader.p != '"' || !readString(reader, NULL, NULL, NULL)) return false;
+      if (!consume(reader, ':')) return false;
+    }
+    if (!skipValue(reader, depth + 1)) return false;
+    if (consume(reader, close)) return true;
+    if (!consume(reader, ',')) return false;
+  }
+}
+
+static bool skipValue(Reader &reader, int depth) {
+  skipSpace(reader);
+  if (reader.p >= reader.end || depth > 16) return false;
+  double ignored;
+  switch (*reader.p) {
+    case '"': return readString(reader, NULL, NULL, NULL);
+    case '{': return skipContainer(reader, '}', depth);
+    case '[': return skipContainer(reader, ']', depth);
+    case 't': return readLiteral(reader, "true", 4);
+    case 'f': return readLiteral(reader, "false", 5);
+    case 'n': return readLiteral(reader, "null", 4);
+    default: return readNumber(reader, ignored);
+  }
+}
+
+// Campo del esquema con esa clave: primero el siguiente al último leído
+// (el orden del codificador), después todos
+static int findField(const char *key, size_t length, int expected) {
+  if (expected < TELEMETRY_FIELD_COUNT && FIELD_NAME_LENGTHS[expected] == length &&
+      memcmp(FIELD_NAMES[expected], key, length) == 0) {
+    return expected;
+  }
+  for (int field = 0; field < TELEMETRY_FIELD_COUNT; field++) {
+    if (FIELD_NAME_LENGTHS[field] == length && memcmp(FIELD_NAMES[field], key, length) == 0) return field;
+  }
+  return -1;
+}
+
+// Valor de un campo conocido. Un tipo que no corresponde (p. ej. null) deja
+// el campo ausente; un número entre comillas se acepta (firmware anterior).
+static bool readField(Reader &reader, TelemetryRecord *record, int field) {
+  skipSpace(reader);
+  if (reader.p >= reader.end) return false;
+  char first = *reader.p;
+  uint8_t type = FIELD_TYPES[field];
+  double value;
+
+  if (type == TELEMETRY_TYPE_TEXT) {
+    if (first != '"') return skipValue(reader, 0);
+    TextBuffer text = {record->text[textSlotOf(field)], TELEMETRY_TEXT_SIZE, 0, false};
+    if (!readString(reader, &text, NULL, NULL)) return false;
+    text.data[text.length] = '\0';
+    markPresent(record, field);
+    return true;
+  }
+  if (first == 't' || first == 'f') {
+    bool truth = first == 't';
+    if (!readLiteral(reader, truth ? "true" : "false", truth ? 4 : 5)) return false;
+    telemetrySetNumber(record, field, truth ? 1 : 0);
+    return true;
+  }
+  if (first == '"') {
+    const char *raw;
+    size_t rawLength;
+    if (!readString(reader, NULL, &raw, &rawLength)) return false;
+    Reader inner = {raw, raw != NULL ? raw + rawLength : NULL};
+    if (raw != NULL && rawLength > 0 && readNumber(inner, value) && inner.p == inner.end) {
+      telemetrySetNumber(record, field, value);
+    }
+    return true;
+  }
+  if (first == '-' || (first >= '0' && first <= '9')) {
+    if (!readNumber(reader, value)) return false;
+    telemetrySetNumber(record, field, type == TELEMETRY_TYPE_BOOL ? (value != 0 ? 1 : 0) : value);
+    return true;
+  }
+  return skipValue(reader, 0);
+}
+
+int telemetryDecode(const char *text, size_t length, TelemetryRecord *record) {
+  memset(record, 0, sizeof(*record));
+  Reader reader = {text, text + length};
+  skipSpace(reader);
+  if (reader.end - reader.p >= 5 && memcmp(reader.p, "DATA:", 5) == 0) reader.p += 5;
+  if (!consume(reader, '{')) return -1;
+
+  int expected = 0;
+  if (!consume(reader, '}')) {
+    while (true) {
+      skipSpace(reader);
+      if (reader.p >= reader.end || *reader.p != '"') return -1;
+      char keyBuffer[64];
+      TextBuffer keyText = {keyBuffer, sizeof(keyBuffer), 0, false};
+      const char *key;
+      size_t keyLength;
+      if (!readString(reader, &keyText, &key, &keyLength)) return -1;
+      if (key == NULL) {
+        key = keyText.full ? "" : keyBuffer;
+        keyLength = keyText.full ? 0 : keyText.length;
+      }
+      if (!consume(reader, ':')) return -1;
+
+      int field = findField(key, keyLength, expected);
+      if (field >= 0) {
+        if (!readField(reader, record, field)) return -1;
+        expected = field + 1;
+      } else if (!skipValue(reader, 0)) {
+        return -1;
+      }
+      if (consume(reader, '}')) break;
+      if (!consume(reader, ',')) return -1;
+    }
+  }
+  skipSpace(reader);
+  if (reader.p != reader.end && *reader.p != '\0') return -1;
+
+  int count = 0;
+  for (int word = 0; word < TELEMETRY_PRESENT_WORDS; word++) {
+    for (uint32_t bits = record->present[word]; bits != 0; bits &= bits - 1) count++;
+  }
+  return count;
+}
+
+// ===== Descripción del esquema =====
+int telemetryFieldCount(void) {
+  return TELEMETRY_FIELD_COUNT;
+}
+
+const char *telemetryFieldName(int field) {
+  return field >= 0 && field < TELEMETRY_FIELD_COUNT ? FIELD_NAMES[field] : NULL;
+}
+
+int telemetryFieldType(int field) {
+  return field >= 0 && field < TELEMETRY_FIELD_COUNT ? FIELD_TYPES[field] : -1;
+}
+
+int telemetryFieldDecimals(int field) {
+  return field >= 0 && field < TELEMETRY_FIELD_COUNT ? FIELD_DECIMALS[field] : -1;
+}
+
+int telemetryTextSlot(int field) {
+  return field >= 0 && field < TELEMETRY_FIELD_COUNT ? textSlotOf(field) : -1;
+}
+
+int telemetryTextCount(void) {
+  return TELEMETRY_TEXT_COUNT;
+}
+
+int telemetryTextSize(void) {
+  return TELEMETRY_TEXT_SIZE;
+}
+
+size_t telemetryRecordSize(void) {
+  return sizeof(TelemetryRecord);
+}
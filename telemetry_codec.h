@@ -0,0 +1,82 @@
+#ifndef TELEMETRY_CODEC_H
+#define TELEMETRY_CODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "telemetry_schema.h"
+
+// Codificador y decodificador del JSON de telemetría generados desde
+// telemetry_schema.h. Sin Arduino ni heap: el firmware lo usa para
+// CMD:GET_DATA y /data, y tools/telemetry lo compila como biblioteca
+// compartida (libesp32telemetry.so) con ABI C para la Orange Pi (ctypes,
+// orangepi_backend/telemetry.py).
+//
+// El registro guarda cada campo numérico o booleano (0/1) en values[] como
+// double (los enteros de hasta 2^53 son exactos) y cada TEXT en su ranura de
+// text[]; present[] marca los campos leídos por el decodificador.
+#define TELEMETRY_TEXT_SIZE 128           // Bytes por texto, con el '\0' (se trunca)
+#define TELEMETRY_JSON_MAX 3072           // Salida del codificador, con el '\0'
+
+enum TelemetryType {
+  TELEMETRY_TYPE_FLOAT = 0,
+  TELEMETRY_TYPE_INT,
+  TELEMETRY_TYPE_BOOL,
+  TELEMETRY_TYPE_TEXT
+};
+
+#define TELEMETRY_FIELD_ENUM(name, type, decimals, source) TELEMETRY_FIELD_##name,
+enum TelemetryField {
+  TELEMETRY_FIELDS(TELEMETRY_FIELD_ENUM)
+  TELEMETRY_FIELD_COUNT
+};
+#undef TELEMETRY_FIELD_ENUM
+
+#define TELEMETRY_IS_TEXT_FLOAT 0
+#define TELEMETRY_IS_TEXT_INT 0
+#define TELEMETRY_IS_TEXT_BOOL 0
+#define TELEMETRY_IS_TEXT_TEXT 1
+#define TELEMETRY_TEXT_ONE(name, type, decimals, source) +TELEMETRY_IS_TEXT_##type
+#define TELEMETRY_TEXT_COUNT (0 TELEMETRY_FIELDS(TELEMETRY_TEXT_ONE))
+#define TELEMETRY_PRESENT_WORDS ((TELEMETRY_FIELD_COUNT + 31) / 32)
+
+typedef struct TelemetryRecord {
+  uint32_t present[TELEMETRY_PRESENT_WORDS];
+  double values[TELEMETRY_FIELD_COUNT];   // TEXT: sin uso
+  char text[TELEMETRY_TEXT_COUNT][TELEMETRY_TEXT_SIZE];
+} TelemetryRecord;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// JSON compacto con todos los campos en el orden del esquema, terminado en
+// '\0'. Los FLOAT no finitos salen como 0 (JSON no admite NaN). Devuelve la
+// longitud o -1 si no cabe en size.
+int telemetryEncode(const TelemetryRecord *record, char *out, size_t size);
+
+// Lee un objeto JSON plano, con o sin el prefijo "DATA:". Pone a cero el
+// registro, rellena los campos del esquema y descarta las claves
+// desconocidas. Devuelve cuántos campos del esquema se leyeron o -1 si el
+// texto no es un objeto JSON válido.
+int telemetryDecode(const char *text, size_t length, TelemetryRecord *record);
+
+// Valor o texto de un campo (los TEXT se truncan a TELEMETRY_TEXT_SIZE - 1
+// bytes sin partir un carácter UTF-8)
+void telemetrySetNumber(TelemetryRecord *record, int field, double value);
+void telemetrySetText(TelemetryRecord *record, int field, const char *value);
+
+// Descripción del esquema para quien no compila contra este header
+int telemetryFieldCount(void);
+const char *telemetryFieldName(int field);
+int telemetryFieldType(int field);        // TelemetryType
+int telemetryFieldDecimals(int field);
+int telemetryTextSlot(int field);         // Índice en text[] o -1
+int telemetryTextCount(void);
+int telemetryTextSize(void);
+size_t telemetryRecordSize(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,109 @@
+#ifndef TELEMETRY_SCHEMA_H
+#define TELEMETRY_SCHEMA_H
+
+// Única lista de campos de la telemetría (CMD:GET_DATA y /data). De aquí
+// salen el registro TelemetryRecord, el codificador JSON del firmware y el
+// decodificador de la biblioteca del host (telemetry_codec.h); la Orange Pi
+// lee la lista de la propia biblioteca. Un campo nuevo se añade solo aquí.
+//
+// X(nombre, tipo, decimales, fuente)
+//   nombre: clave JSON
+//   tipo: FLOAT, INT (entero con signo, 64 bits), BOOL o TEXT
+//   decimales: solo FLOAT
+//   fuente: expresión evaluada en fillTelemetryRecord() (cargador_gel_litio.ino),
+//           con m = getLatestMeasurement() y ripple = getRippleReport(); la
+//           biblioteca del host no la usa. TEXT: const char *.
+#define TELEMETRY_FIELDS(X)                                                                            \
+  /* === MEDICIONES EN TIEMPO REAL === */                                                              \
+  X(panelToBatteryCurrent, FLOAT, 2, m.panelToBatteryCurrent)              /* mA */                    \
+  X(batteryToLoadCurrent, FLOAT, 2, m.batteryToLoadCurrent)                /* mA */                    \
+  X(voltagePanel, FLOAT, 2, m.voltagePanel)                                                            \
+  X(voltageBatterySensor2, FLOAT, 2, m.voltageBattery)                                                 \
+  X(currentPWM, INT, 0, m.pwm)                                                                         \
+  X(temperature, FLOAT, 2, m.temperature)                                                              \
+  X(chargeState, TEXT, 0, getChargeStateName(m.state))                                                 \
+  /* === PARÁMETROS DE CARGA === */                                                                    \
+  X(bulkVoltage, FLOAT, 2, bulkVoltage)                                                                \
+  X(absorptionVoltage, FLOAT, 2, absorptionVoltage)                                                    \
+  X(floatVoltage, FLOAT, 2, floatVoltage)                                                              \
+  X(LVD, FLOAT, 2, LVD)                                                                                \
+  X(LVR, FLOAT, 2, LVR)                                                                                \
+  /* === CONFIGURACIÓN DE BATERÍA === */                                                               \
+  X(batteryCapacity, FLOAT, 2, batteryCapacity)                                                        \
+  X(thresholdPercentage, FLOAT, 2, thresholdPercentage)                                                \
+  X(maxAllowedCurrent, FLOAT, 2, maxAllowedCurrent)                                                    \
+  X(isLithium, BOOL, 0, isLithium)                                                                     \
+  X(maxBatteryVoltageAllowed, FLOAT, 2, maxBatteryVoltageAllowed)                                      \
+  /* === PARÁMETROS CALCULADOS === */                                                                  \
+  X(absorptionCurrentThreshold_mA, FLOAT, 2, absorptionCurrentThreshold_mA)                            \
+  X(currentLimitIntoFloatStage, FLOAT, 2, currentLimitIntoFloatStage)                                  \
+  X(calculatedAbsorptionHours, FLOAT, 2, calculatedAbsorptionHours)                                    \
+  X(accumulatedAh, FLOAT, 2, accumulatedAh)                                                            \
+  X(estimatedSOC, FLOAT, 2, getSOCFromVoltage(m.voltageBattery))           /* % por voltaje */         \
+  X(calculatedSOC, FLOAT, 2, accumulatedAh / batteryCapacity * 100.0)      /* % por Ah */              \
+  X(netCurrent, FLOAT, 2, m.panelToBatteryCurrent - m.batteryToLoadCurrent)                            \
+  X(factorDivider, INT, 0, factorDivider)                                                              \
+  X(currentBulkHours, FLOAT, 2, currentBulkHours)                                                      \
+  X(panelSensorAvailable, BOOL, 0, panelSensorAvailable)                                               \
+  /* === CONFIGURACIÓN DE FUENTE === */                                                                \
+  X(useFuenteDC, BOOL, 0, useFuenteDC)                                                                 \
+  X(fuenteDC_Amps, FLOAT, 2, fuenteDC_Amps)                                                            \
+  X(maxBulkHours, FLOAT, 2, maxBulkHours)                                                              \
+  /* === CONFIGURACIÓN AVANZADA === */                                                                 \
+  X(maxAbsorptionHours, FLOAT, 2, maxAbsorptionHours)                                                  \
+  X(chargedBatteryRestVoltage, FLOAT, 2, chargedBatteryRestVoltage)                                    \
+  X(reEnterBulkVoltage, FLOAT, 2, 12.6)                                    /* Valor fijo por ahora */  \
+  X(pwmFrequency, INT, 0, pwmFrequency)                                                                \
+  /* === ESTABILIDAD DE LA REGULACIÓN === */                                                           \
+  X(rippleFrequencyHz, FLOAT, 3, ripple.frequencyHz)                                                   \
+  X(rippleAmplitude_mV, FLOAT, 1, ripple.amplitude_mV)                                                 \
+  X(stabilityScore, INT, 0, ripple.stabilityScore)                                                     \
+  X(oscillationActive, BOOL, 0, ripple.oscillating)                                                    \
+  X(rippleAnalysisUs, INT, 0, ripple.analysisUs)                                                       \
+  X(autotuneState, TEXT, 0, getAutotuneStateString(getAutotuneState()).c_str())                        \
+  X(regulatorTuned, BOOL, 0, tunedGains.valid)                                                         \
+  X(tunedKp, FLOAT, 3, tunedGains.kp)                                                                  \
+  X(tunedKi, FLOAT, 4, tunedGains.ki)                                                                  \
+  X(samplingMode, TEXT, 0, getSamplingModeString(samplingMode).c_str())                                \
+  X(currentNoiseFreeRunning_mA, FLOAT, 2, samplingNoise_mA[SAMPLING_FREE_RUNNING])                     \
+  X(currentNoisePwmSync_mA, FLOAT, 2, samplingNoise_mA[SAMPLING_PWM_SYNC])                             \
+  X(tempThreshold, INT, 0, 55)                                             /* Valor fijo por ahora */  \
+  /* === DERATING TÉRMICO === */                                                                       \
+  X(tempSoftLimit, FLOAT, 2, tempSoftLimit)                                                            \
+  X(tempHardLimit, FLOAT, 2, tempHardLimit)                                                            \
+  X(thermalDeratingFactor, FLOAT, 2, thermalDeratingFactor)                                            \
+  X(effectiveMaxCurrent, FLOAT, 2, getEffectiveMaxCurrent())                                           \
+  X(estimatedMosfetTemp, FLOAT, 2, estimatedMosfetTemp)                                                \
+  X(mosfetPowerLoss, FLOAT, 2, mosfetPowerLoss)                                                        \
+  /* === MODO NOCTURNO / CONSUMO PROPIO === */                                                         \
+  X(nightMode, BOOL, 0, nightModeActive)                                                               \
+  X(selfConsumption_mA, FLOAT, 2, selfConsumption_mA)                                                  \
+  X(awakeDutyPercent, FLOAT, 2, awakeDutyPercent)                                                      \
+  X(powerReductionFactor, FLOAT, 2, getPowerReductionFactor())                                         \
+  /* === RADIO WIFI === */                                                                             \
+  X(wifiPolicy, TEXT, 0, getWifiPolicyString(wifiPolicy).c_str())                                      \
+  X(wifiRadioOn, BOOL, 0, isWifiRadioOn())                                                             \
+  X(wifiWindowRemainingSeconds, INT, 0, getWifiWindowRemainingSeconds())                               \
+  /* === ESTADO DE APAGADO TEMPORAL === */                                                             \
+  X(temporaryLoadOff, BOOL, 0, temporaryLoadOff)                                                       \
+  X(loadOffRemainingSeconds, INT, 0, getLoadOffRemainingSeconds())                                     \
+  X(loadOffDuration, INT, 0, temporaryLoadOff ? loadOffDuration / 1000 : 0)                            \
+  /* === ESTADO DEL SISTEMA === */                                                                     \
+  X(loadControlState, BOOL, 0, digitalRead(LOAD_CONTROL_PIN))                                          \
+  X(ledSolarState, BOOL, 0, digitalRead(LED_SOLAR))                                                    \
+  X(notaPersonalizada, TEXT, 0, notaPersonalizada.c_str())                                             \
+  /* === METADATOS === */                                                                              \
+  X(connected, BOOL, 0, true)                                                                          \
+  X(firmware_version, TEXT, 0, "ESP32_v2.1")                                                           \
+  X(uptime, INT, 0, monoMillis())                                          /* ms */                    \
+  X(measurementTimestamp, INT, 0, m.timestamp)                             /* ms monotónicos */        \
+  X(eventBusDropped, INT, 0, getEventBusDropped())                                                     \
+  X(nvsCommits, INT, 0, nvsCommitCount)                                                                \
+  X(nvsStallMaxUs, INT, 0, nvsStallMaxUs)                                                              \
+  X(nvsStallAvgUs, FLOAT, 0, getNvsStallAverageUs())                                                   \
+  X(controlTickLateMaxMs, INT, 0, controlTickLateMaxMs)                                                \
+  X(controlTickLateCount, INT, 0, controlTickLateCount)                                                \
+  X(wallClockSynced, BOOL, 0, isWallClockSynced())                                                     \
+  X(last_update, INT, 0, isWallClockSynced() ? wallClockMillis() : monoMillis()) /* ms */
+
+#endif
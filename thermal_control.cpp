@@ -0,0 +1,90 @@
+#include "thermal_control.h"
+#include "time_base.h"
+
+extern float maxAllowedCurrent;
+
+float tempSoftLimit = TEMP_DERATE_SOFT_LIMIT;
+float tempHardLimit = TEMP_DERATE_HARD_LIMIT;
+
+float thermalDeratingFactor = 1.0;
+float estimatedMosfetTemp = 0.0;
+float mosfetPowerLoss = 0.0;
+
+// Elevación de temperatura del MOSFET sobre el NTC (estado del modelo)
+static float mosfetTempRise = 0.0;
+static uint64_t lastThermalUpdate = 0;
+
+// Pérdidas estimadas en el MOSFET. El cargador conmuta el panel directamente
+// sobre la batería, así que la corriente promedio medida se concentra en el
+// tiempo de encendido: I_on = I_avg / D.
+static float estimateMosfetLoss(float chargeCurrent_mA, int pwmValue, float panelVoltage, int pwmFreq) {
+  float duty = constrain(pwmValue, 0, 255) / 255.0;
+  float avgCurrent = chargeCurrent_mA / 1000.0;
+  if (duty < 0.02 || avgCurrent <= 0) {
+    return 0.0;
+  }
+
+  float onCurrent = avgCurrent / duty;
+  float conductionLoss = onCurrent * onCurrent * MOSFET_RDS_ON * duty;
+
+  // Con duty 100% no hay conmutación
+  float switchingLoss = 0.0;
+  if (pwmValue < 255) {
+    switchingLoss = 0.5 * panelVoltage * onCurrent * MOSFET_SWITCHING_TIME * pwmFreq;
+  }
+
+  return conductionLoss + switchingLoss;
+}
+
+// Curva de derating: 1.0 hasta el límite suave, lineal hasta 0.0 en el límite duro
+static float deratingForTemperature(float temp) {
+  if (temp <= tempSoftLimit) return 1.0;
+  if (temp >= tempHardLimit) return 0.0;
+  return 1.0 - (temp - tempSoftLimit) / (tempHardLimit - tempSoftLimit);
+}
+
+void updateThermalModel(float ntcTemperature, float chargeCurrent_mA, int pwmValue, float panelVoltage, int pwmFreq) {
+  uint64_t now = monoMillis();
+
+  // Sin lectura válida del NTC no se modifica el derating
+  if (isnan(ntcTemperature) || isinf(ntcTemperature)) {
+    Serial.println("⚠️ [Térmico] Lectura de NTC inválida - manteniendo derating actual");
+    return;
+  }
+
+  if (lastThermalUpdate == 0) {
+    lastThermalUpdate = now;
+    estimatedMosfetTemp = ntcTemperature;
+    return;
+  }
+
+  float dt = (now - lastThermalUpdate) / 1000.0;
+  lastThermalUpdate = now;
+
+  // Modelo de primer orden: la elevación tiende a P·Rth con constante MOSFET_THERMAL_TAU
+  mosfetPowerLoss = estimateMosfetLoss(chargeCurrent_mA, pwmValue, panelVoltage, pwmFreq);
+  float targetRise = mosfetPowerLoss * MOSFET_RTH_JUNCTION_NTC;
+  float alpha = min(1.0f, dt / (float)MOSFET_THERMAL_TAU);
+  mosfetTempRise += (targetRise - mosfetTempRise) * alpha;
+  estimatedMosfetTemp = ntcTemperature + mosfetTempRise;
+
+  // La reducción se aplica de inmediato; la recuperación se limita en velocidad
+  // para no oscilar alrededor del límite suave
+  float targetFactor = deratingForTemperature(estimatedMosfetTemp);
+  float previousFactor = thermalDeratingFactor;
+  if (targetFactor < thermalDeratingFactor) {
+    thermalDeratingFactor = targetFactor;
+  } else {
+    thermalDeratingFactor = min(targetFactor, thermalDeratingFactor + (float)TEMP_DERATE_SLEW_PER_S * dt);
+  }
+
+  if (thermalDeratingFactor < 1.0 || previousFactor < 1.0) {
+    Serial.println("🌡️ [Térmico] NTC=" + String(ntcTemperature, 1) + "°C, MOSFET≈" + String(estimatedMosfetTemp, 1) +
+                   "°C, P=" + String(mosfetPowerLoss, 2) + "W, derating=" + String(thermalDeratingFactor * 100.0, 0) +
+                   "% (" + String(getEffectiveMaxCurrent(), 0) + "mA)");
+  }
+}
+
+float getEffectiveMaxCurrent() {
+  return maxAllowedCurrent * thermalDeratingFactor;
+}
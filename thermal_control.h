@@ -0,0 +1,22 @@
+#ifndef THERMAL_CONTROL_H
+#define THERMAL_CONTROL_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Límites configurables del derating (persistidos en Preferences)
+extern float tempSoftLimit;
+extern float tempHardLimit;
+
+// Estado del modelo térmico
+extern float thermalDeratingFactor;   // 1.0 = sin reducción, 0.0 = carga detenida
+extern float estimatedMosfetTemp;     // °C estimados en el MOSFET
+extern float mosfetPowerLoss;         // W disipados según el modelo
+
+// Actualiza el modelo con la última medición. Llamar una vez por ciclo de loop().
+void updateThermalModel(float ntcTemperature, float chargeCurrent_mA, int pwmValue, float panelVoltage, int pwmFreq);
+
+// Corriente máxima efectiva (mA) tras aplicar el derating térmico
+float getEffectiveMaxCurrent();
+
+#endif
@@ -0,0 +1,39 @@
+#include "time_base.h"
+#include "esp_timer.h"
+
+// Diferencia entre el reloj de pared y el monotónico (ms), válida tras la sincronización
+static int64_t wallOffsetMs = 0;
+static bool wallClockSynced = false;
+
+uint64_t monoMicros() {
+  return (uint64_t)esp_timer_get_time();
+}
+
+uint64_t monoMillis() {
+  return monoMicros() / 1000ULL;
+}
+
+void setWallClock(uint64_t epochSeconds) {
+  wallOffsetMs = (int64_t)(epochSeconds * 1000ULL) - (int64_t)monoMillis();
+  wallClockSynced = true;
+  Serial.println("🕒 [Reloj] Sincronizado: epoch=" + uint64ToString(epochSeconds));
+}
+
+bool isWallClockSynced() {
+  return wallClockSynced;
+}
+
+uint64_t wallClockMillis() {
+  return monoToWallMillis(monoMillis());
+}
+
+uint64_t monoToWallMillis(uint64_t monoMs) {
+  if (!wallClockSynced) return 0;
+  return (uint64_t)((int64_t)monoMs + wallOffsetMs);
+}
+
+String uint64ToString(uint64_t value) {
+  char buffer[21];
+  snprintf(buffer, sizeof(buffer), "%llu", (unsigned long long)value);
+  return String(buffer);
+}
@@ -0,0 +1,20 @@
+#ifndef TIME_BASE_H
+#define TIME_BASE_H
+
+#include <Arduino.h>
+
+// Reloj monotónico de 64 bits basado en esp_timer (µs desde el arranque).
+// A diferencia de millis() (32 bits, desborda cada 49.7 días) no desborda en la práctica.
+uint64_t monoMicros();
+uint64_t monoMillis();
+
+// Reloj de pared opcional, sincronizado desde el Orange Pi con CMD:SET_TIME:<epoch>
+void setWallClock(uint64_t epochSeconds);
+bool isWallClockSynced();
+uint64_t wallClockMillis();                    // ms UNIX, 0 si no está sincronizado
+uint64_t monoToWallMillis(uint64_t monoMs);    // Convierte una marca monotónica, 0 si no está sincronizado
+
+// String() de Arduino no es portable para 64 bits
+String uint64ToString(uint64_t value);
+
+#endif
@@ -0,0 +1,214 @@
+#include "timer_wheel.h"
+#include "time_base.h"
+
+// Cabeceras centinela de cada ranura (listas circulares)
+static WheelTimer wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+static uint64_t currentTick = 0;
+static uint32_t activeTimers = 0;
+static bool wheelInitialized = false;
+
+const uint64_t SLOT_MASK = TIMER_WHEEL_SLOTS - 1;
+const uint64_t MAX_WHEEL_RANGE = 1ULL << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS);
+
+static void listInit(WheelTimer *head) {
+  head->next = head;
+  head->prev = head;
+}
+
+static bool listEmpty(const WheelTimer *head) {
+  return head->next == head;
+}
+
+static void listAppend(WheelTimer *head, WheelTimer *timer) {
+  timer->prev = head->prev;
+  timer->next = head;
+  head->prev->next = timer;
+  head->prev = timer;
+}
+
+static void listUnlink(WheelTimer *timer) {
+  timer->prev->next = timer->next;
+  timer->next->prev = timer->prev;
+  timer->next = NULL;
+  timer->prev = NULL;
+}
+
+// Mueve todos los nodos de 'from' a 'to' (ambos centinelas) en O(1)
+static void listSplice(WheelTimer *from, WheelTimer *to) {
+  if (listEmpty(from)) return;
+  from->next->prev = to->prev;
+  to->prev->next = from->next;
+  from->prev->next = to;
+  to->prev = from->prev;
+  listInit(from);
+}
+
+static void ensureWheelInitialized() {
+  if (wheelInitialized) return;
+  for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+    for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+      listInit(&wheel[level][slot]);
+    }
+  }
+  currentTick = monoMillis() / TIMER_WHEEL_TICK_MS;
+  wheelInitialized = true;
+}
+
+// Coloca el temporizador en el nivel cuyo alcance cubre su vencimiento
+static void placeTimer(WheelTimer *timer) {
+  uint64_t expires = timer->expiresTick;
+  if (expires <= currentTick) {
+    expires = currentTick + 1;
+  }
+  uint64_t delta = expires - currentTick;
+  if (delta >= MAX_WHEEL_RANGE) {
+    // Fuera de alcance: se recoloca en cada recascada del último nivel
+    expires = currentTick + MAX_WHEEL_RANGE - 1;
+    delta = MAX_WHEEL_RANGE - 1;
+  }
+
+  int level = 0;
+  while (level < TIMER_WHEEL_LEVELS - 1 && delta >= (1ULL << (TIMER_WHEEL_SLOT_BITS * (level + 1)))) {
+    level++;
+  }
+  uint64_t slot = (expires >> (TIMER_WHEEL_SLOT_BITS * level)) & SLOT_MASK;
+  listAppend(&wheel[level][slot], timer);
+}
+
+static uint64_t msToTicks(uint32_t ms) {
+  uint64_t ticks = (ms + TIMER_WHEEL_TICK_MS - 1) / TIMER_WHEEL_TICK_MS;
+  return ticks == 0 ? 1 : ticks;
+}
+
+void timerInit(WheelTimer *timer, TimerCallback callback, void *arg) {
+  timer->next = NULL;
+  timer->prev = NULL;
+  timer->expiresTick = 0;
+  timer->periodMs = 0;
+  timer->callback = callback;
+  timer->arg = arg;
+  timer->active = false;
+}
+
+void timerStart(WheelTimer *timer, uint32_t delayMs, uint32_t periodMs) {
+  ensureWheelInitialized();
+  timerCancel(timer);
+
+  // Relativo al reloj real: la rueda puede ir atrasada si no se avanzó recientemente
+  uint64_t nowTick = monoMillis() / TIMER_WHEEL_TICK_MS;
+  timer->expiresTick = max(nowTick, currentTick) + msToTicks(delayMs);
+  timer->periodMs = periodMs;
+  timer->active = true;
+  activeTimers++;
+  placeTimer(timer);
+}
+
+void timerCancel(WheelTimer *timer) {
+  if (!timer->active) return;
+  listUnlink(timer);
+  timer->active = false;
+  activeTimers--;
+}
+
+bool timerIsActive(const WheelTimer *timer) {
+  return timer->active;
+}
+
+uint64_t timerRemainingMs(const WheelTimer *timer) {
+  if (!timer->active) return 0;
+  uint64_t expiresMs = timer->expiresTick * TIMER_WHEEL_TICK_MS;
+  uint64_t now = monoMillis();
+  return expiresMs > now ? expiresMs - now : 0;
+}
+
+// Redistribuye una ranura de un nivel superior hacia los niveles inferiores
+static void cascade(int level, uint64_t slot) {
+  WheelTimer pending;
+  listInit(&pending);
+  listSplice(&wheel[level][slot], &pending);
+  while (!listEmpty(&pending)) {
+    WheelTimer *timer = pending.next;
+    listUnlink(timer);
+    placeTimer(timer);
+  }
+}
+
+static void runExpired(uint64_t slot) {
+  WheelTimer pending;
+  listInit(&pending);
+  listSplice(&wheel[0][slot], &pending);
+
+  while (!listEmpty(&pending)) {
+    WheelTimer *timer = pending.next;
+    listUnlink(timer);
+    timer->active = false;
+    activeTimers--;
+
+    // Rearmar antes del callback para que éste pueda cancelarlo o reprogramarlo
+    if (timer->periodMs > 0) {
+      uint64_t next = timer->expiresTick + msToTicks(timer->periodMs);
+      if (next <= currentTick) {
+        next = currentTick + msToTicks(timer->periodMs); // Saltar periodos perdidos
+      }
+      timer->expiresTick = next;
+      timer->active = true;
+      activeTimers++;
+      placeTimer(timer);
+    }
+
+    timer->callback(timer->arg);
+  }
+}
+
+void timerWheelAdvance(uint64_t nowMs) {
+  ensureWheelInitialized();
+  uint64_t nowTick = nowMs / TIMER_WHEEL_TICK_MS;
+
+  if (activeTimers == 0) {
+    if (nowTick > currentTick) currentTick = nowTick;
+    return;
+  }
+
+  while (currentTick < nowTick) {
+    currentTick++;
+
+    // Al completar una vuelta de un nivel se recascada la ranura del siguiente
+    for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+      if ((currentTick & ((1ULL << (TIMER_WHEEL_SLOT_BITS * level)) - 1)) != 0) break;
+      cascade(level, (currentTick >> (TIMER_WHEEL_SLOT_BITS * level)) & SLOT_MASK);
+    }
+
+    runExpired(currentTick & SLOT_MASK);
+  }
+}
+
+uint64_t timerWheelNextDeadline() {
+  ensureWheelInitialized();
+  if (activeTimers == 0) return UINT64_MAX;
+
+  uint64_t best = UINT64_MAX;
+
+  // Nivel 0: vencimiento exacto
+  for (uint64_t i = 1; i <= TIMER_WHEEL_SLOTS; i++) {
+    uint64_t tick = currentTick + i;
+    if (!listEmpty(&wheel[0][tick & SLOT_MASK])) {
+      best = tick;
+      break;
+    }
+  }
+
+  // Niveles superiores: la próxima frontera con una ranura ocupada por recascadar
+  for (int level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+    int shift = TIMER_WHEEL_SLOT_BITS * level;
+    for (uint64_t k = 1; k <= TIMER_WHEEL_SLOTS; k++) {
+      uint64_t boundary = ((currentTick >> shift) + k) << shift;
+      if (boundary >= best) break;
+      if (!listEmpty(&wheel[level][(boundary >> shift) & SLOT_MASK])) {
+        best = boundary;
+        break;
+      }
+    }
+  }
+
+  return best == UINT64_MAX ? best : best * TIMER_WHEEL_TICK_MS;
+}
@@ -0,0 +1,45 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <Arduino.h>
+
+// Rueda de temporizadores jerárquica (4 niveles x 64 ranuras, tick de 10 ms).
+// Alcance sin recascada: 64^4 ticks ≈ 46 horas. Inserción y cancelación O(1):
+// cada temporizador es un nodo de una lista doblemente enlazada circular.
+#define TIMER_WHEEL_TICK_MS 10
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+
+typedef void (*TimerCallback)(void *arg);
+
+struct WheelTimer {
+  WheelTimer *next;
+  WheelTimer *prev;
+  uint64_t expiresTick;
+  uint32_t periodMs;        // 0 = disparo único
+  TimerCallback callback;
+  void *arg;
+  bool active;
+};
+
+// Inicializa un temporizador (no lo arma)
+void timerInit(WheelTimer *timer, TimerCallback callback, void *arg = NULL);
+
+// Arma el temporizador para dentro de delayMs; si periodMs > 0 se rearma solo
+void timerStart(WheelTimer *timer, uint32_t delayMs, uint32_t periodMs = 0);
+void timerCancel(WheelTimer *timer);
+bool timerIsActive(const WheelTimer *timer);
+
+// Ms monotónicos restantes hasta el vencimiento (0 si inactivo o vencido)
+uint64_t timerRemainingMs(const WheelTimer *timer);
+
+// Avanza la rueda hasta 'nowMs' y ejecuta los callbacks vencidos
+void timerWheelAdvance(uint64_t nowMs);
+
+// Próximo instante (ms monotónicos) en que la rueda necesita atención: el
+// vencimiento exacto en el nivel 0 o la recascada de un nivel superior.
+// Devuelve UINT64_MAX si no hay temporizadores activos.
+uint64_t timerWheelNextDeadline();
+
+#endif
@@ -0,0 +1,253 @@
+// Comprueba las tramas ALARM no solicitadas (alarms.h) sobre el firmware
+// compilado para Linux, en el mismo proceso y con el reloj virtual: la
+// salida de OrangePiSerial se recoge en memoria y los comandos entran por
+// OrangePiSerial.feed().
+//
+//   alarm_check [--verbose]
+//
+// Recorre sobretensión (latencia de la primera trama frente al sondeo de 2 s
+// de la Orange Pi), reenvíos con espera creciente hasta CMD:ACK, entrada y
+// salida de ERROR, LVD/LVR, ACK sin respuesta y la cola acotada: desalojo de
+// la alarma menos prioritaria y orden de transmisión por prioridad al
+// liberarse la UART. Código 1 si falla.
+
+#include <Arduino.h>
+
+#include <string>
+#include <vector>
+
+#include "alarms.h"
+#include "host.h"
+#include "modbus_slave.h"
+
+// cargador_gel_litio.ino
+void setup();
+void loop();
+extern HardwareSerial OrangePiSerial;
+
+#define CHECK_START_HOUR 10
+#define CHECK_PANEL_ADDRESS 0x40
+#define CHECK_BATTERY_ADDRESS 0x41
+#define CHECK_NTC_ADC_25C 2048
+#define CHECK_STEP_MS 10                  // Vuelta de loop() simulada
+#define CHECK_POLL_PERIOD_MS 2000         // Sondeo CMD:GET_DATA de la Orange Pi
+#define CHECK_DETECTION_MS 2000           // Ciclo de control + validación de voltaje (1 s cada uno)
+
+struct Frame {
+  unsigned seq;
+  std::string priority;
+  std::string code;
+  float value;
+  unsigned long uptime;
+  unsigned sends;
+  uint64_t atMs;                          // Reloj virtual al salir por la UART
+};
+
+static FILE *uart = nullptr;
+static char *uartBuffer = nullptr;
+static size_t uartSize = 0;
+static size_t uartConsumed = 0;
+static std::vector<Frame> frames;
+static std::vector<std::string> replies;   // Líneas que no son ALARM ni HEARTBEAT
+static bool verbose = false;
+static int failures = 0;
+
+static void expect(bool condition, const char *what) {
+  printf("%s %s\n", condition ? "✓" : "✗", what);
+  if (!condition) failures++;
+}
+
+static uint64_t nowMs() {
+  return hostMicros() / 1000;
+}
+
+// Separa las líneas nuevas de la UART en tramas y respuestas
+static void collect() {
+  fflush(uart);
+  while (true) {
+    char *start = uartBuffer + uartConsumed;
+    char *end = (char *)memchr(start, '\n', uartSize - uartConsumed);
+    if (end == nullptr) return;
+    std::string line(start, end - start);
+    uartConsumed += end - start + 1;
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (verbose) printf("  <- %s\n", line.c_str());
+
+    char priority[16], code[24];
+    Frame frame;
+    if (sscanf(line.c_str(), "ALARM:%u:%15[A-Z]:%23[A-Z_]:%f:%lu:%u", &frame.seq, priority, code, &frame.value,
+               &frame.uptime, &frame.sends) == 6) {
+      frame.priority = priority;
+      frame.code = code;
+      frame.atMs = nowMs();
+      frames.push_back(frame);
+    } else if (line.compare(0, 10, "HEARTBEAT:") != 0) {
+      replies.push_back(line);
+    }
+  }
+}
+
+static void run(uint64_t ms) {
+  for (uint64_t elapsed = 0; elapsed < ms; elapsed += CHECK_STEP_MS) {
+    hostAdvanceMicros(CHECK_STEP_MS * 1000ULL);
+    loop();
+    collect();
+  }
+}
+
+// Avanza hasta la primera trama nueva con ese código (nullptr si no llega)
+static const Frame *runUntilFrame(const char *code, uint64_t timeoutMs) {
+  size_t from = frames.size();
+  for (uint64_t elapsed = 0; elapsed < timeoutMs; elapsed += CHECK_STEP_MS) {
+    run(CHECK_STEP_MS);
+    for (size_t i = from; i < frames.size(); i++) {
+      if (frames[i].code == code) return &frames[i];
+    }
+  }
+  return nullptr;
+}
+
+static void sendCommand(const std::string &command) {
+  if (verbose) printf("  -> %s\n", command.c_str());
+  std::string line = command + "\n";
+  OrangePiSerial.feed(line.c_str(), line.size());
+  run(CHECK_STEP_MS * 2);
+}
+
+static void setBattery(float volts) {
+  hostSetIna219(CHECK_BATTERY_ADDRESS, volts, 40.0f);
+}
+
+static std::vector<const Frame *> framesFor(unsigned seq, size_t from = 0) {
+  std::vector<const Frame *> found;
+  for (size_t i = from; i < frames.size(); i++) {
+    if (frames[i].seq == seq) found.push_back(&frames[i]);
+  }
+  return found;
+}
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--verbose") == 0) verbose = true;
+    else {
+      fprintf(stderr, "Uso: %s [--verbose]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  uart = open_memstream(&uartBuffer, &uartSize);
+  Serial.setSink(nullptr);
+  OrangePiSerial.setSink(uart);
+  hostSetDelayAdvancesClock(false);
+  hostSetMicros((uint64_t)CHECK_START_HOUR * 3600ULL * 1000000ULL);
+  hostSetIna219(CHECK_PANEL_ADDRESS, 18.5f, 250.0f);
+  setBattery(12.9f);
+  hostSetAnalog(TEMP_PIN, CHECK_NTC_ADC_25C);
+  setup();
+  run(3000);
+  expect(frames.empty(), "sin alarmas en condiciones normales");
+
+  // --- Sobretensión: trama inmediata y reenvíos hasta el ACK ---
+  uint64_t changedAt = nowMs();
+  setBattery(15.5f);
+  const Frame *overVoltage = runUntilFrame("OVER_VOLTAGE", 3000);
+  expect(overVoltage != nullptr, "OVER_VOLTAGE empujada sin sondeo");
+  if (overVoltage == nullptr) return 1;
+  Frame first = *overVoltage;
+  uint64_t latency = first.atMs - changedAt;
+  printf("  %llu ms desde el cambio (detección cada %d ms; sondeo cada %d ms)\n", (unsigned long long)latency,
+         CHECK_DETECTION_MS, CHECK_POLL_PERIOD_MS);
+  expect(latency <= CHECK_DETECTION_MS + CHECK_STEP_MS, "sale en el ciclo que detecta la sobretensión");
+  expect(first.seq == 1 && first.priority == "CRITICAL" && first.sends == 1 && first.value > 15.0f,
+         "ALARM:1:CRITICAL:OVER_VOLTAGE con el voltaje medido");
+
+  const Frame *error = runUntilFrame("ERROR_ENTERED", 8000);
+  expect(error != nullptr && error->seq == 2 && error->priority == "CRITICAL",
+         "ERROR_ENTERED tras las 5 validaciones");
+  run(ALARM_RETRY_MIN_MS * 8);
+  std::vector<const Frame *> resent = framesFor(1);
+  bool backoff = resent.size() >= 4;
+  for (size_t i = 1; i < resent.size(); i++) {
+    backoff &= resent[i]->sends == i + 1 && resent[i]->uptime == first.uptime;
+    if (i >= 2) backoff &= resent[i]->atMs - resent[i - 1]->atMs > resent[i - 1]->atMs - resent[i - 2]->atMs;
+  }
+  printf("  #1 enviada %zu veces sin ACK\n", resent.size());
+  expect(backoff, "reenvíos con espera creciente y el mismo instante de origen");
+
+  size_t repliesBefore = replies.size();
+  sendCommand("CMD:ACK:abc");
+  sendCommand("CMD:ACK:1");
+  sendCommand("CMD:ACK:999");
+  expect(replies.size() == repliesBefore, "CMD:ACK no tiene respuesta");
+  size_t afterAck = frames.size();
+  run(ALARM_RETRY_MAX_MS * 2);
+  expect(framesFor(1, afterAck).empty() && !framesFor(2, afterAck).empty(),
+         "#1 confirmada deja de reenviarse; #2 sigue");
+  sendCommand("CMD:ACK:2");
+  afterAck = frames.size();
+  run(ALARM_RETRY_MAX_MS * 2);
+  expect(frames.size() == afterAck && getAlarmsPending() == 0, "sin pendientes tras confirmar todo");
+
+  sendCommand("CMD:ALARMS");
+  std::string status = replies.empty() ? "" : replies.back();
+  expect(status.compare(0, 7, "ALARMS:") == 0 && status.find("\"pending\":[]") != std::string::npos &&
+         status.find("\"acked\":2") != std::string::npos, "CMD:ALARMS: sin pendientes, 2 confirmadas");
+
+  // --- Salida de ERROR, LVD y LVR ---
+  setBattery(13.0f);
+  const Frame *cleared = runUntilFrame("ERROR_CLEARED", 5000);
+  expect(cleared != nullptr && cleared->priority == "INFO", "ERROR_CLEARED al normalizarse");
+  if (cleared != nullptr) sendCommand("CMD:ACK:" + std::to_string(cleared->seq));
+
+  setBattery(11.5f);
+  const Frame *lvd = runUntilFrame("LOAD_DISCONNECT", 3000);
+  expect(lvd != nullptr && lvd->priority == "WARNING" && lvd->value < 12.0f, "LOAD_DISCONNECT por debajo de LVD");
+  if (lvd != nullptr) sendCommand("CMD:ACK:" + std::to_string(lvd->seq));
+  size_t beforeRepeat = frames.size();
+  run(5000);
+  expect(frames.size() == beforeRepeat, "el LVD no se repite mientras dura");
+
+  setBattery(12.8f);
+  const Frame *lvr = runUntilFrame("LOAD_RECONNECT", 3000);
+  expect(lvr != nullptr && lvr->priority == "INFO", "LOAD_RECONNECT por encima de LVR");
+  if (lvr != nullptr) sendCommand("CMD:ACK:" + std::to_string(lvr->seq));
+  run(100);
+  expect(getAlarmsPending() == 0, "todas confirmadas");
+
+  // --- Cola acotada con la UART ocupada (Modbus) ---
+  modbusStart(MODBUS_DEFAULT_ID);
+  unsigned firstSeq = 0;
+  for (int i = 0; i < ALARM_QUEUE_SIZE; i++) {
+    alarmRaise(ALARM_LOAD_RECONNECT, 12.6f + i * 0.01f);
+    if (i == 0) firstSeq = frames.empty() ? 0 : frames.back().seq + 1;
+  }
+  alarmRaise(ALARM_LOAD_DISCONNECT, 11.9f);
+  alarmRaise(ALARM_OVER_VOLTAGE, 15.2f);
+  size_t blocked = frames.size();
+  run(100);
+  expect(frames.size() == blocked, "en Modbus las alarmas esperan en la cola");
+  expect(getAlarmsPending() == ALARM_QUEUE_SIZE && getAlarmsDropped() == 2,
+         "cola llena: se desalojan las 2 INFO más antiguas");
+
+  modbusStop();
+  run(CHECK_STEP_MS);
+  std::vector<Frame> burst(frames.begin() + blocked, frames.end());
+  expect(burst.size() == ALARM_QUEUE_SIZE, "al liberar la UART salen las 8 pendientes");
+  if (burst.size() == ALARM_QUEUE_SIZE) {
+    bool ordered = burst[0].code == "OVER_VOLTAGE" && burst[1].code == "LOAD_DISCONNECT";
+    for (size_t i = 2; i < burst.size(); i++) {
+      ordered &= burst[i].code == "LOAD_RECONNECT" && burst[i].seq == firstSeq + i;
+    }
+    expect(ordered, "por prioridad: CRITICAL, WARNING y las INFO de la más antigua a la más nueva");
+    for (const Frame &frame : burst) sendCommand("CMD:ACK:" + std::to_string(frame.seq));
+  }
+  run(100);
+  expect(getAlarmsPending() == 0, "cola vacía tras los ACK");
+
+  if (failures > 0) {
+    printf("FALLO: %d comprobaciones\n", failures);
+    return 1;
+  }
+  printf("OK: tramas de alarma\n");
+  return 0;
+}
@@ -0,0 +1,253 @@
+// Comprueba que el ciclo de control del firmware no usa el heap. Corre el
+// firmware compilado para Linux contra la planta de tools/sweep (sol, batería
+// de gel y consumo) durante dos días simulados, con la Orange Pi pidiendo
+// GET_DATA cada 5 s y la web sirviendo /, /data y /metrics, y cuenta las asignaciones
+// por región con alloc_tracker (CMD:HEAP) alimentado por un interpositor de
+// malloc.
+//
+//   alloc_check [--days N] [--backtraces N]
+//
+// Falla (código 1) si un ciclo de control o nocturno en régimen permanente
+// (misma etapa que los ciclos anteriores) asigna memoria, y muestra la pila
+// de las primeras asignaciones culpables. Las transiciones de etapa sí pueden
+// asignar (notas, registro) y solo se informan. /metrics se escribe desde un
+// buffer fijo y tampoco puede asignar.
+//
+// Diferencia con el equipo: el String del host usa std::string, que guarda
+// sin heap hasta 15 caracteres; el de Arduino-ESP32 solo hasta 11. CMD:HEAP
+// en el equipo (modo exacto) cubre ese margen.
+
+#include <Arduino.h>
+
+#include <cxxabi.h>
+#include <execinfo.h>
+
+#include <string>
+
+#include "alloc_tracker.h"
+#include "host.h"
+#include "metrics.h"
+#include "plant_model.h"
+#include "timer_wheel.h"
+#include "web_server.h"
+
+// cargador_gel_litio.ino
+void setup();
+void loop();
+String getChargeStateString(ChargeState state);
+extern HardwareSerial OrangePiSerial;
+extern ChargeState currentState;
+extern int currentPWM;
+extern bool nightModeActive;
+
+#define CHECK_START_HOUR 5
+#define CHECK_DAYS 2.0f
+#define CHECK_GET_DATA_PERIOD_MS 5000     // Sondeo de la Orange Pi
+#define CHECK_WEB_PERIOD_MS 60000         // Una visita a / y /data por minuto
+#define CHECK_STEADY_TICKS 3              // Ciclos en la misma etapa antes de exigir cero
+#define CHECK_MAX_IDLE_MS 1000
+#define MAX_CAPTURED_STACKS 4
+#define MAX_STACK_DEPTH 24
+
+// ===== Interpositor de malloc =====
+// glibc permite sustituir malloc/free en el ejecutable; operator new de
+// libstdc++ (y por tanto String) pasa por aquí
+extern "C" void *__libc_malloc(size_t size);
+extern "C" void *__libc_calloc(size_t count, size_t size);
+extern "C" void *__libc_realloc(void *ptr, size_t size);
+extern "C" void __libc_free(void *ptr);
+
+static bool captureStacks = false;
+static bool capturing = false;
+static int capturedCount = 0;
+static int capturedDepth[MAX_CAPTURED_STACKS];
+static void *capturedStacks[MAX_CAPTURED_STACKS][MAX_STACK_DEPTH];
+
+static void noteAllocation(size_t size) {
+  allocTrackerNoteAlloc(size);
+  if (!captureStacks || capturing || capturedCount >= MAX_CAPTURED_STACKS) return;
+  if (!isAllocRegionOpen(ALLOC_REGION_CONTROL_TICK) && !isAllocRegionOpen(ALLOC_REGION_NIGHT_TICK)) return;
+  capturing = true;   // backtrace() no asigna una vez inicializado, pero por si acaso
+  capturedDepth[capturedCount] = backtrace(capturedStacks[capturedCount], MAX_STACK_DEPTH);
+  capturedCount++;
+  capturing = false;
+}
+
+extern "C" void *malloc(size_t size) {
+  noteAllocation(size);
+  return __libc_malloc(size);
+}
+
+extern "C" void *calloc(size_t count, size_t size) {
+  noteAllocation(count * size);
+  return __libc_calloc(count, size);
+}
+
+// El String de Arduino crece con realloc(): cuenta como asignación
+extern "C" void *realloc(void *ptr, size_t size) {
+  noteAllocation(size);
+  return __libc_realloc(ptr, size);
+}
+
+extern "C" void free(void *ptr) {
+  if (ptr != nullptr) allocTrackerNoteFree();
+  __libc_free(ptr);
+}
+
+// Nombre legible de un marco de backtrace_symbols(): "exe(_Z3fooi+0x1c) [0x...]"
+static std::string describeFrame(const char *symbol) {
+  std::string text(symbol);
+  size_t open = text.find('(');
+  size_t plus = text.find('+', open);
+  if (open == std::string::npos || plus == std::string::npos || plus == open + 1) return text;
+  std::string mangled = text.substr(open + 1, plus - open - 1);
+  int status = 0;
+  char *demangled = abi::__cxa_demangle(mangled.c_str(), nullptr, nullptr, &status);
+  std::string name = (status == 0 && demangled != nullptr) ? demangled : mangled;
+  free(demangled);
+  return name + text.substr(plus, text.find(')', plus) - plus);
+}
+
+static void printCapturedStacks() {
+  for (int i = 0; i < capturedCount; i++) {
+    fprintf(stderr, "    asignación %d:\n", i + 1);
+    char **symbols = backtrace_symbols(capturedStacks[i], capturedDepth[i]);
+    // Se saltan los marcos del propio interpositor
+    for (int frame = 2; frame < capturedDepth[i] && symbols != nullptr; frame++) {
+      std::string name = describeFrame(symbols[frame]);
+      fprintf(stderr, "      %s\n", name.c_str());
+      if (name.compare(0, 11, "controlTick") == 0 || name.compare(0, 9, "nightTick") == 0) break;
+    }
+    free(symbols);
+  }
+}
+
+static void discardChunk(const char *data, size_t length) {}
+
+// ===== Escenario =====
+struct TickWatch {
+  AllocRegion region;
+  const char *name;
+  uint32_t lastCalls;
+  uint32_t violations;
+};
+
+static void printRegionTable(double loops) {
+  printf("%-12s %9s %9s %10s %8s %12s\n", "región", "llamadas", "asignan", "asig/llam", "máx", "bytes/llam");
+  for (int i = 0; i < ALLOC_REGION_COUNT; i++) {
+    const AllocRegionStats &stats = getAllocRegionStats((AllocRegion)i);
+    if (stats.calls == 0) continue;
+    printf("%-12s %9u %9u %10.2f %8u %12.1f\n", getAllocRegionName((AllocRegion)i), stats.calls,
+           stats.allocatingCalls, (double)stats.allocs / stats.calls, stats.maxAllocs,
+           (double)stats.bytes / stats.calls);
+  }
+  printf("(%.0f vueltas de loop())\n", loops);
+}
+
+int main(int argc, char **argv) {
+  float days = CHECK_DAYS;
+  int maxReports = 5;
+  for (int i = 1; i + 1 < argc; i += 2) {
+    if (strcmp(argv[i], "--days") == 0) days = strtof(argv[i + 1], nullptr);
+    else if (strcmp(argv[i], "--backtraces") == 0) maxReports = atoi(argv[i + 1]);
+  }
+
+  // Primera llamada fuera del escenario: carga libgcc y deja backtrace() listo
+  void *warmup[2];
+  backtrace(warmup, 2);
+
+  Serial.setSink(nullptr);
+  OrangePiSerial.setSink(nullptr);
+  hostSetDelayAdvancesClock(true);
+  hostSetMicros((uint64_t)CHECK_START_HOUR * 3600ULL * 1000000ULL);
+
+  PlantConfig plantConfig;
+  PlantState plant;
+  plantInit(plant, plantConfig, hostMicros());
+  setup();
+  allocTrackerStart();
+  captureStacks = true;
+
+  TickWatch watches[] = {
+    {ALLOC_REGION_CONTROL_TICK, "controlTick", 0, 0},
+    {ALLOC_REGION_NIGHT_TICK, "nightTick", 0, 0},
+  };
+  ChargeState lastState = currentState;
+  bool lastNight = nightModeActive;
+  uint32_t steadyTicks = 0;
+  uint32_t transitionAllocs = 0;
+  int reports = 0;
+  double loops = 0;
+
+  uint64_t endUs = hostMicros() + (uint64_t)(days * 86400.0f) * 1000000ULL;
+  uint64_t nextPollMs = hostMicros() / 1000;
+  uint64_t nextWebMs = nextPollMs;
+  while (hostMicros() < endUs) {
+    uint64_t nowMs = hostMicros() / 1000;
+    plantStep(plant, hostMicros(), currentPWM / 255.0f, hostDigitalLevel(LOAD_CONTROL_PIN) == HIGH);
+    if (nowMs >= nextPollMs) {
+      OrangePiSerial.feed("CMD:GET_DATA\n", 13);
+      nextPollMs += CHECK_GET_DATA_PERIOD_MS;
+    }
+    if (nowMs >= nextWebMs) {
+      // El WebServer del host no atiende clientes: se mide el trabajo de los manejadores
+      allocRegionBegin(ALLOC_REGION_WEB_PAGE);
+      String html = getHTML();
+      allocRegionEnd(ALLOC_REGION_WEB_PAGE);
+      allocRegionBegin(ALLOC_REGION_WEB_DATA);
+      String json = getData();
+      allocRegionEnd(ALLOC_REGION_WEB_DATA);
+      allocRegionBegin(ALLOC_REGION_WEB_METRICS);
+      writeMetrics(discardChunk);
+      allocRegionEnd(ALLOC_REGION_WEB_METRICS);
+      nextWebMs += CHECK_WEB_PERIOD_MS;
+    }
+
+    capturedCount = 0;
+    loop();
+    loops++;
+
+    bool changed = currentState != lastState || nightModeActive != lastNight;
+    for (TickWatch &watch : watches) {
+      const AllocRegionStats &stats = getAllocRegionStats(watch.region);
+      if (stats.calls == watch.lastCalls) continue;
+      watch.lastCalls = stats.calls;
+      if (changed || steadyTicks < CHECK_STEADY_TICKS) {
+        transitionAllocs += stats.lastAllocs;
+        continue;
+      }
+      if (stats.lastAllocs == 0) continue;
+      watch.violations++;
+      if (reports < maxReports) {
+        reports++;
+        fprintf(stderr, "✗ %s a las %.3f h en %s%s: %u asignaciones\n", watch.name, hostMicros() / 3600e6,
+                getChargeStateString(currentState).c_str(), nightModeActive ? " (noche)" : "", stats.lastAllocs);
+        printCapturedStacks();
+      }
+    }
+    steadyTicks = changed ? 0 : steadyTicks + 1;
+    lastState = currentState;
+    lastNight = nightModeActive;
+
+    uint64_t afterMs = hostMicros() / 1000;
+    uint64_t nextMs = std::min(timerWheelNextDeadline(), afterMs + CHECK_MAX_IDLE_MS);
+    if (nextMs <= afterMs) nextMs = afterMs + 1;
+    hostSetMicros(std::max(hostMicros(), nextMs * 1000));
+  }
+  captureStacks = false;
+
+  printRegionTable(loops);
+  uint32_t violations = 0;
+  for (const TickWatch &watch : watches) violations += watch.violations;
+  printf("Asignaciones en transiciones de etapa: %u\n", transitionAllocs);
+  if (violations > 0) {
+    printf("FALLO: %u ciclos en régimen permanente asignaron memoria\n", violations);
+    return 1;
+  }
+  if (getAllocRegionStats(ALLOC_REGION_WEB_METRICS).allocs > 0) {
+    printf("FALLO: /metrics asignó memoria\n");
+    return 1;
+  }
+  printf("OK: ciclo de control sin heap en régimen permanente\n");
+  return 0;
+}
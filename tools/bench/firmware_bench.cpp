@@ -0,0 +1,256 @@
+// Benchmarks de host (Google Benchmark) de las rutas calientes del firmware:
+// conversiones numéricas, contabilidad de Ah, constructores de JSON, parseo de
+// comandos de la Orange Pi (también a ritmo de UART, en comandos/s y baudios
+// sostenidos) y la página web. Se compilan desde las mismas fuentes que el
+// equipo (tools/host), de modo que una regresión en estas funciones aparece
+// antes de flashear.
+//
+//   cmake -S tools/bench -B build-bench && cmake --build build-bench --target bench
+//
+// El objetivo 'bench' deja los resultados en build-bench/bench_results.json
+// (formato JSON de Google Benchmark, comparable con compare.py entre
+// versiones). firmware_bench acepta además todas las opciones --benchmark_*.
+//
+// Complementa a CMD:BENCH (benchmark.h), que mide en el ESP32-C3 las mismas
+// rutas junto con los buses reales.
+
+#include <Arduino.h>
+#include <benchmark/benchmark.h>
+
+#include <string>
+
+#include "event_bus.h"
+#include "host.h"
+#include "metrics.h"
+#include "web_server.h"
+
+// cargador_gel_litio.ino
+void setup();
+void controlTick(void *arg);
+void updateAhTracking();
+float readTemperature();
+void processSerialCommand(String command);
+void handleSerialCommands();
+bool isSerialLineIdle();
+void sendDataToOrangePi();
+String buildOrangePiJson();
+extern HardwareSerial OrangePiSerial;
+
+#define BENCH_PANEL_ADDRESS 0x40
+#define BENCH_BATTERY_ADDRESS 0x41
+#define BENCH_NTC_ADC_25C 2048             // Divisor 10k/10k a 25 °C
+#define BENCH_TICK_US 1000000ULL          // Un ciclo de control entre llamadas
+#define BENCH_UART_BITS_PER_BYTE 10       // 8N1
+
+// ===== Conversiones numéricas =====
+static void BM_GetSOCFromVoltage(benchmark::State &state) {
+  // Recorre todo el rango de la tabla (incluidos los extremos recortados)
+  float voltage = 11.0f;
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(getSOCFromVoltage(voltage));
+    voltage += 0.01f;
+    if (voltage > 13.5f) voltage = 11.0f;
+  }
+}
+BENCHMARK(BM_GetSOCFromVoltage);
+
+static void BM_ReadTemperature(benchmark::State &state) {
+  // Promediado del ADC + Steinhart-Hart; el ADC simulado varía entre llamadas
+  uint16_t adc = 1500;
+  for (auto _ : state) {
+    hostSetAnalog(TEMP_PIN, adc);
+    benchmark::DoNotOptimize(readTemperature());
+    adc = adc >= 2600 ? 1500 : adc + 7;
+  }
+}
+BENCHMARK(BM_ReadTemperature);
+
+static void BM_UpdateAhTracking(benchmark::State &state) {
+  for (auto _ : state) {
+    hostAdvanceMicros(BENCH_TICK_US);
+    updateAhTracking();
+  }
+}
+BENCHMARK(BM_UpdateAhTracking);
+
+// ===== Serializadores =====
+static void BM_GetData(benchmark::State &state) {
+  size_t bytes = 0;
+  for (auto _ : state) {
+    String json = getData();
+    bytes = json.length();
+    benchmark::DoNotOptimize(json);
+  }
+  state.counters["bytes"] = bytes;
+  state.SetBytesProcessed((int64_t)state.iterations() * bytes);
+}
+BENCHMARK(BM_GetData);
+
+static void BM_BuildOrangePiJson(benchmark::State &state) {
+  size_t bytes = 0;
+  for (auto _ : state) {
+    String json = buildOrangePiJson();
+    bytes = json.length();
+    benchmark::DoNotOptimize(json);
+  }
+  state.counters["bytes"] = bytes;
+  state.SetBytesProcessed((int64_t)state.iterations() * bytes);
+}
+BENCHMARK(BM_BuildOrangePiJson);
+
+// /metrics completo por trozos de METRICS_CHUNK_SIZE (sumidero que solo cuenta)
+static size_t metricsBytes = 0;
+static void countChunk(const char *data, size_t length) {
+  metricsBytes += length;
+}
+
+static void BM_WriteMetrics(benchmark::State &state) {
+  size_t bytes = 0;
+  for (auto _ : state) {
+    metricsBytes = 0;
+    writeMetrics(countChunk);
+    bytes = metricsBytes;
+  }
+  state.counters["bytes"] = bytes;
+  state.SetBytesProcessed((int64_t)state.iterations() * bytes);
+}
+BENCHMARK(BM_WriteMetrics);
+
+// Incluye la escritura en la UART (descartada en el host)
+static void BM_SendDataToOrangePi(benchmark::State &state) {
+  for (auto _ : state) {
+    sendDataToOrangePi();
+  }
+}
+BENCHMARK(BM_SendDataToOrangePi);
+
+static void BM_GetHTML(benchmark::State &state) {
+  size_t bytes = 0;
+  for (auto _ : state) {
+    String html = getHTML();
+    bytes = html.length();
+    benchmark::DoNotOptimize(html);
+  }
+  state.counters["bytes"] = bytes;
+  state.SetBytesProcessed((int64_t)state.iterations() * bytes);
+}
+BENCHMARK(BM_GetHTML);
+
+// ===== Parseo de comandos =====
+// Cada caso es una línea tal como llega de la Orange Pi; el bus se despacha
+// en cada iteración para que los SET_ se apliquen y no llenen la cola
+static const char *const BENCH_COMMANDS[] = {
+  "CMD:GET_DATA",
+  "CMD:SET_bulkVoltage:14.4",
+  "CMD:SET_thresholdPercentage:1.0",
+  "CMD:SET_noSuchParam:1",
+  "CMD:NO_SUCH_COMMAND",
+  "garbage without prefix",
+};
+
+static void BM_ProcessSerialCommand(benchmark::State &state) {
+  String command(BENCH_COMMANDS[state.range(0)]);
+  state.SetLabel(command.c_str());
+  for (auto _ : state) {
+    processSerialCommand(command);
+    eventBusDispatch();
+  }
+}
+BENCHMARK(BM_ProcessSerialCommand)->DenseRange(0, sizeof(BENCH_COMMANDS) / sizeof(BENCH_COMMANDS[0]) - 1);
+
+// ===== Recepción por la UART =====
+// Lo que manda la Orange Pi en una sesión típica: sondeo de datos, algún
+// ajuste, sincronía de hora, apagado temporal y una línea corrupta
+static const char *const BENCH_COMMAND_MIX[] = {
+  "CMD:GET_DATA", "CMD:GET_DATA", "CMD:SET_bulkVoltage:14.4", "CMD:GET_DATA",
+  "CMD:SET_TIME:1760000000", "CMD:GET_DATA", "CMD:SET_thresholdPercentage:1.0", "CMD:GET_DATA",
+  "CMD:TOGGLE_LOAD:30", "CMD:GET_DATA", "CMD:CANCEL_TEMP_OFF", "CMD:GET_DATA",
+  "CMD:SET_isLithium:false", "CMD:GET_DATA", "CMD:GET_D\x01TA", "CMD:GET_DATA",
+};
+
+// Vacía la UART simulada como lo hace loop(): varias llamadas si hay más
+// líneas que SERIAL_MAX_LINES_PER_CALL
+static void drainSerial() {
+  while (OrangePiSerial.available() > 0 || !isSerialLineIdle()) {
+    handleSerialCommands();
+    eventBusDispatch();
+  }
+}
+
+static void reportLineRate(benchmark::State &state, size_t bytesPerIteration, size_t linesPerIteration) {
+  state.SetBytesProcessed((int64_t)state.iterations() * bytesPerIteration);
+  state.SetItemsProcessed((int64_t)state.iterations() * linesPerIteration);
+  // Baudios que el parser sostiene: por encima de 921600 no es el cuello de botella
+  state.counters["baud"] = benchmark::Counter((double)state.iterations() * bytesPerIteration * BENCH_UART_BITS_PER_BYTE,
+                                              benchmark::Counter::kIsRate);
+}
+
+// Comandos por segundo con la mezcla completa (incluye construir y enviar
+// las respuestas, que dominan en GET_DATA)
+static void BM_SerialCommandMix(benchmark::State &state) {
+  std::string batch;
+  for (const char *command : BENCH_COMMAND_MIX) {
+    batch += command;
+    batch += "\n";
+  }
+  size_t lines = sizeof(BENCH_COMMAND_MIX) / sizeof(BENCH_COMMAND_MIX[0]);
+  for (auto _ : state) {
+    OrangePiSerial.feed(batch.data(), batch.size());
+    drainSerial();
+  }
+  reportLineRate(state, batch.size(), lines);
+}
+BENCHMARK(BM_SerialCommandMix);
+
+// Solo el parser: líneas que no generan trabajo (comando desconocido)
+static void BM_SerialUnknownCommand(benchmark::State &state) {
+  const char line[] = "CMD:NO_SUCH_COMMAND\n";
+  for (auto _ : state) {
+    OrangePiSerial.feed(line, sizeof(line) - 1);
+    drainSerial();
+  }
+  reportLineRate(state, sizeof(line) - 1, 1);
+}
+BENCHMARK(BM_SerialUnknownCommand);
+
+// Entrada mal formada de longitud creciente: una línea sin fin de ruido.
+// El coste debe crecer linealmente (las líneas largas se descartan sin copiar)
+static void BM_SerialMalformedLine(benchmark::State &state) {
+  std::string line = "CMD:SET_bulkVoltage:";
+  while (line.size() < (size_t)state.range(0)) line += (char)('!' + line.size() % 90);
+  line += "\n";
+  for (auto _ : state) {
+    OrangePiSerial.feed(line.data(), line.size());
+    drainSerial();
+  }
+  reportLineRate(state, line.size(), 1);
+  state.SetComplexityN(state.range(0));
+}
+BENCHMARK(BM_SerialMalformedLine)->RangeMultiplier(4)->Range(64, 64 << 10)->Complexity(benchmark::oN);
+
+// Estado de trabajo realista: batería a media carga, panel entregando y
+// varios ciclos de control para que haya instantánea y regulador en marcha
+static void prepareFirmware() {
+  Serial.setSink(nullptr);
+  OrangePiSerial.setSink(nullptr);
+  hostSetDelayAdvancesClock(true);
+  hostSetMicros(6ULL * 3600ULL * 1000000ULL);
+  hostSetIna219(BENCH_PANEL_ADDRESS, 18.5f, 250.0f);      // 2.5 A tras SHUNT_CURRENT_SCALE
+  hostSetIna219(BENCH_BATTERY_ADDRESS, 12.9f, 40.0f);     // 0.4 A de consumo
+  hostSetAnalog(TEMP_PIN, BENCH_NTC_ADC_25C);
+  setup();
+  for (int i = 0; i < 10; i++) {
+    hostAdvanceMicros(BENCH_TICK_US);
+    controlTick(nullptr);
+    eventBusDispatch();
+  }
+}
+
+int main(int argc, char **argv) {
+  prepareFirmware();
+  benchmark::Initialize(&argc, argv);
+  if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+  benchmark::RunSpecifiedBenchmarks();
+  benchmark::Shutdown();
+  return 0;
+}
@@ -0,0 +1,56 @@
+// Comprueba que los núcleos iir_float e iir_q15 de CMD:BENCH (benchmark.h)
+// calculan lo mismo: la comparación float/Q15 solo tiene sentido si las dos
+// versiones filtran igual. Se usa la señal del propio CMD:BENCH y entradas a
+// fondo de escala (escalones de -32768 a 32767), donde un desbordamiento del
+// producto en Q15 se nota enseguida.
+//
+//   kernel_check
+//
+// Código 1 si alguna salida Q15 se separa más de KERNEL_TOLERANCE de la float.
+
+#include <Arduino.h>
+
+#include <cmath>
+#include <cstdio>
+
+#include "benchmark.h"
+
+#define KERNEL_TOLERANCE 1.0f             // La salida Q15 se trunca al entero
+#define STEP_SAMPLES 128                  // Asentado de sobra con alpha = 1/8
+
+static int failures = 0;
+
+static void expectKernelsAgree(const int16_t *input, int count, const char *what) {
+  float reference = iirFloatKernel(input, count);
+  int32_t fixed = iirQ15Kernel(input, count);
+  bool ok = fabsf((float)fixed - reference) <= KERNEL_TOLERANCE;
+  printf("%s %s: float %.2f, Q15 %ld\n", ok ? "✓" : "✗", what, reference, (long)fixed);
+  if (!ok) failures++;
+}
+
+int main() {
+  static int16_t input[BENCH_KERNEL_SAMPLES];
+  fillBenchKernelInput(input);
+  expectKernelsAgree(input, BENCH_KERNEL_SAMPLES, "señal de CMD:BENCH");
+  for (int count = 1; count < BENCH_KERNEL_SAMPLES; count *= 2) {
+    char what[48];
+    snprintf(what, sizeof(what), "señal de CMD:BENCH, %d muestras", count);
+    expectKernelsAgree(input, count, what);
+  }
+
+  static int16_t steps[2 * STEP_SAMPLES];
+  for (int i = 0; i < STEP_SAMPLES; i++) {
+    steps[i] = INT16_MAX;
+    steps[STEP_SAMPLES + i] = INT16_MIN;
+  }
+  expectKernelsAgree(steps, STEP_SAMPLES, "fondo de escala positivo");
+  expectKernelsAgree(steps, 2 * STEP_SAMPLES, "escalón de 32767 a -32768");
+  expectKernelsAgree(steps + STEP_SAMPLES, STEP_SAMPLES, "fondo de escala negativo");
+
+  if (failures > 0) {
+    printf("FALLO: %d comprobaciones\n", failures);
+    return 1;
+  }
+  printf("OK: núcleos float y Q15 equivalentes\n");
+  return 0;
+}
@@ -0,0 +1,262 @@
+// Fuzzing del protocolo serial con la Orange Pi: los bytes de cada entrada
+// entran por OrangePiSerial y recorren handleSerialCommands(),
+// processSerialCommand(), handleSetCommand(), handleToggleLoad(), ... (o
+// modbusService() tras CMD:MODBUS:ON, mqttService() y el receptor del túnel
+// tras CMD:MQTT:ON), los reenvíos de alarmas y el despacho del bus, sobre el
+// firmware compilado para Linux (tools/host).
+//
+// Con clang es un objetivo de libFuzzer guiado por cobertura:
+//   CC=clang CXX=clang++ cmake -S tools/fuzz -B build-fuzz
+//   cmake --build build-fuzz --target fuzz      (60 s con commands.dict)
+// Con gcc (sin libFuzzer) se compila el mismo objetivo con un driver propio
+// que reproduce ficheros o genera entradas aleatorias desde el diccionario:
+//   command_fuzz [fichero|directorio ...] [--runs N] [--seed S] [--verbose]
+// (--verbose muestra las respuestas a la Orange Pi: útil para reproducir un
+// fallo).
+// En ambos casos con ASan y UBSan.
+//
+// Además de los fallos de memoria, aborta si una entrada rompe una
+// invariante: parámetros de carga fuera de rango o no finitos, o el buffer
+// de línea por encima de su capacidad.
+
+#include <Arduino.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "alarms.h"
+#include "event_bus.h"
+#include "history.h"
+#include "host.h"
+#include "modbus_slave.h"
+#include "mqtt_publisher.h"
+#include "thermal_control.h"
+
+// cargador_gel_litio.ino
+void setup();
+void controlTick(void *arg);
+void handleSerialCommands();
+bool isSerialLineIdle();
+extern HardwareSerial OrangePiSerial;
+extern String serialBuffer;
+extern float batteryCapacity, thresholdPercentage, maxAllowedCurrent;
+extern float bulkVoltage, absorptionVoltage, floatVoltage, fuenteDC_Amps;
+extern float absorptionCurrentThreshold_mA, currentLimitIntoFloatStage;
+extern int factorDivider;
+
+#define FUZZ_LINE_MAX 200                 // SERIAL_LINE_MAX del firmware
+#define FUZZ_PANEL_ADDRESS 0x40
+#define FUZZ_BATTERY_ADDRESS 0x41
+#define FUZZ_NTC_ADC_25C 2048
+#define FUZZ_MAX_INPUT 4096
+#define FUZZ_DEFAULT_RUNS 20000
+
+// Comandos lentos por diseño (bucles de medida de varios segundos): no aportan
+// cobertura del parser y disparan los timeouts del fuzzer
+static const char *const SLOW_COMMANDS[] = {"CMD:BENCH", "CMD:SAMPLING_TEST"};
+
+static bool containsSlowCommand(const uint8_t *data, size_t size) {
+  std::string text((const char *)data, size);
+  for (const char *command : SLOW_COMMANDS) {
+    if (text.find(command) != std::string::npos) return true;
+  }
+  return false;
+}
+
+static void check(bool condition, const char *what) {
+  if (condition) return;
+  fprintf(stderr, "✗ invariante rota: %s\n", what);
+  abort();
+}
+
+static void checkInvariants() {
+  check(serialBuffer.length() <= FUZZ_LINE_MAX, "serialBuffer supera SERIAL_LINE_MAX");
+  check(std::isfinite(batteryCapacity) && batteryCapacity > 0 && batteryCapacity <= 1000, "batteryCapacity");
+  check(thresholdPercentage >= 0.1f && thresholdPercentage <= 5.0f, "thresholdPercentage");
+  check(maxAllowedCurrent >= 1000 && maxAllowedCurrent <= 15000, "maxAllowedCurrent");
+  check(bulkVoltage >= 12.0f && bulkVoltage <= 15.0f, "bulkVoltage");
+  check(absorptionVoltage >= 12.0f && absorptionVoltage <= 15.0f, "absorptionVoltage");
+  check(floatVoltage >= 12.0f && floatVoltage <= 15.0f, "floatVoltage");
+  check(fuenteDC_Amps >= 0 && fuenteDC_Amps <= 50, "fuenteDC_Amps");
+  check(factorDivider >= 1 && factorDivider <= 10, "factorDivider");
+  check(tempSoftLimit >= 40.0f && tempSoftLimit < tempHardLimit, "tempSoftLimit < tempHardLimit");
+  check(std::isfinite(absorptionCurrentThreshold_mA) && std::isfinite(currentLimitIntoFloatStage),
+        "parámetros derivados no finitos");
+}
+
+extern "C" int LLVMFuzzerInitialize(int *argc, char ***argv) {
+  Serial.setSink(nullptr);
+  OrangePiSerial.setSink(nullptr);
+  hostSetDelayAdvancesClock(true);
+  hostSetMicros(6ULL * 3600ULL * 1000000ULL);
+  hostSetIna219(FUZZ_PANEL_ADDRESS, 18.5f, 250.0f);
+  hostSetIna219(FUZZ_BATTERY_ADDRESS, 12.9f, 40.0f);
+  hostSetAnalog(TEMP_PIN, FUZZ_NTC_ADC_25C);
+  setup();
+  for (int i = 0; i < 3; i++) {
+    hostAdvanceMicros(1000000ULL);
+    controlTick(nullptr);
+    eventBusDispatch();
+  }
+  return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  if (size > FUZZ_MAX_INPUT || containsSlowCommand(data, size)) return -1;
+
+  OrangePiSerial.feed((const char *)data, size);
+  // El '\n' final cierra la última línea: cada entrada empieza con el buffer vacío
+  OrangePiSerial.feed("\n", 1);
+  while (OrangePiSerial.available() > 0 || !isSerialLineIdle()) {
+    // Tras CMD:MODBUS:ON el resto de la entrada son tramas Modbus, como en loop()
+    if (isModbusActive()) modbusService();
+    else handleSerialCommands();
+    mqttService();
+    alarmsService();
+    historyService();
+    eventBusDispatch();
+    checkInvariants();
+  }
+  checkInvariants();
+  // Cada entrada empieza en el protocolo de texto
+  if (isModbusActive()) modbusStop();
+  if (isMqttEnabled()) mqttSetEnabled(false);
+  return 0;
+}
+
+#ifndef FUZZ_WITH_LIBFUZZER
+// ===== Driver sin libFuzzer =====
+// Fichas del protocolo (las mismas que commands.dict)
+static const char *const COMMANDS[] = {
+  "GET_DATA", "SET_", "SET_TIME:", "TOGGLE_LOAD:", "CANCEL_TEMP_OFF", "PROFILE:", "CAPTURE:", "AUTOTUNE",
+  "REGULATION", "REGULATION:RESET", "HEAP", "HEAP:ON", "HEAP:OFF", "TRACE:ON", "TRACE:OFF", "WIFI_ON:",
+  "WIFI_OFF", "MODBUS:ON", "MQTT:ON", "MQTT:OFF", "MQTT:STATUS", "BRIDGE:UP", "BRIDGE:DOWN", "BRIDGE:D:",
+  "ACK:", "ALARMS", "HISTORY", "HISTORY:", "HISTORY:CLEAR",
+};
+static const char *const PARAMETERS[] = {
+  "batteryCapacity", "thresholdPercentage", "maxAllowedCurrent", "bulkVoltage", "absorptionVoltage",
+  "floatVoltage", "isLithium", "useFuenteDC", "fuenteDC_Amps", "factorDivider", "tempSoftLimit",
+  "tempHardLimit", "samplingMode", "wifiPolicy", "wifiSsid", "wifiPassword", "LVD", "LVR", "mqttTopic",
+  "mqttInterval",
+};
+static const char *const VALUES[] = {
+  "true", "false", "nan", "inf", "-inf", "1e38", "-1", "0", "1", "2", "5", "14.4", "0x10", "45", "60",
+  "99999999999999999999", "1600000000", "", " ", "1:2", "12345678",
+  "IAIAAA==", "kAMAAQA=", "QAIAAQ==", "0AA=", "A===",
+};
+#define COUNT_OF(array) (sizeof(array) / sizeof(array[0]))
+
+static uint64_t rngState;
+
+static uint64_t nextRandom() {
+  uint64_t z = (rngState += 0x9E3779B97F4A7C15ULL);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+static const char *pick(const char *const *tokens, size_t count) {
+  return tokens[nextRandom() % count];
+}
+
+// Una línea casi válida: CMD:<comando>[<parámetro>:]<valor>, con mutaciones
+// (bytes cambiados, insertados o recortados) y de vez en cuando una racha
+// larga que desborda el buffer de línea
+static std::string randomLine() {
+  std::string line;
+  if (nextRandom() % 10 != 0) line += "CMD:";
+  std::string command = pick(COMMANDS, COUNT_OF(COMMANDS));
+  line += command;
+  if (command == "SET_") {
+    line += pick(PARAMETERS, COUNT_OF(PARAMETERS));
+    line += ":";
+  }
+  if (command.back() == ':' || command == "SET_" || nextRandom() % 4 == 0) {
+    line += pick(VALUES, COUNT_OF(VALUES));
+    if (nextRandom() % 4 == 0) {
+      line += ":";
+      line += pick(VALUES, COUNT_OF(VALUES));
+    }
+  }
+
+  int mutations = nextRandom() % 4 == 0 ? 1 + nextRandom() % 4 : 0;
+  for (int i = 0; i < mutations && !line.empty(); i++) {
+    size_t at = nextRandom() % line.size();
+    switch (nextRandom() % 3) {
+      case 0: line[at] = (char)(nextRandom() & 0xFF); break;
+      case 1: line.insert(at, 1, (char)(nextRandom() & 0xFF)); break;
+      default: line.resize(at); break;
+    }
+  }
+  if (nextRandom() % 20 == 0) line.append(1 + nextRandom() % 600, (char)(' ' + nextRandom() % 95));
+  return line;
+}
+
+static std::string randomInput() {
+  std::string input;
+  int lines = 1 + nextRandom() % 6;
+  for (int i = 0; i < lines; i++) {
+    input += randomLine();
+    input += nextRandom() % 8 == 0 ? "\r\n" : "\n";
+  }
+  return input.size() > FUZZ_MAX_INPUT ? input.substr(0, FUZZ_MAX_INPUT) : input;
+}
+
+static void runFile(const std::string &path, int &count) {
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0) {
+    fprintf(stderr, "No se puede leer %s\n", path.c_str());
+    exit(2);
+  }
+  if (S_ISDIR(info.st_mode)) {
+    DIR *dir = opendir(path.c_str());
+    while (struct dirent *entry = readdir(dir)) {
+      if (entry->d_name[0] != '.') runFile(path + "/" + entry->d_name, count);
+    }
+    closedir(dir);
+    return;
+  }
+  std::ifstream file(path, std::ios::binary);
+  std::stringstream content;
+  content << file.rdbuf();
+  std::string input = content.str();
+  LLVMFuzzerTestOneInput((const uint8_t *)input.data(), input.size());
+  count++;
+}
+
+int main(int argc, char **argv) {
+  long runs = -1;
+  bool verbose = false;
+  rngState = 1;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--runs") == 0 && i + 1 < argc) runs = atol(argv[++i]);
+    else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) rngState = strtoull(argv[++i], nullptr, 10);
+    else if (strcmp(argv[i], "--verbose") == 0) verbose = true;
+    else paths.push_back(argv[i]);
+  }
+  LLVMFuzzerInitialize(&argc, &argv);
+  if (verbose) OrangePiSerial.setSink(stdout);
+
+  int files = 0;
+  for (const std::string &path : paths) runFile(path, files);
+  if (runs < 0) runs = paths.empty() ? FUZZ_DEFAULT_RUNS : 0;
+
+  auto start = std::chrono::steady_clock::now();
+  for (long i = 0; i < runs; i++) {
+    std::string input = randomInput();
+    LLVMFuzzerTestOneInput((const uint8_t *)input.data(), input.size());
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("OK: %d ficheros, %ld entradas aleatorias (%.0f ejecuciones/s)\n", files, runs,
+         seconds > 0 ? runs / seconds : 0.0);
+  return 0;
+}
+#endif
@@ -0,0 +1,629 @@
+// Comprueba el histórico comprimido (history_codec.h, history.h) y mide su
+// compresión sobre el firmware compilado para Linux:
+//   - códec: ida y vuelta de una serie sintética con fluctuación del ciclo,
+//     huecos, NaN, fuera de rango y cambios de etapa/PWM (marcas, PWM y etapa
+//     exactos; canales a medio cuanto), y bloques truncados o dañados;
+//   - firmware: CMD:HISTORY, la descarga incremental con <desde>, el CRC y
+//     CMD:HISTORY:CLEAR contra las instantáneas publicadas en el bus, con la
+//     planta de tools/sweep (plant_model.h) a 1 muestra por ciclo; la
+//     partición tras un reinicio y tras un registro a medio grabar, y el
+//     anillo de sectores lleno al final de los días simulados;
+//   - banco: bytes por muestra, relación frente a la muestra binaria sin
+//     comprimir y ns por muestra al codificar y decodificar, sobre los días
+//     simulados (sin ruido y con ruido de sensor sintético) y sobre las
+//     trazas reales que se pasen en CSV (salida de history_dump).
+//
+//   history_check [--days N] [--seed N] [--csv traza.csv]... [--verbose]
+//
+// Código 1 si falla.
+
+#include <Arduino.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "esp_partition.h"
+#include "event_bus.h"
+#include "history.h"
+#include "host.h"
+#include "plant_model.h"
+#include "timer_wheel.h"
+
+// cargador_gel_litio.ino
+void setup();
+void loop();
+void handleSerialCommands();
+extern HardwareSerial OrangePiSerial;
+extern int currentPWM;
+
+#define CHECK_START_HOUR 10
+#define CHECK_MAX_IDLE_MS 1000            // Salto máximo del reloj entre vueltas de loop()
+#define CHECK_SYNTHETIC_SAMPLES 40000
+#define CHECK_TIMING_ROUNDS 5
+// Muestra sin comprimir: marca u64, cinco float, PWM int32 y etapa u8
+#define RAW_SAMPLE_BYTES (8 + HISTORY_CHANNEL_COUNT * 4 + 4 + 1)
+#define PARTITION_BYTES (HISTORY_MAX_SECTORS * HISTORY_SECTOR_BYTES)
+
+typedef std::vector<uint8_t> Block;
+
+static FILE *uart = nullptr;
+static char *uartBuffer = nullptr;
+static size_t uartSize = 0;
+static size_t uartConsumed = 0;
+static bool verbose = false;
+static int failures = 0;
+
+static std::vector<HistorySample> published;   // Instantáneas del bus, para comparar
+static PlantState plant;
+
+static void expect(bool condition, const char *what) {
+  printf("%s %s\n", condition ? "✓" : "✗", what);
+  if (!condition) failures++;
+}
+
+#define HISTORY_SCALE(name, scale) (float)(scale),
+static const float SCALES[HISTORY_CHANNEL_COUNT] = {HISTORY_CHANNELS(HISTORY_SCALE)};
+#undef HISTORY_SCALE
+
+// Los canales son float consecutivos en HistorySample
+static_assert(offsetof(HistorySample, temperature) - offsetof(HistorySample, panelToBatteryCurrent) ==
+                  (HISTORY_CHANNEL_COUNT - 1) * sizeof(float), "canales no consecutivos");
+
+static float *channels(HistorySample &sample) {
+  return &sample.panelToBatteryCurrent;
+}
+
+static const float *channels(const HistorySample &sample) {
+  return &sample.panelToBatteryCurrent;
+}
+
+static void recordPublished(const BusEvent &event) {
+  const MeasurementSnapshot &m = event.measurement;
+  if (!m.valid) return;
+  HistorySample sample;
+  sample.timestamp = m.timestamp;
+#define HISTORY_COPY(name, scale) sample.name = m.name;
+  HISTORY_CHANNELS(HISTORY_COPY)
+#undef HISTORY_COPY
+  sample.pwm = m.pwm;
+  sample.state = (uint8_t)m.state;
+  published.push_back(sample);
+}
+
+// ===== Códec =====
+
+static std::vector<Block> encodeAll(const std::vector<HistorySample> &samples) {
+  static uint8_t buffer[HISTORY_BLOCK_BYTES];
+  std::vector<Block> blocks;
+  HistoryEncoder encoder;
+  historyEncoderBegin(encoder, buffer, sizeof(buffer), 0);
+  for (const HistorySample &sample : samples) {
+    if (historyEncoderAppend(encoder, sample)) continue;
+    size_t length = historyEncoderFinish(encoder);
+    blocks.emplace_back(buffer, buffer + length);
+    historyEncoderBegin(encoder, buffer, sizeof(buffer), 0);
+    historyEncoderAppend(encoder, sample);
+  }
+  size_t length = historyEncoderFinish(encoder);
+  if (length > 0) blocks.emplace_back(buffer, buffer + length);
+  return blocks;
+}
+
+static bool decodeAll(const std::vector<Block> &blocks, std::vector<HistorySample> &out) {
+  static HistorySample decoded[HISTORY_BLOCK_MAX_SAMPLES(HISTORY_MAX_BLOCK_BYTES)];
+  out.clear();
+  for (const Block &block : blocks) {
+    int count = historyDecodeBlock(block.data(), block.size(), decoded, sizeof(decoded) / sizeof(decoded[0]));
+    if (count < 0) return false;
+    out.insert(out.end(), decoded, decoded + count);
+  }
+  return true;
+}
+
+static bool channelMatches(float original, float decoded, float scale) {
+  if (std::isnan(decoded)) return !std::isfinite(original) || fabs(original * (double)scale) >= 2147483647.0;
+  return fabs((double)decoded - original) <= 0.5 / scale + fabs(original) * 1e-6;
+}
+
+// Marcas, PWM y etapa exactos; canales a medio cuanto
+static size_t countMismatches(const std::vector<HistorySample> &original, const std::vector<HistorySample> &decoded,
+                              size_t firstOriginal = 0) {
+  if (decoded.size() + firstOriginal != original.size()) return std::max<size_t>(1, original.size());
+  size_t mismatches = 0;
+  for (size_t i = 0; i < decoded.size(); i++) {
+    const HistorySample &a = original[firstOriginal + i];
+    const HistorySample &b = decoded[i];
+    bool same = a.timestamp == b.timestamp && a.pwm == b.pwm && a.state == b.state;
+    for (int c = 0; c < HISTORY_CHANNEL_COUNT; c++) {
+      same = same && channelMatches(channels(a)[c], channels(b)[c], SCALES[c]);
+    }
+    if (!same && mismatches++ < 3) {
+      printf("  muestra %zu: t=%llu/%llu pwm=%d/%d etapa=%u/%u\n", i, (unsigned long long)a.timestamp,
+             (unsigned long long)b.timestamp, a.pwm, b.pwm, a.state, b.state);
+    }
+  }
+  return mismatches;
+}
+
+static uint64_t nextRandom(uint64_t &state) {
+  state += 0x9e3779b97f4a7c15ULL;
+  uint64_t x = state;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// Ruido aproximadamente normal (suma de cuatro uniformes), desviación 'sigma'
+static float noise(uint64_t &state, float sigma) {
+  double sum = 0;
+  for (int i = 0; i < 4; i++) sum += (nextRandom(state) >> 11) * (1.0 / 9007199254740992.0) - 0.5;
+  return (float)(sum * sqrt(3.0) * sigma);
+}
+
+static std::vector<HistorySample> syntheticSeries() {
+  std::vector<HistorySample> samples;
+  uint64_t random = 12345;
+  HistorySample sample = {};
+  sample.timestamp = 36000000;
+  float level[HISTORY_CHANNEL_COUNT] = {800.0f, 400.0f, 18.5f, 12.9f, 25.0f};
+  for (int i = 0; i < CHECK_SYNTHETIC_SAMPLES; i++) {
+    // Fluctuación del ciclo, modo nocturno (10 s) y algún hueco largo
+    uint64_t step = 1000 + (nextRandom(random) % 7) - 3;
+    if (i % 5000 > 4000) step = 10000;
+    if (i % 9973 == 0) step = 3ULL * 3600 * 1000 + 17;
+    sample.timestamp += step;
+    for (int c = 0; c < HISTORY_CHANNEL_COUNT; c++) {
+      level[c] += noise(random, c < 2 ? 20.0f : 0.01f);
+      channels(sample)[c] = level[c] + noise(random, c < 2 ? 3.0f : 0.004f);
+    }
+    if (i % 777 == 5) sample.temperature = NAN;
+    if (i % 1501 == 9) sample.voltagePanel = INFINITY;
+    if (i % 2003 == 11) sample.panelToBatteryCurrent = 3e9f;   // Fuera del rango de 32 bits
+    if (i % 2011 == 13) sample.batteryToLoadCurrent = -0.0f;
+    if (nextRandom(random) % 10 < 3) sample.pwm = (int32_t)(nextRandom(random) % 256);
+    if (i % 1234 == 0) sample.state = (uint8_t)(nextRandom(random) % 4);
+    samples.push_back(sample);
+  }
+  return samples;
+}
+
+static void checkCodec() {
+  printf("--- Códec ---\n");
+  std::vector<HistorySample> samples = syntheticSeries();
+  std::vector<Block> blocks = encodeAll(samples);
+  std::vector<HistorySample> decoded;
+  bool ok = decodeAll(blocks, decoded);
+  size_t bytes = 0;
+  bool sizes = true;
+  for (const Block &block : blocks) {
+    bytes += block.size();
+    sizes = sizes && block.size() <= HISTORY_BLOCK_BYTES;
+  }
+  printf("  %zu muestras en %zu bloques, %.2f bytes/muestra\n", samples.size(), blocks.size(),
+         (double)bytes / samples.size());
+  expect(ok && countMismatches(samples, decoded) == 0,
+         "ida y vuelta: marcas, PWM y etapa exactos, canales a medio cuanto, NaN e infinito como NaN");
+  expect(sizes, "ningún bloque pasa de HISTORY_BLOCK_BYTES");
+
+  // Una sola muestra y un bloque vacío
+  std::vector<HistorySample> one(samples.begin(), samples.begin() + 1);
+  std::vector<Block> single = encodeAll(one);
+  expect(single.size() == 1 && decodeAll(single, decoded) && countMismatches(one, decoded) == 0, "bloque de una muestra");
+  uint8_t empty[HISTORY_BLOCK_BYTES];
+  HistoryEncoder encoder;
+  historyEncoderBegin(encoder, empty, sizeof(empty), 0);
+  expect(historyEncoderFinish(encoder) == 0, "bloque sin muestras: 0 bytes");
+
+  // Bloque truncado o dañado: se rechaza o se decodifica sin salirse del búfer
+  const Block &block = blocks[0];
+  HistorySample scratch[HISTORY_BLOCK_MAX_SAMPLES(HISTORY_MAX_BLOCK_BYTES)];
+  bool truncatedRejected = true;
+  for (size_t length = 0; length < block.size(); length++) {
+    if (historyDecodeBlock(block.data(), length, scratch, sizeof(scratch) / sizeof(scratch[0])) >= 0) {
+      truncatedRejected = false;
+    }
+  }
+  expect(truncatedRejected, "cada bloque truncado se rechaza");
+  HistoryBlockInfo info;
+  historyBlockInfo(block.data(), block.size(), &info);
+  expect(historyDecodeBlock(block.data(), block.size(), scratch, info.samples - 1) == -1,
+         "más muestras que el destino: -1");
+  size_t corruptRejected = 0;
+  uint64_t random = 99;
+  const int corruptions = 2000;
+  for (int i = 0; i < corruptions; i++) {
+    Block corrupt = block;
+    size_t at = HISTORY_HEADER_BYTES + nextRandom(random) % (corrupt.size() - HISTORY_HEADER_BYTES);
+    corrupt[at] ^= (uint8_t)(1 << (nextRandom(random) % 8));
+    if (historyDecodeBlock(corrupt.data(), corrupt.size(), scratch, sizeof(scratch) / sizeof(scratch[0])) < 0) {
+      corruptRejected++;
+    }
+  }
+  printf("  %zu de %d bloques con un bit cambiado detectados por la estructura (el resto, por el CRC del volcado)\n",
+         corruptRejected, corruptions);
+  Block badMagic = block;
+  badMagic[0] ^= 0xFF;
+  expect(historyBlockInfo(badMagic.data(), badMagic.size(), nullptr) == 0, "cabecera con otra magia rechazada");
+}
+
+// ===== Firmware =====
+
+static uint16_t crc16(const std::vector<uint8_t> &data) {
+  uint16_t crc = 0xFFFF;
+  for (uint8_t byte : data) {
+    crc ^= (uint16_t)byte << 8;
+    for (int bit = 0; bit < 8; bit++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+static int base64Value(char c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+') return 62;
+  if (c == '/') return 63;
+  return -1;
+}
+
+static bool base64Append(const std::string &text, std::vector<uint8_t> &out) {
+  if (text.size() % 4 != 0) return false;
+  for (size_t i = 0; i < text.size(); i += 4) {
+    uint32_t n = 0;
+    int padding = 0;
+    for (int k = 0; k < 4; k++) {
+      int value = text[i + k] == '=' ? (padding++, 0) : base64Value(text[i + k]);
+      if (value < 0) return false;
+      n = (n << 6) | value;
+    }
+    out.push_back((n >> 16) & 0xFF);
+    if (padding < 2) out.push_back((n >> 8) & 0xFF);
+    if (padding < 1) out.push_back(n & 0xFF);
+  }
+  return true;
+}
+
+struct Export {
+  bool complete = false;
+  bool crcOk = false;
+  std::string error;
+  unsigned long first = 0, blocks = 0, samples = 0, bytes = 0, next = 0;
+  std::vector<uint8_t> data;
+};
+
+static void runFor(uint64_t ms) {
+  uint64_t endUs = hostMicros() + ms * 1000;
+  while (hostMicros() < endUs) {
+    plantStep(plant, hostMicros(), currentPWM / 255.0f, hostDigitalLevel(LOAD_CONTROL_PIN) == HIGH);
+    loop();
+    // Sin nada pendiente se salta al siguiente vencimiento de la rueda
+    uint64_t nowMs = hostMicros() / 1000;
+    uint64_t nextMs = std::min(timerWheelNextDeadline(), nowMs + CHECK_MAX_IDLE_MS);
+    if (nextMs <= nowMs) nextMs = nowMs + 1;
+    hostSetMicros(std::max(hostMicros(), nextMs * 1000));
+  }
+}
+
+// Sin pasar por loop(): el reloj no avanza y ningún ciclo de control se
+// cuela entre el comando y el volcado
+static Export requestExport(const std::string &command) {
+  fflush(uart);
+  uartConsumed = uartSize;
+  if (verbose) printf("  -> %s\n", command.c_str());
+  std::string line = command + "\n";
+  OrangePiSerial.feed(line.c_str(), line.size());
+  handleSerialCommands();
+
+  Export result;
+  unsigned crc = 0;
+  for (int round = 0; round < 100 && !result.complete && result.error.empty(); round++) {
+    if (round > 0) historyService();
+    fflush(uart);
+    while (true) {
+      char *start = uartBuffer + uartConsumed;
+      char *end = (char *)memchr(start, '\n', uartSize - uartConsumed);
+      if (end == nullptr) break;
+      std::string text(start, end - start);
+      uartConsumed += end - start + 1;
+      if (!text.empty() && text.back() == '\r') text.pop_back();
+      if (verbose && text.compare(0, 10, "HISTORY:D:") != 0) printf("  <- %s\n", text.c_str());
+      if (text.compare(0, 10, "HISTORY:D:") == 0) {
+        if (!base64Append(text.substr(10), result.data)) result.error = "base64 inválido";
+      } else if (sscanf(text.c_str(), "HISTORY:BEGIN:first=%lu,blocks=%lu,samples=%lu,bytes=%lu", &result.first,
+                        &result.blocks, &result.samples, &result.bytes) == 4) {
+        result.data.clear();
+      } else if (sscanf(text.c_str(), "HISTORY:END:next=%lu,crc=0x%x", &result.next, &crc) == 2) {
+        result.complete = true;
+        result.crcOk = crc == crc16(result.data);
+      } else if (text.compare(0, 6, "ERROR:") == 0 || text.compare(0, 3, "OK:") == 0 ||
+                 text == "HISTORY:END:overrun") {
+        result.error = text;
+      }
+    }
+  }
+  return result;
+}
+
+static bool decodeExport(const Export &exported, std::vector<HistorySample> &out) {
+  std::vector<Block> blocks;
+  size_t at = 0;
+  while (at < exported.data.size()) {
+    size_t length = historyBlockInfo(exported.data.data() + at, exported.data.size() - at, nullptr);
+    if (length == 0) return false;
+    blocks.emplace_back(exported.data.begin() + at, exported.data.begin() + at + length);
+    at += length;
+  }
+  return blocks.size() == exported.blocks && decodeAll(blocks, out);
+}
+
+// Último byte grabado de la partición (sin vuelta del anillo aún): dentro
+// del registro más nuevo
+static long lastProgrammedByte(const esp_partition_t *partition) {
+  std::vector<uint8_t> flash(partition->size);
+  esp_partition_read(partition, 0, flash.data(), flash.size());
+  for (long i = (long)flash.size() - 1; i >= 0; i--) {
+    if (flash[i] != 0xFF && flash[i] != 0x00) return i;
+  }
+  return -1;
+}
+
+static void checkTornRecord(const Export &before) {
+  const esp_partition_t *partition = esp_partition_find_first(
+      ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)HISTORY_PARTITION_SUBTYPE, HISTORY_PARTITION_LABEL);
+  long torn = lastProgrammedByte(partition);
+  uint8_t zero = 0;
+  esp_partition_write(partition, torn, &zero, 1);
+  historyBegin();
+  Export after = requestExport("CMD:HISTORY");
+  std::vector<HistorySample> decoded;
+  expect(after.complete && after.crcOk && after.next == before.next - 1 && decodeExport(after, decoded) &&
+         after.blocks == before.blocks - 1, "registro a medio grabar descartado al arrancar");
+
+  size_t from = published.size();
+  runFor(5 * 60 * 1000);
+  Export resumed = requestExport("CMD:HISTORY:" + std::to_string(after.next));
+  expect(resumed.complete && resumed.crcOk && resumed.first == after.next && decodeExport(resumed, decoded) &&
+         countMismatches(published, decoded, from) == 0 &&
+         lastProgrammedByte(partition) / HISTORY_SECTOR_BYTES != torn / HISTORY_SECTOR_BYTES,
+         "tras el corte se graba en el sector siguiente");
+}
+
+static void checkFirmware() {
+  printf("--- Firmware (CMD:HISTORY) ---\n");
+  published.clear();
+  runFor(20 * 60 * 1000);
+
+  Export full = requestExport("CMD:HISTORY");
+  std::vector<HistorySample> decoded;
+  expect(full.complete && full.crcOk && full.bytes == full.data.size(), "volcado completo con CRC y bytes correctos");
+  expect(decodeExport(full, decoded) && decoded.size() == full.samples &&
+         countMismatches(published, decoded) == 0, "el volcado decodificado coincide con las instantáneas del bus");
+  printf("  %zu muestras en %lu bloques, %lu bytes (%.2f bytes/muestra)\n", decoded.size(), full.blocks, full.bytes,
+         (double)full.bytes / std::max<size_t>(1, decoded.size()));
+
+  size_t before = published.size();
+  runFor(10 * 60 * 1000);
+  Export incremental = requestExport("CMD:HISTORY:" + std::to_string(full.next));
+  expect(incremental.complete && incremental.crcOk && incremental.first == full.next &&
+         decodeExport(incremental, decoded) && countMismatches(published, decoded, before) == 0,
+         "CMD:HISTORY:<next> trae solo lo nuevo");
+
+  Export again = requestExport("CMD:HISTORY:" + std::to_string(incremental.next));
+  expect(again.complete && again.blocks == 0 && again.next == incremental.next, "sin muestras nuevas: 0 bloques");
+  expect(requestExport("CMD:HISTORY:abc").error == "ERROR:Invalid HISTORY format", "<desde> inválido rechazado");
+
+  expect(requestExport("CMD:HISTORY:CLEAR").error == "OK:History cleared", "CMD:HISTORY:CLEAR");
+  before = published.size();
+  runFor(60 * 1000);
+  Export cleared = requestExport("CMD:HISTORY");
+  expect(cleared.complete && cleared.first == incremental.next && decodeExport(cleared, decoded) &&
+         countMismatches(published, decoded, before) == 0, "tras CLEAR solo lo nuevo y la numeración sigue");
+
+  // Reinicio: la RAM se pierde (el bloque abierto lo cerró el volcado)
+  historyBegin();
+  Export rebooted = requestExport("CMD:HISTORY");
+  expect(rebooted.complete && rebooted.first == cleared.first && rebooted.next == cleared.next &&
+         rebooted.data == cleared.data, "tras reiniciar, la partición conserva los bloques, CLEAR y la numeración");
+
+  // Corte durante la grabación del último bloque: se descarta y se sigue en otro sector
+  checkTornRecord(rebooted);
+}
+
+// ===== Banco =====
+
+struct TraceResult {
+  std::string name;
+  size_t samples = 0;
+  size_t bytes = 0;
+  double encodeNs = 0;
+  double decodeNs = 0;
+  double days = 0;
+  bool lossless = false;
+};
+
+template <typename Fn>
+static double nanosecondsPerSample(size_t samples, Fn fn) {
+  double best = 1e300;
+  for (int round = 0; round < CHECK_TIMING_ROUNDS; round++) {
+    auto start = std::chrono::steady_clock::now();
+    fn();
+    auto elapsed = std::chrono::steady_clock::now() - start;
+    best = std::min(best, std::chrono::duration<double, std::nano>(elapsed).count() / samples);
+  }
+  return best;
+}
+
+static TraceResult measure(const std::string &name, const std::vector<HistorySample> &samples) {
+  TraceResult result;
+  result.name = name;
+  result.samples = samples.size();
+  if (samples.empty()) return result;
+  std::vector<Block> blocks = encodeAll(samples);
+  for (const Block &block : blocks) result.bytes += block.size();
+  std::vector<HistorySample> decoded;
+  result.lossless = decodeAll(blocks, decoded) && countMismatches(samples, decoded) == 0;
+  result.days = (samples.back().timestamp - samples.front().timestamp) / 86400e3;
+
+  // Solo el códec, sobre el búfer fijo del equipo
+  static uint8_t buffer[HISTORY_BLOCK_BYTES];
+  volatile size_t sink = 0;
+  result.encodeNs = nanosecondsPerSample(samples.size(), [&] {
+    HistoryEncoder encoder;
+    historyEncoderBegin(encoder, buffer, sizeof(buffer), 0);
+    for (const HistorySample &sample : samples) {
+      if (historyEncoderAppend(encoder, sample)) continue;
+      sink += historyEncoderFinish(encoder);
+      historyEncoderBegin(encoder, buffer, sizeof(buffer), 0);
+      historyEncoderAppend(encoder, sample);
+    }
+    sink += historyEncoderFinish(encoder);
+  });
+  static HistorySample out[HISTORY_BLOCK_MAX_SAMPLES(HISTORY_MAX_BLOCK_BYTES)];
+  result.decodeNs = nanosecondsPerSample(samples.size(), [&] {
+    for (const Block &block : blocks) sink += historyDecodeBlock(block.data(), block.size(), out, sizeof(out) / sizeof(out[0]));
+  });
+  return result;
+}
+
+// Ruido de sensor sintético sobre la simulación (la planta no tiene): ±σ de
+// unos mA en las corrientes, voltajes al LSB de 4 mV del INA219 con ±1 LSB y
+// ±0,15 °C en el NTC
+static std::vector<HistorySample> withSensorNoise(std::vector<HistorySample> samples) {
+  uint64_t random = 7;
+  for (HistorySample &sample : samples) {
+    sample.panelToBatteryCurrent += sample.panelToBatteryCurrent != 0 ? noise(random, 3.0f) : 0;
+    sample.batteryToLoadCurrent += noise(random, 3.0f);
+    sample.voltagePanel = roundf((sample.voltagePanel + noise(random, 0.004f)) / 0.004f) * 0.004f;
+    sample.voltageBattery = roundf((sample.voltageBattery + noise(random, 0.004f)) / 0.004f) * 0.004f;
+    sample.temperature += noise(random, 0.15f);
+  }
+  return samples;
+}
+
+// timestamp_ms,wall_ms,<canales>,pwm,state (cabecera y formato de history_dump)
+static bool loadCsv(const char *path, std::vector<HistorySample> &samples) {
+  std::ifstream file(path);
+  if (!file) {
+    fprintf(stderr, "No se pudo abrir %s\n", path);
+    return false;
+  }
+  std::string line;
+  while (std::getline(file, line)) {
+    if (line.empty() || !isdigit((unsigned char)line[0])) continue;   // Cabecera
+    std::stringstream fields(line);
+    std::string field;
+    std::vector<std::string> values;
+    while (std::getline(fields, field, ',')) values.push_back(field);
+    if (values.size() != 2 + HISTORY_CHANNEL_COUNT + 2) {
+      fprintf(stderr, "%s: línea inválida: %s\n", path, line.c_str());
+      return false;
+    }
+    HistorySample sample;
+    sample.timestamp = strtoull(values[0].c_str(), nullptr, 10);
+    for (int c = 0; c < HISTORY_CHANNEL_COUNT; c++) channels(sample)[c] = strtof(values[2 + c].c_str(), nullptr);
+    sample.pwm = atoi(values[2 + HISTORY_CHANNEL_COUNT].c_str());
+    sample.state = (uint8_t)atoi(values[3 + HISTORY_CHANNEL_COUNT].c_str());
+    samples.push_back(sample);
+  }
+  return true;
+}
+
+static void printResults(const std::vector<TraceResult> &results) {
+  printf("  %-28s %9s %6s %9s %7s %8s %8s %14s\n", "traza", "muestras", "días", "B/muestra", "relación",
+         "cod ns", "dec ns", "días partición");
+  for (const TraceResult &r : results) {
+    double perSample = (double)r.bytes / std::max<size_t>(1, r.samples);
+    double samplesPerDay = r.days > 0 ? r.samples / r.days : 86400.0;
+    printf("  %-28s %9zu %6.2f %9.2f %6.1fx %8.1f %8.1f %14.1f\n", r.name.c_str(), r.samples, r.days,
+           perSample, RAW_SAMPLE_BYTES / perSample, r.encodeNs, r.decodeNs, PARTITION_BYTES / perSample / samplesPerDay);
+  }
+}
+
+static void runBenchmark(float days, const std::vector<const char *> &csvPaths) {
+  printf("--- Banco (%.1f días simulados) ---\n", days);
+  published.clear();
+  runFor((uint64_t)(days * 86400.0f) * 1000);
+
+  // La partición guarda el final de la simulación (con el anillo ya dado la
+  // vuelta si los días no caben)
+  Export tail = requestExport("CMD:HISTORY");
+  std::vector<HistorySample> decoded;
+  bool decodedTail = tail.complete && tail.crcOk && decodeExport(tail, decoded);
+  if (decoded.size() > published.size()) decoded.erase(decoded.begin(), decoded.end() - published.size());
+  expect(decodedTail && tail.bytes <= PARTITION_BYTES &&
+         countMismatches(published, decoded, published.size() - decoded.size()) == 0,
+         "la partición conserva las últimas muestras");
+  // Con la vuelta dada, todos los sectores salvo el recién borrado llenos (los
+  // bloques se dimensionan con el hueco del sector)
+  bool wrapped = decoded.size() < published.size();
+  if (wrapped) {
+    expect(tail.bytes >= 0.9 * (PARTITION_BYTES - 2 * HISTORY_SECTOR_BYTES), "anillo de sectores lleno sin huecos");
+  }
+  printf("  partición: %zu muestras (%.2f días) en %lu bloques, %lu de %d KB\n", decoded.size(),
+         decoded.empty() ? 0.0 : (decoded.back().timestamp - decoded.front().timestamp) / 86400e3, tail.blocks,
+         tail.bytes / 1024, PARTITION_BYTES / 1024);
+
+  std::vector<TraceResult> results;
+  results.push_back(measure("simulada", published));
+  results.push_back(measure("simulada + ruido de sensor", withSensorNoise(published)));
+  for (const char *path : csvPaths) {
+    std::vector<HistorySample> samples;
+    if (!loadCsv(path, samples)) {
+      failures++;
+      continue;
+    }
+    const char *slash = strrchr(path, '/');
+    results.push_back(measure(slash != nullptr ? slash + 1 : path, samples));
+  }
+  printResults(results);
+  bool lossless = true;
+  for (const TraceResult &r : results) lossless = lossless && r.lossless;
+  expect(lossless, "todas las trazas vuelven a medio cuanto");
+  printf("  muestra sin comprimir: %d bytes; partición: %d sectores de %d bytes\n", RAW_SAMPLE_BYTES,
+         HISTORY_MAX_SECTORS, HISTORY_SECTOR_BYTES);
+}
+
+int main(int argc, char **argv) {
+  float days = 4.0f;                      // Más de lo que cabe: el anillo da la vuelta
+  uint32_t seed = 1;
+  std::vector<const char *> csvPaths;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--days") == 0 && i + 1 < argc) days = strtof(argv[++i], nullptr);
+    else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) seed = (uint32_t)strtoul(argv[++i], nullptr, 10);
+    else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) csvPaths.push_back(argv[++i]);
+    else if (strcmp(argv[i], "--verbose") == 0) verbose = true;
+    else {
+      fprintf(stderr, "Uso: %s [--days N] [--seed N] [--csv traza.csv]... [--verbose]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  checkCodec();
+
+  uart = open_memstream(&uartBuffer, &uartSize);
+  Serial.setSink(nullptr);
+  OrangePiSerial.setSink(uart);
+  hostSetDelayAdvancesClock(true);
+  hostSetMicros((uint64_t)CHECK_START_HOUR * 3600ULL * 1000000ULL);
+  PlantConfig config;
+  config.weatherSeed = seed;
+  plantInit(plant, config, hostMicros());
+  setup();
+  eventBusSubscribe(EVENT_MEASUREMENT, recordPublished);
+
+  checkFirmware();
+  runBenchmark(days, csvPaths);
+
+  if (failures > 0) {
+    printf("FALLO: %d comprobaciones\n", failures);
+    return 1;
+  }
+  printf("OK: histórico comprimido\n");
+  return 0;
+}
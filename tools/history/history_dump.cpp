@@ -0,0 +1,174 @@
+// Decodifica los volcados de CMD:HISTORY guardados de la UART de la Orange Pi
+// (las demás líneas se ignoran, así que vale el log completo) y escribe las
+// muestras en CSV, una por línea:
+//   timestamp_ms,wall_ms,<canales de HISTORY_CHANNELS>,pwm,state
+// wall_ms queda vacío si el reloj de pared no estaba sincronizado al abrir el
+// bloque. Cada volcado se comprueba con su CRC; uno dañado se descarta entero.
+// El CSV sirve también de traza para history_check --csv.
+//
+//   history_dump [log.txt] [-o muestras.csv]
+//
+// Código 1 si algún volcado estaba incompleto o dañado.
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "history_codec.h"
+
+struct Dump {
+  std::vector<uint8_t> data;
+  bool open = false;
+  bool valid = true;
+};
+
+static int base64Value(char c) {
+  if (c >= 'A' && c <= 'Z') return c - 'A';
+  if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+  if (c >= '0' && c <= '9') return c - '0' + 52;
+  if (c == '+') return 62;
+  if (c == '/') return 63;
+  return -1;
+}
+
+static bool base64Append(const char *text, size_t length, std::vector<uint8_t> &out) {
+  if (length % 4 != 0) return false;
+  for (size_t i = 0; i < length; i += 4) {
+    uint32_t n = 0;
+    int padding = 0;
+    for (int k = 0; k < 4; k++) {
+      char c = text[i + k];
+      int value = 0;
+      if (c == '=' && i + 4 == length && k >= 2) {
+        padding++;
+      } else {
+        value = base64Value(c);
+        if (value < 0 || padding > 0) return false;
+      }
+      n = (n << 6) | value;
+    }
+    out.push_back((n >> 16) & 0xFF);
+    if (padding < 2) out.push_back((n >> 8) & 0xFF);
+    if (padding < 1) out.push_back(n & 0xFF);
+  }
+  return true;
+}
+
+static uint16_t crc16(const std::vector<uint8_t> &data) {
+  uint16_t crc = 0xFFFF;
+  for (uint8_t byte : data) {
+    crc ^= (uint16_t)byte << 8;
+    for (int bit = 0; bit < 8; bit++) crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+  }
+  return crc;
+}
+
+static void printValue(FILE *out, float value) {
+  if (std::isnan(value)) fprintf(out, ",nan");
+  else fprintf(out, ",%.3f", value);
+}
+
+// Devuelve las muestras escritas o -1 si algún bloque no se pudo decodificar
+static long writeSamples(const std::vector<uint8_t> &data, FILE *out, size_t &blocks) {
+  static HistorySample samples[HISTORY_BLOCK_MAX_SAMPLES(HISTORY_MAX_BLOCK_BYTES)];
+  long written = 0;
+  size_t at = 0;
+  while (at < data.size()) {
+    HistoryBlockInfo info;
+    size_t length = historyBlockInfo(data.data() + at, data.size() - at, &info);
+    int count = length > 0 ? historyDecodeBlock(data.data() + at, length, samples, sizeof(samples) / sizeof(samples[0])) : -1;
+    if (count < 0) {
+      fprintf(stderr, "Bloque dañado en el byte %zu del volcado\n", at);
+      return -1;
+    }
+    for (int i = 0; i < count; i++) {
+      const HistorySample &s = samples[i];
+      fprintf(out, "%llu,", (unsigned long long)s.timestamp);
+      if (info.wallClockOffset != 0) fprintf(out, "%lld", (long long)(s.timestamp + info.wallClockOffset));
+#define HISTORY_PRINT(name, scale) printValue(out, s.name);
+      HISTORY_CHANNELS(HISTORY_PRINT)
+#undef HISTORY_PRINT
+      fprintf(out, ",%d,%u\n", s.pwm, s.state);
+    }
+    written += count;
+    blocks++;
+    at += length;
+  }
+  return written;
+}
+
+int main(int argc, char **argv) {
+  const char *inputPath = nullptr;
+  const char *outputPath = nullptr;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) outputPath = argv[++i];
+    else if (inputPath == nullptr && argv[i][0] != '-') inputPath = argv[i];
+    else {
+      fprintf(stderr, "Uso: %s [log.txt] [-o muestras.csv]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  std::ifstream file;
+  if (inputPath != nullptr) {
+    file.open(inputPath);
+    if (!file) {
+      fprintf(stderr, "No se pudo abrir %s\n", inputPath);
+      return 1;
+    }
+  }
+  std::istream &input = inputPath != nullptr ? file : std::cin;
+  FILE *out = outputPath != nullptr ? fopen(outputPath, "w") : stdout;
+  if (out == nullptr) {
+    fprintf(stderr, "No se pudo crear %s\n", outputPath);
+    return 1;
+  }
+
+  fprintf(out, "timestamp_ms,wall_ms");
+#define HISTORY_HEADER(name, scale) fprintf(out, ",%s", #name);
+  HISTORY_CHANNELS(HISTORY_HEADER)
+#undef HISTORY_HEADER
+  fprintf(out, ",pwm,state\n");
+
+  Dump dump;
+  int damaged = 0;
+  size_t dumps = 0, blocks = 0, bytes = 0;
+  long samples = 0;
+  std::string line;
+  while (std::getline(input, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.compare(0, 14, "HISTORY:BEGIN:") == 0) {
+      if (dump.open) damaged++;   // Volcado anterior sin END
+      dump = Dump();
+      dump.open = true;
+    } else if (!dump.open) {
+      continue;
+    } else if (line.compare(0, 10, "HISTORY:D:") == 0) {
+      dump.valid = dump.valid && base64Append(line.c_str() + 10, line.size() - 10, dump.data);
+    } else if (line.compare(0, 12, "HISTORY:END:") == 0) {
+      unsigned crc = 0;
+      const char *crcText = strstr(line.c_str(), "crc=0x");
+      bool ok = dump.valid && crcText != nullptr && sscanf(crcText, "crc=0x%x", &crc) == 1 && crc == crc16(dump.data);
+      long written = ok ? writeSamples(dump.data, out, blocks) : -1;
+      if (written < 0) {
+        fprintf(stderr, "Volcado %zu descartado: %s\n", dumps + 1, line.c_str());
+        damaged++;
+      } else {
+        samples += written;
+        bytes += dump.data.size();
+      }
+      dumps++;
+      dump.open = false;
+    }
+  }
+  if (dump.open) damaged++;
+  if (out != stdout) fclose(out);
+
+  fprintf(stderr, "%zu volcados, %zu bloques, %ld muestras, %zu bytes (%.2f bytes/muestra)%s\n", dumps, blocks,
+          samples, bytes, samples > 0 ? (double)bytes / samples : 0.0, damaged > 0 ? ", con errores" : "");
+  return damaged > 0 ? 1 : 0;
+}
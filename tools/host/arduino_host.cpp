@@ -0,0 +1,340 @@
+// Implementación de la capa Arduino/ESP-IDF del host (ver include/Arduino.h)
+
+#include <Adafruit_INA219.h>
+#include <Arduino.h>
+#include <Preferences.h>
+#include <WiFi.h>
+#include <Wire.h>
+
+#include <algorithm>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "driver/gpio.h"
+#include "driver/uart.h"
+#include "esp_partition.h"
+#include "esp_sleep.h"
+#include "esp_task_wdt.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "host.h"
+
+HardwareSerial Serial(0);
+TwoWire Wire;
+WiFiClass WiFi;
+EspClass ESP;
+
+// ===== Reloj virtual =====
+static uint64_t virtualMicros = 0;
+static bool delayAdvancesClock = true;
+static uint64_t sleepTimerUs = 0;
+
+void hostSetMicros(uint64_t us) { virtualMicros = us; }
+void hostAdvanceMicros(uint64_t us) { virtualMicros += us; }
+uint64_t hostMicros() { return virtualMicros; }
+void hostSetDelayAdvancesClock(bool enabled) { delayAdvancesClock = enabled; }
+
+int64_t esp_timer_get_time() { return (int64_t)virtualMicros; }
+unsigned long millis() { return (unsigned long)(virtualMicros / 1000); }
+unsigned long micros() { return (unsigned long)virtualMicros; }
+
+void delay(unsigned long ms) {
+  if (delayAdvancesClock) virtualMicros += (uint64_t)ms * 1000;
+}
+
+void delayMicroseconds(unsigned int us) {
+  if (delayAdvancesClock) virtualMicros += us;
+}
+
+void yield() {}
+
+// ===== UART =====
+static FILE *uartSinks[3];
+
+void hostSetUartSink(int uartNum, FILE *file) {
+  if (uartNum >= 0 && uartNum < 3) uartSinks[uartNum] = file;
+}
+
+FILE *hostUartSink(int uartNum) { return uartNum >= 0 && uartNum < 3 ? uartSinks[uartNum] : nullptr; }
+
+// ===== GPIO, ADC y PWM =====
+static uint8_t digitalLevels[64];
+static uint16_t analogValues[64];
+static uint32_t pwmDuty[64];
+
+void pinMode(uint8_t pin, uint8_t mode) {}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < 64) digitalLevels[pin] = value ? HIGH : LOW;
+}
+
+int digitalRead(uint8_t pin) { return pin < 64 ? digitalLevels[pin] : LOW; }
+uint16_t analogRead(uint8_t pin) { return pin < 64 ? analogValues[pin] : 0; }
+
+void hostSetAnalog(uint8_t pin, uint16_t value) {
+  if (pin < 64) analogValues[pin] = value;
+}
+
+int hostDigitalLevel(uint8_t pin) { return digitalRead(pin); }
+uint32_t hostPwmDuty(uint8_t pin) { return pin < 64 ? pwmDuty[pin] : 0; }
+
+bool ledcAttach(uint8_t pin, uint32_t frequency, uint8_t resolution) { return true; }
+bool ledcDetach(uint8_t pin) { return true; }
+
+bool ledcWrite(uint8_t pin, uint32_t duty) {
+  if (pin < 64) pwmDuty[pin] = duty;
+  return true;
+}
+
+uint32_t ledcChangeFrequency(uint8_t pin, uint32_t frequency, uint8_t resolution) { return frequency; }
+
+// Determinista: las herramientas comparan salidas entre ejecuciones
+uint32_t esp_random() {
+  static uint32_t state = 0x12345678;
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+long map(long x, long inMin, long inMax, long outMin, long outMax) {
+  return (x - inMin) * (outMax - outMin) / (inMax - inMin) + outMin;
+}
+
+// ===== INA219 =====
+struct InaReading {
+  float busVoltage_V;
+  float current_mA;
+};
+
+static std::map<uint8_t, InaReading> inaReadings;
+
+void hostSetIna219(uint8_t address, float busVoltage_V, float current_mA) {
+  inaReadings[address] = {busVoltage_V, current_mA};
+}
+
+float Adafruit_INA219::getBusVoltage_V() { return inaReadings[address].busVoltage_V; }
+float Adafruit_INA219::getCurrent_mA() { return inaReadings[address].current_mA; }
+// Calibración 32V_2A: 1 mA de lectura = 10 µV en el shunt de 0.1 Ω del módulo
+float Adafruit_INA219::getShuntVoltage_mV() { return inaReadings[address].current_mA * 0.1f; }
+float Adafruit_INA219::getPower_mW() { return inaReadings[address].busVoltage_V * inaReadings[address].current_mA; }
+
+// ===== Preferences =====
+static std::map<std::string, std::map<std::string, std::string>> nvs;
+
+void hostPreferencesClear() { nvs.clear(); }
+
+bool Preferences::begin(const char *name, bool readOnlyMode) {
+  space = name;
+  readOnly = readOnlyMode;
+  opened = true;
+  return true;
+}
+
+void Preferences::end() { opened = false; }
+
+bool Preferences::clear() {
+  if (!opened || readOnly) return false;
+  nvs[space.c_str()].clear();
+  return true;
+}
+
+bool Preferences::remove(const char *key) {
+  if (!opened || readOnly) return false;
+  return nvs[space.c_str()].erase(key) > 0;
+}
+
+bool Preferences::isKey(const char *key) {
+  return opened && nvs[space.c_str()].count(key) > 0;
+}
+
+size_t Preferences::put(const char *key, const void *value, size_t length) {
+  if (!opened || readOnly) return 0;
+  nvs[space.c_str()][key] = std::string((const char *)value, length);
+  return length;
+}
+
+bool Preferences::get(const char *key, void *value, size_t length) {
+  if (!opened) return false;
+  auto &entries = nvs[space.c_str()];
+  auto it = entries.find(key);
+  if (it == entries.end() || it->second.size() != length) return false;
+  memcpy(value, it->second.data(), length);
+  return true;
+}
+
+#define PREFERENCES_SCALAR(Name, Type)                                   \
+  size_t Preferences::put##Name(const char *key, Type value) {           \
+    return put(key, &value, sizeof(value));                              \
+  }                                                                      \
+  Type Preferences::get##Name(const char *key, Type defaultValue) {      \
+    Type value;                                                          \
+    return get(key, &value, sizeof(value)) ? value : defaultValue;       \
+  }
+
+PREFERENCES_SCALAR(Float, float)
+PREFERENCES_SCALAR(Bool, bool)
+PREFERENCES_SCALAR(UChar, uint8_t)
+PREFERENCES_SCALAR(Int, int32_t)
+PREFERENCES_SCALAR(UInt, uint32_t)
+PREFERENCES_SCALAR(ULong, uint32_t)
+PREFERENCES_SCALAR(Long64, int64_t)
+PREFERENCES_SCALAR(ULong64, uint64_t)
+
+size_t Preferences::putString(const char *key, const String &value) {
+  return put(key, value.c_str(), value.length());
+}
+
+String Preferences::getString(const char *key, const String &defaultValue) {
+  if (!opened) return defaultValue;
+  auto &entries = nvs[space.c_str()];
+  auto it = entries.find(key);
+  return it == entries.end() ? defaultValue : String(it->second);
+}
+
+size_t Preferences::putBytes(const char *key, const void *value, size_t length) {
+  return put(key, value, length);
+}
+
+size_t Preferences::getBytes(const char *key, void *buffer, size_t maxLength) {
+  if (!opened) return 0;
+  auto &entries = nvs[space.c_str()];
+  auto it = entries.find(key);
+  if (it == entries.end() || it->second.size() > maxLength) return 0;
+  memcpy(buffer, it->second.data(), it->second.size());
+  return it->second.size();
+}
+
+size_t Preferences::getBytesLength(const char *key) {
+  if (!opened) return 0;
+  auto &entries = nvs[space.c_str()];
+  auto it = entries.find(key);
+  return it == entries.end() ? 0 : it->second.size();
+}
+
+size_t Preferences::freeEntries() { return 500; }
+
+// ===== Temporizadores hardware y FreeRTOS =====
+extern "C" {
+hw_timer_t *timerBegin(uint32_t frequency) { return nullptr; }
+void timerEnd(hw_timer_t *timer) {}
+void timerWrite(hw_timer_t *timer, uint64_t value) {}
+void timerStart(hw_timer_t *timer) {}
+void timerStop(hw_timer_t *timer) {}
+void timerAttachInterrupt(hw_timer_t *timer, void (*userFunc)(void)) {}
+void timerAlarm(hw_timer_t *timer, uint64_t alarmValue, bool autoreload, uint64_t reloadCount) {}
+
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle) {
+  return pdFAIL;
+}
+TickType_t xTaskGetTickCount(void) { return (TickType_t)(virtualMicros / 1000); }
+BaseType_t xTaskDelayUntil(TickType_t *previousWake, TickType_t increment) {
+  *previousWake += increment;
+  return pdTRUE;
+}
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t timeout) { return 0; }
+BaseType_t xTaskNotifyGive(TaskHandle_t task) { return pdPASS; }
+void vTaskDelay(TickType_t ticks) { delay(ticks); }
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer) {
+  buffer->count = 1;
+  return buffer;
+}
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout) {
+  if (semaphore == nullptr || semaphore->count == 0) {
+    fprintf(stderr, "host: mutex tomado dos veces o sin crear\n");
+    abort();
+  }
+  semaphore->count = 0;
+  return pdTRUE;
+}
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore) {
+  semaphore->count = 1;
+  return pdTRUE;
+}
+}
+
+// ===== ESP-IDF =====
+const char *EspClass::getChipModel() { return "host"; }
+uint8_t EspClass::getChipRevision() { return 0; }
+uint32_t EspClass::getCpuFreqMHz() { return 0; }
+uint32_t EspClass::getFlashChipSpeed() { return 0; }
+uint32_t EspClass::getFreeHeap() { return 0; }
+uint32_t EspClass::getMinFreeHeap() { return 0; }
+uint32_t EspClass::getMaxAllocHeap() { return 0; }
+
+// ===== Flash (particiones de datos) =====
+static const esp_partition_t historyPartition = {
+  ESP_PARTITION_TYPE_DATA, (esp_partition_subtype_t)0x40, 0x290000, 0x40000, SPI_FLASH_SEC_SIZE, "history", false, false
+};
+static std::vector<uint8_t> historyFlash(historyPartition.size, 0xFF);
+
+void hostFlashErase() { std::fill(historyFlash.begin(), historyFlash.end(), 0xFF); }
+
+const esp_partition_t *esp_partition_find_first(esp_partition_type_t type, esp_partition_subtype_t subtype,
+                                                const char *label) {
+  if (type != historyPartition.type) return nullptr;
+  if (subtype != ESP_PARTITION_SUBTYPE_ANY && subtype != historyPartition.subtype) return nullptr;
+  if (label != nullptr && strcmp(label, historyPartition.label) != 0) return nullptr;
+  return &historyPartition;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t *partition, size_t srcOffset, void *dst, size_t size) {
+  if (partition != &historyPartition || srcOffset + size > partition->size) return ESP_ERR_INVALID_SIZE;
+  memcpy(dst, historyFlash.data() + srcOffset, size);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t *partition, size_t dstOffset, const void *src, size_t size) {
+  if (partition != &historyPartition || dstOffset + size > partition->size) return ESP_ERR_INVALID_SIZE;
+  const uint8_t *bytes = (const uint8_t *)src;
+  for (size_t i = 0; i < size; i++) historyFlash[dstOffset + i] &= bytes[i];
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t *partition, size_t offset, size_t size) {
+  if (partition != &historyPartition) return ESP_ERR_INVALID_ARG;
+  if (offset % SPI_FLASH_SEC_SIZE != 0 || size % SPI_FLASH_SEC_SIZE != 0) return ESP_ERR_INVALID_ARG;
+  if (offset + size > partition->size) return ESP_ERR_INVALID_SIZE;
+  memset(historyFlash.data() + offset, 0xFF, size);
+  return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_init(const esp_task_wdt_config_t *config) { return ESP_OK; }
+esp_err_t esp_task_wdt_reconfigure(const esp_task_wdt_config_t *config) { return ESP_OK; }
+esp_err_t esp_task_wdt_add(void *task) { return ESP_OK; }
+esp_err_t esp_task_wdt_reset() { return ESP_OK; }
+
+esp_err_t esp_sleep_enable_timer_wakeup(uint64_t timeUs) {
+  sleepTimerUs = timeUs;
+  return ESP_OK;
+}
+esp_err_t esp_sleep_enable_gpio_wakeup() { return ESP_OK; }
+esp_err_t esp_sleep_enable_uart_wakeup(int uartNum) { return ESP_OK; }
+esp_err_t esp_sleep_disable_wakeup_source(esp_sleep_source_t source) {
+  if (source == ESP_SLEEP_WAKEUP_TIMER || source == ESP_SLEEP_WAKEUP_ALL) sleepTimerUs = 0;
+  return ESP_OK;
+}
+esp_err_t esp_light_sleep_start() {
+  if (delayAdvancesClock) virtualMicros += sleepTimerUs;
+  return ESP_OK;
+}
+esp_sleep_wakeup_cause_t esp_sleep_get_wakeup_cause() {
+  return sleepTimerUs > 0 ? ESP_SLEEP_WAKEUP_TIMER : ESP_SLEEP_WAKEUP_UNDEFINED;
+}
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type) { return ESP_OK; }
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *config) {
+  memset(config, 0, sizeof(*config));
+  return ESP_OK;
+}
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *config) { return ESP_OK; }
+
+esp_err_t gpio_wakeup_enable(gpio_num_t pin, gpio_int_type_t type) { return ESP_OK; }
+esp_err_t gpio_wakeup_disable(gpio_num_t pin) { return ESP_OK; }
+esp_err_t gpio_hold_en(gpio_num_t pin) { return ESP_OK; }
+esp_err_t gpio_hold_dis(gpio_num_t pin) { return ESP_OK; }
+
+esp_err_t uart_set_wakeup_threshold(uart_port_t port, int threshold) { return ESP_OK; }
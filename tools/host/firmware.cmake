@@ -0,0 +1,29 @@
+# Firmware completo compilado para Linux sobre la capa de include/.
+# Las herramientas del host lo incluyen y enlazan contra firmware_host:
+#   include(${CMAKE_CURRENT_LIST_DIR}/../host/firmware.cmake)
+#   target_link_libraries(mi_herramienta PRIVATE firmware_host)
+# -DFIRMWARE_DIR=<árbol> compila otra versión del firmware (p. ej. un
+# git worktree) con las mismas herramientas.
+
+if(NOT FIRMWARE_DIR)
+  get_filename_component(FIRMWARE_DIR ${CMAKE_CURRENT_LIST_DIR}/../.. ABSOLUTE)
+endif()
+set(HOST_DIR ${CMAKE_CURRENT_LIST_DIR})
+
+if(NOT TARGET firmware_host)
+  file(GLOB FIRMWARE_SOURCES ${FIRMWARE_DIR}/*.cpp)
+  set(FIRMWARE_SKETCH ${FIRMWARE_DIR}/cargador_gel_litio.ino)
+  set_source_files_properties(${FIRMWARE_SKETCH} PROPERTIES LANGUAGE CXX)
+
+  add_library(firmware_host STATIC
+    ${FIRMWARE_SKETCH}
+    ${FIRMWARE_SOURCES}
+    ${HOST_DIR}/arduino_host.cpp)
+  target_include_directories(firmware_host PUBLIC ${HOST_DIR}/include ${FIRMWARE_DIR})
+  # Como hace el IDE: Arduino.h implícito y el .ino compilado como C++
+  target_compile_options(firmware_host PRIVATE -include Arduino.h)
+  set_source_files_properties(${FIRMWARE_SKETCH} PROPERTIES COMPILE_OPTIONS "-xc++")
+  # Sin contracciones FMA: los resultados deben coincidir con el soft-float del ESP32-C3
+  target_compile_options(firmware_host PUBLIC -ffp-contract=off)
+  set_target_properties(firmware_host PROPERTIES CXX_STANDARD 17 CXX_STANDARD_REQUIRED ON CXX_EXTENSIONS ON)
+endif()
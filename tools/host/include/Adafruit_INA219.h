@@ -0,0 +1,25 @@
+// INA219 simulado: las lecturas salen de los valores que fija la herramienta
+// con hostSetIna219() (ver host.h)
+#pragma once
+
+#include "Arduino.h"
+#include "Wire.h"
+
+class Adafruit_INA219 {
+ public:
+  explicit Adafruit_INA219(uint8_t address = 0x40) : address(address) {}
+
+  bool begin(TwoWire *wire = &Wire) { return true; }
+  void setCalibration_32V_2A() {}
+  void setCalibration_32V_1A() {}
+  void setCalibration_16V_400mA() {}
+  void powerSave(bool on) {}
+  bool success() { return true; }
+
+  float getBusVoltage_V();
+  float getShuntVoltage_mV();
+  float getCurrent_mA();
+  float getPower_mW();
+
+  const uint8_t address;
+};
@@ -0,0 +1,137 @@
+// Capa Arduino/ESP-IDF mínima para compilar el firmware en Linux (trazas,
+// barridos, benchmarks). Solo cubre lo que usa el firmware; el tiempo es
+// virtual y lo avanza la herramienta (ver host.h).
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using std::abs;
+using std::isinf;
+using std::isnan;
+
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define PI 3.1415926535897932384626433832795
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define FALLING 0x02
+#define CHANGE 0x03
+#define A3 3
+
+typedef uint8_t byte;
+
+#include "WString.h"
+#include "HardwareSerial.h"
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void yield();
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+uint16_t analogRead(uint8_t pin);
+
+bool ledcAttach(uint8_t pin, uint32_t frequency, uint8_t resolution);
+bool ledcDetach(uint8_t pin);
+bool ledcWrite(uint8_t pin, uint32_t duty);
+uint32_t ledcChangeFrequency(uint8_t pin, uint32_t frequency, uint8_t resolution);
+
+uint32_t esp_random();
+long map(long x, long inMin, long inMax, long outMin, long outMax);
+
+template <class T, class L, class H>
+T constrain(T x, L low, H high) {
+  return x < low ? (T)low : (x > high ? (T)high : x);
+}
+template <class A, class B>
+auto min(A a, B b) -> decltype(a + b) {
+  return a < b ? a : b;
+}
+template <class A, class B>
+auto max(A a, B b) -> decltype(a + b) {
+  return a > b ? a : b;
+}
+
+// Secciones críticas: el host es de un solo hilo
+typedef struct {
+  int owner;
+  int count;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0, 0}
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+#define portENTER_CRITICAL_ISR(mux) ((void)(mux))
+#define portEXIT_CRITICAL_ISR(mux) ((void)(mux))
+
+// Temporizadores hardware: timerBegin() devuelve NULL, de modo que el
+// firmware usa su camino sin temporizador (esperas por software)
+struct hw_timer_s;
+typedef struct hw_timer_s hw_timer_t;
+extern "C" {
+hw_timer_t *timerBegin(uint32_t frequency);
+void timerEnd(hw_timer_t *timer);
+void timerWrite(hw_timer_t *timer, uint64_t value);
+void timerStart(hw_timer_t *timer);
+void timerStop(hw_timer_t *timer);
+void timerAttachInterrupt(hw_timer_t *timer, void (*userFunc)(void));
+void timerAlarm(hw_timer_t *timer, uint64_t alarmValue, bool autoreload, uint64_t reloadCount);
+}
+
+class EspClass {
+ public:
+  const char *getChipModel();
+  uint8_t getChipRevision();
+  uint32_t getCpuFreqMHz();
+  uint32_t getFlashChipSpeed();
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getMaxAllocHeap();
+};
+extern EspClass ESP;
+
+// FreeRTOS: xTaskCreate() falla, el firmware no arranca tareas en el host
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void *TaskHandle_t;
+typedef void (*TaskFunction_t)(void *);
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+#define portMAX_DELAY 0xffffffffUL
+#define portTICK_PERIOD_MS 1
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+extern "C" {
+BaseType_t xTaskCreate(TaskFunction_t task, const char *name, uint32_t stack, void *arg,
+                       UBaseType_t priority, TaskHandle_t *handle);
+TickType_t xTaskGetTickCount(void);
+BaseType_t xTaskDelayUntil(TickType_t *previousWake, TickType_t increment);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t timeout);
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+void vTaskDelay(TickType_t ticks);
+}
+
+// Mutex: sin otras tareas, tomarlo nunca espera
+typedef struct {
+  int count;
+} StaticSemaphore_t;
+typedef StaticSemaphore_t *SemaphoreHandle_t;
+extern "C" {
+SemaphoreHandle_t xSemaphoreCreateMutexStatic(StaticSemaphore_t *buffer);
+BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, TickType_t timeout);
+BaseType_t xSemaphoreGive(SemaphoreHandle_t semaphore);
+}
@@ -0,0 +1,133 @@
+// Print/Stream/HardwareSerial del núcleo Arduino. Cada UART del host escribe
+// en un FILE* (NULL = descartar) y lee de una cola que llena la herramienta
+// (ver host.h). El destino se fija por objeto o, para objetos internos de un
+// módulo, por número de UART.
+#pragma once
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+
+#include "WString.h"
+
+#define SERIAL_8N1 0x800001c
+#define DEC 10
+#define HEX 16
+
+FILE *hostUartSink(int uartNum);
+
+class Print {
+ public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t *buffer, size_t size) {
+    size_t written = 0;
+    for (size_t i = 0; i < size; i++) written += write(buffer[i]);
+    return written;
+  }
+  size_t write(const char *text) { return write((const uint8_t *)text, strlen(text)); }
+  virtual void flush() {}
+
+  size_t print(const char *text) { return write(text); }
+  size_t print(const String &text) { return write(text.c_str()); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(int number, int base = DEC) { return printNumber((long long)number, base); }
+  size_t print(unsigned int number, int base = DEC) { return printNumber((unsigned long long)number, base); }
+  size_t print(long number, int base = DEC) { return printNumber((long long)number, base); }
+  size_t print(unsigned long number, int base = DEC) { return printNumber((unsigned long long)number, base); }
+  size_t print(double number, int decimals = 2) { return write(String(number, decimals).c_str()); }
+
+  size_t println() { return write("\r\n"); }
+  template <class T>
+  size_t println(T value) {
+    size_t written = print(value);
+    return written + println();
+  }
+  template <class T>
+  size_t println(T value, int format) {
+    size_t written = print(value, format);
+    return written + println();
+  }
+
+  size_t printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+    char buffer[512];
+    va_list args;
+    va_start(args, format);
+    int length = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (length < 0) return 0;
+    return write((const uint8_t *)buffer, (size_t)length < sizeof(buffer) ? length : sizeof(buffer) - 1);
+  }
+
+ private:
+  size_t printNumber(long long number, int base) {
+    char buffer[24];
+    snprintf(buffer, sizeof(buffer), base == HEX ? "%llX" : "%lld", number);
+    return write(buffer);
+  }
+  size_t printNumber(unsigned long long number, int base) {
+    char buffer[24];
+    snprintf(buffer, sizeof(buffer), base == HEX ? "%llX" : "%llu", number);
+    return write(buffer);
+  }
+};
+
+class Stream : public Print {
+ public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() { return -1; }
+  size_t readBytes(uint8_t *buffer, size_t length) {
+    size_t count = 0;
+    while (count < length) {
+      int c = read();
+      if (c < 0) break;
+      buffer[count++] = (uint8_t)c;
+    }
+    return count;
+  }
+};
+
+class HardwareSerial : public Stream {
+ public:
+  explicit HardwareSerial(int uartNum) : uartNum(uartNum) {}
+
+  void begin(unsigned long baud, uint32_t config = SERIAL_8N1, int8_t rxPin = -1, int8_t txPin = -1) {}
+  void end() {}
+  size_t setTxBufferSize(size_t size) { return size; }
+  size_t setRxBufferSize(size_t size) { return size; }
+  int availableForWrite() { return 4096; }
+  operator bool() const { return true; }
+
+  int available() override { return (int)rx.size(); }
+  int read() override {
+    if (rx.empty()) return -1;
+    int c = rx.front();
+    rx.pop_front();
+    return c;
+  }
+  int peek() override { return rx.empty() ? -1 : rx.front(); }
+  size_t read(uint8_t *buffer, size_t size) { return readBytes(buffer, size); }
+
+  size_t write(uint8_t c) override { return write(&c, 1); }
+  size_t write(const uint8_t *buffer, size_t size) override {
+    FILE *out = sink != nullptr ? sink : hostUartSink(uartNum);
+    if (out != nullptr) fwrite(buffer, 1, size, out);
+    return size;
+  }
+  using Print::write;
+
+  // Lado del host
+  void feed(const char *data, size_t length) { rx.insert(rx.end(), data, data + length); }
+  void setSink(FILE *file) { sink = file; }
+
+  const int uartNum;
+
+ private:
+  std::deque<uint8_t> rx;
+  FILE *sink = nullptr;
+};
+
+extern HardwareSerial Serial;
@@ -0,0 +1,45 @@
+// NVS en memoria: un mapa por espacio de nombres que sobrevive a begin/end
+// durante toda la ejecución (el host no reinicia)
+#pragma once
+
+#include "Arduino.h"
+
+class Preferences {
+ public:
+  bool begin(const char *name, bool readOnly = false);
+  void end();
+  bool clear();
+  bool remove(const char *key);
+  bool isKey(const char *key);
+
+  size_t putFloat(const char *key, float value);
+  float getFloat(const char *key, float defaultValue = 0);
+  size_t putBool(const char *key, bool value);
+  bool getBool(const char *key, bool defaultValue = false);
+  size_t putUChar(const char *key, uint8_t value);
+  uint8_t getUChar(const char *key, uint8_t defaultValue = 0);
+  size_t putInt(const char *key, int32_t value);
+  int32_t getInt(const char *key, int32_t defaultValue = 0);
+  size_t putUInt(const char *key, uint32_t value);
+  uint32_t getUInt(const char *key, uint32_t defaultValue = 0);
+  size_t putULong(const char *key, uint32_t value);
+  uint32_t getULong(const char *key, uint32_t defaultValue = 0);
+  size_t putLong64(const char *key, int64_t value);
+  int64_t getLong64(const char *key, int64_t defaultValue = 0);
+  size_t putULong64(const char *key, uint64_t value);
+  uint64_t getULong64(const char *key, uint64_t defaultValue = 0);
+  size_t putString(const char *key, const String &value);
+  String getString(const char *key, const String &defaultValue = String());
+  size_t putBytes(const char *key, const void *value, size_t length);
+  size_t getBytes(const char *key, void *buffer, size_t maxLength);
+  size_t getBytesLength(const char *key);
+  size_t freeEntries();
+
+ private:
+  size_t put(const char *key, const void *value, size_t length);
+  bool get(const char *key, void *value, size_t length);
+
+  String space;
+  bool opened = false;
+  bool readOnly = true;
+};
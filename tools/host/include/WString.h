@@ -0,0 +1,151 @@
+// String de Arduino sobre std::string (mismo formato numérico que el núcleo
+// ESP32 para los usos del firmware)
+#pragma once
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+class String {
+ public:
+  String() {}
+  String(const char *text) : value(text != nullptr ? text : "") {}
+  String(const std::string &text) : value(text) {}
+  String(char c) : value(1, c) {}
+  String(int number) : value(std::to_string(number)) {}
+  String(unsigned int number) : value(std::to_string(number)) {}
+  String(long number) : value(std::to_string(number)) {}
+  String(unsigned long number) : value(std::to_string(number)) {}
+  String(long long number) : value(std::to_string(number)) {}
+  String(unsigned long long number) : value(std::to_string(number)) {}
+  String(float number, unsigned int decimals = 2) { format(number, decimals); }
+  String(double number, unsigned int decimals = 2) { format(number, decimals); }
+
+  // Como en el núcleo: asignar texto reutiliza el búfer existente
+  String &operator=(const char *text) {
+    value = text != nullptr ? text : "";
+    return *this;
+  }
+
+  unsigned int length() const { return value.size(); }
+  const char *c_str() const { return value.c_str(); }
+  bool reserve(unsigned int size) {
+    value.reserve(size);
+    return true;
+  }
+  bool isEmpty() const { return value.empty(); }
+  void clear() { value.clear(); }
+
+  String &operator+=(const String &other) {
+    value += other.value;
+    return *this;
+  }
+  String &operator+=(const char *other) {
+    value += other;
+    return *this;
+  }
+  String &operator+=(char c) {
+    value += c;
+    return *this;
+  }
+  String &operator+=(int number) { return *this += String(number); }
+  String &operator+=(unsigned int number) { return *this += String(number); }
+  String &operator+=(unsigned long number) { return *this += String(number); }
+  String &operator+=(float number) { return *this += String(number); }
+  String &operator+=(double number) { return *this += String(number); }
+
+  bool concat(const String &other) {
+    value += other.value;
+    return true;
+  }
+  bool concat(const char *other) {
+    value += other;
+    return true;
+  }
+  bool concat(const char *other, unsigned int length) {
+    value.append(other, length);
+    return true;
+  }
+  bool concat(char c) {
+    value += c;
+    return true;
+  }
+
+  bool operator==(const String &other) const { return value == other.value; }
+  bool operator==(const char *other) const { return value == other; }
+  bool operator!=(const String &other) const { return value != other.value; }
+  bool operator!=(const char *other) const { return value != other; }
+  bool equals(const String &other) const { return value == other.value; }
+
+  bool startsWith(const String &prefix) const { return value.compare(0, prefix.value.size(), prefix.value) == 0; }
+  bool endsWith(const String &suffix) const {
+    return value.size() >= suffix.value.size() &&
+           value.compare(value.size() - suffix.value.size(), suffix.value.size(), suffix.value) == 0;
+  }
+
+  String substring(unsigned int from) const { return from >= value.size() ? String() : String(value.substr(from)); }
+  String substring(unsigned int from, unsigned int to) const {
+    if (from > to) std::swap(from, to);
+    if (from >= value.size()) return String();
+    return String(value.substr(from, to - from));
+  }
+  int indexOf(char c, unsigned int from = 0) const { return position(value.find(c, from)); }
+  int indexOf(const String &text, unsigned int from = 0) const { return position(value.find(text.value, from)); }
+  int lastIndexOf(char c) const { return position(value.rfind(c)); }
+
+  long toInt() const { return strtol(value.c_str(), nullptr, 10); }
+  float toFloat() const { return strtof(value.c_str(), nullptr); }
+
+  void trim() {
+    size_t first = value.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos) {
+      value.clear();
+      return;
+    }
+    size_t last = value.find_last_not_of(" \t\r\n");
+    value = value.substr(first, last - first + 1);
+  }
+  void replace(const String &find, const String &with) {
+    if (find.value.empty()) return;
+    size_t at = 0;
+    while ((at = value.find(find.value, at)) != std::string::npos) {
+      value.replace(at, find.value.size(), with.value);
+      at += with.value.size();
+    }
+  }
+  void remove(unsigned int index) {
+    if (index < value.size()) value.erase(index);
+  }
+  void remove(unsigned int index, unsigned int count) {
+    if (index < value.size()) value.erase(index, count);
+  }
+  void toUpperCase() {
+    for (char &c : value) c = toupper(c);
+  }
+  void toLowerCase() {
+    for (char &c : value) c = tolower(c);
+  }
+  char charAt(unsigned int index) const { return index < value.size() ? value[index] : 0; }
+  char operator[](unsigned int index) const { return charAt(index); }
+
+  std::string value;
+
+ private:
+  void format(double number, unsigned int decimals) {
+    char buffer[64];
+    snprintf(buffer, sizeof(buffer), "%.*f", (int)decimals, number);
+    value = buffer;
+  }
+  static int position(size_t at) { return at == std::string::npos ? -1 : (int)at; }
+};
+
+inline String operator+(const String &a, const String &b) { return String(a.value + b.value); }
+inline String operator+(const String &a, const char *b) { return String(a.value + b); }
+inline String operator+(const char *a, const String &b) { return String(std::string(a) + b.value); }
+inline String operator+(const String &a, char b) { return String(a.value + b); }
+inline String operator+(const String &a, int b) { return a + String(b); }
+inline String operator+(const String &a, unsigned int b) { return a + String(b); }
+inline String operator+(const String &a, unsigned long b) { return a + String(b); }
+inline String operator+(const String &a, float b) { return a + String(b); }
+inline String operator+(const String &a, double b) { return a + String(b); }
@@ -0,0 +1,36 @@
+// Servidor web inerte: registra las rutas pero nunca recibe peticiones
+#pragma once
+
+#include <functional>
+
+#include "Arduino.h"
+
+typedef enum { HTTP_ANY, HTTP_GET, HTTP_POST } HTTPMethod;
+#define CONTENT_LENGTH_UNKNOWN ((size_t)-1)
+
+class WebServer {
+ public:
+  typedef std::function<void(void)> THandlerFunction;
+
+  explicit WebServer(int port = 80) {}
+  void on(const String &uri, HTTPMethod method, THandlerFunction handler) {}
+  void onNotFound(THandlerFunction handler) {}
+  void begin() {}
+  void stop() {}
+  void close() {}
+  void handleClient() {}
+
+  void send(int code, const char *contentType = nullptr, const String &content = String()) {}
+  void send(int code, const String &contentType, const String &content) {}
+  void send_P(int code, const char *contentType, const char *content) {}
+  void sendHeader(const String &name, const String &value, bool first = false) {}
+  void setContentLength(size_t length) {}
+  void sendContent(const String &content) {}
+  void sendContent(const char *content, size_t length) {}
+
+  bool hasArg(const String &name) { return false; }
+  String arg(const String &name) { return String(); }
+  String arg(int index) { return String(); }
+  int args() { return 0; }
+  String uri() { return String("/"); }
+};
@@ -0,0 +1,49 @@
+// Radio inexistente: el softAP "arranca" pero nadie se conecta
+#pragma once
+
+#include "Arduino.h"
+
+typedef int esp_err_t;
+
+class IPAddress {
+ public:
+  String toString() const { return "192.168.4.1"; }
+  operator String() const { return toString(); }
+};
+
+typedef enum { WIFI_OFF = 0, WIFI_STA = 1, WIFI_AP = 2, WIFI_AP_STA = 3 } wifi_mode_t;
+typedef enum { WIFI_PS_NONE, WIFI_PS_MIN_MODEM, WIFI_PS_MAX_MODEM } wifi_ps_type_t;
+typedef enum { WL_IDLE_STATUS = 0, WL_CONNECTED = 3, WL_DISCONNECTED = 6 } wl_status_t;
+typedef enum {
+  WIFI_POWER_19_5dBm = 78,
+  WIFI_POWER_11dBm = 44,
+  WIFI_POWER_8_5dBm = 34,
+  WIFI_POWER_5dBm = 20,
+  WIFI_POWER_2dBm = 8
+} wifi_power_t;
+
+class WiFiClass {
+ public:
+  bool softAP(const char *ssid, const char *password = nullptr, int channel = 1, int hidden = 0, int maxConnections = 4) {
+    currentMode = WIFI_AP;
+    return true;
+  }
+  bool softAPdisconnect(bool wifiOff = false) {
+    if (wifiOff) currentMode = WIFI_OFF;
+    return true;
+  }
+  IPAddress softAPIP() { return IPAddress(); }
+  uint8_t softAPgetStationNum() { return 0; }
+  bool mode(wifi_mode_t mode) {
+    currentMode = mode;
+    return true;
+  }
+  wifi_mode_t getMode() { return currentMode; }
+  bool setSleep(bool enable) { return true; }
+  bool setTxPower(wifi_power_t power) { return true; }
+
+ private:
+  wifi_mode_t currentMode = WIFI_OFF;
+};
+
+extern WiFiClass WiFi;
@@ -0,0 +1,23 @@
+// I2C sin dispositivos: toda transacción falla (los INA219 del host no usan Wire)
+#pragma once
+
+#include "Arduino.h"
+
+class TwoWire {
+ public:
+  bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0) { return true; }
+  void setClock(uint32_t frequency) { clock = frequency; }
+  uint32_t getClock() { return clock; }
+  void setTimeOut(uint16_t timeoutMs) {}
+  void beginTransmission(uint8_t address) {}
+  uint8_t endTransmission(bool sendStop = true) { return 2; }
+  size_t write(uint8_t data) { return 1; }
+  uint8_t requestFrom(uint8_t address, uint8_t quantity) { return 0; }
+  int available() { return 0; }
+  int read() { return -1; }
+
+ private:
+  uint32_t clock = 100000;
+};
+
+extern TwoWire Wire;
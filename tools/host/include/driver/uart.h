@@ -0,0 +1,7 @@
+#pragma once
+
+#include "esp_err.h"
+
+typedef enum { UART_NUM_0, UART_NUM_1 } uart_port_t;
+
+esp_err_t uart_set_wakeup_threshold(uart_port_t port, int threshold);
@@ -0,0 +1,6 @@
+#pragma once
+
+#include <cstdint>
+
+// Reloj virtual en µs (ver hostSetMicros)
+int64_t esp_timer_get_time();
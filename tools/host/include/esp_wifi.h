@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+
+#include "WiFi.h"
+#include "esp_err.h"
+
+typedef enum { WIFI_IF_STA, WIFI_IF_AP } wifi_interface_t;
+
+typedef struct {
+  uint8_t ssid[32];
+  uint8_t password[64];
+  uint8_t ssid_len;
+  uint8_t channel;
+  int authmode;
+  uint8_t ssid_hidden;
+  uint8_t max_connection;
+  uint16_t beacon_interval;
+  uint8_t csa_count;
+  uint8_t dtim_period;
+} wifi_ap_config_t;
+
+typedef struct {
+  uint8_t ssid[32];
+  uint8_t password[64];
+  uint16_t listen_interval;
+} wifi_sta_config_t;
+
+typedef union {
+  wifi_ap_config_t ap;
+  wifi_sta_config_t sta;
+} wifi_config_t;
+
+esp_err_t esp_wifi_set_ps(wifi_ps_type_t type);
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *config);
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *config);
@@ -0,0 +1,32 @@
+// Control del entorno simulado desde las herramientas del host (replay,
+// barridos, benchmarks). El firmware no incluye este archivo.
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+
+// Reloj virtual: esp_timer_get_time(), millis() y el reloj monotónico del
+// firmware lo leen; solo avanza con estas funciones y, si está habilitado,
+// con delay()/delayMicroseconds()/light sleep
+void hostSetMicros(uint64_t us);
+void hostAdvanceMicros(uint64_t us);
+uint64_t hostMicros();
+void hostSetDelayAdvancesClock(bool enabled);
+
+// Valores que devuelve el INA219 en 'address' tal como los entrega el chip
+// (getCurrent_mA() antes del factor del shunt del firmware)
+void hostSetIna219(uint8_t address, float busVoltage_V, float current_mA);
+
+void hostSetAnalog(uint8_t pin, uint16_t value);
+int hostDigitalLevel(uint8_t pin);
+uint32_t hostPwmDuty(uint8_t pin);        // Último ledcWrite() (ya invertido por el firmware)
+
+// Destino de las UART sin destino propio (HardwareSerial::setSink), p. ej.
+// la UART1 de la grabación de trazas
+void hostSetUartSink(int uartNum, FILE *file);
+
+// Borra todos los espacios de nombres de Preferences
+void hostPreferencesClear();
+
+// Borra la flash simulada de las particiones de datos (esp_partition.h)
+void hostFlashErase();
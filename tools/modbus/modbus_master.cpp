@@ -0,0 +1,539 @@
+// Maestro Modbus RTU para el esclavo de la UART de la Orange Pi
+// (modbus_slave.h). Sin --device se prueba contra el firmware: crea un par de
+// pseudo-terminales, corre el firmware compilado para Linux (tools/host) en
+// un proceso hijo con OrangePiSerial en el lado esclavo y hace de maestro por
+// el otro lado. Recorre el cambio desde el protocolo de texto, la lectura de
+// la instantánea completa en una sola transacción, las escrituras FC06/FC16,
+// las excepciones, las tramas con CRC erróneo o para otro esclavo y la vuelta
+// al texto.
+//
+//   modbus_master [--verbose]                    autoprueba (código 1 si falla)
+//   modbus_master --device /dev/ttyUSB0 [--id N] [--baud 9600] [--write DIR=VALOR ...]
+//
+// Con --device hace las escrituras pedidas y lee y decodifica los dos mapas
+// de un equipo real. Nombres, direcciones y escalas salen de las mismas
+// tablas X que usa el firmware; el CRC se calcula aparte para no heredar un
+// error del esclavo.
+
+#include <Arduino.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "host.h"
+#include "modbus_slave.h"
+
+// cargador_gel_litio.ino
+void setup();
+void loop();
+extern HardwareSerial OrangePiSerial;
+
+#define MASTER_TIMEOUT_MS 500             // Incluye el cierre por silencio del esclavo (100 ms)
+#define MASTER_SILENCE_MS 300             // Espera para dar por buena la falta de respuesta
+#define MASTER_TEXT_TIMEOUT_MS 2000
+#define MASTER_LINE_BAUD 9600             // Para estimar el tiempo de línea real
+#define SELFTEST_SLAVE_ID 7
+#define SELFTEST_OTHER_ID 8
+#define SELFTEST_START_HOUR 10
+#define SELFTEST_PANEL_ADDRESS 0x40
+#define SELFTEST_BATTERY_ADDRESS 0x41
+#define SELFTEST_NTC_ADC_25C 2048
+#define SELFTEST_POLL_MS 2                // Ritmo del loop() del hijo
+
+typedef std::vector<uint8_t> Bytes;
+typedef std::vector<uint16_t> Words;
+
+static int port = -1;
+static bool verbose = false;
+
+// ===== Mapa de registros =====
+struct RegisterInfo {
+  const char *name;
+  uint16_t address;
+  int words;
+  uint16_t scale;
+  bool isSigned;
+};
+
+#define INPUT_INFO(name, words, scale, isSigned) {#name, MODBUS_INPUT_##name, words, scale, isSigned},
+static const RegisterInfo INPUT_TABLE[] = {MODBUS_INPUT_REGISTERS(INPUT_INFO)};
+#undef INPUT_INFO
+
+#define HOLDING_INFO(name, scale) {#name, PARAM_##name, 1, scale, false},
+static const RegisterInfo HOLDING_TABLE[] = {
+  MODBUS_HOLDING_REGISTERS(HOLDING_INFO)
+  {"LOAD_OFF", MODBUS_HOLDING_LOAD_OFF, 1, 1, false},
+  {"PROTOCOL", MODBUS_HOLDING_PROTOCOL, 1, 1, false},
+};
+#undef HOLDING_INFO
+
+#define COUNT_OF(array) (sizeof(array) / sizeof(array[0]))
+
+static double decode(const RegisterInfo &info, const Words &words) {
+  const uint16_t *raw = &words[info.address];
+  if (info.words == 2) return (((uint32_t)raw[0] << 16) | raw[1]) / (double)info.scale;
+  return (info.isSigned ? (int16_t)raw[0] : raw[0]) / (double)info.scale;
+}
+
+static const RegisterInfo &inputInfo(uint16_t address) {
+  for (const RegisterInfo &info : INPUT_TABLE) {
+    if (info.address == address) return info;
+  }
+  abort();
+}
+
+static void printTable(const char *title, const RegisterInfo *table, size_t count, const Words &words) {
+  printf("%s\n", title);
+  for (size_t i = 0; i < count; i++) {
+    const RegisterInfo &info = table[i];
+    printf("  %3u  %-22s %6u", info.address, info.name, words[info.address]);
+    if (info.words == 2) printf(" %6u", words[info.address + 1]);
+    else printf("       ");
+    printf("  %14.3f\n", decode(info, words));
+  }
+}
+
+// ===== Transporte =====
+static uint16_t crc16(const uint8_t *data, size_t length) {
+  uint16_t crc = 0xFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) crc = (crc & 1) ? (crc >> 1) ^ 0xA001 : crc >> 1;
+  }
+  return crc;
+}
+
+static Bytes withCrc(Bytes frame) {
+  uint16_t crc = crc16(frame.data(), frame.size());
+  frame.push_back(crc & 0xFF);
+  frame.push_back(crc >> 8);
+  return frame;
+}
+
+static void dump(const char *direction, const uint8_t *data, size_t length) {
+  if (!verbose) return;
+  fprintf(stderr, "%s", direction);
+  for (size_t i = 0; i < length; i++) fprintf(stderr, " %02X", data[i]);
+  fprintf(stderr, "\n");
+}
+
+static void sendRaw(const Bytes &data) {
+  dump("->", data.data(), data.size());
+  size_t sent = 0;
+  while (sent < data.size()) {
+    ssize_t written = write(port, data.data() + sent, data.size() - sent);
+    if (written < 0 && errno != EAGAIN && errno != EINTR) {
+      perror("write");
+      exit(2);
+    }
+    if (written > 0) sent += written;
+  }
+}
+
+static void sendText(const char *text) {
+  sendRaw(Bytes(text, text + strlen(text)));
+}
+
+static uint64_t nowMs() {
+  using namespace std::chrono;
+  return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Lee exactamente length bytes antes de deadline (ms de nowMs())
+static bool readExact(uint8_t *buffer, size_t length, uint64_t deadline) {
+  size_t received = 0;
+  while (received < length) {
+    uint64_t now = nowMs();
+    if (now >= deadline) return false;
+    struct pollfd waiting = {port, POLLIN, 0};
+    if (poll(&waiting, 1, (int)(deadline - now)) <= 0) continue;
+    ssize_t count = read(port, buffer + received, length - received);
+    if (count > 0) received += count;
+    else if (count < 0 && errno != EAGAIN && errno != EINTR) return false;
+  }
+  return true;
+}
+
+// Respuesta sin el CRC. false si no llega a tiempo o el CRC no cuadra.
+static bool readReply(Bytes &reply, int timeoutMs = MASTER_TIMEOUT_MS) {
+  uint64_t deadline = nowMs() + timeoutMs;
+  reply.assign(3, 0);
+  if (!readExact(reply.data(), 3, deadline)) return false;
+  size_t total = 8;                       // Eco de FC06/FC16
+  if (reply[1] & 0x80) total = 5;         // Excepción
+  else if (reply[1] == MODBUS_FC_READ_HOLDING || reply[1] == MODBUS_FC_READ_INPUT) total = 5 + reply[2];
+  reply.resize(total);
+  if (!readExact(reply.data() + 3, total - 3, deadline)) return false;
+  dump("<-", reply.data(), reply.size());
+  uint16_t crc = crc16(reply.data(), total - 2);
+  if (reply[total - 2] != (crc & 0xFF) || reply[total - 1] != (crc >> 8)) return false;
+  reply.resize(total - 2);
+  return true;
+}
+
+// true si no llega nada en MASTER_SILENCE_MS
+static bool expectSilence() {
+  uint8_t byte;
+  return !readExact(&byte, 1, nowMs() + MASTER_SILENCE_MS);
+}
+
+static Bytes request(uint8_t id, uint8_t function, uint16_t first, uint16_t second) {
+  return {id, function, (uint8_t)(first >> 8), (uint8_t)first, (uint8_t)(second >> 8), (uint8_t)second};
+}
+
+static Bytes writeMultipleRequest(uint8_t id, uint16_t start, const Words &values) {
+  Bytes frame = request(id, MODBUS_FC_WRITE_MULTIPLE, start, values.size());
+  frame.push_back(values.size() * 2);
+  for (uint16_t value : values) {
+    frame.push_back(value >> 8);
+    frame.push_back(value & 0xFF);
+  }
+  return frame;
+}
+
+// Resultado de una transacción: sin respuesta, excepción o correcta
+struct Result {
+  bool answered;
+  uint8_t exception;
+  Bytes reply;
+  bool ok() const { return answered && exception == 0; }
+};
+
+static Result transact(const Bytes &frame) {
+  Result result = {false, 0, {}};
+  sendRaw(withCrc(frame));
+  result.answered = readReply(result.reply);
+  if (result.answered && (result.reply[1] & 0x80)) result.exception = result.reply[2];
+  return result;
+}
+
+static Result readRegisters(uint8_t id, uint8_t function, uint16_t start, uint16_t count, Words &words) {
+  Result result = transact(request(id, function, start, count));
+  words.clear();
+  if (result.ok()) {
+    for (size_t i = 3; i + 1 < result.reply.size(); i += 2) {
+      words.push_back((uint16_t)(result.reply[i] << 8) | result.reply[i + 1]);
+    }
+  }
+  return result;
+}
+
+static Result writeRegister(uint8_t id, uint16_t address, uint16_t value) {
+  return transact(request(id, MODBUS_FC_WRITE_SINGLE, address, value));
+}
+
+// ===== Equipo real =====
+static speed_t toSpeed(int baud) {
+  switch (baud) {
+    case 9600: return B9600;
+    case 19200: return B19200;
+    case 38400: return B38400;
+    case 57600: return B57600;
+    case 115200: return B115200;
+    default: return 0;
+  }
+}
+
+static void makeRaw(int fd, speed_t speed) {
+  struct termios settings;
+  tcgetattr(fd, &settings);
+  cfmakeraw(&settings);
+  settings.c_cflag |= CLOCAL | CREAD;
+  settings.c_cc[VMIN] = 0;
+  settings.c_cc[VTIME] = 0;
+  if (speed != 0) cfsetspeed(&settings, speed);
+  tcsetattr(fd, TCSANOW, &settings);
+}
+
+static int runDevice(const char *path, uint8_t id, int baud, const std::vector<std::string> &writes) {
+  speed_t speed = toSpeed(baud);
+  if (speed == 0) {
+    fprintf(stderr, "Baudios no soportados: %d\n", baud);
+    return 2;
+  }
+  port = open(path, O_RDWR | O_NOCTTY);
+  if (port < 0) {
+    perror(path);
+    return 2;
+  }
+  makeRaw(port, speed);
+  tcflush(port, TCIOFLUSH);
+
+  for (const std::string &write : writes) {
+    size_t equals = write.find('=');
+    if (equals == std::string::npos) {
+      fprintf(stderr, "--write espera DIR=VALOR: %s\n", write.c_str());
+      return 2;
+    }
+    uint16_t address = strtoul(write.substr(0, equals).c_str(), nullptr, 0);
+    uint16_t value = strtoul(write.substr(equals + 1).c_str(), nullptr, 0);
+    Result result = writeRegister(id, address, value);
+    if (!result.answered) printf("Escritura %u=%u: sin respuesta\n", address, value);
+    else if (result.exception != 0) printf("Escritura %u=%u: excepción %02X\n", address, value, result.exception);
+    else printf("Escritura %u=%u: OK\n", address, value);
+  }
+
+  Words inputs, holdings;
+  Result input = readRegisters(id, MODBUS_FC_READ_INPUT, 0, MODBUS_INPUT_COUNT, inputs);
+  Result holding = readRegisters(id, MODBUS_FC_READ_HOLDING, 0, MODBUS_HOLDING_COUNT, holdings);
+  if (!input.ok() || !holding.ok()) {
+    fprintf(stderr, "Sin respuesta válida del esclavo %u (input %s, holding %s)\n", id,
+            input.answered ? "excepción" : "mudo", holding.answered ? "excepción" : "mudo");
+    return 1;
+  }
+  printTable("Registros input (FC04)", INPUT_TABLE, COUNT_OF(INPUT_TABLE), inputs);
+  printTable("Registros holding (FC03)", HOLDING_TABLE, COUNT_OF(HOLDING_TABLE), holdings);
+  return 0;
+}
+
+// ===== Autoprueba =====
+static int failures = 0;
+
+static void expect(bool condition, const char *what) {
+  printf("%s %s\n", condition ? "✓" : "✗", what);
+  if (!condition) failures++;
+}
+
+// Firmware en el proceso hijo: el reloj virtual sigue al real para que el
+// ciclo de control y el cierre de tramas por silencio ocurran a su ritmo
+static void runFirmware(int fd) {
+  FILE *uart = fdopen(fd, "w");
+  setvbuf(uart, nullptr, _IONBF, 0);
+  Serial.setSink(verbose ? stderr : nullptr);
+  OrangePiSerial.setSink(uart);
+  hostSetDelayAdvancesClock(false);
+  uint64_t startUs = (uint64_t)SELFTEST_START_HOUR * 3600ULL * 1000000ULL;
+  hostSetMicros(startUs);
+  hostSetIna219(SELFTEST_PANEL_ADDRESS, 18.5f, 250.0f);
+  hostSetIna219(SELFTEST_BATTERY_ADDRESS, 12.9f, 40.0f);
+  hostSetAnalog(TEMP_PIN, SELFTEST_NTC_ADC_25C);
+  setup();
+
+  uint64_t start = nowMs();
+  char buffer[256];
+  while (true) {
+    struct pollfd waiting = {fd, POLLIN, 0};
+    poll(&waiting, 1, SELFTEST_POLL_MS);
+    if (waiting.revents & POLLIN) {
+      ssize_t count = read(fd, buffer, sizeof(buffer));
+      if (count > 0) OrangePiSerial.feed(buffer, count);
+      else if (count == 0 || (errno != EAGAIN && errno != EINTR)) break;
+    } else if (waiting.revents & (POLLHUP | POLLERR)) {
+      break;                              // El maestro cerró el pty
+    }
+    hostSetMicros(startUs + (nowMs() - start) * 1000ULL);
+    loop();
+  }
+  _exit(0);
+}
+
+// Siguiente línea de texto que empieza por prefix ("" = cualquiera)
+static std::string readLine(const char *prefix) {
+  uint64_t deadline = nowMs() + MASTER_TEXT_TIMEOUT_MS;
+  std::string line;
+  uint8_t byte;
+  while (readExact(&byte, 1, deadline)) {
+    if (byte == '\r') continue;
+    if (byte != '\n') {
+      line += (char)byte;
+      continue;
+    }
+    if (line.compare(0, strlen(prefix), prefix) == 0) return line;
+    line.clear();
+  }
+  return "";
+}
+
+static uint16_t holdingValue(uint16_t address) {
+  Words words;
+  Result result = readRegisters(SELFTEST_SLAVE_ID, MODBUS_FC_READ_HOLDING, address, 1, words);
+  return result.ok() ? words[0] : 0xFFFF;
+}
+
+static uint16_t inputValue(uint16_t address) {
+  Words words;
+  Result result = readRegisters(SELFTEST_SLAVE_ID, MODBUS_FC_READ_INPUT, address, 1, words);
+  return result.ok() ? words[0] : 0;
+}
+
+static void runSelfTest() {
+  const uint8_t id = SELFTEST_SLAVE_ID;
+  Bytes reference = {0x01, 0x03, 0x00, 0x00, 0x00, 0x0A};
+  expect(crc16(reference.data(), reference.size()) == 0xCDC5, "CRC16 de la trama de referencia (C5 CD)");
+
+  // --- Cambio desde el protocolo de texto ---
+  sendText("CMD:MODBUS:ON:0\n");
+  expect(readLine("") == "ERROR:Invalid Modbus id (1-247)", "CMD:MODBUS:ON rechaza el esclavo 0");
+  sendText("CMD:MODBUS:ON:7\n");
+  expect(readLine("") == "OK:Modbus RTU slave 7", "CMD:MODBUS:ON:7 pasa la UART a Modbus");
+
+  // --- Instantánea completa ---
+  bool valid = false;
+  for (uint64_t deadline = nowMs() + 3000; !valid && nowMs() < deadline;) {
+    valid = inputValue(MODBUS_INPUT_FLAGS) & MODBUS_FLAG_MEASUREMENT_VALID;
+    if (!valid) usleep(100000);
+  }
+  expect(valid, "primer ciclo de control publicado (FLAGS)");
+
+  Words inputs;
+  uint64_t before = nowMs();
+  Result snapshot = readRegisters(id, MODBUS_FC_READ_INPUT, 0, MODBUS_INPUT_COUNT, inputs);
+  uint64_t elapsed = nowMs() - before;
+  size_t requestBytes = 8, replyBytes = snapshot.reply.size() + 2;
+  expect(snapshot.ok() && inputs.size() == MODBUS_INPUT_COUNT, "FC04 lee los registros input en una transacción");
+  if (snapshot.ok()) {
+    printTable("Registros input (FC04)", INPUT_TABLE, COUNT_OF(INPUT_TABLE), inputs);
+    printf("  %d registros, respuesta de %zu bytes: %.0f ms de línea a %d baudios (%llu ms por el pty)\n",
+           MODBUS_INPUT_COUNT, replyBytes, (requestBytes + replyBytes) * 10 * 1000.0 / MASTER_LINE_BAUD,
+           MASTER_LINE_BAUD, (unsigned long long)elapsed);
+    double battery = decode(inputInfo(MODBUS_INPUT_BATTERY_VOLTAGE), inputs);
+    double panel = decode(inputInfo(MODBUS_INPUT_PANEL_VOLTAGE), inputs);
+    expect(replyBytes <= 64, "la instantánea cabe en una trama de ~60 bytes");
+    expect(battery > 12.0 && battery < 14.0, "voltaje de batería coherente con el INA219 simulado");
+    expect(panel > 17.5 && panel < 19.5, "voltaje de panel coherente con el INA219 simulado");
+    expect(inputs[MODBUS_INPUT_CHARGE_STATE] <= ERROR, "etapa de carga válida");
+  }
+
+  // --- Holding: lectura y escrituras ---
+  Words holdings;
+  Result holding = readRegisters(id, MODBUS_FC_READ_HOLDING, 0, MODBUS_HOLDING_COUNT, holdings);
+  expect(holding.ok() && holdings.size() == MODBUS_HOLDING_COUNT, "FC03 lee todo el mapa holding");
+  if (holding.ok()) {
+    printTable("Registros holding (FC03)", HOLDING_TABLE, COUNT_OF(HOLDING_TABLE), holdings);
+    expect(holdings[MODBUS_HOLDING_PROTOCOL] == 1, "PROTOCOL se lee 1 en modo Modbus");
+  }
+
+  Bytes single = request(id, MODBUS_FC_WRITE_SINGLE, PARAM_BULK_VOLTAGE, 14200);
+  Result echo = transact(single);
+  expect(echo.ok() && echo.reply == single, "FC06 responde con el eco de la petición");
+  expect(holdingValue(PARAM_BULK_VOLTAGE) == 14200, "FC06 aplica bulkVoltage = 14.2 V");
+
+  Result multiple = transact(writeMultipleRequest(id, PARAM_ABSORPTION_VOLTAGE, {14300, 13500}));
+  expect(multiple.ok() && multiple.reply == request(id, MODBUS_FC_WRITE_MULTIPLE, PARAM_ABSORPTION_VOLTAGE, 2),
+         "FC16 responde con inicio y cantidad");
+  expect(holdingValue(PARAM_ABSORPTION_VOLTAGE) == 14300 && holdingValue(PARAM_FLOAT_VOLTAGE) == 13500,
+         "FC16 aplica absorptionVoltage y floatVoltage");
+
+  // --- Excepciones ---
+  expect(writeRegister(id, PARAM_BULK_VOLTAGE, 20000).exception == MODBUS_EX_ILLEGAL_VALUE,
+         "valor fuera de rango: excepción 03");
+  Result partial = transact(writeMultipleRequest(id, PARAM_BULK_VOLTAGE, {14100, 9000}));
+  expect(partial.exception == MODBUS_EX_ILLEGAL_VALUE && holdingValue(PARAM_BULK_VOLTAGE) == 14200,
+         "FC16 con un valor inválido no aplica ninguno");
+  Words unused;
+  expect(readRegisters(id, MODBUS_FC_READ_HOLDING, MODBUS_HOLDING_COUNT - 1, 2, unused).exception ==
+         MODBUS_EX_ILLEGAL_ADDRESS, "lectura fuera del mapa: excepción 02");
+  expect(readRegisters(id, MODBUS_FC_READ_INPUT, 0, MODBUS_MAX_READ + 1, unused).exception ==
+         MODBUS_EX_ILLEGAL_VALUE, "más de 125 registros: excepción 03");
+  expect(writeRegister(id, MODBUS_HOLDING_PROTOCOL, 2).exception == MODBUS_EX_ILLEGAL_VALUE,
+         "PROTOCOL solo admite 0 o 1");
+  expect(transact({id, 0x2B, 0x0E, 0x01}).exception == MODBUS_EX_ILLEGAL_FUNCTION,
+         "función desconocida (cerrada por silencio): excepción 01");
+
+  // --- Tramas que no se contestan ---
+  Bytes corrupted = withCrc(request(id, MODBUS_FC_READ_HOLDING, 0, 1));
+  corrupted.back() ^= 0x55;
+  sendRaw(corrupted);
+  expect(expectSilence(), "CRC erróneo: sin respuesta");
+  sendRaw(withCrc(request(SELFTEST_OTHER_ID, MODBUS_FC_READ_HOLDING, 0, 1)));
+  expect(expectSilence(), "trama para otro esclavo: sin respuesta");
+  sendRaw(withCrc(request(0, MODBUS_FC_WRITE_SINGLE, PARAM_BULK_VOLTAGE, 14000)));
+  expect(expectSilence(), "escritura de difusión: sin respuesta");
+  expect(holdingValue(PARAM_BULK_VOLTAGE) == 14000, "escritura de difusión aplicada");
+
+  // Sin silencio entre tramas: basura y dos peticiones seguidas
+  Bytes burst = corrupted;
+  Bytes first = withCrc(request(id, MODBUS_FC_READ_INPUT, MODBUS_INPUT_PWM, 1));
+  Bytes second = withCrc(request(id, MODBUS_FC_READ_HOLDING, PARAM_BULK_VOLTAGE, 1));
+  burst.insert(burst.end(), first.begin(), first.end());
+  burst.insert(burst.end(), second.begin(), second.end());
+  sendRaw(burst);
+  Bytes reply1, reply2;
+  bool both = readReply(reply1) && readReply(reply2);
+  expect(both && reply1[1] == MODBUS_FC_READ_INPUT && reply2[1] == MODBUS_FC_READ_HOLDING,
+         "se resincroniza tras un CRC erróneo y atiende dos tramas seguidas");
+
+  // --- Registros de control ---
+  bool loadOn = inputValue(MODBUS_INPUT_FLAGS) & MODBUS_FLAG_LOAD_ON;
+  expect(loadOn, "carga encendida al empezar");
+  expect(writeRegister(id, MODBUS_HOLDING_LOAD_OFF, 60).ok(), "LOAD_OFF = 60 s");
+  uint16_t flags = inputValue(MODBUS_INPUT_FLAGS);
+  uint16_t remaining = inputValue(MODBUS_INPUT_LOAD_OFF_REMAINING);
+  expect((flags & MODBUS_FLAG_LOAD_TEMP_OFF) && !(flags & MODBUS_FLAG_LOAD_ON) && remaining >= 59 && remaining <= 60,
+         "carga apagada temporalmente con la cuenta atrás en LOAD_OFF_REMAINING");
+  expect(writeRegister(id, MODBUS_HOLDING_LOAD_OFF, 0).ok() && (inputValue(MODBUS_INPUT_FLAGS) & MODBUS_FLAG_LOAD_ON),
+         "LOAD_OFF = 0 cancela el apagado");
+
+  // --- Vuelta al texto ---
+  Bytes back = request(id, MODBUS_FC_WRITE_SINGLE, MODBUS_HOLDING_PROTOCOL, 0);
+  Result backResult = transact(back);
+  expect(backResult.ok() && backResult.reply == back, "PROTOCOL = 0 responde en Modbus");
+  sendText("CMD:GET_DATA\n");
+  expect(readLine("{").size() > 0, "CMD:GET_DATA vuelve a funcionar en texto");
+}
+
+static int runPtySelfTest() {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+    perror("posix_openpt");
+    return 2;
+  }
+  int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+  if (slave < 0) {
+    perror("ptsname");
+    return 2;
+  }
+  // En crudo antes de que el maestro escriba nada: sin eco ni traducción de \n
+  makeRaw(slave, 0);
+  printf("Esclavo en %s\n", ptsname(master));
+  fflush(stdout);
+
+  pid_t child = fork();
+  if (child == 0) {
+    close(master);
+    runFirmware(slave);
+  }
+  close(slave);
+  port = master;
+
+  runSelfTest();
+
+  close(master);
+  kill(child, SIGTERM);
+  waitpid(child, nullptr, 0);
+  if (failures > 0) {
+    printf("FALLO: %d comprobaciones\n", failures);
+    return 1;
+  }
+  printf("OK: esclavo Modbus RTU\n");
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  const char *device = nullptr;
+  int slaveId = MODBUS_DEFAULT_ID;
+  int baud = MASTER_LINE_BAUD;
+  std::vector<std::string> writes;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--device") == 0 && i + 1 < argc) device = argv[++i];
+    else if (strcmp(argv[i], "--id") == 0 && i + 1 < argc) slaveId = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--baud") == 0 && i + 1 < argc) baud = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--write") == 0 && i + 1 < argc) writes.push_back(argv[++i]);
+    else if (strcmp(argv[i], "--verbose") == 0) verbose = true;
+    else {
+      fprintf(stderr, "Uso: %s [--verbose] | --device TTY [--id N] [--baud B] [--write DIR=VALOR ...]\n", argv[0]);
+      return 2;
+    }
+  }
+  if (device != nullptr) return runDevice(device, slaveId, baud, writes);
+  return runPtySelfTest();
+}
@@ -0,0 +1,610 @@
+// Broker MQTT de prueba para el publicador de telemetría (mqtt_publisher.h).
+// Crea un par de pseudo-terminales y corre el firmware compilado para Linux
+// (tools/host) en un proceso hijo con OrangePiSerial en un lado; por el otro
+// hace de Orange Pi (túnel BRIDGE) y de broker MQTT 3.1.1 mínimo: CONNACK,
+// PUBACK, PINGRESP y registro de cada PUBLISH.
+//
+//   mqtt_broker [--verbose]                      autoprueba (código 1 si falla)
+//
+// El reloj virtual del hijo corre SELFTEST_TIME_SCALE veces más rápido que el
+// real, así los intervalos de muestreo, los reintentos y el vaciado de la
+// cola pasan en segundos. Recorre la sesión (CONNECT, último deseo, estado
+// retenido), el formato de los lotes, el muestreo por cambio, la cola sin
+// broker con su backoff, el vaciado ordenado y a ritmo controlado, la
+// retransmisión de un lote sin PUBACK y el cierre con CMD:MQTT:OFF. El
+// base64 y el formato de los paquetes se implementan aparte para no heredar
+// un error del firmware.
+
+#include <Arduino.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "host.h"
+#include "mqtt_publisher.h"
+
+// cargador_gel_litio.ino
+void setup();
+void loop();
+extern HardwareSerial OrangePiSerial;
+
+#define SELFTEST_TIME_SCALE 20            // ms virtuales del hijo por ms real
+#define SELFTEST_START_HOUR 10
+#define SELFTEST_PANEL_ADDRESS 0x40
+#define SELFTEST_BATTERY_ADDRESS 0x41
+#define SELFTEST_NTC_ADC_25C 2048
+#define SELFTEST_POLL_MS 2                // Ritmo del loop() del hijo
+#define SELFTEST_TOPIC "test_charger"
+#define SELFTEST_BATTERY_V 12.9f
+#define SELFTEST_STEP_V 13.4f             // Salto de batería para el muestreo por cambio
+#define SELFTEST_TEXT_TIMEOUT_MS 2000
+
+typedef std::vector<uint8_t> Bytes;
+
+static int port = -1;
+static int control = -1;                  // Tubería hacia el hijo para mover el INA219
+static bool verbose = false;
+
+static uint64_t nowMs() {
+  using namespace std::chrono;
+  return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Milisegundos reales que tarda en pasar 'virtualMs' en el hijo
+static uint64_t realMs(uint64_t virtualMs) {
+  return (virtualMs + SELFTEST_TIME_SCALE - 1) / SELFTEST_TIME_SCALE;
+}
+
+// ===== Base64 =====
+static const char BASE64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+static std::string encodeBase64(const uint8_t *data, size_t length) {
+  std::string text;
+  for (size_t i = 0; i < length; i += 3) {
+    uint32_t n = data[i] << 16;
+    if (i + 1 < length) n |= data[i + 1] << 8;
+    if (i + 2 < length) n |= data[i + 2];
+    text += BASE64[n >> 18];
+    text += BASE64[(n >> 12) & 0x3F];
+    text += i + 1 < length ? BASE64[(n >> 6) & 0x3F] : '=';
+    text += i + 2 < length ? BASE64[n & 0x3F] : '=';
+  }
+  return text;
+}
+
+static bool decodeBase64(const std::string &text, Bytes &out) {
+  if (text.size() % 4 != 0) return false;
+  uint32_t n = 0;
+  int bits = 0;
+  for (size_t i = 0; i < text.size(); i++) {
+    char c = text[i];
+    if (c == '=') {
+      if (i + 2 < text.size()) return false;
+      continue;
+    }
+    const char *at = strchr(BASE64, c);
+    if (at == nullptr || c == '\0') return false;
+    n = (n << 6) | (at - BASE64);
+    bits += 6;
+    if (bits >= 8) {
+      bits -= 8;
+      out.push_back((n >> bits) & 0xFF);
+    }
+  }
+  return true;
+}
+
+// ===== Pseudo-terminal =====
+static void sendText(const std::string &text) {
+  if (verbose) fprintf(stderr, "-> %s", text.c_str());
+  size_t sent = 0;
+  while (sent < text.size()) {
+    ssize_t written = write(port, text.data() + sent, text.size() - sent);
+    if (written < 0 && errno != EAGAIN && errno != EINTR) {
+      perror("write");
+      exit(2);
+    }
+    if (written > 0) sent += written;
+  }
+}
+
+static void setBattery(float volts) {
+  float reading[3] = {SELFTEST_BATTERY_ADDRESS, volts, 40.0f};
+  if (write(control, reading, sizeof(reading)) != sizeof(reading)) perror("control");
+}
+
+// ===== Broker =====
+struct Publish {
+  std::string topic;
+  std::string payload;
+  int qos;
+  bool retain;
+  uint16_t packetId;
+  uint64_t receivedMs;                    // Reloj real del padre
+};
+
+struct Connect {
+  int level;
+  uint8_t flags;
+  uint16_t keepAlive;
+  std::string clientId;
+  std::string willTopic;
+  std::string willMessage;
+};
+
+static bool brokerOnline = true;          // false: la Orange Pi no llega al broker
+static bool autoAck = true;
+static bool bridgeOpen = false;
+static Bytes rxBuffer;
+static std::vector<Connect> connects;
+static std::vector<Publish> publishes;
+static int bridgeOpens = 0;
+static int disconnects = 0;
+static int pings = 0;
+static std::vector<uint64_t> refusedOpens;
+static std::deque<std::string> textLines;
+static std::string partialLine;
+
+// Paquete al firmware, troceado como lo haría la Orange Pi
+static void brokerSend(uint8_t header, const Bytes &body) {
+  Bytes packet = {header};
+  size_t remaining = body.size();
+  do {
+    uint8_t digit = remaining % 128;
+    remaining /= 128;
+    packet.push_back(digit | (remaining > 0 ? 0x80 : 0));
+  } while (remaining > 0);
+  packet.insert(packet.end(), body.begin(), body.end());
+  for (size_t offset = 0; offset < packet.size(); offset += MQTT_BRIDGE_CHUNK) {
+    size_t chunk = std::min((size_t)MQTT_BRIDGE_CHUNK, packet.size() - offset);
+    sendText("CMD:BRIDGE:D:" + encodeBase64(packet.data() + offset, chunk) + "\n");
+  }
+}
+
+static std::string readString(const Bytes &body, size_t &at) {
+  if (at + 2 > body.size()) return "";
+  size_t length = (body[at] << 8) | body[at + 1];
+  at += 2;
+  if (at + length > body.size()) length = body.size() - at;
+  std::string text(body.begin() + at, body.begin() + at + length);
+  at += length;
+  return text;
+}
+
+static void handlePacket(uint8_t header, const Bytes &body) {
+  size_t at = 0;
+  switch (header & 0xF0) {
+    case 0x10: {
+      Connect connect;
+      std::string protocol = readString(body, at);
+      connect.level = protocol == "MQTT" && at < body.size() ? body[at] : -1;
+      connect.flags = at + 1 < body.size() ? body[at + 1] : 0;
+      connect.keepAlive = at + 3 < body.size() ? (body[at + 2] << 8) | body[at + 3] : 0;
+      at += 4;
+      connect.clientId = readString(body, at);
+      if (connect.flags & 0x04) {
+        connect.willTopic = readString(body, at);
+        connect.willMessage = readString(body, at);
+      }
+      connects.push_back(connect);
+      brokerSend(0x20, {0x00, 0x00});
+      break;
+    }
+    case 0x30: {
+      Publish publish;
+      publish.topic = readString(body, at);
+      publish.qos = (header >> 1) & 0x03;
+      publish.retain = header & 0x01;
+      publish.packetId = 0;
+      if (publish.qos > 0 && at + 2 <= body.size()) {
+        publish.packetId = (body[at] << 8) | body[at + 1];
+        at += 2;
+      }
+      publish.payload.assign(body.begin() + at, body.end());
+      publish.receivedMs = nowMs();
+      publishes.push_back(publish);
+      if (publish.qos == 1 && autoAck) {
+        brokerSend(0x40, {(uint8_t)(publish.packetId >> 8), (uint8_t)publish.packetId});
+      }
+      break;
+    }
+    case 0xC0:
+      pings++;
+      brokerSend(0xD0, {});
+      break;
+    case 0xE0:
+      disconnects++;
+      break;
+  }
+}
+
+// Separa los paquetes completos del flujo del túnel
+static void brokerReceive(const Bytes &data) {
+  rxBuffer.insert(rxBuffer.end(), data.begin(), data.end());
+  while (rxBuffer.size() >= 2) {
+    size_t remaining = 0, multiplier = 1, at = 1;
+    bool complete = false;
+    while (at < rxBuffer.size() && at <= 4) {
+      remaining += (rxBuffer[at] & 0x7F) * multiplier;
+      multiplier *= 128;
+      if ((rxBuffer[at++] & 0x80) == 0) {
+        complete = true;
+        break;
+      }
+    }
+    if (!complete || rxBuffer.size() < at + remaining) return;
+    Bytes body(rxBuffer.begin() + at, rxBuffer.begin() + at + remaining);
+    uint8_t header = rxBuffer[0];
+    rxBuffer.erase(rxBuffer.begin(), rxBuffer.begin() + at + remaining);
+    handlePacket(header, body);
+  }
+}
+
+// ===== Orange Pi =====
+static void handleLine(const std::string &line) {
+  if (verbose) fprintf(stderr, "<- %s\n", line.c_str());
+  if (line == "BRIDGE:OPEN") {
+    bridgeOpens++;
+    rxBuffer.clear();
+    bridgeOpen = brokerOnline;
+    if (!brokerOnline) refusedOpens.push_back(nowMs());
+    sendText(brokerOnline ? "CMD:BRIDGE:UP\n" : "CMD:BRIDGE:DOWN\n");
+  } else if (line == "BRIDGE:CLOSE") {
+    bridgeOpen = false;
+  } else if (line.compare(0, 9, "BRIDGE:D:") == 0) {
+    Bytes data;
+    if (!decodeBase64(line.substr(9), data)) {
+      fprintf(stderr, "Bloque del túnel no es base64: %s\n", line.c_str());
+      return;
+    }
+    if (bridgeOpen) brokerReceive(data);
+  } else if (line.compare(0, 10, "HEARTBEAT:") != 0) {
+    textLines.push_back(line);      // El latido llega cada 30 s virtuales: no es respuesta
+  }
+}
+
+// Atiende la UART durante timeoutMs o hasta que done() se cumpla
+template <typename Condition>
+static bool pumpUntil(Condition done, uint64_t timeoutMs) {
+  uint64_t deadline = nowMs() + timeoutMs;
+  while (!done()) {
+    uint64_t now = nowMs();
+    if (now >= deadline) return false;
+    struct pollfd waiting = {port, POLLIN, 0};
+    if (poll(&waiting, 1, (int)std::min<uint64_t>(deadline - now, 50)) <= 0) continue;
+    char buffer[256];
+    ssize_t count = read(port, buffer, sizeof(buffer));
+    for (ssize_t i = 0; i < count; i++) {
+      if (buffer[i] == '\r') continue;
+      if (buffer[i] != '\n') {
+        partialLine += buffer[i];
+        continue;
+      }
+      handleLine(partialLine);
+      partialLine.clear();
+    }
+  }
+  return true;
+}
+
+static void pumpFor(uint64_t ms) {
+  pumpUntil([] { return false; }, ms);
+}
+
+// Siguiente línea de texto que empieza por prefix
+static std::string waitLine(const char *prefix) {
+  std::string found;
+  pumpUntil([&] {
+    while (!textLines.empty()) {
+      std::string line = textLines.front();
+      textLines.pop_front();
+      if (line.compare(0, strlen(prefix), prefix) == 0) {
+        found = line;
+        return true;
+      }
+    }
+    return false;
+  }, SELFTEST_TEXT_TIMEOUT_MS);
+  return found;
+}
+
+static std::string command(const std::string &text, const char *prefix) {
+  sendText(text + "\n");
+  return waitLine(prefix);
+}
+
+// Entero de "clave":valor en el JSON de CMD:MQTT:STATUS (-1 si falta)
+static long statusField(const char *key) {
+  std::string status = command("CMD:MQTT:STATUS", "MQTT:");
+  std::string pattern = std::string("\"") + key + "\":";
+  size_t at = status.find(pattern);
+  return at == std::string::npos ? -1 : atol(status.c_str() + at + pattern.size());
+}
+
+// ===== Lotes =====
+struct Sample {
+  long offset, panel_mV, battery_mV, charge_mA, load_mA, pwm, state, temperature_dC;
+};
+
+struct Batch {
+  bool valid;
+  long boot, sequence, baseTime;
+  std::string clock;
+  std::vector<Sample> samples;
+};
+
+static Batch parseBatch(const std::string &payload) {
+  Batch batch = {false, 0, 0, 0, "", {}};
+  size_t start = 0;
+  bool header = true;
+  while (start < payload.size()) {
+    size_t end = payload.find('\n', start);
+    if (end == std::string::npos) return batch;   // Cada línea acaba en '\n'
+    std::string line = payload.substr(start, end - start);
+    start = end + 1;
+    if (header) {
+      char clock[16];
+      if (sscanf(line.c_str(), "%ld,%ld,%15[a-z],%ld", &batch.boot, &batch.sequence, clock, &batch.baseTime) != 4) {
+        return batch;
+      }
+      batch.clock = clock;
+      header = false;
+      continue;
+    }
+    Sample s;
+    if (sscanf(line.c_str(), "%ld,%ld,%ld,%ld,%ld,%ld,%ld,%ld", &s.offset, &s.panel_mV, &s.battery_mV,
+               &s.charge_mA, &s.load_mA, &s.pwm, &s.state, &s.temperature_dC) != 8) {
+      return batch;
+    }
+    batch.samples.push_back(s);
+  }
+  batch.valid = !header && !batch.samples.empty();
+  return batch;
+}
+
+static std::vector<const Publish *> telemetry() {
+  std::vector<const Publish *> found;
+  for (const Publish &publish : publishes) {
+    if (publish.topic == SELFTEST_TOPIC "/telemetry") found.push_back(&publish);
+  }
+  return found;
+}
+
+static bool waitTelemetry(size_t count, uint64_t virtualMs) {
+  return pumpUntil([&] { return telemetry().size() >= count; }, realMs(virtualMs) + 1000);
+}
+
+// ===== Autoprueba =====
+static int failures = 0;
+
+static void expect(bool condition, const char *what) {
+  printf("%s %s\n", condition ? "✓" : "✗", what);
+  if (!condition) failures++;
+}
+
+// Firmware en el proceso hijo con el reloj virtual acelerado
+static void runFirmware(int fd, int controlFd) {
+  FILE *uart = fdopen(fd, "w");
+  setvbuf(uart, nullptr, _IONBF, 0);
+  Serial.setSink(verbose ? stderr : nullptr);
+  OrangePiSerial.setSink(uart);
+  hostSetDelayAdvancesClock(false);
+  uint64_t startUs = (uint64_t)SELFTEST_START_HOUR * 3600ULL * 1000000ULL;
+  hostSetMicros(startUs);
+  hostSetIna219(SELFTEST_PANEL_ADDRESS, 18.5f, 250.0f);
+  hostSetIna219(SELFTEST_BATTERY_ADDRESS, SELFTEST_BATTERY_V, 40.0f);
+  hostSetAnalog(TEMP_PIN, SELFTEST_NTC_ADC_25C);
+  setup();
+
+  uint64_t start = nowMs();
+  char buffer[256];
+  while (true) {
+    struct pollfd waiting[2] = {{fd, POLLIN, 0}, {controlFd, POLLIN, 0}};
+    poll(waiting, 2, SELFTEST_POLL_MS);
+    if (waiting[0].revents & POLLIN) {
+      ssize_t count = read(fd, buffer, sizeof(buffer));
+      if (count > 0) OrangePiSerial.feed(buffer, count);
+      else if (count == 0 || (errno != EAGAIN && errno != EINTR)) break;
+    } else if (waiting[0].revents & (POLLHUP | POLLERR)) {
+      break;                              // El padre cerró el pty
+    }
+    if (waiting[1].revents & POLLIN) {
+      float reading[3];
+      if (read(controlFd, reading, sizeof(reading)) == sizeof(reading)) {
+        hostSetIna219((uint8_t)reading[0], reading[1], reading[2]);
+      }
+    }
+    hostSetMicros(startUs + (nowMs() - start) * 1000ULL * SELFTEST_TIME_SCALE);
+    loop();
+  }
+  _exit(0);
+}
+
+static void runSelfTest() {
+  // --- Configuración ---
+  expect(command("CMD:SET_mqttTopic:a/b", "").compare(0, 6, "ERROR:") == 0, "tema con '/' rechazado");
+  expect(command("CMD:SET_mqttTopic:" SELFTEST_TOPIC, "").compare(0, 3, "OK:") == 0, "mqttTopic = " SELFTEST_TOPIC);
+  expect(command("CMD:SET_mqttInterval:1", "").compare(0, 6, "ERROR:") == 0, "intervalo por debajo de 5 s rechazado");
+  expect(command("CMD:SET_mqttInterval:5", "").compare(0, 3, "OK:") == 0, "mqttInterval = 5 s");
+  expect(command("CMD:MQTT:ON", "") == "OK:MQTT publishing to " SELFTEST_TOPIC "/telemetry", "CMD:MQTT:ON");
+
+  // --- Sesión ---
+  pumpUntil([] { return !publishes.empty(); }, 3000);
+  expect(connects.size() == 1, "BRIDGE:OPEN y CONNECT por el túnel");
+  if (!connects.empty()) {
+    const Connect &c = connects[0];
+    expect(c.level == 4 && c.clientId == SELFTEST_TOPIC && c.keepAlive == MQTT_KEEPALIVE_S,
+           "CONNECT MQTT 3.1.1 con el tema como client id");
+    expect((c.flags & 0x02) && c.willTopic == SELFTEST_TOPIC "/status" && c.willMessage == "offline" &&
+           (c.flags & 0x20), "último deseo retenido: status = offline");
+  }
+  expect(!publishes.empty() && publishes[0].topic == SELFTEST_TOPIC "/status" && publishes[0].payload == "online" &&
+         publishes[0].retain, "status = online retenido tras el CONNACK");
+
+  // --- Primer lote ---
+  expect(waitTelemetry(1, (MQTT_BATCH_SAMPLES + 2) * 5000), "primer lote publicado");
+  if (telemetry().empty()) return;
+  const Publish &first = *telemetry()[0];
+  Batch batch = parseBatch(first.payload);
+  expect(first.qos == 1 && first.packetId != 0, "telemetría con QoS 1");
+  expect(batch.valid && batch.sequence == 0 && batch.clock == "uptime" &&
+         batch.samples.size() == MQTT_BATCH_SAMPLES, "lote 0 con 8 muestras y reloj desde el arranque");
+  if (batch.valid) {
+    printf("%s", first.payload.c_str());
+    printf("  %zu bytes por %d muestras\n", first.payload.size(), MQTT_BATCH_SAMPLES);
+    const Sample &s = batch.samples.back();
+    expect(s.battery_mV > 12500 && s.battery_mV < 13300 && s.panel_mV > 17500 && s.panel_mV < 19500,
+           "voltajes coherentes con el INA219 simulado");
+    expect(batch.samples[0].offset == 0 && s.offset >= 5 && s.offset <= MQTT_BATCH_SAMPLES * 5,
+           "desplazamientos en segundos desde el inicio del lote");
+  }
+  long boot = batch.boot;
+
+  // --- Muestreo por cambio: con 60 s de intervalo, un lote en menos de 60 s ---
+  expect(command("CMD:SET_mqttInterval:60", "").compare(0, 3, "OK:") == 0, "mqttInterval = 60 s");
+  size_t before = telemetry().size();
+  uint64_t changeStart = nowMs();
+  bool high = false;
+  while (telemetry().size() == before && nowMs() - changeStart < realMs(60000)) {
+    high = !high;
+    setBattery(high ? SELFTEST_STEP_V : SELFTEST_BATTERY_V);
+    pumpFor(realMs(3000));
+  }
+  setBattery(SELFTEST_BATTERY_V);
+  bool closedEarly = telemetry().size() > before;
+  expect(closedEarly, "los cambios de batería llenan un lote antes del intervalo");
+  if (closedEarly) {
+    Batch changed = parseBatch(telemetry()[before]->payload);
+    bool sawStep = false;
+    for (const Sample &s : changed.samples) sawStep |= s.battery_mV > 13200;
+    expect(changed.valid && changed.samples.size() == MQTT_BATCH_SAMPLES && sawStep,
+           "lote completo con el salto a 13.4 V");
+  }
+  expect(command("CMD:SET_mqttInterval:5", "").compare(0, 3, "OK:") == 0, "mqttInterval = 5 s");
+
+  // --- Sin broker: cola y backoff ---
+  pumpFor(200);                           // PUBACK pendientes
+  long lastOnline = parseBatch(telemetry().back()->payload).sequence;
+  brokerOnline = false;
+  sendText("CMD:BRIDGE:DOWN\n");
+  bridgeOpen = false;
+  pumpFor(realMs(3 * MQTT_BATCH_SAMPLES * 5000 + 10000));
+  long queued = statusField("queued");
+  printf("  %ld lotes en cola, %zu aperturas rechazadas\n", queued, refusedOpens.size());
+  expect(queued >= 3, "los lotes se acumulan en la cola de NVS");
+  bool backoff = refusedOpens.size() >= 3;
+  for (size_t i = 2; i < refusedOpens.size(); i++) {
+    backoff &= refusedOpens[i] - refusedOpens[i - 1] > refusedOpens[i - 1] - refusedOpens[i - 2];
+  }
+  expect(backoff, "reintentos del túnel con espera creciente");
+
+  // --- Reconexión: vaciado en orden y a ritmo controlado ---
+  size_t sessions = connects.size();
+  size_t drainStart = telemetry().size();
+  brokerOnline = true;
+  bool drained = pumpUntil([&] { return telemetry().size() >= drainStart + (size_t)queued; },
+                           realMs(MQTT_RETRY_MAX_MS + queued * MQTT_DRAIN_INTERVAL_MS) + 2000);
+  expect(connects.size() == sessions + 1 && drained, "reconecta y publica los lotes encolados");
+  if (drained) {
+    std::vector<const Publish *> all = telemetry();
+    bool ordered = true, paced = true;
+    for (size_t i = drainStart; i < drainStart + (size_t)queued; i++) {
+      Batch queuedBatch = parseBatch(all[i]->payload);
+      ordered &= queuedBatch.valid && queuedBatch.boot == boot && queuedBatch.sequence == lastOnline + 1 + (long)(i - drainStart);
+      // Margen de un ciclo de poll del hijo en cada extremo
+      if (i > drainStart) {
+        paced &= (all[i]->receivedMs - all[i - 1]->receivedMs + 20) * SELFTEST_TIME_SCALE >= MQTT_DRAIN_INTERVAL_MS;
+      }
+    }
+    expect(ordered, "lotes en orden y sin huecos en la secuencia");
+    expect(paced, "un lote cada MQTT_DRAIN_INTERVAL_MS como mucho");
+  }
+  pumpUntil([] { return statusField("queued") == 0; }, realMs(4 * MQTT_DRAIN_INTERVAL_MS) + 1000);
+  expect(statusField("dropped") == 0, "ningún lote descartado");
+
+  // --- Un lote sin PUBACK se vuelve a enviar en la sesión siguiente ---
+  autoAck = false;
+  size_t unackedAt = telemetry().size();
+  sessions = connects.size();
+  expect(waitTelemetry(unackedAt + 1, (MQTT_BATCH_SAMPLES + 2) * 5000), "lote publicado sin PUBACK");
+  long unacked = telemetry().size() > unackedAt ? parseBatch(telemetry()[unackedAt]->payload).sequence : -1;
+  autoAck = true;
+  pumpUntil([&] { return connects.size() > sessions && telemetry().size() > unackedAt + 1; },
+            realMs(MQTT_RESPONSE_TIMEOUT_MS + MQTT_RETRY_MIN_MS + MQTT_DRAIN_INTERVAL_MS) + 2000);
+  expect(disconnects >= 1 && connects.size() == sessions + 1, "sin PUBACK a tiempo cierra y reabre la sesión");
+  expect(telemetry().size() > unackedAt + 1 && parseBatch(telemetry()[unackedAt + 1]->payload).sequence == unacked,
+         "el lote sin PUBACK se retransmite primero");
+
+  // --- Keepalive y apagado ---
+  printf("  %d PINGREQ, %d aperturas del túnel, %zu publicaciones\n", pings, bridgeOpens, publishes.size());
+  int disconnectsBefore = disconnects;
+  expect(command("CMD:MQTT:OFF", "OK:MQTT") == "OK:MQTT off", "CMD:MQTT:OFF");
+  pumpFor(200);
+  expect(disconnects == disconnectsBefore + 1 && !bridgeOpen, "DISCONNECT y BRIDGE:CLOSE al desactivar");
+  expect(command("CMD:MQTT:STATUS", "MQTT:").find("\"enabled\":false") != std::string::npos,
+         "CMD:MQTT:STATUS informa desactivado");
+}
+
+static int runPtySelfTest() {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+    perror("posix_openpt");
+    return 2;
+  }
+  int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+  int pipeFds[2];
+  if (slave < 0 || pipe(pipeFds) != 0) {
+    perror("ptsname");
+    return 2;
+  }
+  // En crudo antes de que nadie escriba: sin eco ni traducción de \n
+  struct termios settings;
+  tcgetattr(slave, &settings);
+  cfmakeraw(&settings);
+  tcsetattr(slave, TCSANOW, &settings);
+
+  pid_t child = fork();
+  if (child == 0) {
+    close(master);
+    close(pipeFds[1]);
+    runFirmware(slave, pipeFds[0]);
+  }
+  close(slave);
+  close(pipeFds[0]);
+  port = master;
+  control = pipeFds[1];
+
+  runSelfTest();
+
+  close(master);
+  close(control);
+  kill(child, SIGTERM);
+  waitpid(child, nullptr, 0);
+  if (failures > 0) {
+    printf("FALLO: %d comprobaciones\n", failures);
+    return 1;
+  }
+  printf("OK: publicador MQTT\n");
+  return 0;
+}
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--verbose") == 0) verbose = true;
+    else {
+      fprintf(stderr, "Uso: %s [--verbose]\n", argv[0]);
+      return 2;
+    }
+  }
+  return runPtySelfTest();
+}
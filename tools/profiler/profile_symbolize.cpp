@@ -0,0 +1,223 @@
+// Simboliza el volcado de CMD:PROFILE contra el ELF del firmware y muestra
+// un perfil plano por función más un resumen por categoría (soft-float,
+// I2C, String, idle).
+//
+//   profile_symbolize <firmware.elf> [volcado.txt]   (sin archivo: stdin)
+//
+// Lee .symtab directamente (ELF32/ELF64 little-endian); no necesita binutils.
+
+#include <cxxabi.h>
+#include <elf.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+struct Symbol {
+  uint64_t address;
+  uint64_t size;
+  std::string name;
+};
+
+struct Sample {
+  uint64_t pc;
+  uint64_t count;
+};
+
+static std::string demangle(const std::string &name) {
+  int status = 0;
+  char *out = abi::__cxa_demangle(name.c_str(), nullptr, nullptr, &status);
+  if (status != 0 || out == nullptr) return name;
+  std::string result(out);
+  free(out);
+  return result;
+}
+
+template <typename Ehdr, typename Shdr, typename Sym>
+static bool loadSymbols(const std::vector<char> &image, std::vector<Symbol> &symbols) {
+  if (image.size() < sizeof(Ehdr)) return false;
+  const Ehdr *ehdr = reinterpret_cast<const Ehdr *>(image.data());
+  if (ehdr->e_shoff == 0 || ehdr->e_shoff + (uint64_t)ehdr->e_shnum * sizeof(Shdr) > image.size()) return false;
+  const Shdr *sections = reinterpret_cast<const Shdr *>(image.data() + ehdr->e_shoff);
+
+  for (int i = 0; i < ehdr->e_shnum; i++) {
+    if (sections[i].sh_type != SHT_SYMTAB) continue;
+    const Shdr &symtab = sections[i];
+    if (symtab.sh_link >= ehdr->e_shnum) return false;
+    const Shdr &strtab = sections[symtab.sh_link];
+    if (symtab.sh_offset + symtab.sh_size > image.size() || strtab.sh_offset + strtab.sh_size > image.size()) return false;
+
+    const Sym *entries = reinterpret_cast<const Sym *>(image.data() + symtab.sh_offset);
+    size_t count = symtab.sh_size / sizeof(Sym);
+    for (size_t j = 0; j < count; j++) {
+      unsigned type = entries[j].st_info & 0xf;
+      if (type != STT_FUNC || entries[j].st_value == 0 || entries[j].st_name >= strtab.sh_size) continue;
+      const char *name = image.data() + strtab.sh_offset + entries[j].st_name;
+      symbols.push_back({(uint64_t)entries[j].st_value, (uint64_t)entries[j].st_size, demangle(name)});
+    }
+  }
+  return !symbols.empty();
+}
+
+static bool loadElf(const char *path, std::vector<Symbol> &symbols) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    fprintf(stderr, "No se pudo abrir %s\n", path);
+    return false;
+  }
+  std::vector<char> image((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+  if (image.size() < EI_NIDENT || memcmp(image.data(), ELFMAG, SELFMAG) != 0) {
+    fprintf(stderr, "%s no es un ELF\n", path);
+    return false;
+  }
+  if (image[EI_DATA] != ELFDATA2LSB) {
+    fprintf(stderr, "Solo se soportan ELF little-endian\n");
+    return false;
+  }
+
+  bool ok = image[EI_CLASS] == ELFCLASS32 ? loadSymbols<Elf32_Ehdr, Elf32_Shdr, Elf32_Sym>(image, symbols)
+                                          : loadSymbols<Elf64_Ehdr, Elf64_Shdr, Elf64_Sym>(image, symbols);
+  if (!ok) {
+    fprintf(stderr, "%s no tiene tabla de símbolos (¿firmware sin -g o con strip?)\n", path);
+    return false;
+  }
+
+  std::sort(symbols.begin(), symbols.end(), [](const Symbol &a, const Symbol &b) { return a.address < b.address; });
+  return true;
+}
+
+// Símbolo que contiene pc; los de tamaño 0 se extienden hasta el siguiente
+// (el último sin tamaño no se extiende: sería todo el espacio de direcciones)
+static const Symbol *findSymbol(const std::vector<Symbol> &symbols, uint64_t pc) {
+  auto it = std::upper_bound(symbols.begin(), symbols.end(), pc,
+                             [](uint64_t value, const Symbol &s) { return value < s.address; });
+  if (it == symbols.begin()) return nullptr;
+  const Symbol &candidate = *(it - 1);
+  if (candidate.size > 0) {
+    return pc < candidate.address + candidate.size ? &candidate : nullptr;
+  }
+  return it != symbols.end() ? &candidate : nullptr;
+}
+
+static bool endsWith(const std::string &s, const char *suffix) {
+  size_t n = strlen(suffix);
+  return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+static const char *categorize(const std::string &name) {
+  // Rutinas de libgcc para float/double: __addsf3, __muldf3, __floatsisf, __fixsfsi...
+  if (name.compare(0, 2, "__") == 0 &&
+      (endsWith(name, "sf3") || endsWith(name, "df3") || endsWith(name, "sf2") || endsWith(name, "df2") ||
+       name.find("float") != std::string::npos || name.find("fix") != std::string::npos)) {
+    return "soft-float";
+  }
+  if (name.find("i2c") != std::string::npos || name.find("I2C") != std::string::npos ||
+      name.find("TwoWire") != std::string::npos || name.find("INA219") != std::string::npos) {
+    return "I2C";
+  }
+  if (name.compare(0, 6, "String") == 0 || name.find("String::") != std::string::npos) {
+    return "String";
+  }
+  if (name.find("malloc") != std::string::npos || name.find("free") != std::string::npos ||
+      name.find("heap_caps") != std::string::npos || name.find("tlsf") != std::string::npos) {
+    return "heap";
+  }
+  if (name.find("Idle") != std::string::npos || name.find("idle") != std::string::npos ||
+      name.find("waiti") != std::string::npos || name.find("wait_for_intr") != std::string::npos) {
+    return "idle";
+  }
+  return "otros";
+}
+
+int main(int argc, char **argv) {
+  if (argc < 2 || argc > 3) {
+    fprintf(stderr, "Uso: %s <firmware.elf> [volcado.txt]\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<Symbol> symbols;
+  if (!loadElf(argv[1], symbols)) return 1;
+
+  std::ifstream dumpFile;
+  if (argc == 3) {
+    dumpFile.open(argv[2]);
+    if (!dumpFile) {
+      fprintf(stderr, "No se pudo abrir %s\n", argv[2]);
+      return 1;
+    }
+  }
+  std::istream &in = argc == 3 ? static_cast<std::istream &>(dumpFile) : std::cin;
+
+  std::vector<Sample> samples;
+  std::string header;
+  bool inDump = false;
+  std::string line;
+  while (std::getline(in, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.compare(0, 14, "PROFILE:BEGIN:") == 0) {
+      // Un volcado nuevo reemplaza a uno anterior en el mismo log
+      samples.clear();
+      header = line.substr(14);
+      inDump = true;
+    } else if (inDump && line.compare(0, 11, "PROFILE:PC:") == 0) {
+      char *end = nullptr;
+      uint64_t pc = strtoull(line.c_str() + 11, &end, 16);
+      if (end == nullptr || *end != ':') continue;
+      samples.push_back({pc, strtoull(end + 1, nullptr, 10)});
+    } else if (line == "PROFILE:END") {
+      inDump = false;
+    }
+  }
+
+  if (samples.empty()) {
+    fprintf(stderr, "No se encontró ningún volcado PROFILE en la entrada\n");
+    return 1;
+  }
+
+  std::map<std::string, uint64_t> perFunction;
+  std::map<std::string, uint64_t> perCategory;
+  uint64_t total = 0;
+  for (const Sample &sample : samples) {
+    const Symbol *symbol = findSymbol(symbols, sample.pc);
+    std::string name;
+    if (symbol != nullptr) {
+      name = symbol->name;
+    } else {
+      char buffer[32];
+      snprintf(buffer, sizeof(buffer), "?? 0x%08llx", (unsigned long long)sample.pc);
+      name = buffer;
+    }
+    perFunction[name] += sample.count;
+    perCategory[symbol != nullptr ? categorize(name) : "sin símbolo"] += sample.count;
+    total += sample.count;
+  }
+
+  std::vector<std::pair<std::string, uint64_t>> flat(perFunction.begin(), perFunction.end());
+  std::sort(flat.begin(), flat.end(), [](const std::pair<std::string, uint64_t> &a, const std::pair<std::string, uint64_t> &b) {
+    return a.second != b.second ? a.second > b.second : a.first < b.first;
+  });
+
+  printf("Captura: %s\n", header.c_str());
+  printf("Muestras simbolizadas: %llu en %zu funciones\n\n", (unsigned long long)total, flat.size());
+  printf("%7s %9s %9s  %s\n", "%", "acum %", "muestras", "función");
+  double cumulative = 0;
+  for (const auto &entry : flat) {
+    double percent = 100.0 * entry.second / total;
+    cumulative += percent;
+    printf("%7.2f %9.2f %9llu  %s\n", percent, cumulative, (unsigned long long)entry.second, entry.first.c_str());
+  }
+
+  printf("\nResumen por categoría:\n");
+  for (const auto &entry : perCategory) {
+    printf("  %-12s %7.2f%%  (%llu)\n", entry.first.c_str(), 100.0 * entry.second / total, (unsigned long long)entry.second);
+  }
+  return 0;
+}
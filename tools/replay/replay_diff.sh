@@ -0,0 +1,45 @@
+#!/bin/bash
+# Reproduce una traza con dos versiones del firmware y compara las salidas.
+#
+#   replay_diff.sh <traza.txt> <rev-a> [rev-b]
+#
+# Sin rev-b se usa el árbol de trabajo. Cada revisión se extrae con
+# git worktree y se compila con este mismo trace_replay (-DFIRMWARE_DIR), así
+# que ambas deben incluir trace.h. Devuelve 0 si las salidas son idénticas.
+set -e
+
+if [ $# -lt 2 ]; then
+  echo "Uso: $0 <traza.txt> <rev-a> [rev-b]" >&2
+  exit 2
+fi
+
+TRACE=$(realpath "$1")
+REV_A=$2
+REV_B=$3
+TOOL_DIR=$(cd "$(dirname "$0")" && pwd)
+REPO=$(git -C "$TOOL_DIR" rev-parse --show-toplevel)
+WORK=$(mktemp -d)
+trap 'git -C "$REPO" worktree remove --force "$WORK/a" >/dev/null 2>&1 || true;
+      git -C "$REPO" worktree remove --force "$WORK/b" >/dev/null 2>&1 || true;
+      rm -rf "$WORK"' EXIT
+
+replay() {
+  local name=$1 firmware=$2 label=$3
+  cmake -S "$TOOL_DIR" -B "$WORK/build-$name" -DCMAKE_BUILD_TYPE=Release -DFIRMWARE_DIR="$firmware" >/dev/null
+  cmake --build "$WORK/build-$name" -j"$(nproc)" >/dev/null
+  echo "== $label" >&2
+  # 3 = divergencias frente a la grabación, esperables con otra versión
+  "$WORK/build-$name/trace_replay" "$TRACE" "$WORK/$name.txt" || [ $? -eq 3 ]
+}
+
+git -C "$REPO" worktree add --detach "$WORK/a" "$REV_A" >/dev/null
+replay a "$WORK/a" "$REV_A"
+if [ -n "$REV_B" ]; then
+  git -C "$REPO" worktree add --detach "$WORK/b" "$REV_B" >/dev/null
+  replay b "$WORK/b" "$REV_B"
+else
+  REV_B="árbol de trabajo"
+  replay b "$REPO" "$REV_B"
+fi
+
+diff -u --label "$REV_A" --label "$REV_B" "$WORK/a.txt" "$WORK/b.txt"
@@ -0,0 +1,282 @@
+// Reproduce una traza de CMD:TRACE contra el firmware compilado para Linux.
+// Cada registro K ejecuta controlTick() (updateAhTracking(),
+// updateChargeState(), ...) con las lecturas y marcas de tiempo grabadas, y
+// cada registro C pasa el comando por processSerialCommand(). El reloj es
+// virtual: la reproducción corre tan rápido como la CPU del host.
+//
+//   trace_replay <traza.txt> [salida.txt] [--serial]
+//
+// La traza se captura de la UART1 del equipo (TRACE_TX_PIN) con cualquier
+// adaptador USB-serie, entre CMD:TRACE:ON y CMD:TRACE:OFF:
+//   stty -F /dev/ttyUSB0 921600 raw && cat /dev/ttyUSB0 > traza.txt
+//
+// La salida (una línea por ciclo con estado, PWM y Ah, más todo lo que el
+// firmware envía a la Orange Pi) es determinista y se compara con diff entre
+// versiones del firmware (ver replay_diff.sh). Con la misma versión que grabó
+// la traza cada ciclo se verifica bit a bit contra su registro O; --serial
+// muestra en stderr el log de depuración del firmware.
+
+#include <Arduino.h>
+
+#include <chrono>
+#include <cinttypes>
+#include <deque>
+#include <fstream>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "event_bus.h"
+#include "host.h"
+#include "trace.h"
+
+// cargador_gel_litio.ino
+void setup();
+void controlTick(void *arg);
+void processSerialCommand(String command);
+String getChargeStateString(ChargeState state);
+extern HardwareSerial OrangePiSerial;
+extern ChargeState currentState;
+extern int currentPWM;
+extern float accumulatedAh;
+
+// autotune.h (el resultado se informa desde loop())
+void autotuneService(Print &out);
+
+struct Record {
+  char type;
+  std::string text;   // Resto de la línea tras "<tipo> "
+};
+
+// Lecturas y marcas de tiempo del evento (K o C) en curso
+static std::map<char, std::deque<float>> pendingReads;
+static std::deque<uint64_t> pendingClock;
+static std::map<char, float> lastRead;
+static uint32_t desyncReads = 0;
+static uint32_t desyncClock = 0;
+
+static float bitsToFloat(uint32_t bits) {
+  float value;
+  memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+static uint32_t floatToBits(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+// Otra versión del firmware puede leer los canales en otro orden o cantidad:
+// se toma la siguiente lectura grabada de ese canal o, si no quedan, la última
+static float replayRead(TraceChannel channel, float live) {
+  auto &queue = pendingReads[(char)channel];
+  if (queue.empty()) {
+    desyncReads++;
+    auto last = lastRead.find((char)channel);
+    return last != lastRead.end() ? last->second : live;
+  }
+  float value = queue.front();
+  queue.pop_front();
+  lastRead[(char)channel] = value;
+  return value;
+}
+
+static uint64_t replayClock(uint64_t live) {
+  if (pendingClock.empty()) {
+    desyncClock++;
+    return live;   // Reloj virtual = marca del evento
+  }
+  uint64_t value = pendingClock.front();
+  pendingClock.pop_front();
+  return value;
+}
+
+static bool loadTrace(const char *path, std::vector<Record> &records) {
+  std::ifstream file(path);
+  if (!file) {
+    fprintf(stderr, "No se pudo abrir %s\n", path);
+    return false;
+  }
+  std::string line;
+  bool header = false;
+  while (std::getline(file, line)) {
+    if (!line.empty() && line.back() == '\r') line.pop_back();
+    if (line.empty()) continue;
+    if (line.compare(0, 7, "#TRACE ") == 0) {
+      int version = atoi(line.c_str() + 7);
+      if (version != TRACE_FORMAT_VERSION) {
+        fprintf(stderr, "Versión de traza %d no soportada (se espera %d)\n", version, TRACE_FORMAT_VERSION);
+        return false;
+      }
+      header = true;
+      continue;
+    }
+    if (line[0] == '#') continue;
+    if (line.size() < 2 || line[1] != ' ') {
+      fprintf(stderr, "Registro inválido: %s\n", line.c_str());
+      continue;
+    }
+    records.push_back({line[0], line.substr(2)});
+  }
+  if (!header) {
+    fprintf(stderr, "%s no tiene cabecera #TRACE\n", path);
+    return false;
+  }
+  return true;
+}
+
+static void restoreState(const std::string &fields) {
+  size_t at = 0;
+  while (at < fields.size()) {
+    size_t end = fields.find(' ', at);
+    if (end == std::string::npos) end = fields.size();
+    std::string field = fields.substr(at, end - at);
+    size_t equals = field.find('=');
+    if (equals != std::string::npos) {
+      String name(field.substr(0, equals));
+      uint64_t bits = strtoull(field.c_str() + equals + 1, nullptr, 16);
+      if (!traceRestoreField(name, bits)) {
+        fprintf(stderr, "Campo de estado desconocido: %s\n", name.c_str());
+      }
+    }
+    at = end + 1;
+  }
+}
+
+// Reúne los R/M que siguen al evento en 'index' hasta el siguiente evento
+static size_t collectInputs(const std::vector<Record> &records, size_t index) {
+  pendingReads.clear();
+  pendingClock.clear();
+  size_t next = index + 1;
+  for (; next < records.size(); next++) {
+    const Record &record = records[next];
+    if (record.type == 'R' && record.text.size() > 2) {
+      uint32_t bits = (uint32_t)strtoul(record.text.c_str() + 2, nullptr, 16);
+      pendingReads[record.text[0]].push_back(bitsToFloat(bits));
+    } else if (record.type == 'M') {
+      pendingClock.push_back(strtoull(record.text.c_str(), nullptr, 10));
+    } else {
+      break;
+    }
+  }
+  return next;
+}
+
+static void afterEvent() {
+  eventBusDispatch();
+  autotuneService(OrangePiSerial);
+}
+
+int main(int argc, char **argv) {
+  const char *tracePath = nullptr;
+  const char *outputPath = nullptr;
+  bool serialLog = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--serial") == 0) {
+      serialLog = true;
+    } else if (tracePath == nullptr) {
+      tracePath = argv[i];
+    } else {
+      outputPath = argv[i];
+    }
+  }
+  if (tracePath == nullptr) {
+    fprintf(stderr, "Uso: %s <traza.txt> [salida.txt] [--serial]\n", argv[0]);
+    return 2;
+  }
+
+  std::vector<Record> records;
+  if (!loadTrace(tracePath, records)) return 1;
+
+  FILE *output = stdout;
+  if (outputPath != nullptr) {
+    output = fopen(outputPath, "w");
+    if (output == nullptr) {
+      fprintf(stderr, "No se pudo crear %s\n", outputPath);
+      return 1;
+    }
+  }
+  Serial.setSink(serialLog ? stderr : nullptr);
+  OrangePiSerial.setSink(output);
+
+  // El tiempo solo avanza con las marcas de la traza
+  hostSetDelayAdvancesClock(false);
+  uint64_t firstMs = 0;
+  for (const Record &record : records) {
+    if (record.type == 'K' || record.type == 'C') {
+      firstMs = strtoull(record.text.c_str(), nullptr, 10);
+      break;
+    }
+  }
+  hostSetMicros(firstMs * 1000);
+  setup();
+  for (const Record &record : records) {
+    if (record.type == 'S') restoreState(record.text);
+  }
+  traceSetReplayHooks(replayRead, replayClock);
+
+  auto started = std::chrono::steady_clock::now();
+  uint32_t ticks = 0;
+  uint32_t commands = 0;
+  uint32_t checked = 0;
+  uint32_t mismatches = 0;
+  uint64_t lastMs = firstMs;
+
+  size_t i = 0;
+  while (i < records.size()) {
+    const Record &record = records[i];
+    if (record.type == 'K') {
+      uint64_t ms = strtoull(record.text.c_str(), nullptr, 10);
+      size_t next = collectInputs(records, i);
+      hostSetMicros(ms * 1000);
+      controlTick(nullptr);
+      afterEvent();
+      ticks++;
+      lastMs = ms;
+
+      uint32_t ahBits = floatToBits(accumulatedAh);
+      fprintf(output, "TICK %" PRIu64 " %s pwm=%d ah=%.6f/%08x\n", ms, getChargeStateString(currentState).c_str(),
+              currentPWM, accumulatedAh, ahBits);
+
+      if (next < records.size() && records[next].type == 'O') {
+        int state = 0;
+        int pwm = 0;
+        unsigned int recordedBits = 0;
+        sscanf(records[next].text.c_str(), "%d %d %x", &state, &pwm, &recordedBits);
+        checked++;
+        if (state != (int)currentState || pwm != currentPWM || recordedBits != ahBits) {
+          mismatches++;
+          fprintf(stderr, "Divergencia en K %" PRIu64 ": grabado %d/%d/%08x, reproducido %d/%d/%08x\n", ms, state,
+                  pwm, recordedBits, (int)currentState, currentPWM, ahBits);
+        }
+        next++;
+      }
+      i = next;
+    } else if (record.type == 'C') {
+      char *rest = nullptr;
+      uint64_t ms = strtoull(record.text.c_str(), &rest, 10);
+      String command(rest != nullptr && *rest == ' ' ? rest + 1 : "");
+      size_t next = collectInputs(records, i);
+      hostSetMicros(ms * 1000);
+      fprintf(output, "CMD %" PRIu64 " %s\n", ms, command.c_str());
+      processSerialCommand(command);
+      afterEvent();
+      commands++;
+      lastMs = ms;
+      i = next;
+    } else {
+      i++;
+    }
+  }
+
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+  double tracedSeconds = (lastMs - firstMs) / 1000.0;
+  fprintf(stderr, "%u ciclos, %u comandos, %.0f s de traza en %.3f s (%.0fx tiempo real)\n", ticks, commands,
+          tracedSeconds, wallSeconds, wallSeconds > 0 ? tracedSeconds / wallSeconds : 0.0);
+  fprintf(stderr, "Verificados %u ciclos contra la grabación: %u divergencias; %u lecturas y %u marcas sin grabar\n",
+          checked, mismatches, desyncReads, desyncClock);
+
+  if (output != stdout) fclose(output);
+  return mismatches > 0 ? 3 : 0;
+}
@@ -0,0 +1,386 @@
+// Barrido de parámetros de carga contra el firmware compilado para Linux y
+// una planta simulada (plant_model.h). Cada combinación de thresholdPercentage,
+// factorDivider, maxAbsorptionHours y voltajes de etapa corre varios días de
+// sol y consumo con el loop() real del firmware (planificador, modo nocturno,
+// LVD...) y se puntúa con tres objetivos:
+//   energía cosechada (Wh, maximizar), horas con SOC lleno (maximizar) y
+//   sobrecarga convertida en gas (Ah, minimizar).
+// Al final se imprime la frontera de Pareto y se escribe un CSV con todo.
+//
+//   charge_sweep [-j hilos] [--days N] [--soc0 0.5] [--seed N] [--out res.csv]
+//                [--threshold 0.5,1,2] [--divider 2,5,8] [--max-abs 0.5,1,2]
+//                [--bulk 14.2,14.4] [--absorption 14.1,14.4] [--float 13.4,13.6]
+//                [--timeline minuto.csv]
+//
+// --timeline (solo con una combinación) escribe la evolución minuto a minuto
+// de la etapa, el PWM y la planta para revisar una combinación concreta.
+//
+// El firmware guarda su estado en variables globales, así que las
+// combinaciones no pueden compartir proceso. El pool es de procesos: setup()
+// corre una sola vez y cada combinación se evalúa en un fork() de ese estado
+// inicial; cada trabajador libre toma la siguiente combinación pendiente, de
+// modo que las combinaciones largas no dejan núcleos ociosos. Los resultados
+// vuelven por memoria compartida.
+
+#include <Arduino.h>
+
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "event_bus.h"
+#include "host.h"
+#include "plant_model.h"
+#include "timer_wheel.h"
+
+// cargador_gel_litio.ino
+void setup();
+void loop();
+bool isValidParamValue(ParamId id, float value);
+String getChargeStateString(ChargeState state);
+extern HardwareSerial OrangePiSerial;
+extern ChargeState currentState;
+extern int currentPWM;
+extern float maxAbsorptionHours;
+
+#define SWEEP_START_HOUR 5                // La simulación arranca antes del amanecer
+#define SWEEP_MAX_IDLE_MS 1000            // Salto máximo del reloj entre vueltas de loop()
+#define TIMELINE_PERIOD_US 60000000ULL    // Una línea por minuto simulado
+
+struct Combination {
+  float thresholdPercentage;
+  float factorDivider;
+  float maxAbsorptionHours;
+  float bulkVoltage;
+  float absorptionVoltage;
+  float floatVoltage;
+};
+
+// Resultado de una combinación (en memoria compartida con los trabajadores)
+struct SweepResult {
+  bool done;
+  bool rejected;                          // Parámetro fuera de rango para el firmware
+  PlantTotals totals;
+  double errorHours;                      // Tiempo en estado ERROR
+  uint64_t loopCalls;
+};
+
+struct SweepAxes {
+  std::vector<float> threshold = {0.5f, 1.0f, 1.5f, 2.0f, 3.0f};
+  std::vector<float> divider = {2, 5, 8};
+  std::vector<float> maxAbsorption = {0.5f, 1.0f, 2.0f, 3.0f};
+  std::vector<float> bulk = {14.2f, 14.4f, 14.6f};
+  std::vector<float> absorption = {14.0f, 14.2f, 14.4f};
+  std::vector<float> floatV = {13.2f, 13.5f, 13.8f};
+};
+
+static std::vector<float> parseList(const char *text) {
+  std::vector<float> values;
+  const char *at = text;
+  while (*at != '\0') {
+    char *end = nullptr;
+    float value = strtof(at, &end);
+    if (end == at) break;
+    values.push_back(value);
+    at = (*end == ',') ? end + 1 : end;
+  }
+  return values;
+}
+
+// Solo combinaciones con sentido físico: flotación < absorción <= bulk
+static std::vector<Combination> buildGrid(const SweepAxes &axes) {
+  std::vector<Combination> grid;
+  for (float threshold : axes.threshold)
+    for (float divider : axes.divider)
+      for (float maxAbs : axes.maxAbsorption)
+        for (float bulk : axes.bulk)
+          for (float absorption : axes.absorption)
+            for (float floatV : axes.floatV) {
+              if (floatV >= absorption || absorption > bulk) continue;
+              grid.push_back({threshold, divider, maxAbs, bulk, absorption, floatV});
+            }
+  return grid;
+}
+
+// Aplica la combinación por el bus de eventos, como un CMD:SET_ de la Orange
+// Pi: applyParamChange() recalcula los umbrales derivados
+static bool applyCombination(const Combination &c) {
+  const struct {
+    ParamId id;
+    float value;
+  } params[] = {
+    {PARAM_THRESHOLD_PERCENTAGE, c.thresholdPercentage},
+    {PARAM_FACTOR_DIVIDER, c.factorDivider},
+    {PARAM_BULK_VOLTAGE, c.bulkVoltage},
+    {PARAM_ABSORPTION_VOLTAGE, c.absorptionVoltage},
+    {PARAM_FLOAT_VOLTAGE, c.floatVoltage},
+  };
+  for (const auto &param : params) {
+    if (!isValidParamValue(param.id, param.value)) return false;
+    publishParamChange(param.id, param.value, SOURCE_SERIAL);
+  }
+  eventBusDispatch();
+  maxAbsorptionHours = c.maxAbsorptionHours;
+  return true;
+}
+
+// Corre en el proceso hijo, sobre la copia del estado posterior a setup()
+static void simulate(const Combination &c, const PlantConfig &plantConfig, float days, SweepResult &result,
+                     FILE *timeline) {
+  if (!applyCombination(c)) {
+    result.rejected = true;
+    return;
+  }
+
+  PlantState plant;
+  uint64_t startUs = hostMicros();
+  uint64_t endUs = startUs + (uint64_t)(days * 86400.0f) * 1000000ULL;
+  plantInit(plant, plantConfig, startUs);
+
+  double errorHours = 0;
+  uint64_t loops = 0;
+  uint64_t lastUs = startUs;
+  uint64_t nextTimelineUs = startUs;
+  if (timeline != nullptr) fprintf(timeline, "hora,estado,pwm,irradiancia,vBat,vPanel,iCarga,iConsumo,soc\n");
+  while (hostMicros() < endUs) {
+    uint64_t nowUs = hostMicros();
+    plantStep(plant, nowUs, currentPWM / 255.0f, hostDigitalLevel(LOAD_CONTROL_PIN) == HIGH);
+    if (currentState == ERROR) errorHours += (nowUs - lastUs) / 3600e6;
+    lastUs = nowUs;
+    if (timeline != nullptr && nowUs >= nextTimelineUs) {
+      fprintf(timeline, "%.3f,%s,%d,%.3f,%.3f,%.3f,%.3f,%.3f,%.4f\n", nowUs / 3600e6,
+              getChargeStateString(currentState).c_str(), currentPWM, plantIrradiance(plantConfig, nowUs),
+              plant.batteryVoltage, plant.panelVoltage, plant.chargeCurrent_A, plant.loadCurrent_A, plant.soc);
+      nextTimelineUs += TIMELINE_PERIOD_US;
+    }
+
+    loop();
+    loops++;
+
+    // loop() ya esperó con delay()/light sleep; sin nada pendiente se salta
+    // directamente al siguiente vencimiento de la rueda
+    uint64_t nowMs = hostMicros() / 1000;
+    uint64_t deadline = timerWheelNextDeadline();
+    uint64_t nextMs = std::min(deadline, nowMs + SWEEP_MAX_IDLE_MS);
+    if (nextMs <= nowMs) nextMs = nowMs + 1;
+    hostSetMicros(std::max(hostMicros(), nextMs * 1000));
+  }
+
+  result.totals = plant.totals;
+  result.errorHours = errorHours;
+  result.loopCalls = loops;
+}
+
+// Los objetivos se comparan redondeados a la resolución del modelo: sin esto
+// las diferencias de centésimas de Wh dejan casi toda la malla en la frontera
+#define SCORE_ENERGY_WH 1.0
+#define SCORE_FULL_HOURS 0.1
+#define SCORE_OVERCHARGE_AH 0.01
+
+struct Score {
+  long energy;
+  long full;
+  long overcharge;
+  bool operator==(const Score &other) const {
+    return energy == other.energy && full == other.full && overcharge == other.overcharge;
+  }
+};
+
+static Score scoreOf(const PlantTotals &totals) {
+  return {lround(totals.harvestedWh / SCORE_ENERGY_WH), lround(totals.hoursAtFull / SCORE_FULL_HOURS),
+          lround(totals.overchargeAh / SCORE_OVERCHARGE_AH)};
+}
+
+// a domina a b si no es peor en ningún objetivo y es mejor en al menos uno
+static bool dominates(const Score &a, const Score &b) {
+  bool noWorse = a.energy >= b.energy && a.full >= b.full && a.overcharge <= b.overcharge;
+  return noWorse && !(a == b);
+}
+
+// Para cada combinación: índice del representante de su punto de la frontera
+// (ella misma o la primera con la misma puntuación) o -1 si está dominada
+static std::vector<long> paretoFrontier(const std::vector<Combination> &grid, const SweepResult *results) {
+  std::vector<long> representative(grid.size(), -1);
+  std::vector<Score> scores(grid.size());
+  for (size_t i = 0; i < grid.size(); i++) scores[i] = scoreOf(results[i].totals);
+
+  for (size_t i = 0; i < grid.size(); i++) {
+    if (!results[i].done || results[i].rejected) continue;
+    bool dominated = false;
+    long first = (long)i;
+    for (size_t j = 0; j < grid.size() && !dominated; j++) {
+      if (j == i || !results[j].done || results[j].rejected) continue;
+      dominated = dominates(scores[j], scores[i]);
+      if (j < (size_t)first && scores[j] == scores[i]) first = (long)j;
+    }
+    if (!dominated) representative[i] = first;
+  }
+  return representative;
+}
+
+static void writeCsv(const char *path, const std::vector<Combination> &grid, const SweepResult *results,
+                     const std::vector<long> &frontier) {
+  FILE *file = fopen(path, "w");
+  if (file == nullptr) {
+    fprintf(stderr, "No se pudo crear %s\n", path);
+    return;
+  }
+  fprintf(file,
+          "thresholdPercentage,factorDivider,maxAbsorptionHours,bulkVoltage,absorptionVoltage,floatVoltage,"
+          "harvestedWh,hoursAtFull,overchargeAh,storedAh,hoursAboveGassing,hoursLoadOff,minSoc,finalSoc,"
+          "maxBatteryVoltage,errorHours,pareto\n");
+  for (size_t i = 0; i < grid.size(); i++) {
+    const Combination &c = grid[i];
+    const SweepResult &r = results[i];
+    if (!r.done || r.rejected) continue;
+    fprintf(file, "%.2f,%.0f,%.2f,%.2f,%.2f,%.2f,%.2f,%.3f,%.4f,%.3f,%.3f,%.3f,%.4f,%.4f,%.3f,%.3f,%d\n",
+            c.thresholdPercentage, c.factorDivider, c.maxAbsorptionHours, c.bulkVoltage, c.absorptionVoltage,
+            c.floatVoltage, r.totals.harvestedWh, r.totals.hoursAtFull, r.totals.overchargeAh, r.totals.storedAh,
+            r.totals.hoursAboveGassing, r.totals.hoursLoadOff, r.totals.minSoc, r.totals.finalSoc,
+            r.totals.maxBatteryVoltage, r.errorHours, frontier[i] >= 0 ? 1 : 0);
+  }
+  fclose(file);
+}
+
+int main(int argc, char **argv) {
+  SweepAxes axes;
+  PlantConfig plantConfig;
+  float days = 3;
+  unsigned int jobs = std::max(1u, std::thread::hardware_concurrency());
+  const char *outputPath = "sweep_results.csv";
+  const char *timelinePath = nullptr;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    const char *value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+    if (value == nullptr) {
+      fprintf(stderr, "Falta el valor de %s\n", arg.c_str());
+      return 2;
+    }
+    i++;
+    if (arg == "-j") jobs = std::max(1, atoi(value));
+    else if (arg == "--days") days = strtof(value, nullptr);
+    else if (arg == "--soc0") plantConfig.initialSoc = strtof(value, nullptr);
+    else if (arg == "--seed") plantConfig.weatherSeed = (uint32_t)strtoul(value, nullptr, 10);
+    else if (arg == "--out") outputPath = value;
+    else if (arg == "--timeline") timelinePath = value;
+    else if (arg == "--threshold") axes.threshold = parseList(value);
+    else if (arg == "--divider") axes.divider = parseList(value);
+    else if (arg == "--max-abs") axes.maxAbsorption = parseList(value);
+    else if (arg == "--bulk") axes.bulk = parseList(value);
+    else if (arg == "--absorption") axes.absorption = parseList(value);
+    else if (arg == "--float") axes.floatV = parseList(value);
+    else {
+      fprintf(stderr, "Opción desconocida: %s\n", arg.c_str());
+      return 2;
+    }
+  }
+
+  std::vector<Combination> grid = buildGrid(axes);
+  if (grid.empty() || days <= 0) {
+    fprintf(stderr, "No hay combinaciones que evaluar\n");
+    return 2;
+  }
+  if (timelinePath != nullptr && grid.size() != 1) {
+    fprintf(stderr, "--timeline requiere una sola combinación (hay %zu)\n", grid.size());
+    return 2;
+  }
+  size_t resultBytes = grid.size() * sizeof(SweepResult);
+  auto *results = (SweepResult *)mmap(nullptr, resultBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (results == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  std::uninitialized_value_construct_n(results, grid.size());
+
+  // Estado inicial común: arranque de madrugada con la batería de la planta
+  Serial.setSink(nullptr);
+  OrangePiSerial.setSink(nullptr);
+  hostSetDelayAdvancesClock(true);
+  hostSetMicros((uint64_t)SWEEP_START_HOUR * 3600ULL * 1000000ULL);
+  PlantState initialPlant;
+  plantInit(initialPlant, plantConfig, hostMicros());
+  setup();
+
+  fprintf(stderr, "%zu combinaciones x %.1f días en %u procesos\n", grid.size(), days, jobs);
+  auto started = std::chrono::steady_clock::now();
+
+  size_t next = 0;
+  size_t finished = 0;
+  size_t reported = 0;
+  unsigned int running = 0;
+  while (finished < grid.size()) {
+    while (running < jobs && next < grid.size()) {
+      pid_t pid = fork();
+      if (pid < 0) {
+        perror("fork");
+        break;
+      }
+      if (pid == 0) {
+        FILE *timeline = timelinePath != nullptr ? fopen(timelinePath, "w") : nullptr;
+        simulate(grid[next], plantConfig, days, results[next], timeline);
+        if (timeline != nullptr) fclose(timeline);
+        results[next].done = true;
+        _exit(0);
+      }
+      next++;
+      running++;
+    }
+    int status = 0;
+    if (wait(&status) < 0) break;
+    running--;
+    finished++;
+    if (finished * 20 / grid.size() > reported) {
+      reported = finished * 20 / grid.size();
+      fprintf(stderr, "  %zu/%zu\n", finished, grid.size());
+    }
+  }
+
+  double wallSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+  size_t evaluated = 0;
+  size_t rejected = 0;
+  uint64_t loopCalls = 0;
+  for (size_t i = 0; i < grid.size(); i++) {
+    if (results[i].rejected) rejected++;
+    else if (results[i].done) evaluated++;
+    loopCalls += results[i].loopCalls;
+  }
+  fprintf(stderr, "%zu evaluadas (%zu rechazadas, %zu fallidas) en %.1f s: %.0f días simulados/s, %.0f loop()/s\n",
+          evaluated, rejected, grid.size() - evaluated - rejected, wallSeconds, evaluated * days / wallSeconds,
+          loopCalls / wallSeconds);
+
+  std::vector<long> frontier = paretoFrontier(grid, results);
+  std::vector<size_t> order;
+  std::vector<unsigned int> equivalents(grid.size(), 0);
+  for (size_t i = 0; i < grid.size(); i++) {
+    if (frontier[i] == (long)i) order.push_back(i);
+    if (frontier[i] >= 0) equivalents[frontier[i]]++;
+  }
+  std::sort(order.begin(), order.end(),
+            [&](size_t a, size_t b) { return results[a].totals.harvestedWh > results[b].totals.harvestedWh; });
+
+  printf("Frontera de Pareto (%zu puntos de %zu combinaciones): energía y horas llenas a maximizar, sobrecarga a "
+         "minimizar\n",
+         order.size(), evaluated);
+  printf("%6s %4s %5s %6s %6s %6s | %9s %7s %8s %7s %6s\n", "umbral", "div", "maxAb", "bulk", "absor", "float",
+         "Wh", "h llena", "gas Ah", "SOC fin", "equiv");
+  for (size_t i : order) {
+    const Combination &c = grid[i];
+    const PlantTotals &t = results[i].totals;
+    printf("%6.2f %4.0f %5.2f %6.2f %6.2f %6.2f | %9.1f %7.2f %8.3f %7.3f %6u\n", c.thresholdPercentage,
+           c.factorDivider, c.maxAbsorptionHours, c.bulkVoltage, c.absorptionVoltage, c.floatVoltage, t.harvestedWh,
+           t.hoursAtFull, t.overchargeAh, t.finalSoc, equivalents[i]);
+  }
+
+  writeCsv(outputPath, grid, results, frontier);
+  fprintf(stderr, "Resultados en %s\n", outputPath);
+  munmap(results, resultBytes);
+  return 0;
+}
@@ -0,0 +1,143 @@
+#include "plant_model.h"
+
+#include <Arduino.h>
+
+#include <cmath>
+
+#include "config.h"
+#include "host.h"
+#include "sampling.h"
+
+#define INA_PANEL_ADDRESS 0x40
+#define INA_BATTERY_ADDRESS 0x41
+#define SECONDS_PER_DAY 86400ULL
+#define SUNRISE_HOUR 6.0
+#define SUNSET_HOUR 18.0
+#define CLOUD_SLOT_SECONDS 600            // Las nubes cambian cada 10 minutos
+#define MAX_PLANT_STEP_US 1000000ULL      // Integración de Euler a 1 s como máximo
+
+// Modelo de la batería de gel (referido a 50 Ah y escalado con la capacidad)
+#define GEL_OCV_EMPTY 11.75               // V en reposo a SOC 0
+#define GEL_OCV_SPAN 1.05                 // V de reposo entre SOC 0 y 1
+#define GEL_SERIES_RESISTANCE 0.012       // Ω
+#define GEL_TAFEL_SLOPE 0.35              // V por unidad de ln() de la polarización
+#define GEL_ACCEPTANCE_FLOOR 0.0005       // Corriente de intercambio mínima (xC)
+#define GEL_ACCEPTANCE_SPAN 0.3           // (xC) a SOC 0, cae con (1 - SOC)^2
+#define GEL_EFFICIENCY_KNEE 0.03          // Rendimiento coulómbico: 1 - e^(-(1-SOC)/knee)
+
+static uint64_t splitmix64(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+// Número pseudoaleatorio en [0, 1) que solo depende de la semilla y la clave
+static double weatherRandom(uint32_t seed, uint64_t key) {
+  return (splitmix64(((uint64_t)seed << 40) ^ key) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+float plantIrradiance(const PlantConfig &config, uint64_t nowUs) {
+  uint64_t seconds = nowUs / 1000000ULL;
+  uint64_t day = seconds / SECONDS_PER_DAY;
+  double hour = (seconds % SECONDS_PER_DAY) / 3600.0;
+  if (hour <= SUNRISE_HOUR || hour >= SUNSET_HOUR) return 0.0f;
+
+  double clearSky = pow(sin(M_PI * (hour - SUNRISE_HOUR) / (SUNSET_HOUR - SUNRISE_HOUR)), 1.2);
+  // Nubosidad del día (0 = despejado, 0.8 = muy cubierto) y paso de nubes por ranura
+  double cloudiness = 0.8 * weatherRandom(config.weatherSeed, day);
+  uint64_t slot = seconds / CLOUD_SLOT_SECONDS;
+  double shade = cloudiness * sqrt(weatherRandom(config.weatherSeed, (slot << 1) | 1));
+  return (float)(clearSky * (1.0 - shade));
+}
+
+static double openCircuitVoltage(double soc) { return GEL_OCV_EMPTY + GEL_OCV_SPAN * soc; }
+
+float gelBatteryVoltage(const PlantConfig &config, double soc, float netCurrent_A) {
+  double scale = config.capacityAh / 50.0;
+  double resistance = GEL_SERIES_RESISTANCE / scale;
+  if (netCurrent_A <= 0) {
+    return (float)(openCircuitVoltage(soc) + 2.0 * netCurrent_A * resistance);
+  }
+  // Polarización de carga: la batería casi llena acepta poca corriente y el
+  // voltaje sube hacia los niveles de absorción
+  double remaining = 1.0 - soc;
+  double exchange_A = config.capacityAh * (GEL_ACCEPTANCE_FLOOR + GEL_ACCEPTANCE_SPAN * remaining * remaining);
+  double polarization = GEL_TAFEL_SLOPE * log(1.0 + netCurrent_A / exchange_A);
+  return (float)(openCircuitVoltage(soc) + netCurrent_A * resistance + polarization);
+}
+
+// Voltaje del NTC en el divisor (inversa de readTemperature())
+static uint16_t ntcAdcForTemperature(float celsius) {
+  double kelvin = celsius + 273.15;
+  double resistance = NOMINAL_RESISTANCE * exp(BETA * (1.0 / kelvin - 1.0 / (NOMINAL_TEMPERATURE + 273.15)));
+  double voltage = VCC * resistance / (resistance + SERIES_RESISTOR);
+  return (uint16_t)lround(voltage / VCC * ADC_RESOLUTION);
+}
+
+static float scheduledLoad(const PlantConfig &config, uint64_t nowUs) {
+  double hour = ((nowUs / 1000000ULL) % SECONDS_PER_DAY) / 3600.0;
+  return (hour >= 18.0 && hour < 23.0) ? config.eveningLoad_A : config.baseLoad_A;
+}
+
+static void publishReadings(PlantState &plant, float duty, bool loadOn, uint64_t nowUs) {
+  float irradiance = plantIrradiance(plant.config, nowUs);
+  float panelCurrent_A = plant.config.panelIsc_A * irradiance;
+  float voc = plant.config.panelVoc_V * fminf(1.0f, irradiance / 0.02f) * (0.9f + 0.1f * irradiance);
+  // Regulador PWM: el panel queda unido a la batería durante 'duty' y se
+  // comporta como fuente de corriente (Vbat < Vmp)
+  if (voc <= 0) panelCurrent_A = 0;
+  plant.chargeCurrent_A = duty * panelCurrent_A;
+  plant.loadCurrent_A = loadOn ? scheduledLoad(plant.config, nowUs) : 0.0f;
+  plant.batteryVoltage = gelBatteryVoltage(plant.config, plant.soc, plant.chargeCurrent_A - plant.loadCurrent_A);
+  plant.panelVoltage = duty * plant.batteryVoltage + (1.0f - duty) * voc;
+
+  // Los INA219 entregan la corriente del chip (el firmware aplica SHUNT_CURRENT_SCALE)
+  hostSetIna219(INA_PANEL_ADDRESS, plant.panelVoltage, plant.chargeCurrent_A * 1000.0f / SHUNT_CURRENT_SCALE);
+  hostSetIna219(INA_BATTERY_ADDRESS, plant.batteryVoltage, plant.loadCurrent_A * 1000.0f / SHUNT_CURRENT_SCALE);
+  hostSetAnalog(TEMP_PIN, ntcAdcForTemperature(plant.config.ambient_C));
+}
+
+void plantInit(PlantState &plant, const PlantConfig &config, uint64_t nowUs) {
+  plant = PlantState();
+  plant.config = config;
+  plant.soc = config.initialSoc;
+  plant.lastUs = nowUs;
+  plant.totals.minSoc = config.initialSoc;
+  publishReadings(plant, 0.0f, true, nowUs);
+}
+
+void plantStep(PlantState &plant, uint64_t nowUs, float duty, bool loadOn) {
+  const PlantConfig &config = plant.config;
+  PlantTotals &totals = plant.totals;
+
+  while (plant.lastUs < nowUs) {
+    uint64_t stepUs = nowUs - plant.lastUs;
+    if (stepUs > MAX_PLANT_STEP_US) stepUs = MAX_PLANT_STEP_US;
+    double hours = stepUs / 3600e6;
+
+    // Corrientes del intervalo: las publicadas al inicio (lo que vio el firmware)
+    double charge_A = plant.chargeCurrent_A;
+    double load_A = plant.loadCurrent_A;
+    double efficiency = 1.0 - exp(-(1.0 - plant.soc) / GEL_EFFICIENCY_KNEE);
+    double stored_A = charge_A * efficiency;
+    double gassing_A = charge_A - stored_A;
+
+    plant.soc += (stored_A - load_A) * hours / config.capacityAh;
+    if (plant.soc > 1.0) plant.soc = 1.0;
+    if (plant.soc < 0.0) plant.soc = 0.0;
+
+    totals.harvestedWh += charge_A * plant.batteryVoltage * hours;
+    totals.storedAh += stored_A * hours;
+    totals.overchargeAh += gassing_A * hours;
+    if (plant.soc >= config.fullSocThreshold) totals.hoursAtFull += hours;
+    if (plant.batteryVoltage > config.gassingVoltage) totals.hoursAboveGassing += hours;
+    if (!loadOn) totals.hoursLoadOff += hours;
+    if (plant.soc < totals.minSoc) totals.minSoc = (float)plant.soc;
+    if (plant.batteryVoltage > totals.maxBatteryVoltage) totals.maxBatteryVoltage = plant.batteryVoltage;
+
+    plant.lastUs += stepUs;
+    publishReadings(plant, duty, loadOn, plant.lastUs);
+  }
+  totals.finalSoc = (float)plant.soc;
+}
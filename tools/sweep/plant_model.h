@@ -0,0 +1,55 @@
+// Planta simulada para tools/sweep: panel solar con nubes deterministas,
+// batería de gel de 12 V y consumo con horario. El firmware ve la planta solo
+// a través de los INA219 y el NTC del host (host.h), igual que en el equipo.
+#pragma once
+
+#include <cstdint>
+
+struct PlantConfig {
+  float capacityAh = 50.0f;        // Igual que batteryCapacity por defecto
+  float initialSoc = 0.5f;
+  float panelIsc_A = 5.5f;         // Panel de ~100 W
+  float panelVoc_V = 21.5f;
+  float baseLoad_A = 0.4f;
+  float eveningLoad_A = 1.2f;      // 18:00-23:00
+  float ambient_C = 25.0f;
+  uint32_t weatherSeed = 1;
+  float fullSocThreshold = 0.98f;  // SOC a partir del cual se cuenta "batería llena"
+  float gassingVoltage = 14.4f;    // Gel: por encima empieza la gasificación
+};
+
+// Acumuladores de la simulación (lo que puntúa el barrido)
+struct PlantTotals {
+  double harvestedWh = 0;          // Energía del panel entregada a la batería
+  double storedAh = 0;             // Carga efectivamente almacenada
+  double overchargeAh = 0;         // Carga convertida en gas (sobrecarga)
+  double hoursAtFull = 0;
+  double hoursAboveGassing = 0;
+  double hoursLoadOff = 0;         // Carga desconectada por el LVD
+  float minSoc = 1.0f;
+  float finalSoc = 0;
+  float maxBatteryVoltage = 0;
+};
+
+struct PlantState {
+  PlantConfig config;
+  PlantTotals totals;
+  double soc = 0;
+  uint64_t lastUs = 0;
+  float batteryVoltage = 0;
+  float panelVoltage = 0;
+  float chargeCurrent_A = 0;
+  float loadCurrent_A = 0;
+};
+
+void plantInit(PlantState &plant, const PlantConfig &config, uint64_t nowUs);
+
+// Integra la planta desde la última llamada con el PWM y la carga vigentes y
+// publica las nuevas lecturas en los INA219 y el ADC del NTC del host
+void plantStep(PlantState &plant, uint64_t nowUs, float duty, bool loadOn);
+
+// Irradiancia relativa (0..1) en el instante dado; la hora del día sale del reloj virtual
+float plantIrradiance(const PlantConfig &config, uint64_t nowUs);
+
+// Voltaje en bornes de la batería de gel para una corriente neta (A, >0 carga)
+float gelBatteryVoltage(const PlantConfig &config, double soc, float netCurrent_A);
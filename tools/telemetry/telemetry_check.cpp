@@ -0,0 +1,216 @@
+// Comprueba el JSON de telemetría generado desde telemetry_schema.h sobre el
+// firmware compilado para Linux: CMD:GET_DATA y /data salen del mismo
+// registro (con uptime y el mismo estimatedSOC), encode(decode(x)) == x, los
+// textos se escapan y truncan sin partir UTF-8, y el decodificador rechaza
+// cualquier JSON truncado o mal formado sin salirse del buffer. Mide además
+// cuánto cuesta codificar y decodificar una respuesta.
+//
+//   telemetry_check [--sample <fichero>] [--verbose]
+//
+// --sample guarda la respuesta a CMD:GET_DATA para la comprobación en Python
+// (orangepi_backend/telemetry.py). Código 1 si falla.
+
+#include <Arduino.h>
+
+#include <chrono>
+#include <string>
+
+#include "event_bus.h"
+#include "host.h"
+#include "telemetry_codec.h"
+#include "web_server.h"
+
+// cargador_gel_litio.ino
+void setup();
+void loop();
+const char *buildTelemetryJson(size_t &length);
+String buildOrangePiJson();
+extern HardwareSerial OrangePiSerial;
+
+#define CHECK_START_HOUR 10
+#define CHECK_PANEL_ADDRESS 0x40
+#define CHECK_BATTERY_ADDRESS 0x41
+#define CHECK_NTC_ADC_25C 2048
+#define CHECK_STEP_MS 10
+#define CHECK_TIMING_ROUNDS 20000
+
+static int failures = 0;
+
+static void expect(bool condition, const char *what) {
+  printf("%s %s\n", condition ? "✓" : "✗", what);
+  if (!condition) failures++;
+}
+
+static void run(uint64_t ms) {
+  for (uint64_t elapsed = 0; elapsed < ms; elapsed += CHECK_STEP_MS) {
+    hostAdvanceMicros(CHECK_STEP_MS * 1000ULL);
+    loop();
+  }
+}
+
+static int decode(const std::string &text, TelemetryRecord &record) {
+  return telemetryDecode(text.data(), text.size(), &record);
+}
+
+static bool isPresent(const TelemetryRecord &record, int field) {
+  return record.present[field / 32] >> (field % 32) & 1;
+}
+
+static const char *text(const TelemetryRecord &record, int field) {
+  return record.text[telemetryTextSlot(field)];
+}
+
+static std::string encode(const TelemetryRecord &record) {
+  static char out[TELEMETRY_JSON_MAX];
+  int length = telemetryEncode(&record, out, sizeof(out));
+  return length < 0 ? std::string() : std::string(out, length);
+}
+
+template <typename Fn>
+static double nanosecondsPer(Fn fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < CHECK_TIMING_ROUNDS; i++) fn();
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  return std::chrono::duration<double, std::nano>(elapsed).count() / CHECK_TIMING_ROUNDS;
+}
+
+int main(int argc, char **argv) {
+  const char *samplePath = nullptr;
+  bool verbose = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "--sample") == 0 && i + 1 < argc) samplePath = argv[++i];
+    else if (strcmp(argv[i], "--verbose") == 0) verbose = true;
+    else {
+      fprintf(stderr, "Uso: %s [--sample <fichero>] [--verbose]\n", argv[0]);
+      return 2;
+    }
+  }
+
+  Serial.setSink(nullptr);
+  OrangePiSerial.setSink(nullptr);
+  hostSetDelayAdvancesClock(false);
+  hostSetMicros((uint64_t)CHECK_START_HOUR * 3600ULL * 1000000ULL);
+  hostSetIna219(CHECK_PANEL_ADDRESS, 18.5f, 250.0f);
+  hostSetIna219(CHECK_BATTERY_ADDRESS, 12.9f, 40.0f);
+  hostSetAnalog(TEMP_PIN, CHECK_NTC_ADC_25C);
+  setup();
+  run(5000);
+
+  // --- GET_DATA y /data ---
+  notaPersonalizada = "Batería \"AGM\" 12 V\r\nrevisar \\ bornes";
+  std::string serial = buildOrangePiJson().c_str();
+  std::string web = getData().c_str();
+  if (verbose) printf("  %s\n", serial.c_str());
+  expect(serial == web, "CMD:GET_DATA y /data idénticos");
+
+  TelemetryRecord record;
+  int count = decode(serial, record);
+  printf("  %d campos, %zu bytes\n", count, serial.size());
+  expect(count == TELEMETRY_FIELD_COUNT, "todos los campos del esquema presentes");
+  expect(isPresent(record, TELEMETRY_FIELD_uptime) && record.values[TELEMETRY_FIELD_uptime] > 0, "uptime en /data");
+  MeasurementSnapshot m = getLatestMeasurement();
+  expect(fabs(record.values[TELEMETRY_FIELD_estimatedSOC] - getSOCFromVoltage(m.voltageBattery)) < 0.006,
+         "estimatedSOC = getSOCFromVoltage de la instantánea");
+  expect(fabs(record.values[TELEMETRY_FIELD_voltageBatterySensor2] - m.voltageBattery) < 0.006,
+         "voltaje de batería de la instantánea");
+  expect(strcmp(text(record, TELEMETRY_FIELD_notaPersonalizada), "Batería \"AGM\" 12 V\nrevisar \\ bornes") == 0,
+         "nota con comillas, barra y salto de línea (sin \\r)");
+  expect(encode(record) == serial, "encode(decode(x)) == x");
+
+  TelemetryRecord prefixed;
+  expect(decode("DATA:" + serial + "\r\n", prefixed) == TELEMETRY_FIELD_COUNT &&
+         memcmp(&prefixed, &record, sizeof(record)) == 0, "acepta el prefijo DATA: y el fin de línea");
+
+  // --- Formatos anteriores y claves desconocidas ---
+  TelemetryRecord old;
+  int oldCount = decode("{\"voltagePanel\": 18.25, \"isLithium\": false, \"chargeState\": \"FLOAT_CHARGE\", "
+                        "\"extra\": {\"a\": [1, 2, {\"b\": null}]}, \"last_update\":\"123456\", "
+                        "\"temperature\": null}", old);
+  expect(oldCount == 4 && old.values[TELEMETRY_FIELD_voltagePanel] == 18.25 &&
+         old.values[TELEMETRY_FIELD_last_update] == 123456 &&
+         strcmp(text(old, TELEMETRY_FIELD_chargeState), "FLOAT_CHARGE") == 0 &&
+         !isPresent(old, TELEMETRY_FIELD_temperature), "JSON con espacios, claves desconocidas, null y número entre comillas");
+
+  TelemetryRecord numbers;
+  decode("{\"uptime\":9007199254740993,\"tunedKi\":1.5e-4,\"voltagePanel\":-0.125,"
+         "\"currentPWM\":1E2,\"LVD\":12.000000000000000000001}", numbers);
+  expect(numbers.values[TELEMETRY_FIELD_tunedKi] == 1.5e-4 && numbers.values[TELEMETRY_FIELD_voltagePanel] == -0.125 &&
+         numbers.values[TELEMETRY_FIELD_currentPWM] == 100 && numbers.values[TELEMETRY_FIELD_LVD] == 12.0 &&
+         numbers.values[TELEMETRY_FIELD_uptime] == 9007199254740993.0, "números como strtod");
+
+  // --- Textos: escapes, UTF-8 y truncado ---
+  TelemetryRecord texts = record;
+  std::string accents;
+  for (int i = 0; i < TELEMETRY_TEXT_SIZE; i++) accents += "ñ";
+  telemetrySetText(&texts, TELEMETRY_FIELD_notaPersonalizada, accents.c_str());
+  const char *stored = text(texts, TELEMETRY_FIELD_notaPersonalizada);
+  expect(strlen(stored) == TELEMETRY_TEXT_SIZE - 2 && accents.compare(0, strlen(stored), stored) == 0,
+         "texto largo truncado sin partir un carácter UTF-8");
+  TelemetryRecord decodedTexts;
+  decode("{\"notaPersonalizada\":\"\\u00f1\\ud83d\\ude00\\t\\u0001\\/\"}", decodedTexts);
+  expect(strcmp(text(decodedTexts, TELEMETRY_FIELD_notaPersonalizada), "ñ😀\t\x01/") == 0, "escapes \\u y pares sustitutos");
+  std::string reencoded = encode(decodedTexts);
+  expect(reencoded.find("\"notaPersonalizada\":\"ñ😀\\t\\u0001/\"") != std::string::npos, "caracteres de control escapados");
+
+  // --- Valores no finitos y buffer corto ---
+  TelemetryRecord nonFinite = record;
+  nonFinite.values[TELEMETRY_FIELD_temperature] = NAN;
+  nonFinite.values[TELEMETRY_FIELD_voltagePanel] = INFINITY;
+  std::string finite = encode(nonFinite);
+  expect(finite.find("\"temperature\":0.00,") != std::string::npos &&
+         finite.find("\"voltagePanel\":0.00,") != std::string::npos, "NaN e infinito salen como 0");
+  char small[64];
+  expect(telemetryEncode(&record, small, sizeof(small)) == -1 && small[0] == '\0', "sin espacio: -1 y cadena vacía");
+
+  // --- JSON truncado o mal formado ---
+  bool prefixesRejected = true;
+  for (size_t length = 0; length < serial.size(); length++) {
+    std::string prefix = serial.substr(0, length);
+    TelemetryRecord scratch;
+    if (telemetryDecode(prefix.data(), prefix.size(), &scratch) >= 0) {
+      if (prefixesRejected) printf("  aceptado: %zu bytes\n", length);
+      prefixesRejected = false;
+    }
+  }
+  expect(prefixesRejected, "cada prefijo truncado de la respuesta se rechaza");
+  const char *const malformed[] = {
+    "", "DATA:", "[]", "{", "{\"a\"}", "{\"a\":}", "{\"a\":1,}", "{\"a\":1} x", "{\"a\":tru}", "{\"a\":\"\\x\"}",
+    "{\"a\":\"\x01\"}", "{\"a\":-}", "{\"a\":1.}", "{\"a\":1e}", "{\"voltagePanel\":[1,}",
+    "{\"a\":[[[[[[[[[[[[[[[[[[[[1]]]]]]]]]]]]]]]]]]]}"
+  };
+  bool allRejected = true;
+  for (const char *input : malformed) {
+    TelemetryRecord scratch;
+    if (telemetryDecode(input, strlen(input), &scratch) >= 0) {
+      printf("  aceptado: %s\n", input);
+      allRejected = false;
+    }
+  }
+  expect(allRejected, "JSON mal formado rechazado");
+
+  // --- Coste ---
+  size_t length;
+  printf("  %.0f ns por buildTelemetryJson (registro + JSON)\n", nanosecondsPer([&] {
+    buildTelemetryJson(length);
+  }));
+  printf("  %.0f ns por telemetryEncode\n", nanosecondsPer([&] { encode(record); }));
+  TelemetryRecord timed;
+  printf("  %.0f ns por telemetryDecode\n", nanosecondsPer([&] { decode(serial, timed); }));
+
+  if (samplePath != nullptr) {
+    FILE *sample = fopen(samplePath, "w");
+    if (sample == nullptr) {
+      perror(samplePath);
+      return 1;
+    }
+    fprintf(sample, "%s\n", serial.c_str());
+    fclose(sample);
+  }
+
+  if (failures > 0) {
+    printf("FALLO: %d comprobaciones\n", failures);
+    return 1;
+  }
+  printf("OK: telemetría\n");
+  return 0;
+}
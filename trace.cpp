@@ -0,0 +1,262 @@
+#include "trace.h"
+#include "time_base.h"
+#include "thermal_control.h"
+#include "sampling.h"
+#include "autotune.h"
+
+// Estado de la lógica de carga (cargador_gel_litio.ino)
+extern float batteryCapacity;
+extern float thresholdPercentage;
+extern float maxAllowedCurrent;
+extern float bulkVoltage;
+extern float absorptionVoltage;
+extern float floatVoltage;
+extern bool isLithium;
+extern bool useFuenteDC;
+extern float fuenteDC_Amps;
+extern float absorptionCurrentThreshold_mA;
+extern float currentLimitIntoFloatStage;
+extern int factorDivider;
+extern ChargeState currentState;
+extern int currentPWM;
+extern float accumulatedAh;
+extern uint64_t lastUpdateTime;
+extern int64_t bulkStartTime;
+extern uint64_t absorptionStartTime;
+extern float calculatedAbsorptionHours;
+extern float currentBulkHours;
+extern float maxBulkHours;
+extern float temperature;
+extern float lastBatteryVoltage;
+extern float panelToBatteryCurrent;
+extern float batteryToLoadCurrent;
+
+static HardwareSerial TraceSerial(TRACE_UART_NUM);
+
+static bool recording = false;
+static bool uartReady = false;
+static uint32_t recordCount = 0;
+static uint32_t droppedCount = 0;
+
+static TraceReadHook replayRead = NULL;
+static TraceClockHook replayClock = NULL;
+
+enum TraceFieldType {
+  FIELD_FLOAT = 0,
+  FIELD_INT,            // int y enums
+  FIELD_BOOL,
+  FIELD_U64,
+  FIELD_I64
+};
+
+struct TraceField {
+  const char *name;
+  TraceFieldType type;
+  void *value;
+};
+
+// Todo lo que updateChargeState()/updateAhTracking() leen y no se vuelve a
+// medir en cada ciclo. Estado interno que no figura aquí (historia del PI
+// ajustado, contadores de noche) arranca desde cero en la reproducción.
+static const TraceField stateFields[] = {
+  {"batteryCapacity", FIELD_FLOAT, &batteryCapacity},
+  {"thresholdPercentage", FIELD_FLOAT, &thresholdPercentage},
+  {"maxAllowedCurrent", FIELD_FLOAT, &maxAllowedCurrent},
+  {"bulkVoltage", FIELD_FLOAT, &bulkVoltage},
+  {"absorptionVoltage", FIELD_FLOAT, &absorptionVoltage},
+  {"floatVoltage", FIELD_FLOAT, &floatVoltage},
+  {"isLithium", FIELD_BOOL, &isLithium},
+  {"useFuenteDC", FIELD_BOOL, &useFuenteDC},
+  {"fuenteDC_Amps", FIELD_FLOAT, &fuenteDC_Amps},
+  {"absorptionThreshold", FIELD_FLOAT, &absorptionCurrentThreshold_mA},
+  {"floatCurrentLimit", FIELD_FLOAT, &currentLimitIntoFloatStage},
+  {"factorDivider", FIELD_INT, &factorDivider},
+  {"tempSoftLimit", FIELD_FLOAT, &tempSoftLimit},
+  {"tempHardLimit", FIELD_FLOAT, &tempHardLimit},
+  {"deratingFactor", FIELD_FLOAT, &thermalDeratingFactor},
+  {"samplingMode", FIELD_INT, &samplingMode},
+  {"tunedValid", FIELD_BOOL, &tunedGains.valid},
+  {"tunedKp", FIELD_FLOAT, &tunedGains.kp},
+  {"tunedKi", FIELD_FLOAT, &tunedGains.ki},
+  {"currentState", FIELD_INT, &currentState},
+  {"currentPWM", FIELD_INT, &currentPWM},
+  {"accumulatedAh", FIELD_FLOAT, &accumulatedAh},
+  {"lastUpdateTime", FIELD_U64, &lastUpdateTime},
+  {"bulkStartTime", FIELD_I64, &bulkStartTime},
+  {"absorptionStartTime", FIELD_U64, &absorptionStartTime},
+  {"absorptionHours", FIELD_FLOAT, &calculatedAbsorptionHours},
+  {"currentBulkHours", FIELD_FLOAT, &currentBulkHours},
+  {"maxBulkHours", FIELD_FLOAT, &maxBulkHours},
+  {"temperature", FIELD_FLOAT, &temperature},
+  {"lastBatteryVoltage", FIELD_FLOAT, &lastBatteryVoltage},
+  {"panelCurrent", FIELD_FLOAT, &panelToBatteryCurrent},
+  {"loadCurrent", FIELD_FLOAT, &batteryToLoadCurrent}
+};
+
+#define STATE_FIELD_COUNT (sizeof(stateFields) / sizeof(stateFields[0]))
+
+static uint32_t floatBits(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+static uint64_t fieldBits(const TraceField &field) {
+  switch (field.type) {
+    case FIELD_FLOAT:
+      return floatBits(*(float *)field.value);
+    case FIELD_INT:
+      return (uint32_t)*(int *)field.value;
+    case FIELD_BOOL:
+      return *(bool *)field.value ? 1 : 0;
+    case FIELD_U64:
+      return *(uint64_t *)field.value;
+    case FIELD_I64:
+      return (uint64_t)*(int64_t *)field.value;
+  }
+  return 0;
+}
+
+// Un registro por línea; si no cabe entero se descarta y se cuenta, nunca se
+// espera a la UART desde el ciclo de control
+static void emit(const char *line) {
+  size_t length = strlen(line);
+  if ((size_t)TraceSerial.availableForWrite() < length + 1) {
+    droppedCount++;
+    return;
+  }
+  TraceSerial.write((const uint8_t *)line, length);
+  TraceSerial.write('\n');
+  recordCount++;
+}
+
+void traceBegin() {
+  recording = false;
+  recordCount = 0;
+  droppedCount = 0;
+}
+
+void traceStart() {
+  if (!uartReady) {
+    TraceSerial.setTxBufferSize(TRACE_TX_BUFFER);
+    TraceSerial.begin(TRACE_BAUD, SERIAL_8N1, -1, TRACE_TX_PIN);
+    uartReady = true;
+  }
+  recordCount = 0;
+  droppedCount = 0;
+  recording = true;
+
+  char line[96];
+  snprintf(line, sizeof(line), "#TRACE %d %s", TRACE_FORMAT_VERSION, TRACE_FIRMWARE_ID);
+  emit(line);
+
+  // El estado se parte en varias líneas S para no exceder el búfer de línea
+  String state = "S";
+  for (size_t i = 0; i < STATE_FIELD_COUNT; i++) {
+    snprintf(line, sizeof(line), " %s=%llx", stateFields[i].name, (unsigned long long)fieldBits(stateFields[i]));
+    if (state.length() + strlen(line) > 200) {
+      emit(state.c_str());
+      state = "S";
+    }
+    state += line;
+  }
+  emit(state.c_str());
+  Serial.println("📼 [Traza] Grabando en GPIO" + String(TRACE_TX_PIN) + " a " + String(TRACE_BAUD) + " baudios");
+}
+
+void traceStop() {
+  if (!recording) return;
+  char line[48];
+  snprintf(line, sizeof(line), "#END %lu %lu", (unsigned long)recordCount, (unsigned long)droppedCount);
+  emit(line);
+  recording = false;
+  Serial.println("📼 [Traza] Detenida: " + String(recordCount) + " registros, " + String(droppedCount) + " perdidos");
+}
+
+bool isTraceRecording() {
+  return recording;
+}
+
+uint32_t getTraceDropped() {
+  return droppedCount;
+}
+
+float traceRead(TraceChannel channel, float value) {
+  if (replayRead != NULL) {
+    return replayRead(channel, value);
+  }
+  if (recording) {
+    char line[16];
+    snprintf(line, sizeof(line), "R %c %08lx", (char)channel, (unsigned long)floatBits(value));
+    emit(line);
+  }
+  return value;
+}
+
+uint64_t traceMillis() {
+  uint64_t now = monoMillis();
+  if (replayClock != NULL) {
+    return replayClock(now);
+  }
+  if (recording) {
+    char line[28];
+    snprintf(line, sizeof(line), "M %llu", (unsigned long long)now);
+    emit(line);
+  }
+  return now;
+}
+
+void traceTick() {
+  if (!recording) return;
+  char line[28];
+  snprintf(line, sizeof(line), "K %llu", (unsigned long long)monoMillis());
+  emit(line);
+}
+
+void traceCommand(const String &command) {
+  if (!recording) return;
+  // Un TRACE:OFF no forma parte de lo que se reproduce
+  if (command.startsWith("CMD:TRACE")) return;
+  String line = "C " + uint64ToString(monoMillis()) + " " + command;
+  emit(line.c_str());
+}
+
+void traceOutput(ChargeState state, int pwm, float accumulatedAh) {
+  if (!recording) return;
+  char line[32];
+  snprintf(line, sizeof(line), "O %d %d %08lx", (int)state, pwm, (unsigned long)floatBits(accumulatedAh));
+  emit(line);
+}
+
+void traceSetReplayHooks(TraceReadHook readHook, TraceClockHook clockHook) {
+  replayRead = readHook;
+  replayClock = clockHook;
+}
+
+bool traceRestoreField(const String &name, uint64_t bits) {
+  for (size_t i = 0; i < STATE_FIELD_COUNT; i++) {
+    const TraceField &field = stateFields[i];
+    if (name != field.name) continue;
+    switch (field.type) {
+      case FIELD_FLOAT: {
+        uint32_t raw = (uint32_t)bits;
+        memcpy(field.value, &raw, sizeof(raw));
+        break;
+      }
+      case FIELD_INT:
+        *(int *)field.value = (int)(uint32_t)bits;
+        break;
+      case FIELD_BOOL:
+        *(bool *)field.value = bits != 0;
+        break;
+      case FIELD_U64:
+        *(uint64_t *)field.value = bits;
+        break;
+      case FIELD_I64:
+        *(int64_t *)field.value = (int64_t)bits;
+        break;
+    }
+    return true;
+  }
+  return false;
+}
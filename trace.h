@@ -0,0 +1,60 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Grabación determinista del ciclo de control para reproducirlo en Linux
+// (tools/replay). Toda lectura de sensor, marca de tiempo y comando que
+// consume la lógica de carga pasa por este módulo: en el equipo devuelve el
+// valor real y, si la grabación está activa, lo emite por una UART dedicada;
+// en la reproducción los ganchos sustituyen el valor por el grabado.
+//
+// Formato (una línea de texto por registro; los float van como los 8 dígitos
+// hex de sus bits IEEE-754 para reproducirlos bit a bit):
+//   #TRACE <versión> <firmware>          cabecera
+//   S <campo>=<hex> ...                  estado inicial de la lógica de carga
+//   K <ms>                               inicio de un ciclo de control
+//   R <canal> <hex>                      lectura de sensor
+//   M <ms>                               reloj leído por la lógica de carga
+//   C <ms> <comando>                     comando recibido de la Orange Pi
+//   O <estado> <pwm> <hex Ah>            resultado del ciclo (se verifica)
+//   #END <registros> <perdidos>
+#define TRACE_FORMAT_VERSION 1
+#define TRACE_FIRMWARE_ID "cargador_gel_litio"
+#define TRACE_UART_NUM 1                  // UART1: la UART0 es de la Orange Pi
+#define TRACE_TX_PIN 10                   // GPIO10, solo TX hacia un adaptador USB-serie
+#define TRACE_BAUD 921600                 // Un ciclo (~10 registros) sale en ~2 ms
+#define TRACE_TX_BUFFER 2048
+
+enum TraceChannel {
+  TRACE_PANEL_CURRENT = 'I',              // mA promedio panel -> batería
+  TRACE_LOAD_CURRENT = 'L',               // mA promedio batería -> carga
+  TRACE_PANEL_VOLTAGE = 'P',
+  TRACE_BATTERY_VOLTAGE = 'B',
+  TRACE_TEMPERATURE = 'T'
+};
+
+// Ganchos de reproducción: reciben el valor real (sin sentido en el host) y
+// devuelven el grabado
+typedef float (*TraceReadHook)(TraceChannel channel, float live);
+typedef uint64_t (*TraceClockHook)(uint64_t live);
+
+void traceBegin();
+void traceStart();                        // Cabecera + estado inicial
+void traceStop();
+bool isTraceRecording();
+uint32_t getTraceDropped();               // Registros perdidos por UART llena
+
+float traceRead(TraceChannel channel, float value);
+uint64_t traceMillis();                   // monoMillis() para la lógica de carga
+void traceTick();
+void traceCommand(const String &command);
+void traceOutput(ChargeState state, int pwm, float accumulatedAh);
+
+void traceSetReplayHooks(TraceReadHook readHook, TraceClockHook clockHook);
+
+// Aplica un campo del registro S (reproducción). false si no se reconoce.
+bool traceRestoreField(const String &name, uint64_t bits);
+
+#endif
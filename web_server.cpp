@@ -1,10 +1,19 @@
 #include "web_server.h"
 #include "config.h"
+#include "thermal_control.h"
+#include "power_manager.h"
+#include "wifi_manager.h"
+#include "regulation_metrics.h"
+#include "alloc_tracker.h"
+#include "metrics.h"
 #include <Preferences.h>
 
 WebServer server(80);
 extern Preferences preferences;
 
+// cargador_gel_litio.ino
+String buildOrangePiJson();
+
 // Variable global para almacenar el color aleatorio
 String randomStateColor = "";
 
@@ -17,8 +26,8 @@ extern float maxBulkHours;
 
 // Variables para el control de apagado temporal de la carga
 // Ahora son externas (ya definidas en cargador_gel_litio.ino)
-extern unsigned long loadOffStartTime;
-extern unsigned long loadOffDuration;
+extern uint64_t loadOffStartTime;
+extern uint64_t loadOffDuration;
 extern bool temporaryLoadOff;
 
 // Función para generar un color hexadecimal aleatorio
@@ -32,32 +41,42 @@ String generateRandomColor() {
   return String(colorBuffer);
 }
 
-void checkLoadOffTimer() {
-  if (temporaryLoadOff && millis() - loadOffStartTime >= loadOffDuration) {
-    // Solo encender si fue apagado por esta funcionalidad y no por otras razones
-    digitalWrite(LOAD_CONTROL_PIN, HIGH);
-    temporaryLoadOff = false;
-    notaPersonalizada = "Carga reactivada automáticamente después del tiempo especificado";
-  }
-}
-
-
-
 void initWebServer() {
 
   // Genera un color aleatorio al inicializar el servidor web
   randomStateColor = generateRandomColor(); 
 
   server.on("/", HTTP_GET, []() {
+    allocRegionBegin(ALLOC_REGION_WEB_PAGE);
     server.send(200, "text/html", getHTML());
+    allocRegionEnd(ALLOC_REGION_WEB_PAGE);
   });
 
   server.on("/data", HTTP_GET, []() {
+    allocRegionBegin(ALLOC_REGION_WEB_DATA);
     String json = getData();
     server.send(200, "application/json", json);
+    allocRegionEnd(ALLOC_REGION_WEB_DATA);
+  });
+
+  // Prometheus: se envía por trozos desde el buffer de metrics.cpp
+  server.on("/metrics", HTTP_GET, []() {
+    allocRegionBegin(ALLOC_REGION_WEB_METRICS);
+    server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+    server.send(200, METRICS_CONTENT_TYPE, "");
+    writeMetrics([](const char *data, size_t length) { server.sendContent(data, length); });
+    server.sendContent("");   // Trozo vacío: fin de la transferencia chunked
+    allocRegionEnd(ALLOC_REGION_WEB_METRICS);
+  });
+
+  server.on("/regulation", HTTP_GET, []() {
+    allocRegionBegin(ALLOC_REGION_WEB_OTHER);
+    server.send(200, "application/json", buildRegulationJson());
+    allocRegionEnd(ALLOC_REGION_WEB_OTHER);
   });
 
   server.on("/update", HTTP_POST, []() {
+    allocRegionBegin(ALLOC_REGION_WEB_OTHER);
     if (server.hasArg("batteryCapacity") &&
         server.hasArg("thresholdPercentage") &&
         server.hasArg("maxAllowedCurrent") &&
@@ -66,52 +85,62 @@ void initWebServer() {
         server.hasArg("floatVoltage") &&
         server.hasArg("isLithium")) {
 
-      batteryCapacity = server.arg("batteryCapacity").toFloat();
-      thresholdPercentage = server.arg("thresholdPercentage").toFloat();
-      maxAllowedCurrent = server.arg("maxAllowedCurrent").toFloat();
-      bulkVoltage = server.arg("bulkVoltage").toFloat();
-      absorptionVoltage = server.arg("absorptionVoltage").toFloat();
-      floatVoltage = server.arg("floatVoltage").toFloat();
-      isLithium = server.arg("isLithium") == "true";
-      useFuenteDC = server.arg("powerSource") == "true";
-      fuenteDC_Amps = server.arg("fuenteDC_Amps").toFloat();
-      
-      absorptionCurrentThreshold_mA = (batteryCapacity * thresholdPercentage) * 10;
-      currentLimitIntoFloatStage = absorptionCurrentThreshold_mA / factorDivider;
+      // Los cambios viajan por el bus: se validan aquí y se aplican entre
+      // ciclos de control. Solo los campos que cambian, y todos o ninguno
+      struct WebParam {
+        const char *field;
+        ParamId id;
+      };
+      static const WebParam fields[] = {
+        {"batteryCapacity", PARAM_BATTERY_CAPACITY}, {"thresholdPercentage", PARAM_THRESHOLD_PERCENTAGE},
+        {"maxAllowedCurrent", PARAM_MAX_ALLOWED_CURRENT}, {"bulkVoltage", PARAM_BULK_VOLTAGE},
+        {"absorptionVoltage", PARAM_ABSORPTION_VOLTAGE}, {"floatVoltage", PARAM_FLOAT_VOLTAGE},
+        {"isLithium", PARAM_IS_LITHIUM}, {"powerSource", PARAM_USE_FUENTE_DC},
+        {"fuenteDC_Amps", PARAM_FUENTE_DC_AMPS}
+      };
+      const size_t fieldCount = sizeof(fields) / sizeof(fields[0]);
 
-      preferences.begin("charger", false);
-      preferences.putFloat("batteryCap", batteryCapacity);
-      preferences.putFloat("thresholdPerc", thresholdPercentage);
-      preferences.putFloat("maxCurrent", maxAllowedCurrent);
-      preferences.putFloat("bulkV", bulkVoltage);
-      preferences.putFloat("absV", absorptionVoltage);
-      preferences.putFloat("floatV", floatVoltage);
-      preferences.putBool("isLithium", isLithium);
-      preferences.putBool("useFuenteDC", useFuenteDC);
-      preferences.putFloat("fuenteDC_Amps", fuenteDC_Amps);
-      preferences.end();
+      ParamChange changes[fieldCount];
+      size_t changeCount = 0;
+      String rejected = "";
+      for (size_t i = 0; i < fieldCount; i++) {
+        if (!server.hasArg(fields[i].field)) continue;   // powerSource y fuenteDC_Amps son opcionales
+        float value = parseParamValue(fields[i].id, server.arg(fields[i].field));
+        if (!isValidParamValue(fields[i].id, value)) {
+          if (rejected.length() > 0) rejected += ", ";
+          rejected += fields[i].field;
+          continue;
+        }
+        // El formulario muestra los valores con String(float), a 2 decimales
+        float current = getParamValue(fields[i].id);
+        if (value != current && value != String(current).toFloat()) {
+          changes[changeCount++] = {fields[i].id, value};
+        }
+      }
+
+      if (rejected.length() > 0) {
+        notaPersonalizada = "Cambios desde la web descartados, valor no válido en: " + rejected;
+      } else if (changeCount > 0 && !publishParamChanges(changes, changeCount, SOURCE_WEB)) {
+        notaPersonalizada = "Cambios desde la web descartados: cola de eventos llena, reintentar";
+      }
 
       server.sendHeader("Location", "/");
       server.send(303);
     } else {
       server.send(400, "text/plain", "Parámetros inválidos");
     }
+    allocRegionEnd(ALLOC_REGION_WEB_OTHER);
   });
 
 
   server.on("/toggle-load", HTTP_POST, []() {
+    allocRegionBegin(ALLOC_REGION_WEB_OTHER);
     if (server.hasArg("seconds")) {
       int seconds = server.arg("seconds").toInt();
       if (seconds > 0 && seconds <= 300) { // Máximo 5 minutos (300 segundos)
         if (digitalRead(LOAD_CONTROL_PIN) == HIGH) {
-          digitalWrite(LOAD_CONTROL_PIN, LOW);
-          delay(1000);
-          temporaryLoadOff = true;
-          loadOffStartTime = millis();
-          loadOffDuration = seconds * 1000; // Convertir a milisegundos
-          notaPersonalizada = "Carga apagada por " + String(seconds) + " segundos";
+          publishCommand(COMMAND_LOAD_OFF, seconds, SOURCE_WEB);
         } else {
-          temporaryLoadOff = false; // Asegurarse de que no activemos el temporizador
           notaPersonalizada = "La carga ya está apagada, no se realizó ninguna acción";
         }
       } else {
@@ -122,6 +151,7 @@ void initWebServer() {
     } else {
       server.send(400, "text/plain", "Parámetro 'seconds' no proporcionado");
     }
+    allocRegionEnd(ALLOC_REGION_WEB_OTHER);
   });
 
 
@@ -129,8 +159,10 @@ void initWebServer() {
 }
 
 void handleWebServer() {
-  server.handleClient();
-  checkLoadOffTimer();
+  // El servidor solo existe mientras la radio está encendida
+  if (isWebServerRunning()) {
+    server.handleClient();
+  }
 }
 
 String getHTML() {
@@ -201,6 +233,8 @@ String getHTML() {
   html += "<tr><td>Límite de corriente en float (mA)</td><td id='currentLimitIntoFloatStage'>-</td></tr>";
   html += "<tr><td>Tipo de Batería</td><td id='isLithium'>-</td></tr>";
   html += "<tr><td>Temperatura</td><td id='temperature'>-</td></tr>";
+  html += "<tr><td>Temp. MOSFET estimada</td><td id='estimatedMosfetTemp'>-</td></tr>";
+  html += "<tr><td>Corriente Máx. Efectiva (mA)</td><td id='effectiveMaxCurrent'>-</td></tr>";
   html += "<tr><td>Nota</td><td id='notaPersonalizada'>" + notaPersonalizada + "</td></tr>";
   html += "<tr><td>Fuente de Energía</td><td id='powerSource_display'>-</td></tr>";
   html += "<tr><td>Amperios Fuente DC</td><td id='fuenteDC_Amps_display'>-</td></tr>";
@@ -306,6 +340,8 @@ String getHTML() {
   html += "      updateField('currentLimitIntoFloatStage', data.currentLimitIntoFloatStage);";
   html += "      updateField('isLithium', data.isLithium ? 'Litio' : 'GEL');";
   html += "      updateField('temperature', data.temperature);";
+  html += "      updateField('estimatedMosfetTemp', data.estimatedMosfetTemp);";
+  html += "      updateField('effectiveMaxCurrent', data.effectiveMaxCurrent);";
   html += "      updateField('notaPersonalizada', data.notaPersonalizada);";
   html += "      updateField('powerSource_display', data.useFuenteDC ? 'Fuente DC' : 'Panel Solar');";
   html += "      updateField('fuenteDC_Amps_display', data.fuenteDC_Amps);";
@@ -443,69 +479,8 @@ String getHTML() {
 }
 
 String getData() {
-  // Asegurar que las variables tengan valores válidos
-  float safeVoltagePanel = ina219_1.getBusVoltage_V();
-  float safeVoltageBattery = ina219_2.getBusVoltage_V();
-  
-  // Evitar valores NaN o infinitos
-  if (isnan(safeVoltagePanel) || isinf(safeVoltagePanel)) safeVoltagePanel = 0.0;
-  if (isnan(safeVoltageBattery) || isinf(safeVoltageBattery)) safeVoltageBattery = 0.0;
-  
-  // Asegurar que las variables numéricas sean al menos 0
-  float safePanelToBatteryCurrent = max(0.0f, panelToBatteryCurrent);
-  float safeBatteryToLoadCurrent = max(0.0f, batteryToLoadCurrent);
-  float safeBulkVoltage = max(0.0f, bulkVoltage);
-  float safeAbsorptionVoltage = max(0.0f, absorptionVoltage);
-  float safeFloatVoltage = max(0.0f, floatVoltage);
-  float safeabsorptionCurrentThreshold_mA = max(0.0f, absorptionCurrentThreshold_mA);
-  float safeBatteryCapacity = max(0.0f, batteryCapacity);
-  float safeThresholdPercentage = max(0.0f, thresholdPercentage);
-  float safeCalculatedAbsorptionHours = max(0.0f, calculatedAbsorptionHours);
-  float safeAccumulatedAh = max(0.0f, accumulatedAh);
-  float safeSOC = max(0.0f, getSOCFromVoltage(safeVoltageBattery));
-  float safeMaxAllowedCurrent = max(0.0f, maxAllowedCurrent);
-  float safeNetCurrent = safePanelToBatteryCurrent - safeBatteryToLoadCurrent;
-  float safeCurrentLimitIntoFloatStage = max(0.0f, currentLimitIntoFloatStage);
-  float safeTemperature = isnan(temperature) ? 0.0 : temperature;
-  
-  String json = "{";
-  json += "\"panelToBatteryCurrent\": " + String(safePanelToBatteryCurrent) + ",";
-  json += "\"batteryToLoadCurrent\": " + String(safeBatteryToLoadCurrent) + ",";
-  json += "\"voltagePanel\": " + String(safeVoltagePanel) + ",";
-  json += "\"voltageBatterySensor2\": " + String(safeVoltageBattery) + ",";
-  json += "\"chargeState\": \"" + getChargeStateString(currentState) + "\",";
-  json += "\"bulkVoltage\": " + String(safeBulkVoltage) + ",";
-  json += "\"absorptionVoltage\": " + String(safeAbsorptionVoltage) + ",";
-  json += "\"floatVoltage\": " + String(safeFloatVoltage) + ",";
-  json += "\"currentPWM\": " + String(currentPWM) + ",";
-  json += "\"LVD\": " + String(LVD) + ",";
-  json += "\"LVR\": " + String(LVR) + ",";
-  json += "\"absorptionCurrentThreshold_mA\": " + String(safeabsorptionCurrentThreshold_mA) + ",";
-  json += "\"batteryCapacity\": " + String(safeBatteryCapacity) + ",";
-  json += "\"thresholdPercentage\": " + String(safeThresholdPercentage) + ",";
-  json += "\"calculatedAbsorptionHours\": " + String(safeCalculatedAbsorptionHours) + ",";
-  json += "\"accumulatedAh\": " + String(safeAccumulatedAh) + ",";
-  json += "\"estimatedSOC\": " + String(safeSOC) + ",";
-  json += "\"maxAllowedCurrent\": " + String(safeMaxAllowedCurrent) + ",";
-  json += "\"netCurrent\": " + String(safeNetCurrent) + ",";
-  json += "\"currentLimitIntoFloatStage\": " + String(safeCurrentLimitIntoFloatStage) + ",";
-  json += "\"isLithium\": ";
-  json += isLithium ? "true" : "false";
-  json += ",";
-  json += "\"temperature\": " + String(safeTemperature);
-  json += ",";
-  // Sanitizar notaPersonalizada para evitar problemas con JSON
-  String sanitizedNota = notaPersonalizada;
-  sanitizedNota.replace("\"", "\\\""); // Escapar comillas dobles
-  json += "\"notaPersonalizada\": \"" + sanitizedNota + "\"";
-  json += ",";
-  json += "\"useFuenteDC\": ";
-  json += useFuenteDC ? "true" : "false";
-  json += ",";
-  json += "\"fuenteDC_Amps\": " + String(fuenteDC_Amps);
-  json += ",";
-  json += "\"maxBulkHours\": " + String(maxBulkHours);
-  json += "}";
+  // Mismo registro que CMD:GET_DATA (telemetry_schema.h)
+  String json = buildOrangePiJson();
   
   // Log para depuración
   Serial.println("JSON enviado: " + json);
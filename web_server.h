@@ -4,6 +4,8 @@
 #include <WebServer.h>
 #include <Adafruit_INA219.h>
 #include "config.h"
+#include "time_base.h"
+#include "event_bus.h"
 
 extern WebServer server;
 extern String notaPersonalizada;
@@ -12,11 +14,18 @@ extern float fuenteDC_Amps;
 extern float maxBulkHours;
 
 // Declarar estas variables como externas (definidas en el archivo principal)
-extern unsigned long loadOffStartTime;
-extern unsigned long loadOffDuration;
+extern uint64_t loadOffStartTime;
+extern uint64_t loadOffDuration;
 extern bool temporaryLoadOff;
 
-void checkLoadOffTimer();
+// Apagado temporal de la carga (temporizador de la rueda, definido en el archivo principal)
+void startLoadOffTimer(uint32_t seconds);
+void cancelLoadOffTimer();
+
+// Validación compartida de los parámetros publicados en el bus
+float parseParamValue(ParamId id, const String &text);
+bool isValidParamValue(ParamId id, float value);
+float getParamValue(ParamId id);
 
 // Declaración de la función getChargeStateString
 extern String getChargeStateString(ChargeState state);
@@ -43,7 +52,7 @@ extern Adafruit_INA219 ina219_2;
 extern ChargeState currentState;
 extern bool ina219_1_available;
 
-extern unsigned long bulkStartTime;
+extern int64_t bulkStartTime;
 
 // Declaración de funciones
 void initWebServer();
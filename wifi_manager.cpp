@@ -0,0 +1,208 @@
+#include "wifi_manager.h"
+#include "web_server.h"
+#include <WiFi.h>
+#include <Preferences.h>
+#include "esp_wifi.h"
+#include "esp_idf_version.h"
+#include "time_base.h"
+
+extern Preferences preferences;
+
+WifiPolicy wifiPolicy = (WifiPolicy)WIFI_DEFAULT_POLICY;
+String wifiSsid = WIFI_DEFAULT_SSID;
+String wifiPassword = WIFI_DEFAULT_PASSWORD;
+
+static bool radioOn = false;
+static bool webServerInitialized = false;
+static bool nightModeRequested = false;
+
+// Ventana bajo demanda
+static bool windowOpen = false;
+static uint64_t windowStart = 0;
+static uint64_t windowDuration = 0;
+
+// Antirrebote del botón
+static bool lastButtonReading = HIGH;
+static bool buttonState = HIGH;
+static uint64_t lastButtonChange = 0;
+const uint64_t BUTTON_DEBOUNCE_MS = 50;
+const uint64_t CLIENT_GRACE_MS = 60000; // Extensión mientras haya clientes conectados
+
+// Beacon largo, DTIM alto y potencia reducida: la radio pasa más tiempo inactiva
+static void applyRadioPowerTuning() {
+  wifi_config_t conf;
+  if (esp_wifi_get_config(WIFI_IF_AP, &conf) == ESP_OK) {
+    conf.ap.beacon_interval = WIFI_AP_BEACON_INTERVAL;
+#if ESP_IDF_VERSION >= ESP_IDF_VERSION_VAL(5, 2, 0)
+    conf.ap.dtim_period = WIFI_AP_DTIM_PERIOD;
+#endif
+    esp_wifi_set_config(WIFI_IF_AP, &conf);
+  }
+  WiFi.setTxPower(WIFI_TX_POWER);
+}
+
+static void startRadio() {
+  WiFi.mode(WIFI_AP);
+  WiFi.softAP(wifiSsid.c_str(), wifiPassword.c_str());
+  applyRadioPowerTuning();
+
+  // El servidor web solo se construye la primera vez que se necesita
+  if (!webServerInitialized) {
+    initWebServer();
+    webServerInitialized = true;
+  } else {
+    server.begin();
+  }
+
+  radioOn = true;
+  Serial.println("📶 [WiFi] Punto de acceso iniciado: " + wifiSsid + " (" + WiFi.softAPIP().toString() + ")");
+}
+
+static void stopRadio() {
+  if (webServerInitialized) {
+    server.stop();
+  }
+  WiFi.softAPdisconnect(true);
+  WiFi.mode(WIFI_OFF);
+  radioOn = false;
+  Serial.println("📴 [WiFi] Radio apagada");
+}
+
+static bool radioShouldBeOn() {
+  switch (wifiPolicy) {
+    case WIFI_POLICY_ALWAYS_ON:
+      return !nightModeRequested || windowOpen;
+    case WIFI_POLICY_ON_DEMAND:
+      return windowOpen;
+    case WIFI_POLICY_OFF:
+    default:
+      return false;
+  }
+}
+
+static void applyRadioState() {
+  bool desired = radioShouldBeOn();
+  if (desired && !radioOn) {
+    startRadio();
+  } else if (!desired && radioOn) {
+    stopRadio();
+  }
+}
+
+void wifiManagerBegin() {
+  preferences.begin("charger", true);
+  int storedPolicy = preferences.getUChar("wifiPolicy", WIFI_DEFAULT_POLICY);
+  wifiSsid = preferences.getString("wifiSsid", WIFI_DEFAULT_SSID);
+  wifiPassword = preferences.getString("wifiPass", WIFI_DEFAULT_PASSWORD);
+  preferences.end();
+
+  if (storedPolicy < WIFI_POLICY_ALWAYS_ON || storedPolicy > WIFI_POLICY_OFF) {
+    storedPolicy = WIFI_DEFAULT_POLICY;
+  }
+  wifiPolicy = (WifiPolicy)storedPolicy;
+
+  pinMode(USER_BUTTON_PIN, INPUT_PULLUP);
+
+  Serial.println("📶 [WiFi] Política: " + getWifiPolicyString(wifiPolicy));
+  applyRadioState();
+  if (!radioOn) {
+    WiFi.mode(WIFI_OFF);
+  }
+}
+
+void wifiManagerLoop() {
+  uint64_t now = monoMillis();
+
+  // Botón: un flanco de bajada abre una ventana
+  bool reading = digitalRead(USER_BUTTON_PIN);
+  if (reading != lastButtonReading) {
+    lastButtonChange = now;
+    lastButtonReading = reading;
+  }
+  if (now - lastButtonChange >= BUTTON_DEBOUNCE_MS && reading != buttonState) {
+    buttonState = reading;
+    if (buttonState == LOW) {
+      Serial.println("🔘 [WiFi] Botón presionado");
+      requestWifiWindow(WIFI_BUTTON_WINDOW_MINUTES);
+    }
+  }
+
+  // Expiración de la ventana; se prolonga mientras haya clientes conectados
+  if (windowOpen && now - windowStart >= windowDuration) {
+    if (radioOn && WiFi.softAPgetStationNum() > 0) {
+      windowDuration += CLIENT_GRACE_MS;
+    } else {
+      windowOpen = false;
+      Serial.println("⏰ [WiFi] Ventana bajo demanda expirada");
+    }
+  }
+
+  applyRadioState();
+}
+
+bool requestWifiWindow(unsigned long minutes) {
+  if (wifiPolicy == WIFI_POLICY_OFF) {
+    Serial.println("⚠️ [WiFi] Política OFF - ventana rechazada");
+    return false;
+  }
+  minutes = constrain(minutes, 1UL, (unsigned long)WIFI_MAX_WINDOW_MINUTES);
+  windowOpen = true;
+  windowStart = monoMillis();
+  windowDuration = minutes * 60000ULL;
+  Serial.println("📶 [WiFi] Ventana abierta por " + String(minutes) + " minutos");
+  applyRadioState();
+  return true;
+}
+
+void closeWifiWindow() {
+  windowOpen = false;
+  applyRadioState();
+}
+
+void setWifiPolicy(WifiPolicy policy) {
+  wifiPolicy = policy;
+  if (policy == WIFI_POLICY_OFF) {
+    windowOpen = false;
+  }
+  applyRadioState();
+}
+
+void setWifiNightMode(bool night) {
+  nightModeRequested = night;
+  applyRadioState();
+}
+
+void restartWifiRadio() {
+  if (radioOn) {
+    stopRadio();
+  }
+  applyRadioState();
+}
+
+bool isWifiRadioOn() {
+  return radioOn;
+}
+
+bool isWebServerRunning() {
+  return radioOn && webServerInitialized;
+}
+
+unsigned long getWifiWindowRemainingSeconds() {
+  if (!windowOpen) return 0;
+  uint64_t elapsed = monoMillis() - windowStart;
+  if (elapsed >= windowDuration) return 0;
+  return (windowDuration - elapsed) / 1000;
+}
+
+String getWifiPolicyString(WifiPolicy policy) {
+  switch (policy) {
+    case WIFI_POLICY_ALWAYS_ON:
+      return "ALWAYS_ON";
+    case WIFI_POLICY_ON_DEMAND:
+      return "ON_DEMAND";
+    case WIFI_POLICY_OFF:
+      return "OFF";
+    default:
+      return "UNKNOWN";
+  }
+}
@@ -0,0 +1,37 @@
+#ifndef WIFI_MANAGER_H
+#define WIFI_MANAGER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// Política de la radio WiFi
+enum WifiPolicy {
+  WIFI_POLICY_ALWAYS_ON = 0,  // softAP activo de día (se apaga en modo nocturno)
+  WIFI_POLICY_ON_DEMAND = 1,  // Solo durante ventanas abiertas por botón o CMD:WIFI_ON
+  WIFI_POLICY_OFF = 2         // Radio siempre apagada
+};
+
+extern WifiPolicy wifiPolicy;
+extern String wifiSsid;
+extern String wifiPassword;
+
+// Lee la configuración de Preferences y aplica la política inicial
+void wifiManagerBegin();
+
+// Botón, expiración de ventanas y arranque/parada perezosa del servidor web
+void wifiManagerLoop();
+
+// Abre una ventana bajo demanda; devuelve false si la política es OFF
+bool requestWifiWindow(unsigned long minutes);
+void closeWifiWindow();
+
+void setWifiPolicy(WifiPolicy policy);
+void setWifiNightMode(bool night);
+void restartWifiRadio();    // Reaplica credenciales si la radio está encendida
+
+bool isWifiRadioOn();
+bool isWebServerRunning();
+unsigned long getWifiWindowRemainingSeconds();
+String getWifiPolicyString(WifiPolicy policy);
+
+#endif